@@ -214,8 +214,7 @@ void execute(const calibrate_sweeps::CalibrateSweepsGoalConstPtr& goal, Server*
             aRoom.addIntermediateCloudCameraParametersCorrected(aCameraModel);
             aRoom.addIntermediateRoomCloudRegisteredTransform(transform);
         }
-        semantic_map_room_utilities::reprojectIntermediateCloudsUsingCorrectedParams<PointType>(aRoom);
-        semantic_map_room_utilities::rebuildRegisteredCloud<PointType>(aRoom);
+        semantic_map_room_utilities::reprojectAndRebuildRegisteredCloud<PointType>(aRoom);
         // transform to global frame of reference
         tf::StampedTransform origin = origTransforms[0];
         CloudPtr completeCloud = aRoom.getCompleteRoomCloud();
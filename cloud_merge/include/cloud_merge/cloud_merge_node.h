@@ -50,6 +50,7 @@
 #include <semantic_map/room_utilities.h>
 #include <semantic_map/mongodb_interface.h>
 #include <semantic_map/sweep_parameters.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 
 #include "cloud_merge.h"
 
@@ -83,6 +84,7 @@ public:
     ros::Publisher                                                              m_PublisherMergedCloudDownsampled;
     ros::Publisher                                                              m_PublisherIntermediateCloud;   
     ros::Publisher                                                              m_PublisherRoomObservation;
+    sensor_msgs::PointCloud2                                                    m_IntermediateCloudMsg;         // reused between the positions of a sweep
 
     image_transport::Publisher                                                  m_RosPublisherIntermediateRGB;
     image_transport::Publisher                                                  m_RosPublisherIntermediateDepth;
@@ -118,6 +120,7 @@ private:
 
     bool                                                                        m_bUseImages;
     bool                                                                        m_bSaveIntermediateData;
+    bool                                                                        m_bSaveIntermediateDataAsRGBD;
     int                                                                         m_MaxInstances;
     MongodbInterface                                                            m_MongodbInterface;
 
@@ -253,6 +256,11 @@ CloudMergeNode<PointType>::CloudMergeNode(ros::NodeHandle nh) : m_TransformListe
     } else {
         ROS_INFO_STREAM("Saving intermediate point clouds.");
     }
+    m_NodeHandle.param<bool>("save_intermediate_clouds_as_rgbd",m_bSaveIntermediateDataAsRGBD,false);
+    if (m_bSaveIntermediateData && m_bSaveIntermediateDataAsRGBD)
+    {
+        ROS_INFO_STREAM("Intermediate point clouds will be saved as RGBD views.");
+    }
 
     bool doCleanup=true;
     m_NodeHandle.param<bool>("cleanup",doCleanup,true);
@@ -397,7 +405,7 @@ void CloudMergeNode<PointType>::pointCloudCallback(const sensor_msgs::PointCloud
             return;
 
         CloudPtr new_cloud(new Cloud());
-        pcl::fromROSMsg(*msg, *new_cloud);
+        cloud_msg_utilities::fromROSMsg(*msg, *new_cloud);
 
         new_cloud->header = pcl_conversions::toPCL(msg->header);
 
@@ -423,6 +431,7 @@ void CloudMergeNode<PointType>::controlCallback(const std_msgs::String& controlS
 
          // initialize room
          aSemanticRoom.setSaveIntermediateClouds(m_bSaveIntermediateData);
+         aSemanticRoom.setSaveIntermediateCloudsAsRGBD(m_bSaveIntermediateDataAsRGBD);
 
          // get room start time
          aSemanticRoom.setRoomLogStartTime(ros::Time::now().toBoost());
@@ -524,10 +533,8 @@ void CloudMergeNode<PointType>::controlCallback(const std_msgs::String& controlS
                         aSemanticRoom.addIntermediateCloudCameraParametersCorrected(aCameraModel);
                         aSemanticRoom.addIntermediateRoomCloudRegisteredTransform(transform);
                     }
-                    // reproject individual clouds
-                    semantic_map_room_utilities::reprojectIntermediateCloudsUsingCorrectedParams<PointType>(aSemanticRoom);
-                    // rebuild merged cloud
-                    semantic_map_room_utilities::rebuildRegisteredCloud<PointType>(aSemanticRoom);
+                    // reproject individual clouds and rebuild merged cloud
+                    semantic_map_room_utilities::reprojectAndRebuildRegisteredCloud<PointType>(aSemanticRoom);
                     // transform merged cloud to map frame
                     CloudPtr completeCloud = aSemanticRoom.getCompleteRoomCloud();
                     pcl_ros::transformPointCloud(*completeCloud, *completeCloud,origin);
@@ -565,7 +572,7 @@ void CloudMergeNode<PointType>::controlCallback(const std_msgs::String& controlS
             vg.filter (*subsampled_cloud);
 
             sensor_msgs::PointCloud2 msg_cloud;
-            pcl::toROSMsg(*subsampled_cloud, msg_cloud);
+            cloud_msg_utilities::toROSMsg(*subsampled_cloud, msg_cloud);
             m_PublisherMergedCloud.publish(msg_cloud);
 
             // subsample again for visualization and metaroom purposes
@@ -575,7 +582,7 @@ void CloudMergeNode<PointType>::controlCallback(const std_msgs::String& controlS
             vg.filter (*subsampled_cloud);
 
             sensor_msgs::PointCloud2 sub_msg_cloud;
-            pcl::toROSMsg(*subsampled_cloud, sub_msg_cloud);
+            cloud_msg_utilities::toROSMsg(*subsampled_cloud, sub_msg_cloud);
             m_PublisherMergedCloudDownsampled.publish(sub_msg_cloud);
 
             if (m_bLogToDB)
@@ -628,9 +635,8 @@ void CloudMergeNode<PointType>::controlCallback(const std_msgs::String& controlS
             {
                 tf::StampedTransform transform;
 
-                sensor_msgs::PointCloud2 temp_msg;
-                pcl::toROSMsg(*transformed_cloud, temp_msg);
-                temp_msg.header = pcl_conversions::fromPCL(transformed_cloud->header);
+                sensor_msgs::PointCloud2& temp_msg = m_IntermediateCloudMsg;
+                cloud_msg_utilities::toROSMsg(*transformed_cloud, temp_msg);
                 m_PublisherIntermediateCloud.publish(temp_msg); // publish in the local frame of reference
 
                 m_TransformListener.waitForTransform("/map", transformed_cloud->header.frame_id,temp_msg.header.stamp, ros::Duration(20.0) );
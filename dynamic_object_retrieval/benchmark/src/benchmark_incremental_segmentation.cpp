@@ -8,6 +8,7 @@
 #include <dynamic_object_retrieval/summary_iterators.h>
 #include <dynamic_object_retrieval/visualize.h>
 #include <dynamic_object_retrieval/extract_surfel_features.h>
+#include <dynamic_object_retrieval/incremental_query.h>
 
 #include <pcl/visualization/pcl_visualizer.h>
 #include <pcl/common/centroid.h>
@@ -21,8 +22,9 @@ using HistT = pcl::Histogram<250>;
 using HistCloudT = pcl::PointCloud<HistT>;
 
 grouped_vocabulary_tree<HistT, 8> vt;
-map<grouped_vocabulary_tree<HistT, 8>::node*, int> mapping;
-map<int, grouped_vocabulary_tree<HistT, 8>::node*> inverse_mapping;
+// keeps the lookups, vocabulary vectors and segments of the sweeps between the queries
+std::unique_ptr<dynamic_object_retrieval::incremental_query_engine> engine;
+boost::filesystem::path engine_path;
 
 void visualize_adjacencies(vector<CloudT::Ptr>& segments, const set<pair<int, int> >& adjacencies)
 {
@@ -64,34 +66,21 @@ vector<CloudT::Ptr> perform_incremental_segmentation(CloudT::Ptr& training_map,
                                                      CloudT::Ptr& query_map, CloudT::Ptr& query_object,
                                                      const boost::filesystem::path& query_map_path)
 {
-    cout << "Data path: " << query_map_path.parent_path().parent_path().parent_path().string() << endl;
-    vector<string> folder_xmls = semantic_map_load_utilties::getSweepXmls<PointT>(query_map_path.parent_path().parent_path().parent_path().string(), true);
+    boost::filesystem::path sweeps_path = query_map_path.parent_path().parent_path().parent_path();
+    cout << "Data path: " << sweeps_path.string() << endl;
+    if (!engine || engine_path != sweeps_path) {
+        engine.reset(new dynamic_object_retrieval::incremental_query_engine(vt, sweeps_path));
+        engine_path = sweeps_path;
+    }
 
     cout << query_map_path.string() << endl;
 
-    // DEBUG: only for chair comparison
-    //int sweep_index = 88;
-    //bool found;
-    int sweep_index;
-    bool found = false;
-    for (sweep_index = 0; sweep_index < folder_xmls.size(); ++sweep_index) {
-        boost::filesystem::path sweep_path = boost::filesystem::path(folder_xmls[sweep_index]).parent_path();
-        if (sweep_path == query_map_path) {
-            found = true;
-            break;
-        }
-    }
-    if (!found) {
+    int sweep_index = engine->get_sweep_index(query_map_path);
+    if (sweep_index == -1) {
         cout << "WTF? Did not find any matching sweeps..." << endl;
         exit(-1);
     }
 
-    dynamic_object_retrieval::sweep_convex_segment_cloud_map segment_map(query_map_path);
-    vector<CloudT::Ptr> segments;
-    for (CloudT::Ptr& segment : segment_map) {
-        segments.push_back(CloudT::Ptr(new CloudT(*segment)));
-    }
-
     // first, we need to extract some features for the query cloud
     HistCloudT::Ptr query_cloud(new HistCloudT);
     CloudT::Ptr keypoints(new CloudT);
@@ -101,70 +90,33 @@ vector<CloudT::Ptr> perform_incremental_segmentation(CloudT::Ptr& training_map,
     pfhrgb_estimation::compute_surfel_features(query_cloud, keypoints, training_object, false, true);
 #endif
 
-    vector<vocabulary_vector> vectors;
-    set<pair<int, int> > adjacencies;
-    vt.load_cached_vocabulary_vectors_for_group(vectors, adjacencies, sweep_index); // sweep index needed!
-
-    //visualize_adjacencies(segments, adjacencies);
-
     std::vector<grouped_vocabulary_tree<HistT, 8>::result_type> scores;
     vt.top_combined_similarities(scores, query_cloud, 0);
 
     cout << "Scores size: " << scores.size() << endl;
 
-    found = false;
-    int start_index;
-    float min_score = 1000.0f;//std::numeric_limits<float>::infinity();
-    for (int i = 0; i < scores.size(); ++i) {
-        if (scores[i].group_index == sweep_index) {
-            //cout << "Score: " << scores[i].score << endl;
-            //cout << "Subgroup index: " << scores[i].subgroup_index << endl;
-            if (scores[i].score < min_score && benchmark_retrieval::compute_overlap(query_object, segments[scores[i].subgroup_index]) > 0.1) {
-                found = true;
-                start_index = scores[i].subgroup_index;
-                min_score = scores[i].score;
-            }
-        }
-    }
-    cout << "Chose: " << min_score << " with subgroup index " << start_index << endl;
-    if (!found) {
+    // the best scored segment of the sweep that overlaps the query object, the overlaps are only
+    // computed until the first one that does
+    int start_index = engine->find_start_subgroup(scores, sweep_index, [&](const CloudT::Ptr& segment) {
+        CloudT::Ptr segment_cloud = segment;
+        return benchmark_retrieval::compute_overlap(query_object, segment_cloud) > 0.1;
+    });
+    cout << "Chose subgroup index " << start_index << endl;
+    if (start_index == -1) {
         cout << "WTF? Did not find any matching min segment..." << endl;
-        //start_index = -1;
-        //exit(-1);
-        return segments;
+        dynamic_object_retrieval::incremental_query_engine::sweep_ptr sweep = engine->get_sweep(sweep_index);
+        return engine->get_segments(*sweep);
     }
 
-    vector<int> selected_indices;
-    // get<1>(scores[i])) is actually the index within the group!
-    // if I use -1 here, I get correct results. this means that sweep_index must be correct
-    // however, start index is never correct, so maybe group_subgroup map is not correct?
-    // e.g. when I get the segments back from selected_indices when using -1, this also returns
-    // correct results so it seems like that is the correct way to decide subgroup_index
-    double score = vt.compute_min_combined_dist(selected_indices, query_cloud, vectors, adjacencies,
-                                                mapping, inverse_mapping, start_index); // segment index in sweep needed!
-    //vector<int> selected_indices = {start_index};
+    dynamic_object_retrieval::incremental_query_engine::query_vector query = engine->compute_query_vector(query_cloud);
+    dynamic_object_retrieval::incremental_query_engine::query_result result = engine->grow(query, sweep_index, start_index);
 
     vector<CloudT::Ptr> single_cloud;
-    single_cloud.push_back(CloudT::Ptr(new CloudT));
-
-    for (int segment_index : selected_indices) {
-        *single_cloud[0] += *segments[segment_index];
-    }
-    //*single_cloud[0] += *segments[selected_indices[0]];
+    single_cloud.push_back(engine->merge_segments(result));
 
-    cout << "Scores size: " << scores.size() << endl;
     cout << "Start index: " << start_index << endl;
-    cout << "Selected indices at 0: " << selected_indices[0] << endl;
-    /*CloudT::Ptr vis_cloud(new CloudT);
-    *vis_cloud += *query_object;
-    for (int i = 0; i < segments[selected_indices[0]]->size(); ++i) {
-        PointT p = segments[selected_indices[0]]->at(i);
-        p.x += 1.0f;
-        vis_cloud->push_back(p);
-    }*/
-    //*vis_cloud += *;
-    //dynamic_object_retrieval::visualize(query_object);
-    //dynamic_object_retrieval::visualize(single_cloud[0]);
+    cout << "Selected indices at 0: " << result.subgroups[0] << endl;
+    cout << "Score: " << result.score << endl;
 
     return single_cloud;
 }
@@ -213,10 +165,6 @@ int main(int argc, char** argv)
     dynamic_object_retrieval::load_vocabulary(vt, vocabulary_path);
     vt.set_min_match_depth(3);
     vt.compute_normalizing_constants();
-    vt.get_node_mapping(mapping);
-    for (const pair<grouped_vocabulary_tree<HistT, 8>::node*, int>& u : mapping) {
-        inverse_mapping.insert(make_pair(u.second, u.first));
-    }
 
     vector<CloudT::Ptr> top_segment = perform_incremental_segmentation(training_map, training_object, query_map, query_object, query_map_path);
 
@@ -243,10 +191,6 @@ int main(int argc, char** argv)
     vt.set_cache_path(vocabulary_path.string());
     vt.set_min_match_depth(3);
     vt.compute_normalizing_constants();
-    vt.get_node_mapping(mapping);
-    for (const pair<grouped_vocabulary_tree<HistT, 8>::node*, int>& u : mapping) {
-        inverse_mapping.insert(make_pair(u.second, u.first));
-    }
 
     map<string, pair<float, int> > overlap_ratios = benchmark_retrieval::get_segmentation_scores_for_data(&perform_incremental_segmentation, data_path);
 
@@ -280,6 +224,9 @@ int main(int argc, char** argv)
         ratio.second.first /= float(ratio.second.second);
         cout << ratio.first << ": " << ratio.second.first << " in " << ratio.second.second << " places" << endl;
     }
+    if (engine) {
+        cout << "Sweep cache hits: " << engine->get_sweep_hits() << ", misses: " << engine->get_sweep_misses() << endl;
+    }
 
     return 0;
 }
@@ -3,6 +3,7 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/filters/approximate_voxel_grid.h>
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 
 #include <ros/ros.h>
 #include <std_msgs/String.h>
@@ -54,7 +55,7 @@ ros::Publisher pub;
 void segmentation_callback(const sensor_msgs::PointCloud2::ConstPtr& msg)
 {
     PointNormalCloudT::Ptr normal_cloud(new PointNormalCloudT);
-    pcl::fromROSMsg(*msg, *normal_cloud);
+    cloud_msg_utilities::fromROSMsg(*msg, *normal_cloud);
 
     CloudT::Ptr cloud(new CloudT);
     NormalCloudT::Ptr normals(new NormalCloudT);
@@ -102,7 +103,7 @@ void segmentation_callback(const sensor_msgs::PointCloud2::ConstPtr& msg)
     out_msg.clouds.resize(convex_segments.size());
 
     for (int i = 0; i < convex_segments.size(); ++i) {
-        pcl::toROSMsg(*convex_segments[i], out_msg.clouds[i]);
+        cloud_msg_utilities::toROSMsg(*convex_segments[i], out_msg.clouds[i]);
     }
 
     pub.publish(out_msg);
@@ -5,6 +5,7 @@
 #include "dynamic_object_retrieval/visualize.h"
 #include "dynamic_object_retrieval/summary_iterators.h"
 #include "dynamic_object_retrieval/extract_surfel_features.h"
+#include "dynamic_object_retrieval/incremental_query.h"
 #include "extract_sift/extract_sift.h"
 #include "object_3d_retrieval/pfhrgb_estimation.h"
 #include "object_3d_retrieval/shot_estimation.h"
@@ -164,13 +165,24 @@ query_vocabulary(HistCloudT::Ptr& features, size_t nbr_query, grouped_vocabulary
         vt.compute_normalizing_constants();
     }
 
-    // add some common methods in vt for querying, really only one!
-    std::vector<typename grouped_vocabulary_tree<HistT, 8>::result_type> scores;
-    vt.query_vocabulary(scores, features, nbr_query);
+    // the engine keeps the vocabulary vectors and norms of the sweeps between the queries
+    std::vector<typename grouped_vocabulary_tree<HistT, 8>::result_type> scores = get_query_engine(vt, vocabulary_path, summary).query(features, nbr_query);
 
     return get_retrieved_path_scores(scores, summary);
 }
 
+// called after the weights of the vocabulary changed, the query engine of a grouped vocabulary needs to update its norms
+template <typename VocabularyT>
+inline void weights_changed(VocabularyT& vt, const boost::filesystem::path& vocabulary_path, const vocabulary_summary& summary)
+{
+}
+
+template <>
+inline void weights_changed(grouped_vocabulary_tree<HistT, 8>& vt, const boost::filesystem::path& vocabulary_path, const vocabulary_summary& summary)
+{
+    get_query_engine(vt, vocabulary_path, summary).invalidate_weights();
+}
+
 void insert_index_score(std::vector<std::pair<int, double> >& weighted_indices, const vocabulary_tree<HistT, 8>::result_type& index, float score)
 {
     weighted_indices.push_back(std::make_pair(index.index, score));
@@ -274,6 +286,7 @@ reweight_query(CloudT::Ptr& query_cloud, HistCloudT::Ptr& features, SiftCloudT::
     std::map<int, double> original_norm_constants;
     std::map<vocabulary_tree<HistT, 8>::node*, double> original_weights; // maybe change this to e.g. node_type
     vt.compute_new_weights(original_norm_constants, original_weights, weighted_indices, features);
+    weights_changed(vt, vocabulary_path, summary);
     TOCK("reweighting");
 
     std::cout << "Done re-weighting" << std::endl;
@@ -287,6 +300,7 @@ reweight_query(CloudT::Ptr& query_cloud, HistCloudT::Ptr& features, SiftCloudT::
     std::cout << "Restoring weights" << std::endl;
 
     vt.restore_old_weights(original_norm_constants, original_weights);
+    weights_changed(vt, vocabulary_path, summary);
 
     std::cout << "Done restoring weights" << std::endl;
 
@@ -0,0 +1,346 @@
+#ifndef INCREMENTAL_QUERY_H
+#define INCREMENTAL_QUERY_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#define VT_PRECOMPILE
+#include <vocabulary_tree/vocabulary_tree.h>
+#include <grouped_vocabulary_tree/grouped_vocabulary_tree.h>
+#include <metaroom_xml_parser/load_utilities.h>
+
+#include "dynamic_object_retrieval/summary_iterators.h"
+#include "dynamic_object_retrieval/definitions.h"
+
+using CloudT = pcl::PointCloud<PointT>;
+using HistCloudT = pcl::PointCloud<HistT>;
+
+namespace dynamic_object_retrieval {
+
+/*
+ * incremental_query_engine
+ *
+ * Grows query matches over the convex segments of a sweep, starting from a segment and greedily adding adjacent
+ * segments while the combined vocabulary distance to the query decreases (grouped_vocabulary_tree::query_vocabulary
+ * and benchmark_incremental_segmentation do the same from scratch for every query).
+ *
+ * The engine keeps, for the most recently used sweeps, the cached vocabulary vectors and adjacencies of the sweep
+ * together with their weighted norms and adjacency lists, and the segment clouds once they have been asked for. The
+ * sweep index of a sweep folder is looked up in a map built from the sweeps of the data path when the engine is
+ * created, call refresh_sweeps() after sweeps were added to the data path and the vocabulary. The node weights of the
+ * vocabulary are baked into the kept norms, call invalidate_weights() if they change (e.g. around query reweighting).
+ *
+ * The query methods may be called from several threads. The sweeps are read from disk outside of the lock and
+ * published under it, so a slow load does not hold up queries on cached sweeps. Groups of the vocabulary beyond the
+ * sweeps of the data path (e.g. the annotated sweeps) can be queried, but have no segment clouds.
+ *
+ * get_query_engine keeps one engine per vocabulary file, dynamic_retrieval.h queries grouped vocabularies through it.
+ */
+class incremental_query_engine {
+public:
+
+    using VocabularyT = grouped_vocabulary_tree<HistT, 8>;
+    using node = VocabularyT::node;
+    using result_type = VocabularyT::result_type;
+
+    struct sweep_state {
+        int sweep_index;
+        boost::filesystem::path sweep_path; // the sweep folder
+        std::vector<vocabulary_vector> vectors;
+        std::set<std::pair<int, int> > adjacencies;
+        combined_dist_group group; // weighted norms and adjacency lists of the vectors
+        bool segments_loaded;
+        std::vector<CloudT::Ptr> segments; // the convex segments, indexed by subgroup
+    };
+    using sweep_ptr = std::shared_ptr<sweep_state>;
+
+    struct query_vector {
+        std::map<int, double> freqs; // vocabulary word index -> weighted frequency
+        double norm;
+    };
+
+    struct query_result {
+        int sweep_index;
+        int start_subgroup;
+        double score; // combined distance of the selected segments, lower is better
+        std::vector<int> subgroups; // the selected segments, in the order they were added
+    };
+
+    incremental_query_engine(VocabularyT& vt, const boost::filesystem::path& data_path, size_t sweep_capacity = 32) :
+        vt(vt), data_path(data_path), sweep_capacity(sweep_capacity), sweep_hits(0), sweep_misses(0)
+    {
+        index_sweeps();
+        vt.get_node_mapping(mapping);
+        for (const std::pair<node* const, int>& u : mapping) {
+            inverse_mapping.insert(std::make_pair(u.second, u.first));
+        }
+    }
+
+    // -1 if the sweep folder is not in the data path
+    int get_sweep_index(const boost::filesystem::path& sweep_folder) const
+    {
+        boost::filesystem::path folder = sweep_folder.filename() == "room.xml" ? sweep_folder.parent_path() : sweep_folder;
+        auto iter = sweep_indices.find(folder.string());
+        if (iter == sweep_indices.end() && folder.filename() == ".") {
+            iter = sweep_indices.find(folder.parent_path().string());
+        }
+        return iter == sweep_indices.end() ? -1 : iter->second;
+    }
+
+    size_t nbr_sweeps() const { return sweep_xmls.size(); }
+
+    boost::filesystem::path get_sweep_path(int sweep_index) const
+    {
+        return boost::filesystem::path(sweep_xmls.at(sweep_index)).parent_path();
+    }
+
+    const VocabularyT& get_vocabulary() const { return vt; }
+
+    // The vocabulary vectors, adjacencies and norms of the sweep. A missing sweep is loaded outside of the lock, if
+    // two threads load the same sweep the first one to finish is kept
+    sweep_ptr get_sweep(int sweep_index)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sweeps_mutex);
+            auto iter = sweep_entries.find(sweep_index);
+            if (iter != sweep_entries.end()) {
+                ++sweep_hits;
+                sweep_lru.splice(sweep_lru.begin(), sweep_lru, iter->second);
+                return iter->second->second;
+            }
+            ++sweep_misses;
+        }
+
+        sweep_ptr sweep(new sweep_state);
+        sweep->sweep_index = sweep_index;
+        if (sweep_index < int(sweep_xmls.size())) {
+            sweep->sweep_path = get_sweep_path(sweep_index);
+        }
+        sweep->segments_loaded = false;
+        vt.load_cached_vocabulary_vectors_for_group(sweep->vectors, sweep->adjacencies, sweep_index);
+        vt.prepare_combined_dist_group(sweep->group, sweep->vectors, sweep->adjacencies, inverse_mapping);
+
+        std::lock_guard<std::mutex> lock(sweeps_mutex);
+        auto iter = sweep_entries.find(sweep_index);
+        if (iter != sweep_entries.end()) {
+            sweep_lru.splice(sweep_lru.begin(), sweep_lru, iter->second);
+            return iter->second->second;
+        }
+        sweep_lru.push_front(std::make_pair(sweep_index, sweep));
+        sweep_entries[sweep_index] = sweep_lru.begin();
+        while (sweep_lru.size() > sweep_capacity) {
+            sweep_entries.erase(sweep_lru.back().first);
+            sweep_lru.pop_back();
+        }
+        return sweep;
+    }
+
+    // The convex segment clouds of the sweep, loaded the first time they are needed. The clouds are read outside
+    // the lock and published under it, if two threads load the same sweep the second result is dropped
+    const std::vector<CloudT::Ptr>& get_segments(sweep_state& sweep)
+    {
+        {
+            std::lock_guard<std::mutex> lock(sweeps_mutex);
+            if (sweep.segments_loaded) {
+                return sweep.segments;
+            }
+        }
+
+        std::vector<CloudT::Ptr> segments;
+        if (!sweep.sweep_path.empty()) {
+            sweep_convex_segment_cloud_map segment_map(sweep.sweep_path);
+            for (CloudT::Ptr& segment : segment_map) {
+                segments.push_back(CloudT::Ptr(new CloudT(*segment)));
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(sweeps_mutex);
+        if (!sweep.segments_loaded) {
+            sweep.segments.swap(segments);
+            sweep.segments_loaded = true;
+        }
+        return sweep.segments;
+    }
+
+    query_vector compute_query_vector(HistCloudT::Ptr& features)
+    {
+        query_vector query;
+        query.norm = vt.compute_query_index_vector(query.freqs, features, mapping);
+        return query;
+    }
+
+    // The best scored segment of the sweep in scores that is accepted, trying the segments in the order of their
+    // scores so that accept is only evaluated until the first match. Returns -1 if no segment is accepted.
+    int find_start_subgroup(const std::vector<result_type>& scores, int sweep_index,
+                            const std::function<bool(const CloudT::Ptr&)>& accept, float max_score = 1000.0f)
+    {
+        std::vector<std::pair<float, int> > candidates;
+        for (const result_type& s : scores) {
+            if (s.group_index == sweep_index && s.score < max_score) {
+                candidates.push_back(std::make_pair(s.score, s.subgroup_index));
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+            return a.first < b.first;
+        });
+
+        if (candidates.empty()) {
+            return -1;
+        }
+        sweep_ptr sweep = get_sweep(sweep_index);
+        const std::vector<CloudT::Ptr>& segments = get_segments(*sweep);
+        for (const std::pair<float, int>& c : candidates) {
+            if (c.second < int(segments.size()) && accept(segments[c.second])) {
+                return c.second;
+            }
+        }
+        return -1;
+    }
+
+    // Grows the segments of the sweep from start_subgroup (from the best segment if -1)
+    query_result grow(const query_vector& query, int sweep_index, int start_subgroup)
+    {
+        sweep_ptr sweep = get_sweep(sweep_index);
+        query_result result;
+        result.sweep_index = sweep_index;
+        result.start_subgroup = start_subgroup;
+        result.score = vt.compute_min_combined_dist(result.subgroups, query.freqs, query.norm, sweep->group, start_subgroup);
+        return result;
+    }
+
+    // The same results as VocabularyT::query_vocabulary, with the sweeps taken from the engine
+    std::vector<result_type> query(HistCloudT::Ptr& features, size_t nbr_query)
+    {
+        std::vector<result_type> scores;
+        vt.top_combined_similarities(scores, features, nbr_query == 0 ? 500 : 200);
+
+        query_vector query = compute_query_vector(features);
+        std::vector<result_type> updated_scores;
+        for (const result_type& s : scores) {
+            query_result grown = grow(query, s.group_index, s.subgroup_index);
+            if (grown.subgroups.empty()) {
+                continue;
+            }
+            updated_scores.push_back(result_type(float(grown.score), s.group_index, grown.subgroups[0]));
+            updated_scores.back().subgroup_group_indices = grown.subgroups;
+        }
+        vt.prune_grown_results(updated_scores, nbr_query);
+        return updated_scores;
+    }
+
+    CloudT::Ptr merge_segments(const query_result& result)
+    {
+        sweep_ptr sweep = get_sweep(result.sweep_index);
+        const std::vector<CloudT::Ptr>& segments = get_segments(*sweep);
+        CloudT::Ptr cloud(new CloudT);
+        for (int subgroup : result.subgroups) {
+            if (subgroup < int(segments.size())) {
+                *cloud += *segments[subgroup];
+            }
+        }
+        return cloud;
+    }
+
+    // The kept norms use the node weights of the vocabulary, prepare them again after the weights changed. Must not
+    // run concurrently with queries
+    void invalidate_weights()
+    {
+        std::lock_guard<std::mutex> lock(sweeps_mutex);
+        for (std::pair<int, sweep_ptr>& entry : sweep_lru) {
+            vt.prepare_combined_dist_group(entry.second->group, entry.second->vectors, entry.second->adjacencies, inverse_mapping);
+        }
+    }
+
+    // Looks up the sweeps of the data path again, e.g. after sweeps were appended to the vocabulary. The kept sweeps
+    // are dropped since their indices may have changed. Must not run concurrently with queries
+    void refresh_sweeps()
+    {
+        std::lock_guard<std::mutex> lock(sweeps_mutex);
+        index_sweeps();
+        sweep_lru.clear();
+        sweep_entries.clear();
+    }
+
+    size_t get_sweep_hits() const { return sweep_hits; }
+    size_t get_sweep_misses() const { return sweep_misses; }
+
+private:
+
+    void index_sweeps()
+    {
+        sweep_xmls = semantic_map_load_utilties::getSweepXmls<PointT>(data_path.string(), true);
+        sweep_indices.clear();
+        for (size_t i = 0; i < sweep_xmls.size(); ++i) {
+            sweep_indices[boost::filesystem::path(sweep_xmls[i]).parent_path().string()] = i;
+        }
+    }
+
+    VocabularyT& vt;
+    boost::filesystem::path data_path;
+    std::vector<std::string> sweep_xmls;
+    std::unordered_map<std::string, int> sweep_indices; // sweep folder -> sweep index (group of the vocabulary)
+    std::map<node*, int> mapping;
+    std::map<int, node*> inverse_mapping;
+
+    size_t sweep_capacity;
+    std::mutex sweeps_mutex;
+    std::list<std::pair<int, sweep_ptr> > sweep_lru;
+    std::unordered_map<int, std::list<std::pair<int, sweep_ptr> >::iterator> sweep_entries;
+    size_t sweep_hits;
+    size_t sweep_misses;
+};
+
+namespace detail {
+
+inline std::mutex& query_engines_mutex()
+{
+    static std::mutex engines_mutex;
+    return engines_mutex;
+}
+
+// vocabulary file -> engine, there is at most one engine per file
+inline std::map<std::string, std::unique_ptr<incremental_query_engine> >& query_engines()
+{
+    static std::map<std::string, std::unique_ptr<incremental_query_engine> > engines;
+    return engines;
+}
+
+} // namespace detail
+
+// The engine of the vocabulary loaded from vocabulary_path, created on the first call with the sweeps of the noise data
+// of the summary. The vocabulary has to be loaded and must outlive the engine, or be released with
+// release_query_engine. If the file was loaded into another vocabulary object since, the engine is replaced
+inline incremental_query_engine& get_query_engine(incremental_query_engine::VocabularyT& vt, const boost::filesystem::path& vocabulary_path,
+                                                  const vocabulary_summary& summary)
+{
+    std::lock_guard<std::mutex> lock(detail::query_engines_mutex());
+    std::unique_ptr<incremental_query_engine>& engine = detail::query_engines()[vocabulary_path.string()];
+    if (!engine || &engine->get_vocabulary() != &vt) {
+        engine.reset(new incremental_query_engine(vt, boost::filesystem::path(summary.noise_data_path)));
+    }
+    return *engine;
+}
+
+// Drops the engine of the vocabulary file, e.g. before the vocabulary is destroyed
+inline void release_query_engine(const boost::filesystem::path& vocabulary_path)
+{
+    std::lock_guard<std::mutex> lock(detail::query_engines_mutex());
+    detail::query_engines().erase(vocabulary_path.string());
+}
+
+} // namespace dynamic_object_retrieval
+
+#endif // INCREMENTAL_QUERY_H
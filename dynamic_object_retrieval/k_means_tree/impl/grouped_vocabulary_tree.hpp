@@ -59,6 +59,10 @@ void grouped_vocabulary_tree<Point, K>::query_vocabulary(vector<result_type>& up
         inverse_mapping.insert(make_pair(u.second, u.first));
     }
 
+    // the query vector is the same for all groups
+    map<int, double> cloud_freqs;
+    double qnorm = super::compute_query_index_vector(cloud_freqs, query_cloud, mapping);
+
     //std::vector<result_type> updated_scores;
     //std::vector<group_type> updated_indices;
     //vector<index_score> total_scores;
@@ -71,10 +75,12 @@ void grouped_vocabulary_tree<Point, K>::query_vocabulary(vector<result_type>& up
         cout << "Loading " << i << ":th score with index: " << scores[i].index << endl;
         load_cached_vocabulary_vectors_for_group(vectors, adjacencies, scores[i].group_index);
 
+        combined_dist_group group;
+        super::prepare_combined_dist_group(group, vectors, adjacencies, inverse_mapping);
+
         vector<int> selected_indices;
         // get<1>(scores[i])) is actually the index within the group!
-        double score = super::compute_min_combined_dist(selected_indices, query_cloud, vectors, adjacencies,
-                                                        mapping, inverse_mapping, scores[i].subgroup_index);
+        double score = super::compute_min_combined_dist(selected_indices, cloud_freqs, qnorm, group, scores[i].subgroup_index);
         //double score = scores[i].score;
         //selected_indices.push_back(scores[i].subgroup_index);
         updated_scores.push_back(result_type(float(score), scores[i].group_index, selected_indices[0]));
@@ -84,7 +90,39 @@ void grouped_vocabulary_tree<Point, K>::query_vocabulary(vector<result_type>& up
         cout << "Found " << selected_indices.size() << " number of subsegments..." << endl;
     }
 
+    prune_grown_results(updated_scores, nbr_query);
+
+    /*
+    auto p = sort_permutation_vector(updated_scores, [](const result_type& s1, const result_type& s2) {
+        return s1.score < s2.score; // find min elements!
+    });
+
+    // the new scores after growing and re-ordering
+    results = apply_permutation_vector(updated_scores, p);
+    // the subsegment indices within the sweep, not used atm (but we should be able to retrieve this somehow!!)
+    groups = apply_permutation_vector(updated_indices, p);
+
+    if (nbr_query > 0 && results.size() > nbr_query) {
+        results.resize(nbr_query);
+        // how should we return the oversegment indices????
+        groups.resize(nbr_query);
+    }
+
+    for (result_type& s : results) {
+        s.index = get_id_for_group_subgroup(s.group_index, s.subgroup_index);
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        for (int subgroup_index : results[i].subgroup_group_indices) {
+            results[i].subgroup_global_indices.push_back(get_id_for_group_subgroup(results[i].group_index, subgroup_index));
+        }
+    }*/
+}
 
+// sorts the grown results by score and removes the ones that overlap a better result in the same group
+template <typename Point, size_t K>
+void grouped_vocabulary_tree<Point, K>::prune_grown_results(vector<result_type>& updated_scores, size_t nbr_query)
+{
     std::sort(updated_scores.begin(), updated_scores.end(), [](const result_type& s1, const result_type& s2)
     {
         return s1.group_index < s2.group_index;
@@ -147,32 +185,6 @@ void grouped_vocabulary_tree<Point, K>::query_vocabulary(vector<result_type>& up
         }
         updated_scores[i].index = updated_scores[i].subgroup_global_indices[0];
     }
-
-    /*
-    auto p = sort_permutation_vector(updated_scores, [](const result_type& s1, const result_type& s2) {
-        return s1.score < s2.score; // find min elements!
-    });
-
-    // the new scores after growing and re-ordering
-    results = apply_permutation_vector(updated_scores, p);
-    // the subsegment indices within the sweep, not used atm (but we should be able to retrieve this somehow!!)
-    groups = apply_permutation_vector(updated_indices, p);
-
-    if (nbr_query > 0 && results.size() > nbr_query) {
-        results.resize(nbr_query);
-        // how should we return the oversegment indices????
-        groups.resize(nbr_query);
-    }
-
-    for (result_type& s : results) {
-        s.index = get_id_for_group_subgroup(s.group_index, s.subgroup_index);
-    }
-
-    for (size_t i = 0; i < results.size(); ++i) {
-        for (int subgroup_index : results[i].subgroup_group_indices) {
-            results[i].subgroup_global_indices.push_back(get_id_for_group_subgroup(results[i].group_index, subgroup_index));
-        }
-    }*/
 }
 
 
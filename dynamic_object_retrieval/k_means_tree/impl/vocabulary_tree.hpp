@@ -445,6 +445,163 @@ double vocabulary_tree<Point, K>::compute_min_combined_dist(vector<int>& include
     return last_dist;
 }
 
+template <typename Point, size_t K>
+void vocabulary_tree<Point, K>::prepare_combined_dist_group(combined_dist_group& group, const vector<vocabulary_vector>& vectors,
+                                                            const set<pair<int, int> >& adjacencies, map<int, node*>& inverse_mapping)
+{
+    group.subgroups.resize(vectors.size());
+    group.pnorms.assign(vectors.size(), 0.0);
+    group.words.resize(vectors.size());
+    group.neighbours.assign(vectors.size(), vector<int>());
+
+    unordered_map<int, int> subgroup_vectors;
+    for (size_t i = 0; i < vectors.size(); ++i) {
+        group.subgroups[i] = vectors[i].subgroup;
+        subgroup_vectors[vectors[i].subgroup] = i;
+        group.words[i].clear();
+        for (const pair<const int, pair<int, double> >& u : vectors[i].vec) {
+            double val = inverse_mapping[u.first]->weight*double(u.second.first);
+            group.words[i].push_back(make_pair(u.first, val));
+        }
+        std::sort(group.words[i].begin(), group.words[i].end());
+        for (const pair<int, double>& u : group.words[i]) {
+            group.pnorms[i] += pexp(u.second);
+        }
+    }
+
+    for (const pair<int, int>& a : adjacencies) {
+        auto first = subgroup_vectors.find(a.first);
+        auto second = subgroup_vectors.find(a.second);
+        if (first == subgroup_vectors.end() || second == subgroup_vectors.end()) {
+            continue;
+        }
+        group.neighbours[first->second].push_back(second->second);
+        group.neighbours[second->second].push_back(first->second);
+    }
+    for (vector<int>& n : group.neighbours) {
+        std::sort(n.begin(), n.end());
+        n.erase(std::unique(n.begin(), n.end()), n.end());
+    }
+}
+
+// The candidates are restricted to the neighbours of the included vectors, which are maintained as the growth
+// proceeds, and only the query words of a candidate are visited: the sum over the query words that are not in the
+// candidate does not change with the candidate and is kept in included_sum.
+template <typename Point, size_t K>
+double vocabulary_tree<Point, K>::compute_min_combined_dist(vector<int>& included_indices, const map<int, double>& cloud_freqs, double qnorm,
+                                                            const combined_dist_group& group, int hint)
+{
+    const size_t nbr_vectors = group.pnorms.size();
+
+    // query words are numbered in the order of cloud_freqs
+    vector<double> query_values;
+    unordered_map<int, int> query_words;
+    for (const pair<const int, double>& v : cloud_freqs) {
+        query_words[v.first] = query_values.size();
+        query_values.push_back(v.second);
+    }
+
+    // (query word, weighted frequency) of every vector
+    vector<vector<pair<int, double> > > query_parts(nbr_vectors);
+    for (size_t i = 0; i < nbr_vectors; ++i) {
+        for (const pair<int, double>& u : group.words[i]) {
+            auto iter = query_words.find(u.first);
+            if (iter != query_words.end()) {
+                query_parts[i].push_back(make_pair(iter->second, u.second));
+            }
+        }
+    }
+
+    if (hint != -1) {
+        hint = std::distance(group.subgroups.begin(), std::find(group.subgroups.begin(), group.subgroups.end(), hint));
+        if (hint >= int(nbr_vectors)) {
+            cout << "Hint not among the " << nbr_vectors << " vectors of the group, ignoring it" << endl;
+            hint = -1;
+        }
+    }
+
+    vector<double> source_values(query_values.size(), 0.0);
+    map<int, double> other_source_freqs; // included words that are not in the query, only needed for vnorm
+    vector<bool> included(nbr_vectors, false);
+    vector<bool> adjacent(nbr_vectors, false);
+    double included_sum = 0.0; // sum over the query words of min(query, source) where source is not 0
+    double vnorm = 0.0;
+
+    included_indices.clear();
+    double last_dist = std::numeric_limits<double>::infinity(); // large
+    while (included_indices.size() < nbr_vectors) {
+        double mindist = std::numeric_limits<double>::infinity(); // large
+        int minind = -1;
+
+        size_t first = 0;
+        size_t last = nbr_vectors;
+        if (included_indices.empty() && hint != -1) {
+            first = hint;
+            last = hint + 1;
+        }
+        for (size_t i = first; i < last; ++i) {
+            if (included[i] || (!included_indices.empty() && !adjacent[i])) {
+                continue;
+            }
+            double dist = included_sum;
+            double normdiff = 0.0;
+            for (const pair<int, double>& u : query_parts[i]) {
+                double source_comp = source_values[u.first];
+                double cand_comp = u.second;
+                normdiff += pexp(source_comp) + pexp(cand_comp) - pexp(source_comp+cand_comp);
+                if (source_comp != 0) {
+                    dist -= std::min(query_values[u.first], source_comp);
+                }
+                if (source_comp != 0 || cand_comp != 0) {
+                    dist += std::min(query_values[u.first], source_comp + cand_comp);
+                }
+            }
+            dist = 1.0 - dist/std::max(group.pnorms[i] + vnorm - normdiff, qnorm);
+            if (dist < mindist) {
+                mindist = dist;
+                minind = i;
+            }
+        }
+
+        if (minind == -1 || mindist > last_dist) {
+            break;
+        }
+
+        last_dist = mindist;
+
+        for (const pair<int, double>& u : group.words[minind]) {
+            auto iter = query_words.find(u.first);
+            if (iter == query_words.end()) {
+                double& source = other_source_freqs[u.first];
+                vnorm += pexp(source+u.second) - pexp(source);
+                source += u.second;
+                continue;
+            }
+            int w = iter->second;
+            vnorm += pexp(source_values[w]+u.second) - pexp(source_values[w]);
+            if (source_values[w] != 0) {
+                included_sum -= std::min(query_values[w], source_values[w]);
+            }
+            source_values[w] += u.second;
+            if (source_values[w] != 0) {
+                included_sum += std::min(query_values[w], source_values[w]);
+            }
+        }
+
+        included[minind] = true;
+        included_indices.push_back(minind);
+        for (int n : group.neighbours[minind]) {
+            adjacent[n] = true;
+        }
+    }
+
+    for (int& i : included_indices) {
+        i = group.subgroups[i];
+    }
+
+    return last_dist;
+}
+
 template <typename Point, size_t K>
 double vocabulary_tree<Point, K>::compute_vocabulary_norm(CloudPtrT& cloud)
 {
@@ -78,6 +78,7 @@ public:
     void load_cached_vocabulary_vectors_for_group(std::vector<vocabulary_vector>& vectors, std::set<std::pair<int, int> >& adjacencies, int i);
 
     void query_vocabulary(std::vector<result_type>& results, CloudPtrT& query_cloud, size_t nbr_query);
+    void prune_grown_results(std::vector<result_type>& updated_scores, size_t nbr_query);
 
     void get_subgroups_for_group(std::set<int>& subgroups, int group_id);
     int get_id_for_group_subgroup(int group_id, int subgroup_id);
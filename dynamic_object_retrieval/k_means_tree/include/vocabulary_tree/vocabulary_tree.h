@@ -41,6 +41,16 @@ struct vocabulary_vector
     }
 };
 
+// the part of compute_min_combined_dist that only depends on the vocabulary vectors of a group and not on the query,
+// so that it can be kept between queries. It depends on the node weights and has to be prepared again if they change
+struct combined_dist_group
+{
+    std::vector<int> subgroups; // the subgroup of every vector
+    std::vector<double> pnorms; // the norm of every weighted vector
+    std::vector<std::vector<std::pair<int, double> > > words; // (word index, weighted frequency) of every vector, sorted by word
+    std::vector<std::vector<int> > neighbours; // the adjacent vectors of every vector
+};
+
 struct vocabulary_result {
     int index;
     float score;
@@ -101,6 +111,11 @@ public:
     double compute_vocabulary_norm(CloudPtrT& cloud);
     double compute_min_combined_dist(std::vector<int>& smallest_ind_combination, CloudPtrT& cloud, std::vector<vocabulary_vector>& smaller_freqs,
                                      std::set<std::pair<int, int> >& adjacencies, std::map<node*, int>& mapping, std::map<int, node*>& inverse_mapping, int hint);
+    void prepare_combined_dist_group(combined_dist_group& group, const std::vector<vocabulary_vector>& vectors,
+                                     const std::set<std::pair<int, int> >& adjacencies, std::map<int, node*>& inverse_mapping);
+    // same greedy growth as above, with the query vector computed beforehand and a prepared group
+    double compute_min_combined_dist(std::vector<int>& smallest_ind_combination, const std::map<int, double>& cloud_freqs, double qnorm,
+                                     const combined_dist_group& group, int hint);
 
     void set_min_match_depth(int depth);
     void compute_normalizing_constants(); // this also computes the weights
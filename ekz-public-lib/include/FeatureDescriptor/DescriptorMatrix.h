@@ -0,0 +1,38 @@
+#ifndef DescriptorMatrix_H_
+#define DescriptorMatrix_H_
+#include "FeatureDescriptor.h"
+#include <vector>
+#include <math.h>
+
+using namespace std;
+
+//Descriptors of one type copied to the rows of a 64 byte aligned float matrix, so that distances can be computed
+//without virtual calls. Orb bytes are stored as floats, every row is padded with zeros to a multiple of 16 floats.
+//The distances are the same as FeatureDescriptor::distance: squared L2 for surf, 0.0003 times L2 for orb.
+class DescriptorMatrix
+{
+	public:
+	DescriptorType type;
+	int rows;
+	int dim;
+	int stride;
+	float * data;
+
+	DescriptorMatrix();
+	DescriptorMatrix(vector<FeatureDescriptor *> & descriptors);
+	~DescriptorMatrix();
+
+	void set(vector<FeatureDescriptor *> & descriptors);
+	inline const float * row(int i) const {return data+i*stride;}
+
+	float distance(int i, const DescriptorMatrix & other, int j) const;
+
+	//out[a*nr_dst+b] = scale*distance(src_rows[a], dst, dst_rows[b]), four source rows at a time
+	void distances(const int * src_rows, int nr_src, const DescriptorMatrix & dst, const int * dst_rows, int nr_dst, float scale, float * out) const;
+
+	private:
+	DescriptorMatrix(const DescriptorMatrix &);
+	DescriptorMatrix & operator=(const DescriptorMatrix &);
+	inline float finish(float ssd) const {return type == orb ? 0.0003f*sqrt(ssd) : ssd;}
+};
+#endif
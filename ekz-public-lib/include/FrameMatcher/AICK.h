@@ -40,7 +40,7 @@ class AICK: public FrameMatcher
 		AICK(int max_points_);
 		AICK(int max_points_, int nr_iter, float shrinking_, float distance_threshold_, float feature_threshold_);
 		~AICK();
-		Transformation * getTransformation(RGBDFrame * src, RGBDFrame * dst);
+		Transformation * match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch);
 		float getAlpha(int iteration);
 };
 
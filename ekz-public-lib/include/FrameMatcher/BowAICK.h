@@ -48,7 +48,7 @@ class BowAICK: public FrameMatcher
 		BowAICK(int max_points_);
 		BowAICK(int max_points_, int nr_iter_, float shrinking_,float bow_threshold_, float distance_threshold_,float feature_threshold_);
 		~BowAICK();
-		Transformation * getTransformation(RGBDFrame * src, RGBDFrame * dst);
+		Transformation * match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch);
 		float getAlpha(int iteration);
 		float getAlpha(float avg_d2, int iteration);
 };
@@ -24,6 +24,25 @@ using namespace std;
 //class RGBDFrame;
 //class Transformation;
 
+//Buffers of one matching, reused by the pairs a thread matches in getTransformations
+class MatchingScratch
+{
+	public:
+		vector<int> src_rows;
+		vector<int> dst_rows;
+		vector<float> feature_distances;
+		vector<float> src_x, src_y, src_z;
+		vector<float> dst_x, dst_y, dst_z;
+		vector<int> matches;
+		vector<float> match_distances;
+		vector<int> offsets;
+		vector<int> candidates;
+		vector<int> bucket_offsets;
+		vector<int> bucket_items;
+		DescriptorMatrix src_descriptors;
+		DescriptorMatrix dst_descriptors;
+};
+
 class FrameMatcher
 {
 	public:
@@ -34,9 +53,20 @@ class FrameMatcher
 		void setVerbose(bool b);
 		void setDebugg(bool b);
 		virtual ~FrameMatcher();
+		//Safe to call from several threads at once, every call uses its own buffers
 		virtual Transformation * getTransformation(RGBDFrame * src, RGBDFrame * dst);
+		//src[i] against dst[i] for every i, the pairs are matched in parallel
+		virtual vector<Transformation *> getTransformations(vector<RGBDFrame *> & src, vector<RGBDFrame *> & dst);
+		//Matches every pair of frames once and returns the number of pairs per second
+		virtual double measureThroughput(vector<RGBDFrame *> & frames);
 		virtual void print();
 		void setVisualization(boost::shared_ptr<pcl::visualization::PCLVisualizer> view);
+
+	protected:
+		//Matches src against dst using the buffers in scratch, which belong to the calling thread
+		virtual Transformation * match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch);
+		//The descriptor matrix of the frame, or the frame's valid keypoints copied to tmp
+		const DescriptorMatrix * getDescriptors(RGBDFrame * frame, DescriptorMatrix & tmp);
 };
 
 #include "AICK.h"
@@ -0,0 +1,44 @@
+#ifndef DescriptorKmeans_H_
+#define DescriptorKmeans_H_
+
+#include <vector>
+#include <stdint.h>
+#include "FeatureDescriptor.h"
+
+using namespace std;
+
+//K-means over descriptors copied to contiguous rows.
+//Orb descriptors are packed to 256 bits and clustered by hamming distance, every bit of a centre is the majority vote
+//of its cluster. Surf descriptors are clustered by squared L2 distance to the mean of the cluster. The centres are
+//seeded with k-means++ from seed, so the clusters only depend on the input and the parameters. The restarts are run in
+//parallel when there are at least as many restarts as threads, otherwise the assignment of every restart is.
+class DescriptorKmeans
+{
+	public:
+	int nr_restarts;
+	int iterations;
+	int nr_clusters;
+	unsigned int seed;
+	int nr_threads;			//0 uses omp_get_max_threads()
+	bool verbose;
+	double error;			//mean squared distance to the closest centre of the best restart
+	int best_restart;
+
+	DescriptorKmeans(int nr_restarts_, int iterations_, int nr_clusters_);
+	~DescriptorKmeans();
+
+	//New descriptors of the same type as input[0], descriptors of other types are ignored
+	vector<FeatureDescriptor *> * cluster(vector<FeatureDescriptor *> & input);
+
+	//Rows of 4 words
+	void clusterBinary(const vector<uint64_t> & data, vector<uint64_t> & centres, vector<int> & seeds);
+	//Rows of dim floats
+	void clusterFloat(const vector<float> & data, int dim, vector<float> & centres, vector<int> & seeds);
+
+	static void packOrb(const int * descriptor, uint64_t * row);
+	static void unpackOrb(const uint64_t * row, int * descriptor);
+
+	private:
+	int getThreads();
+};
+#endif
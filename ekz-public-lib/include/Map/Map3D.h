@@ -56,12 +56,18 @@ class Map3D
 	Calibration * calibration;
 
 	bool verbose;
+
+	//Loop closure search of estimate(), see findLoopClosures. A min distance of 0 turns it off.
+	int loopclosure_min_distance;
+	int loopclosure_candidates;
+	float loopclosure_min_weight;
 	
 	vector<RGBDFrame *> frames;
 	vector<int> largest_component;
 
 	
 	vector<Transformation *> transformations;
+	vector<Transformation *> loopclosures;
 	vector<Matrix4f> poses;
 	
 	Map3D();
@@ -78,6 +84,15 @@ class Map3D
 	
 	virtual void addTransformation(Transformation * transformation);
 
+	//Matches every frame with loopclosure_matcher against the frames at least min_frame_distance before it. With
+	//max_candidates > 0 only the earlier frames with the closest image descriptors are tried. The pairs are matched in
+	//parallel, transformations with a weight of at least min_weight are added to loopclosures and returned.
+	virtual vector<Transformation *> findLoopClosures(int min_frame_distance, int max_candidates, float min_weight);
+	//Replaces the loop closures of an earlier call with a new search using the loopclosure_* settings
+	virtual void updateLoopClosures();
+
+	//Chains the sequential transformations into poses and searches for loop closures. The loop closures connect the
+	//frames in getLargestComponent, the poses only follow the sequential transformations.
 	virtual vector<Matrix4f> estimate();
 
 	virtual void setVerbose(bool v);
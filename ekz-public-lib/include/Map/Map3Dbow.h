@@ -12,6 +12,8 @@ class Map3Dbow: public Map3D
 	int nr_restarts_;
 	int iterations_;
 	int nr_clusters_;
+	unsigned int seed;		//k-means++ seeding
+	int nr_threads;			//0 uses omp_get_max_threads()
 	Map3Dbow(string file_path);
 	Map3Dbow(string file_path, int nr_restarts, int iterations, int nr_clusters);
 	~Map3Dbow(); 
@@ -21,6 +21,7 @@
 #include "FeatureExtractor.h"
 #include "RGBDSegmentation.h"
 #include "FloatHistogramFeatureDescriptor.h"
+#include "DescriptorMatrix.h"
 
 #include "FrameInput.h"
 
@@ -32,6 +33,7 @@ class RGBDFrame{
 
 	FeatureDescriptor * image_descriptor;
 	KeyPointSet * keypoints;
+	DescriptorMatrix * descriptors;	//rows of keypoints->valid_key_points, for the matchers
 	
 	Segments * segments;
 	
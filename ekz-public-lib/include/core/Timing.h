@@ -0,0 +1,12 @@
+#ifndef Timing_H_
+#define Timing_H_
+#include <sys/time.h>
+
+//Wall clock time in seconds, for timing the apps
+inline double getTime(){
+	struct timeval start1;
+	gettimeofday(&start1, NULL);
+	return double(start1.tv_sec+(start1.tv_usec/1000000.0));
+}
+
+#endif
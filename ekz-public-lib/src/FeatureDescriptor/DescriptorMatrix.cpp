@@ -0,0 +1,110 @@
+#include "DescriptorMatrix.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+DescriptorMatrix::DescriptorMatrix(){
+	type = unitiated;
+	rows = 0;
+	dim = 0;
+	stride = 0;
+	data = 0;
+}
+
+DescriptorMatrix::DescriptorMatrix(vector<FeatureDescriptor *> & descriptors){
+	type = unitiated;
+	rows = 0;
+	dim = 0;
+	stride = 0;
+	data = 0;
+	set(descriptors);
+}
+
+DescriptorMatrix::~DescriptorMatrix(){free(data);}
+
+void DescriptorMatrix::set(vector<FeatureDescriptor *> & descriptors){
+	rows = descriptors.size();
+	type = rows > 0 ? descriptors.front()->type : unitiated;
+	if(type == orb){			dim = 32;}
+	else if(type == surf64){	dim = 64;}
+	else if(type == surf128){	dim = 128;}
+	else{						dim = 0;}
+	stride = 16*((dim+15)/16);
+
+	free(data);
+	data = 0;
+	if(rows*stride > 0 && posix_memalign((void **)&data,64,sizeof(float)*rows*stride) != 0){data = 0;}
+	if(data == 0){
+		rows = 0;
+		return;
+	}
+	memset(data,0,sizeof(float)*rows*stride);
+	for(int i = 0; i < rows; i++){
+		FeatureDescriptor * descriptor = descriptors[i];
+		float * r = data+i*stride;
+		if(descriptor->type != type){
+			printf("DescriptorMatrix: descriptor %i has another type\n",i);
+			continue;
+		}
+		if(type == orb){
+			int * d = ((OrbFeatureDescriptor *)descriptor)->descriptor;
+			for(int k = 0; k < dim; k++){r[k] = d[k];}
+		}else if(type == surf64){
+			memcpy(r,((SurfFeatureDescriptor64 *)descriptor)->descriptor,dim*sizeof(float));
+		}else{
+			memcpy(r,((SurfFeatureDescriptor128 *)descriptor)->descriptor,dim*sizeof(float));
+		}
+	}
+}
+
+float DescriptorMatrix::distance(int i, const DescriptorMatrix & other, int j) const {
+	if(type != other.type){return 999999;}
+	const float * a = row(i);
+	const float * b = other.row(j);
+	float ssd = 0;
+#pragma omp simd reduction(+:ssd)
+	for(int k = 0; k < stride; k++){
+		float d = a[k]-b[k];
+		ssd += d*d;
+	}
+	return finish(ssd);
+}
+
+void DescriptorMatrix::distances(const int * src_rows, int nr_src, const DescriptorMatrix & dst, const int * dst_rows, int nr_dst, float scale, float * out) const {
+	if(type != dst.type){
+		for(int i = 0; i < nr_src*nr_dst; i++){out[i] = scale*999999;}
+		return;
+	}
+	const int n = stride;
+	for(int a = 0; a < nr_src; a += 4){
+		const int na = std::min(4,nr_src-a);
+		//Missing rows of the last block repeat the first one and are not written
+		const float * s0 = row(src_rows[a]);
+		const float * s1 = na > 1 ? row(src_rows[a+1]) : s0;
+		const float * s2 = na > 2 ? row(src_rows[a+2]) : s0;
+		const float * s3 = na > 3 ? row(src_rows[a+3]) : s0;
+		for(int b = 0; b < nr_dst; b++){
+			const float * d = dst.row(dst_rows[b]);
+			float ssd0 = 0;
+			float ssd1 = 0;
+			float ssd2 = 0;
+			float ssd3 = 0;
+#pragma omp simd reduction(+:ssd0,ssd1,ssd2,ssd3)
+			for(int k = 0; k < n; k++){
+				float v = d[k];
+				float e0 = s0[k]-v;
+				float e1 = s1[k]-v;
+				float e2 = s2[k]-v;
+				float e3 = s3[k]-v;
+				ssd0 += e0*e0;
+				ssd1 += e1*e1;
+				ssd2 += e2*e2;
+				ssd3 += e3*e3;
+			}
+			out[a*nr_dst+b] = scale*finish(ssd0);
+			if(na > 1){out[(a+1)*nr_dst+b] = scale*finish(ssd1);}
+			if(na > 2){out[(a+2)*nr_dst+b] = scale*finish(ssd2);}
+			if(na > 3){out[(a+3)*nr_dst+b] = scale*finish(ssd3);}
+		}
+	}
+}
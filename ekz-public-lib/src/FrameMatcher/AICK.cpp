@@ -50,7 +50,7 @@ AICK::~AICK(){printf("delete AICK\n");}
 
 float AICK::getAlpha(int iteration){return 1-pow(shrinking,float(iteration));}
 
-Transformation * AICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
+Transformation * AICK::match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch)
 {
 	//printf("start AICK...\n");
 	struct timeval start, end;
@@ -115,64 +115,71 @@ Transformation * AICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 	int nr_loop_dst = dst->keypoints->valid_key_points.size();
 	if(nr_loop_dst > max_points){nr_loop_dst = max_points;}
 	
+	vector<int> & src_rows = scratch->src_rows;
+	src_rows.clear();
 	for(int i = 0; i < nr_loop_src; i++)
 	{
 		if(src->keypoints->valid_key_points.at(i)->stabilety > stabilety_threshold){
 			src_keypoints.push_back(src->keypoints->valid_key_points.at(i));
+			src_rows.push_back(i);
 		}
 	}
 
 	vector<KeyPoint * > dst_keypoints;//	= dst->keypoints->valid_key_points;
+	vector<int> & dst_rows = scratch->dst_rows;
+	dst_rows.clear();
 	for(int i = 0; i < nr_loop_dst; i++)
 	{
 		if(dst->keypoints->valid_key_points.at(i)->stabilety > stabilety_threshold){
 			dst_keypoints.push_back(dst->keypoints->valid_key_points.at(i));
+			dst_rows.push_back(i);
 		}
 	}
 	//printf("src_keypoints.size() = %i, dst_keypoints.size() = %i\n",int(src_keypoints.size()),int(dst_keypoints.size()));
 	//if(debugg_AICK){printf("src_keypoints.size() = %i, dst_keypoints.size() = %i\n",int(src_keypoints.size()),int(dst_keypoints.size()));}
 	int src_nr_points = src_keypoints.size();
 	int dst_nr_points = dst_keypoints.size();
-	float ** surf_distances = new float*[src_nr_points];
-	float ** match_distances = new float*[src_nr_points];
-	for(int i = 0; i < src_nr_points;i++)
-	{
-		//printf("i:%i\n",i);
-		surf_distances[i] = new float[dst_nr_points];
-		match_distances[i]= new float[dst_nr_points];		
-		for(int j = 0; j < dst_nr_points;j++)
-		{
-			FeatureDescriptor * descriptorA = src_keypoints.at(i)->descriptor;
-			FeatureDescriptor * descriptorB = dst_keypoints.at(j)->descriptor;
-			surf_distances[i][j] = feature_scale*(descriptorA->distance(descriptorB));
-		}
+
+	//Feature distances of all pairs, row i holds the distances from source point i
+	scratch->feature_distances.resize(src_nr_points*dst_nr_points+1);
+	float * surf_distances = &(scratch->feature_distances[0]);
+	if(src_nr_points > 0 && dst_nr_points > 0){
+		const DescriptorMatrix * src_descriptors = getDescriptors(src,scratch->src_descriptors);
+		const DescriptorMatrix * dst_descriptors = getDescriptors(dst,scratch->dst_descriptors);
+		src_descriptors->distances(&src_rows[0],src_nr_points,*dst_descriptors,&dst_rows[0],dst_nr_points,feature_scale,surf_distances);
 	}
-	float * pos_src_x 				= new float[src_nr_points];
-	float * pos_src_y 				= new float[src_nr_points];
-	float * pos_src_z 				= new float[src_nr_points];
+
+	scratch->src_x.resize(src_nr_points+1);
+	scratch->src_y.resize(src_nr_points+1);
+	scratch->src_z.resize(src_nr_points+1);
+	float * pos_src_x = &(scratch->src_x[0]);
+	float * pos_src_y = &(scratch->src_y[0]);
+	float * pos_src_z = &(scratch->src_z[0]);
 	for(int i = 0; i < src_nr_points; i++)
 	{
 		pos_src_x[i] = src_keypoints.at(i)->point->x;
 		pos_src_y[i] = src_keypoints.at(i)->point->y;
 		pos_src_z[i] = src_keypoints.at(i)->point->z;
 	}	
-	float * pos_src_x_transform 	= new float[src_nr_points];
-	float * pos_src_y_transform 	= new float[src_nr_points];
-	float * pos_src_z_transform 	= new float[src_nr_points];
 	
-	float * pos_dst_x_transform 	= new float[dst_nr_points];
-	float * pos_dst_y_transform 	= new float[dst_nr_points];
-	float * pos_dst_z_transform 	= new float[dst_nr_points];
+	scratch->dst_x.resize(dst_nr_points+1);
+	scratch->dst_y.resize(dst_nr_points+1);
+	scratch->dst_z.resize(dst_nr_points+1);
+	float * pos_dst_x = &(scratch->dst_x[0]);
+	float * pos_dst_y = &(scratch->dst_y[0]);
+	float * pos_dst_z = &(scratch->dst_z[0]);
 	for(int i = 0; i < dst_nr_points; i++)
 	{
-		pos_dst_x_transform[i] = dst_keypoints.at(i)->point->x;
-		pos_dst_y_transform[i] = dst_keypoints.at(i)->point->y;
-		pos_dst_z_transform[i] = dst_keypoints.at(i)->point->z;
+		pos_dst_x[i] = dst_keypoints.at(i)->point->x;
+		pos_dst_y[i] = dst_keypoints.at(i)->point->y;
+		pos_dst_z[i] = dst_keypoints.at(i)->point->z;
 	}
 //printf("line:%i\n",__LINE__);
 	
-	int * src_matches 				= new int[src_nr_points];
-	int * dst_matches 				= new int[dst_nr_points];
+	scratch->matches.resize(src_nr_points+1);
+	scratch->match_distances.resize(src_nr_points+1);
+	int * src_matches 				= &(scratch->matches[0]);
+	float * src_match_distances		= &(scratch->match_distances[0]);
 	
 	
 	Eigen::Matrix4f transformationMat = Eigen::Matrix4f::Identity();
@@ -199,47 +206,33 @@ Transformation * AICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 		float mat22 = transformationMat(2,2);
 		float mat23 = transformationMat(2,3);
 		
+		//Best match of every source point, the match distances are not stored
 		for(int i = 0; i < src_nr_points;i++)
 		{
-			float x = pos_src_x[i];
-			float y = pos_src_y[i];
-			float z = pos_src_z[i];
-				
-			pos_src_x_transform[i] = x*mat00+y*mat01+z*mat02+mat03;
-			pos_src_y_transform[i] = x*mat10+y*mat11+z*mat12+mat13;
-			pos_src_z_transform[i] = x*mat20+y*mat21+z*mat22+mat23;
-		}
-		
-		for(int i = 0; i < src_nr_points;i++)
-		{
-			float x = pos_src_x_transform[i];
-			float y = pos_src_y_transform[i];
-			float z = pos_src_z_transform[i];
-			float dx,dy,dz;
-			for(int j = 0; j < dst_nr_points;j++)
-			{
-				dx = x-pos_dst_x_transform[j];
-				dy = y-pos_dst_y_transform[j];
-				dz = z-pos_dst_z_transform[j];
+			float x_tmp = pos_src_x[i];
+			float y_tmp = pos_src_y[i];
+			float z_tmp = pos_src_z[i];
 
-				match_distances[i][j] = (1-alpha)*surf_distances[i][j] + alpha*sqrt(dx*dx + dy*dy + dz*dz);
-			}
-		}
-		
+			float x = x_tmp*mat00+y_tmp*mat01+z_tmp*mat02+mat03;
+			float y = x_tmp*mat10+y_tmp*mat11+z_tmp*mat12+mat13;
+			float z = x_tmp*mat20+y_tmp*mat21+z_tmp*mat22+mat23;
 
-		for(int i = 0; i < src_nr_points;i++)
-		{
+			const float * row = surf_distances+i*dst_nr_points;
 			src_matches[i] = -1;
 			float best_value = 9999999;
 			for(int j = 0; j < dst_nr_points;j++)
 			{
-				float current = match_distances[i][j];
+				float dx = x-pos_dst_x[j];
+				float dy = y-pos_dst_y[j];
+				float dz = z-pos_dst_z[j];
+				float current = (1-alpha)*row[j] + alpha*sqrt(dx*dx + dy*dy + dz*dz);
 				if(current<best_value)
 				{
 					best_value = current;
 					src_matches[i] = j;
 				}
 			}
+			src_match_distances[i] = best_value;
 		}
 		pcl::TransformationFromCorrespondences tfc;
 		//int nr_matches = 0;
@@ -256,7 +249,7 @@ Transformation * AICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 		{
 			int j = src_matches[i];
 			
-			if(match_distances[i][j] < threshold && j != -1){
+			if(j != -1 && src_match_distances[i] < threshold){
 				//if(src->id == 793){printf("j = %i\n",j);}
 				KeyPoint * src_kp = src_keypoints.at(i);
 				KeyPoint * dst_kp = dst_keypoints.at(j);
@@ -292,29 +285,6 @@ Transformation * AICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 		if(nr_matches < 3){transformation->transformationMatrix = Eigen::Matrix4f::Identity(); break;}
 	}
 	if(debugg_AICK){printf("done\n");cvReleaseImage( &img_combine );}
-	for(int i = 0; i < src_nr_points;i++)
-	{
-		delete[] surf_distances[i];
-		delete[] match_distances[i];		
-	}
-	delete[] surf_distances;
-	delete[] match_distances;
-	
-	delete[] pos_src_x;
-	delete[] pos_src_y;
-	delete[] pos_src_z;
-	
-	delete[] pos_src_x_transform;
-	delete[] pos_src_y_transform;
-	delete[] pos_src_z_transform;
-	
-	
-	delete[] pos_dst_x_transform;
-	delete[] pos_dst_y_transform;
-	delete[] pos_dst_z_transform;
-	
-	delete[] src_matches;
-	delete[] dst_matches;
 
 	gettimeofday(&end, NULL);
 	float time = (end.tv_sec*1000000+end.tv_usec-(start.tv_sec*1000000+start.tv_usec))/1000000.0f;
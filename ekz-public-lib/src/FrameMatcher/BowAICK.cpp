@@ -107,7 +107,7 @@ float BowAICK::getAlpha(float avg_d2, int iteration){
 	return 1-a*b;
 }
 
-Transformation * BowAICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
+Transformation * BowAICK::match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch)
 {
 	struct timeval start, end;
 	gettimeofday(&start, NULL);
@@ -164,58 +164,59 @@ Transformation * BowAICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 	int dst_nr_points = dst_keypoints.size();
 	
 	int nr_bow = src->input->calibration->words.size();
-	vector<int> * bow = new vector<int>[nr_bow];
-	for(int i = 0; i < nr_bow; i++){bow[i] = vector<int>();}
-	for(unsigned int i = 0; i < dst_keypoints.size(); i++){
+
+	//Destination points by their closest word
+	vector<int> & bow_offsets = scratch->bucket_offsets;
+	vector<int> & bow = scratch->bucket_items;
+	bow_offsets.assign(nr_bow+2,0);
+	for(int i = 0; i < dst_nr_points; i++){
 		KeyPoint * kp = dst_keypoints.at(i);
-		if(kp->cluster_distance_pairs.size()>0){
-			int id = kp->cluster_distance_pairs.at(0).first;
-			bow[id].push_back(i);
-		}
+		if(kp->cluster_distance_pairs.size()>0){bow_offsets[kp->cluster_distance_pairs.at(0).first+2]++;}
+	}
+	for(int i = 0; i < nr_bow; i++){bow_offsets[i+2] += bow_offsets[i+1];}
+	bow.resize(bow_offsets[nr_bow+1]+1);
+	for(int i = 0; i < dst_nr_points; i++){
+		KeyPoint * kp = dst_keypoints.at(i);
+		if(kp->cluster_distance_pairs.size()>0){bow[bow_offsets[kp->cluster_distance_pairs.at(0).first+1]++] = i;}
 	}
 
-	vector< vector< int > > possible_matches;
-	float ** feature_distances = new float*[src_nr_points];
+	//Candidates of source point i are possible_matches[offsets[i]] to possible_matches[offsets[i+1]-1]
+	vector<int> & offsets = scratch->offsets;
+	vector<int> & possible_matches = scratch->candidates;
+	offsets.resize(src_nr_points+1);
+	possible_matches.clear();
 	for(int i = 0; i < src_nr_points; i++){
-		possible_matches.push_back(vector< int >());
+		offsets[i] = possible_matches.size();
 		KeyPoint * src_kp = src_keypoints.at(i);
-		//printf("%i gives %i -> ",i,src_kp->cluster_distance_pairs.size());
 		for(unsigned int j = 0; j < src_kp->cluster_distance_pairs.size(); j++){
 			float d = src_kp->cluster_distance_pairs.at(j).second;
-			//printf("%5.5f ",d);
 			int id = src_kp->cluster_distance_pairs.at(j).first;
 			if(d < bow_threshold){
-				vector<int> vec = bow[id];
-				for(unsigned int k = 0; k < vec.size(); k++){
-					possible_matches.at(i).push_back(vec.at(k));
-				}
+				for(int k = bow_offsets[id]; k < bow_offsets[id+1]; k++){possible_matches.push_back(bow[k]);}
 			}else{break;}
 		}
-		//printf("\n");
-		FeatureDescriptor * descriptorA = src_kp->descriptor;
-		int dst_nr_matches = possible_matches.at(i).size();
-		feature_distances[i] = new float[dst_nr_matches];		
-		for(int j = 0; j < dst_nr_matches;j++){
-			FeatureDescriptor * descriptorB = dst_keypoints.at(possible_matches.at(i).at(j))->descriptor;
-			feature_distances[i][j] = feature_scale*(descriptorA->distance(descriptorB));
-		}
 	}
-	
-/*
-	for(int i = 0; i < src_nr_points;i++){
-		FeatureDescriptor * descriptorA = src_keypoints.at(i)->descriptor;
-		int dst_nr_matches = possible_matches.at(i).size();
-		feature_distances[i] = new float[dst_nr_matches];		
-		for(int j = 0; j < dst_nr_matches;j++)
-		{
-			FeatureDescriptor * descriptorB = dst_keypoints.at(possible_matches.at(i).at(j))->descriptor;
-			feature_distances[i][j] = feature_scale*(descriptorA->distance(descriptorB));
+	offsets[src_nr_points] = possible_matches.size();
+	possible_matches.push_back(0);
+
+	//The keypoints are the first valid keypoints, so the descriptor rows are the keypoint indices
+	scratch->feature_distances.resize(offsets[src_nr_points]+1);
+	float * feature_distances = &(scratch->feature_distances[0]);
+	if(offsets[src_nr_points] > 0){
+		const DescriptorMatrix * src_descriptors = getDescriptors(src,scratch->src_descriptors);
+		const DescriptorMatrix * dst_descriptors = getDescriptors(dst,scratch->dst_descriptors);
+		for(int i = 0; i < src_nr_points; i++){
+			int dst_nr_matches = offsets[i+1]-offsets[i];
+			if(dst_nr_matches > 0){src_descriptors->distances(&i,1,*dst_descriptors,&possible_matches[offsets[i]],dst_nr_matches,feature_scale,feature_distances+offsets[i]);}
 		}
 	}
-*/
-	float * pos_src_x 	= new float[src_nr_points];
-	float * pos_src_y 	= new float[src_nr_points];
-	float * pos_src_z 	= new float[src_nr_points];
+
+	scratch->src_x.resize(src_nr_points+1);
+	scratch->src_y.resize(src_nr_points+1);
+	scratch->src_z.resize(src_nr_points+1);
+	float * pos_src_x 	= &(scratch->src_x[0]);
+	float * pos_src_y 	= &(scratch->src_y[0]);
+	float * pos_src_z 	= &(scratch->src_z[0]);
 	for(int i = 0; i < src_nr_points; i++)
 	{
 		pos_src_x[i] = src_keypoints.at(i)->point->x;
@@ -223,9 +224,12 @@ Transformation * BowAICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 		pos_src_z[i] = src_keypoints.at(i)->point->z;
 	}	
 	
-	float * pos_dst_x 	= new float[dst_nr_points];
-	float * pos_dst_y 	= new float[dst_nr_points];
-	float * pos_dst_z 	= new float[dst_nr_points];
+	scratch->dst_x.resize(dst_nr_points+1);
+	scratch->dst_y.resize(dst_nr_points+1);
+	scratch->dst_z.resize(dst_nr_points+1);
+	float * pos_dst_x 	= &(scratch->dst_x[0]);
+	float * pos_dst_y 	= &(scratch->dst_y[0]);
+	float * pos_dst_z 	= &(scratch->dst_z[0]);
 	for(int i = 0; i < dst_nr_points; i++)
 	{
 		pos_dst_x[i] = dst_keypoints.at(i)->point->x;
@@ -273,17 +277,16 @@ Transformation * BowAICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 			float z = x_tmp*mat20+y_tmp*mat21+z_tmp*mat22+mat23;
 
 			float dx,dy,dz;
-			int dst_nr_matches = possible_matches.at(i).size();
 			float best_d = 100000000;
 			int best_j = -1;
-			for(int jj = 0; jj < dst_nr_matches;jj++)
+			for(int jj = offsets[i]; jj < offsets[i+1];jj++)
 			{
-				int j = possible_matches.at(i).at(jj);
+				int j = possible_matches[jj];
 				dx = x-pos_dst_x[j];
 				dy = y-pos_dst_y[j];
 				dz = z-pos_dst_z[j];
 
-				float d = (1-alpha)*feature_distances[i][jj] + alpha*sqrt(dx*dx + dy*dy + dz*dz);
+				float d = (1-alpha)*feature_distances[jj] + alpha*sqrt(dx*dx + dy*dy + dz*dz);
 				if(d < best_d){
 					best_d = d;
 					best_j = j;
@@ -372,19 +375,6 @@ Transformation * BowAICK::getTransformation(RGBDFrame * src, RGBDFrame * dst)
 	//cout<< "transformation->transformationMatrix\n" <<transformation->transformationMatrix<<endl;
 	if(debugg_BowAICK){printf("done\n");cvReleaseImage( &img_combine );}
 	
-	for(int i = 0; i < src_nr_points;i++){delete[] feature_distances[i];}
-	delete[] feature_distances;
-	
-	delete[] pos_src_x;
-	delete[] pos_src_y;
-	delete[] pos_src_z;
-	
-	delete[] pos_dst_x;
-	delete[] pos_dst_y;
-	delete[] pos_dst_z;
-	
-	delete[] bow;
-	
 
 	gettimeofday(&end, NULL);
 	float time = (end.tv_sec*1000000+end.tv_usec-(start.tv_sec*1000000+start.tv_usec))/1000000.0f;
@@ -1,4 +1,8 @@
 #include "FrameMatcher.h"
+#include <sys/time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -6,7 +10,13 @@ void FrameMatcher::setVerbose(bool b){verbose = b;}
 void FrameMatcher::setDebugg(bool b){debugg = b;}
 
 FrameMatcher::~FrameMatcher(){}
+
 Transformation * FrameMatcher::getTransformation(RGBDFrame * src, RGBDFrame * dst){
+	MatchingScratch scratch;
+	return match(src,dst,&scratch);
+}
+
+Transformation * FrameMatcher::match(RGBDFrame * src, RGBDFrame * dst, MatchingScratch * scratch){
 
 	Transformation * transformation = new Transformation();
 	transformation->transformationMatrix = Eigen::Matrix4f::Identity();
@@ -15,5 +25,54 @@ Transformation * FrameMatcher::getTransformation(RGBDFrame * src, RGBDFrame * ds
 	transformation->weight = 0;
 	return transformation;
 }
+
+vector<Transformation *> FrameMatcher::getTransformations(vector<RGBDFrame *> & src, vector<RGBDFrame *> & dst){
+	int nr_pairs = min(src.size(),dst.size());
+	vector<Transformation *> transformations (nr_pairs,(Transformation *)0);
+#pragma omp parallel
+	{
+		MatchingScratch scratch;
+#pragma omp for schedule(dynamic)
+		for(int i = 0; i < nr_pairs; i++){transformations[i] = match(src[i],dst[i],&scratch);}
+	}
+	return transformations;
+}
+
+double FrameMatcher::measureThroughput(vector<RGBDFrame *> & frames){
+	vector<RGBDFrame *> src;
+	vector<RGBDFrame *> dst;
+	for(unsigned int i = 0; i < frames.size(); i++){
+		for(unsigned int j = 0; j < i; j++){
+			src.push_back(frames[i]);
+			dst.push_back(frames[j]);
+		}
+	}
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	vector<Transformation *> transformations = getTransformations(src,dst);
+	gettimeofday(&end, NULL);
+	double time = (end.tv_sec*1000000+end.tv_usec-(start.tv_sec*1000000+start.tv_usec))/1000000.0;
+	double weight = 0;
+	for(unsigned int i = 0; i < transformations.size(); i++){
+		weight += transformations[i]->weight;
+		delete transformations[i];
+	}
+	double pairs_per_second = time > 0 ? double(src.size())/time : 0;
+	printf("%s: %i frame pairs in %f s with %i threads, %f pairs per second, mean weight %f\n",name.c_str(),int(src.size()),time,threads,pairs_per_second,src.size() > 0 ? weight/double(src.size()) : 0);
+	return pairs_per_second;
+}
+
+const DescriptorMatrix * FrameMatcher::getDescriptors(RGBDFrame * frame, DescriptorMatrix & tmp){
+	if(frame->descriptors != 0){return frame->descriptors;}
+	vector<FeatureDescriptor *> descriptors;
+	for(unsigned int i = 0; i < frame->keypoints->valid_key_points.size(); i++){descriptors.push_back(frame->keypoints->valid_key_points[i]->descriptor);}
+	tmp.set(descriptors);
+	return &tmp;
+}
+
 void FrameMatcher::print(){printf("%s\n",name.c_str());}
 void FrameMatcher::setVisualization(boost::shared_ptr<pcl::visualization::PCLVisualizer> view){viewer = view;}
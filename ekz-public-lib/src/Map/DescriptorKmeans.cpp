@@ -0,0 +1,318 @@
+#include "DescriptorKmeans.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+//splitmix64, the same sequence on every platform
+class KmeansRandom
+{
+	public:
+	uint64_t state;
+	KmeansRandom(uint64_t seed){state = seed;}
+	uint64_t next(){
+		uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return z ^ (z >> 31);
+	}
+	double uniform(){return double(next() >> 11) * (1.0/9007199254740992.0);}
+};
+
+//Without hardware popcount __builtin_popcountll is a library call
+static inline int popcount64(uint64_t x){
+#ifdef __POPCNT__
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return int((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+//256 bit rows, hamming distance and majority vote centres
+class BinarySpace
+{
+	public:
+	typedef uint64_t Element;
+	int dim;
+	BinarySpace(){dim = 4;}
+
+	inline double distance(const uint64_t * a, const uint64_t * b) const {
+		return double(popcount64(a[0]^b[0]) + popcount64(a[1]^b[1]) + popcount64(a[2]^b[2]) + popcount64(a[3]^b[3]));
+	}
+	inline double squared(double distance) const {return distance*distance;}
+
+	//Ties keep the bit of the previous centre
+	void centre(const uint64_t * data, const int * members, int nr_members, uint64_t * centre) const {
+		int counts [256];
+		for(int b = 0; b < 256; b++){counts[b] = 0;}
+		for(int m = 0; m < nr_members; m++){
+			const uint64_t * row = data+4*members[m];
+			for(int w = 0; w < 4; w++){
+				uint64_t word = row[w];
+				for(int b = 0; b < 64; b++){counts[64*w+b] += (word >> b) & 1;}
+			}
+		}
+		for(int w = 0; w < 4; w++){
+			uint64_t word = 0;
+			for(int b = 0; b < 64; b++){
+				int votes = 2*counts[64*w+b];
+				uint64_t bit = votes == nr_members ? (centre[w] >> b) & 1 : uint64_t(votes > nr_members);
+				word |= bit << b;
+			}
+			centre[w] = word;
+		}
+	}
+};
+
+//float rows, squared L2 distance as in SurfFeatureDescriptor64 and mean centres
+class FloatSpace
+{
+	public:
+	typedef float Element;
+	int dim;
+	FloatSpace(int dim_){dim = dim_;}
+
+	inline double distance(const float * a, const float * b) const {
+		float sum = 0;
+#pragma omp simd reduction(+:sum)
+		for(int d = 0; d < dim; d++){
+			float diff = a[d]-b[d];
+			sum += diff*diff;
+		}
+		return sum;
+	}
+	inline double squared(double distance) const {return distance;}
+
+	void centre(const float * data, const int * members, int nr_members, float * centre) const {
+		vector<double> sum (dim,0);
+		for(int m = 0; m < nr_members; m++){
+			const float * row = data+dim*members[m];
+			for(int d = 0; d < dim; d++){sum[d] += row[d];}
+		}
+		for(int d = 0; d < dim; d++){centre[d] = sum[d]/double(nr_members);}
+	}
+};
+
+//One restart, the work is split between threads over the rows and the clusters in a fixed order so the result does not
+//depend on the number of threads
+template <class Space>
+double runKmeans(const Space & space, const typename Space::Element * data, int n, int k, int iterations, uint64_t seed, int threads, bool verbose,
+				 vector<typename Space::Element> & centres, vector<int> & seeds){
+	typedef typename Space::Element Element;
+	const int dim = space.dim;
+	KmeansRandom random (seed);
+	centres.resize(k*dim);
+	seeds.resize(k);
+
+	//k-means++ seeding, the probability of a row is its squared distance to the closest centre
+	vector<double> closest (n);
+	for(int c = 0; c < k; c++){
+		int pick = 0;
+		if(c == 0){
+			pick = random.next() % n;
+		}else{
+			double total = 0;
+			for(int i = 0; i < n; i++){total += closest[i];}
+			if(total <= 0){
+				pick = random.next() % n;
+			}else{
+				double target = random.uniform()*total;
+				double cumulative = 0;
+				pick = n-1;
+				for(int i = 0; i < n; i++){
+					cumulative += closest[i];
+					if(cumulative > target){pick = i; break;}
+				}
+			}
+		}
+		seeds[c] = pick;
+		memcpy(&centres[c*dim],data+pick*dim,dim*sizeof(Element));
+		const Element * centre = &centres[c*dim];
+#pragma omp parallel for num_threads(threads) if(threads > 1) schedule(static)
+		for(int i = 0; i < n; i++){
+			double d = space.squared(space.distance(data+i*dim,centre));
+			closest[i] = c == 0 ? d : min(closest[i],d);
+		}
+	}
+
+	vector<int> labels (n,-1);
+	vector<int> members (n);
+	vector<int> offsets (k+1);
+	double error = 0;
+	for(int iter = 0; iter < iterations; iter++){
+		int changed = 0;
+#pragma omp parallel for num_threads(threads) if(threads > 1) schedule(static) reduction(+:changed)
+		for(int i = 0; i < n; i++){
+			const Element * row = data+i*dim;
+			double best = space.distance(row,&centres[0]);
+			int best_id = 0;
+			for(int c = 1; c < k; c++){
+				double d = space.distance(row,&centres[c*dim]);
+				if(d < best){
+					best = d;
+					best_id = c;
+				}
+			}
+			changed += labels[i] != best_id;
+			labels[i] = best_id;
+			closest[i] = space.squared(best);
+		}
+		error = 0;
+		for(int i = 0; i < n; i++){error += closest[i];}
+		error /= double(n);
+		if(verbose){printf("iter %i / %i errorsum: %f changed: %i\n",iter+1,iterations,error,changed);}
+		if(changed == 0){break;}
+
+		//Rows sorted by cluster, in input order within every cluster
+		for(int c = 0; c <= k; c++){offsets[c] = 0;}
+		for(int i = 0; i < n; i++){offsets[labels[i]+1]++;}
+		for(int c = 0; c < k; c++){offsets[c+1] += offsets[c];}
+		vector<int> position (offsets.begin(),offsets.end()-1);
+		for(int i = 0; i < n; i++){members[position[labels[i]]++] = i;}
+
+#pragma omp parallel for num_threads(threads) if(threads > 1) schedule(dynamic,16)
+		for(int c = 0; c < k; c++){
+			int nr_members = offsets[c+1]-offsets[c];
+			if(nr_members > 0){space.centre(data,&members[offsets[c]],nr_members,&centres[c*dim]);}
+		}
+	}
+	return error;
+}
+
+//Restarts in parallel or one after the other, the lowest error wins and ties go to the first restart
+template <class Space>
+double runRestarts(const Space & space, const vector<typename Space::Element> & data, int nr_restarts, int k, int iterations, unsigned int seed, int threads, bool verbose,
+				   vector<typename Space::Element> & centres, vector<int> & seeds, int & best_restart){
+	const int n = data.size()/space.dim;
+	k = min(k,n);
+	nr_restarts = max(1,nr_restarts);
+	vector< vector<typename Space::Element> > restart_centres (nr_restarts);
+	vector< vector<int> > restart_seeds (nr_restarts);
+	vector<double> restart_error (nr_restarts,0);
+	if(n == 0 || k <= 0){
+		centres.clear();
+		seeds.clear();
+		best_restart = 0;
+		return 0;
+	}
+
+	const bool parallel_restarts = nr_restarts >= threads && threads > 1;
+#pragma omp parallel for num_threads(threads) if(parallel_restarts) schedule(dynamic)
+	for(int r = 0; r < nr_restarts; r++){
+		uint64_t restart_seed = uint64_t(seed) * 0x100000001B3ULL + uint64_t(r);
+		restart_error[r] = runKmeans(space,&data[0],n,k,iterations,restart_seed,parallel_restarts ? 1 : threads,verbose && !parallel_restarts,restart_centres[r],restart_seeds[r]);
+		if(verbose){printf("restart %i / %i errorsum: %f\n",r+1,nr_restarts,restart_error[r]);}
+	}
+
+	best_restart = 0;
+	for(int r = 1; r < nr_restarts; r++){
+		if(restart_error[r] < restart_error[best_restart]){best_restart = r;}
+	}
+	centres.swap(restart_centres[best_restart]);
+	seeds.swap(restart_seeds[best_restart]);
+	return restart_error[best_restart];
+}
+
+DescriptorKmeans::DescriptorKmeans(int nr_restarts_, int iterations_, int nr_clusters_){
+	nr_restarts = nr_restarts_;
+	iterations = iterations_;
+	nr_clusters = nr_clusters_;
+	seed = 0;
+	nr_threads = 0;
+	verbose = false;
+	error = 0;
+	best_restart = 0;
+}
+
+DescriptorKmeans::~DescriptorKmeans(){}
+
+int DescriptorKmeans::getThreads(){
+	if(nr_threads > 0){return nr_threads;}
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+void DescriptorKmeans::packOrb(const int * descriptor, uint64_t * row){
+	for(int w = 0; w < 4; w++){
+		uint64_t word = 0;
+		for(int j = 0; j < 8; j++){word |= uint64_t(descriptor[8*w+j] & 0xff) << (8*j);}
+		row[w] = word;
+	}
+}
+
+void DescriptorKmeans::unpackOrb(const uint64_t * row, int * descriptor){
+	for(int w = 0; w < 4; w++){
+		for(int j = 0; j < 8; j++){descriptor[8*w+j] = int((row[w] >> (8*j)) & 0xff);}
+	}
+}
+
+void DescriptorKmeans::clusterBinary(const vector<uint64_t> & data, vector<uint64_t> & centres, vector<int> & seeds){
+	error = runRestarts(BinarySpace(),data,nr_restarts,nr_clusters,iterations,seed,getThreads(),verbose,centres,seeds,best_restart);
+}
+
+void DescriptorKmeans::clusterFloat(const vector<float> & data, int dim, vector<float> & centres, vector<int> & seeds){
+	error = runRestarts(FloatSpace(dim),data,nr_restarts,nr_clusters,iterations,seed,getThreads(),verbose,centres,seeds,best_restart);
+}
+
+vector<FeatureDescriptor *> * DescriptorKmeans::cluster(vector<FeatureDescriptor *> & input){
+	vector<FeatureDescriptor *> * centres = new vector<FeatureDescriptor *>();
+	if(input.size() == 0){return centres;}
+	DescriptorType type = input.front()->type;
+
+	vector<FeatureDescriptor *> used;
+	used.reserve(input.size());
+	for(unsigned int i = 0; i < input.size(); i++){
+		if(input[i]->type == type){used.push_back(input[i]);}
+	}
+	if(used.size() != input.size()){printf("DescriptorKmeans: ignoring %i descriptors of another type\n",int(input.size()-used.size()));}
+	const int n = used.size();
+
+	vector<int> seeds;
+	if(type == orb){
+		vector<uint64_t> data (4*n);
+		for(int i = 0; i < n; i++){packOrb(((OrbFeatureDescriptor *)used[i])->descriptor,&data[4*i]);}
+		vector<uint64_t> words;
+		clusterBinary(data,words,seeds);
+		for(unsigned int c = 0; c < seeds.size(); c++){
+			int * descriptor = new int[32];
+			unpackOrb(&words[4*c],descriptor);
+			centres->push_back(new OrbFeatureDescriptor(descriptor));
+		}
+	}else if(type == surf64 || type == surf128){
+		const int dim = type == surf64 ? 64 : 128;
+		vector<float> data (dim*n);
+		for(int i = 0; i < n; i++){
+			const float * descriptor = type == surf64 ? ((SurfFeatureDescriptor64 *)used[i])->descriptor : ((SurfFeatureDescriptor128 *)used[i])->descriptor;
+			memcpy(&data[dim*i],descriptor,dim*sizeof(float));
+		}
+		vector<float> words;
+		clusterFloat(data,dim,words,seeds);
+		for(unsigned int c = 0; c < seeds.size(); c++){
+			if(type == surf64){
+				SurfFeatureDescriptor64 * surf = new SurfFeatureDescriptor64();
+				memcpy(surf->descriptor,&words[dim*c],dim*sizeof(float));
+				surf->laplacian = ((SurfFeatureDescriptor64 *)used[seeds[c]])->laplacian;
+				centres->push_back(surf);
+			}else{
+				SurfFeatureDescriptor128 * surf = new SurfFeatureDescriptor128();
+				memcpy(surf->descriptor,&words[dim*c],dim*sizeof(float));
+				surf->laplacian = ((SurfFeatureDescriptor128 *)used[seeds[c]])->laplacian;
+				centres->push_back(surf);
+			}
+		}
+	}else{
+		printf("DescriptorKmeans: no rule for descriptor type %i\n",int(type));
+	}
+	return centres;
+}
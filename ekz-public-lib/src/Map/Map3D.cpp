@@ -1,5 +1,6 @@
 #include "Map3D.h"
 #include <map>
+#include <sys/time.h>
 using namespace std;
 
 bool comparison_Map3D (Transformation * i,Transformation * j) {
@@ -20,6 +21,10 @@ void gen_random(char *s, const int len) {
 Map3D::Map3D(){
 	verbose = false;
 
+	loopclosure_min_distance	= 10;
+	loopclosure_candidates		= 10;
+	loopclosure_min_weight		= 15;
+
 	matcher 			= new AICK();					//The keypoint matcher to be used for sequential frames
 	loopclosure_matcher = new AICK();					//The keypoint matcher to be used for loopclosure
 	segmentation 		= new RGBDSegmentation();		//Base segmentation class, no segmentation to be used.
@@ -84,6 +89,50 @@ void Map3D::loadCalibrationWords(string path,string type, int nr_words){
 	
 void Map3D::addTransformation(Transformation * transformation){}
 
+bool comparison_candidates (pair<double,int> i, pair<double,int> j) {return i.first < j.first || (i.first == j.first && i.second < j.second);}
+
+vector<Transformation *> Map3D::findLoopClosures(int min_frame_distance, int max_candidates, float min_weight){
+	vector<RGBDFrame *> src;
+	vector<RGBDFrame *> dst;
+	for(int i = 0; i < int(frames.size()); i++){
+		vector< pair<double,int> > candidates;
+		for(int j = 0; j <= i-min_frame_distance; j++){
+			double d = 0;
+			if(max_candidates > 0 && frames.at(i)->image_descriptor != 0 && frames.at(j)->image_descriptor != 0){d = frames.at(i)->image_descriptor->distance(frames.at(j)->image_descriptor);}
+			candidates.push_back(make_pair(d,j));
+		}
+		if(max_candidates > 0 && int(candidates.size()) > max_candidates){
+			partial_sort(candidates.begin(),candidates.begin()+max_candidates,candidates.end(),comparison_candidates);
+			candidates.resize(max_candidates);
+		}
+		for(unsigned int k = 0; k < candidates.size(); k++){
+			src.push_back(frames.at(i));
+			dst.push_back(frames.at(candidates.at(k).second));
+		}
+	}
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	vector<Transformation *> all = loopclosure_matcher->getTransformations(src,dst);
+	gettimeofday(&end, NULL);
+	float time = (end.tv_sec*1000000+end.tv_usec-(start.tv_sec*1000000+start.tv_usec))/1000000.0f;
+
+	vector<Transformation *> found;
+	for(unsigned int i = 0; i < all.size(); i++){
+		if(all.at(i)->weight >= min_weight){found.push_back(all.at(i));}
+		else{delete all.at(i);}
+	}
+	loopclosures.insert(loopclosures.end(),found.begin(),found.end());
+	if(verbose){printf("loop closure search: %i pairs in %fs, %i found\n",int(all.size()),time,int(found.size()));}
+	return found;
+}
+
+void Map3D::updateLoopClosures(){
+	for(unsigned int i = 0; i < loopclosures.size(); i++){delete loopclosures.at(i);}
+	loopclosures.clear();
+	if(loopclosure_min_distance > 0){findLoopClosures(loopclosure_min_distance,loopclosure_candidates,loopclosure_min_weight);}
+}
+
 vector<Matrix4f> Map3D::estimate(){
 	sort(transformations.begin(),transformations.end(),comparison_Map3D);
 	poses.push_back(Matrix4f::Identity());
@@ -93,6 +142,7 @@ vector<Matrix4f> Map3D::estimate(){
 		//cout << transformations.at(i)->transformationMatrix << endl;
 		poses.push_back(poses.back()*transformations.at(i)->transformationMatrix);
 	}
+	updateLoopClosures();
 	return poses;
 }
 void Map3D::savePCD(string path){savePCD(path,false, false, 0.01);}
@@ -211,8 +261,10 @@ vector<int> Map3D::getLargestComponent(){
 	cvWaitKey(0);
 */
 
-	for(unsigned int i = 0; i < transformations.size(); i++){
-		Transformation * transformation = transformations.at(i);
+	vector<Transformation *> links = transformations;
+	links.insert(links.end(),loopclosures.begin(),loopclosures.end());
+	for(unsigned int i = 0; i < links.size(); i++){
+		Transformation * transformation = links.at(i);
 		if(transformation->weight > 0)
 		{
 			int w = transformation->src->id;
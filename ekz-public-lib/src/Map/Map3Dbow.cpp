@@ -1,4 +1,5 @@
 #include "Map3Dbow.h"
+#include "DescriptorKmeans.h"
 
 using namespace std;
 
@@ -7,6 +8,8 @@ Map3Dbow::Map3Dbow(string file_path){
 	nr_restarts_ = 1;
 	iterations_ = 30;
 	nr_clusters_ = 500;
+	seed = 0;
+	nr_threads = 0;
 }
 
 Map3Dbow::Map3Dbow(string file_path, int nr_restarts, int iterations, int nr_clusters){
@@ -14,6 +17,8 @@ Map3Dbow::Map3Dbow(string file_path, int nr_restarts, int iterations, int nr_clu
 	nr_restarts_ = nr_restarts;
 	iterations_ = iterations;
 	nr_clusters_ = nr_clusters;
+	seed = 0;
+	nr_threads = 0;
 }
 
 Map3Dbow::~Map3Dbow(){}
@@ -34,79 +39,18 @@ vector<Matrix4f> Map3Dbow::estimate(){
 		bags->at(i)->store(string(buff));
 		//bags->at(i)->print();
 	}
+	updateLoopClosures();
 	if(verbose){printf("estimate done\n");}
 	return vector<Matrix4f>();
 }
 
 vector<FeatureDescriptor * > * Map3Dbow::kmeans(vector<FeatureDescriptor *> input, int nr_restarts, int iterations, int nr_clusters){
 	if(verbose){printf("doing kmeans with %i features\n",(int)input.size());}
-	float best_sum = -1;
-	vector<FeatureDescriptor * > * best_centers = new vector<FeatureDescriptor * >();
-	for(int restart = 0; restart < nr_restarts; restart++)
-	{
-		if(verbose){printf("--------------------------------------------------------------------------------\n");}
-		vector<FeatureDescriptor * > * centers = new vector<FeatureDescriptor * >();
-		for(int j = 0; j < nr_clusters; j++){centers->push_back(input.at(rand()%input.size())->clone());}
-		float sum;
-		printf("created clusters\n");
-		for(int iter = 0; iter < iterations; iter++)
-		{
-			vector< vector<FeatureDescriptor * > * > * centers_data = new vector< vector <FeatureDescriptor * > * >();
-			for(int j = 0; j < nr_clusters; j++){centers_data->push_back(new vector<FeatureDescriptor *>());}
-			
-			//printf("looking through input\n");
-			sum = 0;
-			for(unsigned int i = 0; i < input.size(); i++)
-			{
-				//printf("i:%i\n",i);
-				FeatureDescriptor * current = input.at(i);
-				float best = 99999;
-				int best_id = -1;
-				for(int j = 0; j < nr_clusters; j++)
-				{
-					float dist = current->distance(centers->at(j));
-					//printf("%i %i -> %f\n",i,j,dist);
-					//centers->at(j)->print();
-					if(best > dist){
-						best = dist;
-						best_id = j;
-					}
-				}
-				//current->print();
-				//printf("sum:%f\n",sum);
-				//printf("Best: %f\n",best);
-				//printf("best_id:%i\n",best_id);
-				sum+=best*best;
-				centers_data->at(best_id)->push_back(current);
-			}
-			//printf("done with inputs...\n");
-			sum /= float(input.size());
-			if(verbose){printf("iter %i / %i errorsum: %f\n",iter+1,iterations,sum);}
-			
-			for(int j = 0; j < nr_clusters; j++)
-			{
-				if(centers_data->at(j)->size() > 0){
-					centers->at(j)->update(centers_data->at(j));
-				}
-			}
-			
-			for(int j = 0; j < nr_clusters; j++){delete centers_data->back(); centers_data->pop_back();}
-			delete centers_data;
-		}
-		
-		printf("best_sum: %f\n",best_sum);
-		sleep(1);
-		if(best_sum == -1){
-			best_centers = centers;
-			best_sum = sum;
-		}else if(sum < best_sum){
-			best_centers = centers;
-			best_sum = sum;
-		}else{
-			printf("time to delete\n");
-			for(int i = 0; i < nr_clusters; i++){delete centers->at(i);}
-			delete centers;
-		}
-	}
-	return best_centers;
+	DescriptorKmeans km (nr_restarts, iterations, nr_clusters);
+	km.seed = seed;
+	km.nr_threads = nr_threads;
+	km.verbose = verbose;
+	vector<FeatureDescriptor * > * centers = km.cluster(input);
+	if(verbose){printf("best restart %i errorsum: %f\n",km.best_restart,km.error);}
+	return centers;
 }
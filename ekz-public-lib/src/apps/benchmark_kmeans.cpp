@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "FeatureDescriptor.h"
+#include "DescriptorKmeans.h"
+#include "Timing.h"
+
+using namespace std;
+
+//Runtime of the vocabulary k-means on synthetic orb and surf64 descriptors, one iteration of the previous k-means over
+//FeatureDescriptor::distance against DescriptorKmeans with 1, 2, 4... threads. The clusters have to be identical for
+//every number of threads.
+//benchmark_kmeans [nr_descriptors] [nr_clusters] [iterations] [nr_restarts]
+
+//Descriptors around nr_modes random modes, orb bits are flipped with probability 0.1
+vector<FeatureDescriptor *> createDescriptors(DescriptorType type, int nr_descriptors, int nr_modes){
+	vector<FeatureDescriptor *> descriptors;
+	const int dim = type == orb ? 256 : 64;
+	vector<float> modes (nr_modes*dim);
+	for(unsigned int i = 0; i < modes.size(); i++){modes[i] = type == orb ? float(rand()%2) : float(rand())/float(RAND_MAX)-0.5;}
+	for(int i = 0; i < nr_descriptors; i++){
+		float * mode = &modes[dim*(rand()%nr_modes)];
+		if(type == orb){
+			int * desc = new int[32];
+			for(int j = 0; j < 32; j++){
+				desc[j] = 0;
+				for(int b = 0; b < 8; b++){
+					int bit = int(mode[8*j+b]) ^ int(rand()%10 == 0);
+					desc[j] |= bit << b;
+				}
+			}
+			descriptors.push_back(new OrbFeatureDescriptor(desc));
+		}else{
+			float * desc = new float[64];
+			for(int j = 0; j < 64; j++){desc[j] = mode[j] + 0.05*(float(rand())/float(RAND_MAX)-0.5);}
+			descriptors.push_back(new SurfFeatureDescriptor64(desc,1));
+		}
+	}
+	return descriptors;
+}
+
+//The assignment step of the previous Map3Dbow::kmeans
+double legacyIteration(vector<FeatureDescriptor *> & input, vector<FeatureDescriptor *> & centers){
+	double start = getTime();
+	vector< vector<FeatureDescriptor * > * > * centers_data = new vector< vector <FeatureDescriptor * > * >();
+	for(unsigned int j = 0; j < centers.size(); j++){centers_data->push_back(new vector<FeatureDescriptor *>());}
+	for(unsigned int i = 0; i < input.size(); i++){
+		FeatureDescriptor * current = input.at(i);
+		float best = 99999;
+		int best_id = -1;
+		for(unsigned int j = 0; j < centers.size(); j++){
+			float dist = current->distance(centers.at(j));
+			if(best > dist){
+				best = dist;
+				best_id = j;
+			}
+		}
+		centers_data->at(best_id)->push_back(current);
+	}
+	for(unsigned int j = 0; j < centers.size(); j++){
+		if(centers_data->at(j)->size() > 0){centers.at(j)->update(centers_data->at(j));}
+		delete centers_data->at(j);
+	}
+	delete centers_data;
+	return getTime()-start;
+}
+
+bool sameCentres(vector<FeatureDescriptor *> & a, vector<FeatureDescriptor *> & b){
+	if(a.size() != b.size()){return false;}
+	for(unsigned int c = 0; c < a.size(); c++){
+		if(a[c]->type == orb){
+			for(int j = 0; j < 32; j++){if(((OrbFeatureDescriptor *)a[c])->descriptor[j] != ((OrbFeatureDescriptor *)b[c])->descriptor[j]){return false;}}
+		}else{
+			for(int j = 0; j < 64; j++){if(((SurfFeatureDescriptor64 *)a[c])->descriptor[j] != ((SurfFeatureDescriptor64 *)b[c])->descriptor[j]){return false;}}
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv){
+	int nr_descriptors	= argc > 1 ? atoi(argv[1]) : 100000;
+	int nr_clusters		= argc > 2 ? atoi(argv[2]) : 500;
+	int iterations		= argc > 3 ? atoi(argv[3]) : 30;
+	int nr_restarts		= argc > 4 ? atoi(argv[4]) : 1;
+	int max_threads		= 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	srand(0);
+
+	DescriptorType types [2] = {orb, surf64};
+	for(int t = 0; t < 2; t++){
+		vector<FeatureDescriptor *> input = createDescriptors(types[t],nr_descriptors,2*nr_clusters);
+		printf("%s: %i descriptors, %i clusters, %i iterations, %i restarts\n",types[t] == orb ? "orb" : "surf64",nr_descriptors,nr_clusters,iterations,nr_restarts);
+
+		vector<FeatureDescriptor *> legacy_centers;
+		for(int j = 0; j < nr_clusters; j++){legacy_centers.push_back(input.at(rand()%input.size())->clone());}
+		double legacy_time = legacyIteration(input,legacy_centers);
+		printf("  previous kmeans    %8.3f s per iteration\n",legacy_time);
+		for(unsigned int j = 0; j < legacy_centers.size(); j++){delete legacy_centers[j];}
+
+		vector<FeatureDescriptor *> * first = 0;
+		double single_time = 0;
+		for(int threads = 1; threads <= max_threads; threads = threads < max_threads ? min(2*threads,max_threads) : threads+1){
+			DescriptorKmeans km (nr_restarts,iterations,nr_clusters);
+			km.nr_threads = threads;
+			double start = getTime();
+			vector<FeatureDescriptor *> * centres = km.cluster(input);
+			double time = getTime()-start;
+			if(threads == 1){single_time = time;}
+			bool same = first == 0 || sameCentres(*first,*centres);
+			printf("  %2i threads %8.3f s total, %4.2fx vs 1 thread, errorsum %f, %s\n",threads,time,single_time/time,km.error,same ? "same centres" : "DIFFERENT centres");
+			if(first == 0){first = centres;}
+			else{
+				for(unsigned int j = 0; j < centres->size(); j++){delete centres->at(j);}
+				delete centres;
+			}
+		}
+		for(unsigned int j = 0; j < first->size(); j++){delete first->at(j);}
+		delete first;
+		for(unsigned int i = 0; i < input.size(); i++){delete input[i];}
+	}
+	return 0;
+}
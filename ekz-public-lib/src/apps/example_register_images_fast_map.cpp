@@ -5,6 +5,8 @@ using namespace std;
 int main(int argc, char **argv){
 	printf("starting testing software2\n");
 	printf("give path to files as input\n");
+	bool throughput = argc > 1 && string(argv[1]) == "-throughput";	//Only measure how many frame pairs are matched per second
+	if(throughput){argv++; argc--;}
 	string input = argv[1];
 	
 	string bow_path = argv[2];
@@ -38,6 +40,11 @@ int main(int argc, char **argv){
 		m->addFrame(string(rgbbuf) , string(depthbuf));
 	}
 	
+	if(throughput){
+		m->matcher->measureThroughput(m->frames);
+		return 0;
+	}
+
 	vector<Matrix4f> poses = m->estimate();	//Estimate poses for the frames using the map object.
 	m->savePCD("test.pcd");					//Saves a downsampled pointcloud with aligned data.
 	
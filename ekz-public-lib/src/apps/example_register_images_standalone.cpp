@@ -4,6 +4,8 @@ using namespace std;
 
 int main(int argc, char **argv){
 	printf("starting testing software2\n");
+	bool throughput = argc > 1 && string(argv[1]) == "-throughput";	//Only measure how many frame pairs are matched per second
+	if(throughput){argv++; argc--;}
 	string input = argv[1];
 
 	Calibration * cal = new Calibration();
@@ -29,6 +31,11 @@ int main(int argc, char **argv){
 		frames.push_back(new RGBDFrame(fi,fe,seg));
 	}
 
+	if(throughput){
+		matcher->measureThroughput(frames);
+		return 0;
+	}
+
 	for(unsigned int i = 1; i < frames.size(); i++){
 		Transformation * t = matcher->getTransformation(frames.at(i-1),frames.at(i));
 		t->show(false);
@@ -7,6 +7,8 @@ using namespace std;
 int main(int argc, char **argv){
 	printf("starting testing software for pcd files\n");
 	printf("sequentally matches frames in form of pcd files given as input\n");
+	bool throughput = argc > 1 && string(argv[1]) == "-throughput";	//Only measure how many frame pairs are matched per second
+	if(throughput){argv++; argc--;}
 
 	Map3D * m = new Map3D();	//Create a standard map object
 	m->setVerbose(true);		//Set the map to give text output				
@@ -22,6 +24,11 @@ int main(int argc, char **argv){
 		m->addFrame(cloud);
 	}
 	
+	if(throughput){
+		m->matcher->measureThroughput(m->frames);
+		return 0;
+	}
+
 	vector<Matrix4f> poses = m->estimate();//Estimate poses for the frames using the map object.
 	m->savePCD("test.pcd");
 	//Print poses
@@ -5,6 +5,8 @@ using namespace std;
 int main(int argc, char **argv){
 	printf("starting testing software for pcd files\n");
 	printf("sequentally matches frames in form of pcd files given as input\n");
+	bool throughput = argc > 1 && string(argv[1]) == "-throughput";	//Only measure how many frame pairs are matched per second
+	if(throughput){argv++; argc--;}
 
 	Calibration * cal = new Calibration();	//Standard kinect parameters for the recorded pcd files
 	cal->fx			= 525.0;				//Focal Length X
@@ -34,6 +36,11 @@ int main(int argc, char **argv){
 		frames.push_back(new RGBDFrame(fi,fe,seg));
 	}
 	
+	if(throughput){
+		matcher->measureThroughput(frames);
+		return 0;
+	}
+
 	//manually register sequential frames.
 	for(unsigned int i = 1; i < frames.size(); i++){
 		Transformation * t = matcher->getTransformation(frames.at(i-1),frames.at(i));	//Estimate transformation between frame i-1 and frame i
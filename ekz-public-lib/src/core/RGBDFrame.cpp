@@ -3,7 +3,7 @@
 #include "ros/ros.h"
 
 int frame_id_counter = 0;
-RGBDFrame::RGBDFrame(){}
+RGBDFrame::RGBDFrame(){descriptors = 0;}
 RGBDFrame::RGBDFrame(FrameInput * fi, FeatureExtractor * extractor, RGBDSegmentation * segmenter, bool verbose){
 
 	struct timeval start, end;
@@ -15,6 +15,10 @@ RGBDFrame::RGBDFrame(FrameInput * fi, FeatureExtractor * extractor, RGBDSegmenta
 	keypoints = extractor->getKeyPointSet(input);
 	for(unsigned int i = 0; i < keypoints->valid_key_points.size();i++){	keypoints->valid_key_points.at(i)->frame_id		=id;}
 	for(unsigned int i = 0; i < keypoints->invalid_key_points.size();i++){	keypoints->invalid_key_points.at(i)->frame_id	=id;}
+
+	vector<FeatureDescriptor * > valid_descriptors;
+	for(unsigned int i = 0; i < keypoints->valid_key_points.size();i++){valid_descriptors.push_back(keypoints->valid_key_points.at(i)->descriptor);}
+	descriptors = new DescriptorMatrix(valid_descriptors);
 	vector<FeatureDescriptor * > words = fi->calibration->words;
 	float * bow = new float[words.size()];
 	for(unsigned int j = 0; j < words.size();j++){bow[j]=0;}
@@ -63,4 +67,7 @@ RGBDFrame::RGBDFrame(FrameInput * fi, FeatureExtractor * extractor, RGBDSegmenta
 	if(verbose){printf("total time to create frame: %fs\n",time);}
 }
 
-RGBDFrame::~RGBDFrame(){printf("~RGBDFrame()\n");}
+RGBDFrame::~RGBDFrame(){
+	printf("~RGBDFrame()\n");
+	if(descriptors != 0){delete descriptors;}
+}
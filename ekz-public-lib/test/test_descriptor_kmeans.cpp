@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+#include <stdint.h>
+#include <math.h>
+
+#include "DescriptorKmeans.h"
+
+using namespace std;
+
+//Rows of dim floats scattered around nr_blobs well separated centres, blob b has the value 10*b in every dimension
+static vector<float> makeBlobs(int nr_blobs, int per_blob, int dim){
+	vector<float> data;
+	unsigned int state = 12345;
+	for(int b = 0; b < nr_blobs; b++){
+		for(int i = 0; i < per_blob; i++){
+			for(int d = 0; d < dim; d++){
+				state = state*1103515245u + 12345u;
+				data.push_back(10.0f*b + 0.1f*(float((state >> 16) & 0x7fff)/32767.0f - 0.5f));
+			}
+		}
+	}
+	return data;
+}
+
+TEST(DescriptorKmeans, PackOrbRoundTrip){
+	int descriptor [32];
+	for(int i = 0; i < 32; i++){descriptor[i] = (37*i+11) & 0xff;}
+	uint64_t row [4];
+	DescriptorKmeans::packOrb(descriptor,row);
+	int unpacked [32];
+	DescriptorKmeans::unpackOrb(row,unpacked);
+	for(int i = 0; i < 32; i++){EXPECT_EQ(descriptor[i],unpacked[i]);}
+}
+
+TEST(DescriptorKmeans, FloatClustersFindBlobs){
+	const int dim = 8;
+	vector<float> data = makeBlobs(3,50,dim);
+	DescriptorKmeans kmeans (4,20,3);
+	kmeans.nr_threads = 1;
+	vector<float> centres;
+	vector<int> seeds;
+	kmeans.clusterFloat(data,dim,centres,seeds);
+
+	ASSERT_EQ(centres.size(),size_t(3*dim));
+	ASSERT_EQ(seeds.size(),size_t(3));
+	EXPECT_LT(kmeans.error,0.01);
+	vector<bool> found (3,false);
+	for(int c = 0; c < 3; c++){
+		int blob = int(floor(centres[c*dim]/10.0f+0.5f));
+		ASSERT_GE(blob,0);
+		ASSERT_LT(blob,3);
+		found[blob] = true;
+		for(int d = 0; d < dim; d++){EXPECT_NEAR(centres[c*dim+d],10.0f*blob,0.05f);}
+	}
+	EXPECT_TRUE(found[0] && found[1] && found[2]);
+}
+
+TEST(DescriptorKmeans, BinaryCentresAreMajorityVotes){
+	//Two prototypes, every row flips one bit of its prototype
+	uint64_t prototypes [2][4] = {{0,0,0,0},{~0ULL,~0ULL,0,~0ULL}};
+	vector<uint64_t> data;
+	for(int p = 0; p < 2; p++){
+		for(int i = 0; i < 40; i++){
+			for(int w = 0; w < 4; w++){
+				uint64_t word = prototypes[p][w];
+				if(w == i % 4){word ^= 1ULL << (i % 64);}
+				data.push_back(word);
+			}
+		}
+	}
+	DescriptorKmeans kmeans (2,10,2);
+	kmeans.nr_threads = 1;
+	vector<uint64_t> centres;
+	vector<int> seeds;
+	kmeans.clusterBinary(data,centres,seeds);
+
+	ASSERT_EQ(centres.size(),size_t(8));
+	EXPECT_NEAR(kmeans.error,1.0,1e-9);
+	for(int c = 0; c < 2; c++){
+		const int p = centres[4*c] == prototypes[0][0] ? 0 : 1;
+		for(int w = 0; w < 4; w++){EXPECT_EQ(centres[4*c+w],prototypes[p][w]);}
+	}
+	EXPECT_NE(centres[0],centres[4]);
+}
+
+TEST(DescriptorKmeans, SameResultForAnyThreadCount){
+	const int dim = 16;
+	vector<float> data = makeBlobs(5,40,dim);
+	vector<float> reference;
+	vector<int> reference_seeds;
+	for(int threads = 1; threads <= 4; threads++){
+		DescriptorKmeans kmeans (3,15,5);
+		kmeans.seed = 7;
+		kmeans.nr_threads = threads;
+		vector<float> centres;
+		vector<int> seeds;
+		kmeans.clusterFloat(data,dim,centres,seeds);
+		if(threads == 1){
+			reference = centres;
+			reference_seeds = seeds;
+		}else{
+			EXPECT_EQ(reference,centres) << threads << " threads";
+			EXPECT_EQ(reference_seeds,seeds) << threads << " threads";
+		}
+	}
+}
+
+TEST(DescriptorKmeans, MoreClustersThanRows){
+	vector<float> data = makeBlobs(2,1,4);
+	DescriptorKmeans kmeans (1,5,10);
+	vector<float> centres;
+	vector<int> seeds;
+	kmeans.clusterFloat(data,4,centres,seeds);
+	EXPECT_EQ(seeds.size(),size_t(2));
+	EXPECT_EQ(centres.size(),size_t(8));
+
+	vector<float> empty;
+	kmeans.clusterFloat(empty,4,centres,seeds);
+	EXPECT_TRUE(centres.empty());
+	EXPECT_TRUE(seeds.empty());
+}
+
+TEST(DescriptorKmeans, ClusterKeepsDescriptorType){
+	vector<FeatureDescriptor *> input;
+	for(int i = 0; i < 20; i++){
+		int * descriptor = new int[32];
+		for(int j = 0; j < 32; j++){descriptor[j] = i < 10 ? 0 : 0xff;}
+		input.push_back(new OrbFeatureDescriptor(descriptor));
+	}
+	DescriptorKmeans kmeans (1,10,2);
+	vector<FeatureDescriptor *> * centres = kmeans.cluster(input);
+	ASSERT_EQ(centres->size(),size_t(2));
+	for(unsigned int c = 0; c < centres->size(); c++){
+		ASSERT_EQ(centres->at(c)->type,orb);
+		int * descriptor = ((OrbFeatureDescriptor *)centres->at(c))->descriptor;
+		EXPECT_TRUE(descriptor[0] == 0 || descriptor[0] == 0xff);
+		for(int j = 1; j < 32; j++){EXPECT_EQ(descriptor[j],descriptor[0]);}
+		delete centres->at(c);
+	}
+	delete centres;
+	for(unsigned int i = 0; i < input.size(); i++){delete input[i];}
+}
+
+int main(int argc, char **argv){
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
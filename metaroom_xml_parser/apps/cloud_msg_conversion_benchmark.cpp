@@ -0,0 +1,113 @@
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
+#include <metaroom_xml_parser/timing.h>
+
+#include <pcl_conversions/pcl_conversions.h>
+#include <cstdlib>
+#include <iostream>
+
+typedef pcl::PointXYZRGB PointType;
+typedef pcl::PointCloud<PointType> Cloud;
+typedef typename Cloud::Ptr CloudPtr;
+
+using namespace std;
+using timing_utilities::getTime;
+
+void printThroughput(string name, double seconds, size_t bytes, int repetitions)
+{
+    seconds /= repetitions;
+    cout<<name<<": "<<seconds*1000.0<<" ms, "<<(bytes/(1024.0*1024.0))/seconds<<" MB/s"<<endl;
+}
+
+int main(int argc, char** argv)
+{
+    size_t no_points = 3000000;
+    int repetitions = 10;
+    if (argc > 1){
+        no_points = atol(argv[1]);
+    }
+    if (argc > 2){
+        repetitions = atoi(argv[2]);
+    }
+    cout<<"Usage: cloud_msg_conversion_benchmark [no_points] [repetitions]"<<endl;
+    cout<<"Converting a cloud of "<<no_points<<" points "<<repetitions<<" times. Throughput is in MB of message data."<<endl;
+
+    CloudPtr cloud(new Cloud);
+    cloud->points.resize(no_points);
+    for (size_t i=0; i<no_points; i++)
+    {
+        PointType& point = cloud->points[i];
+        point.x = (i%640) * 0.01;
+        point.y = ((i/640)%480) * 0.01;
+        point.z = 1.0 + (i%7) * 0.1;
+        point.r = i%256; point.g = (i/256)%256; point.b = 128;
+    }
+    cloud->width = no_points;
+    cloud->height = 1;
+    cloud->header.frame_id = "/map";
+
+    sensor_msgs::PointCloud2 msg;
+    double t = getTime();
+    for (int i=0; i<repetitions; i++)
+    {
+        sensor_msgs::PointCloud2 pcl_msg;
+        pcl::toROSMsg(*cloud, pcl_msg);
+        msg.data.swap(pcl_msg.data);
+    }
+    printThroughput("pcl::toROSMsg", getTime() - t, msg.data.size(), repetitions);
+
+    cloud_msg_utilities::CloudFields fields[] = {cloud_msg_utilities::ALL_FIELDS, cloud_msg_utilities::XYZRGB_FIELDS, cloud_msg_utilities::XYZ_FIELDS};
+    string field_names[] = {"all fields", "XYZRGB", "XYZ"};
+    for (size_t k=0; k<3; k++)
+    {
+        t = getTime();
+        for (int i=0; i<repetitions; i++)
+        {
+            sensor_msgs::PointCloud2 new_msg;
+            cloud_msg_utilities::toROSMsg(*cloud, new_msg, fields[k]);
+            msg.data.swap(new_msg.data);
+        }
+        printThroughput("cloud_msg_utilities::toROSMsg, " + field_names[k], getTime() - t, msg.data.size(), repetitions);
+
+        sensor_msgs::PointCloud2 reused_msg;
+        cloud_msg_utilities::toROSMsg(*cloud, reused_msg, fields[k]);
+        t = getTime();
+        for (int i=0; i<repetitions; i++)
+        {
+            cloud_msg_utilities::toROSMsg(*cloud, reused_msg, fields[k]);
+        }
+        printThroughput("cloud_msg_utilities::toROSMsg, " + field_names[k] + ", reused message", getTime() - t, reused_msg.data.size(), repetitions);
+    }
+
+    cloud_msg_utilities::CloudMsgCache<PointType> cache;
+    t = getTime();
+    for (int i=0; i<repetitions; i++)
+    {
+        cache.getMsg(cloud);
+    }
+    printThroughput("CloudMsgCache, unchanged cloud", getTime() - t, cache.getMsg(cloud).data.size(), repetitions);
+    cout<<"Cache hits "<<cache.getHits()<<", misses "<<cache.getMisses()<<endl;
+
+    cloud_msg_utilities::toROSMsg(*cloud, msg);
+    Cloud converted;
+    t = getTime();
+    for (int i=0; i<repetitions; i++)
+    {
+        pcl::fromROSMsg(msg, converted);
+    }
+    printThroughput("pcl::fromROSMsg", getTime() - t, msg.data.size(), repetitions);
+
+    t = getTime();
+    for (int i=0; i<repetitions; i++)
+    {
+        cloud_msg_utilities::fromROSMsg(msg, converted);
+    }
+    printThroughput("cloud_msg_utilities::fromROSMsg", getTime() - t, msg.data.size(), repetitions);
+
+    if ((converted.points.size() != cloud->points.size()) || (no_points && (converted.points.back().rgba != cloud->points.back().rgba)))
+    {
+        cerr<<"The converted cloud differs from the original one"<<endl;
+        return -1;
+    }
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include "metaroom_xml_parser/simple_xml_parser.h"
 #include "metaroom_xml_parser/simple_summary_parser.h"
+#include "metaroom_xml_parser/lazy_room.h"
 
 typedef pcl::PointXYZRGB PointType;
 
@@ -24,24 +25,24 @@ int main(int argc, char** argv)
     SimpleSummaryParser summary_parser(summaryXMLPath);
     summary_parser.createSummaryXML(folderPath);
 
-    SimpleXMLParser<PointType> simple_parser;
-    SimpleXMLParser<PointType>::RoomData roomData;
-
     std::vector<Entities> allSweeps = summary_parser.getRooms();
 
     for (size_t i=0; i<allSweeps.size(); i++)
     {
         cout<<"Parsing "<<allSweeps[i].roomXmlFile<<endl;
 
-        roomData = simple_parser.loadRoomFromXML(allSweeps[i].roomXmlFile);
-        cout<<"Complete cloud size "<<roomData.completeRoomCloud->points.size()<<endl;
+        // only the metadata is parsed here, the clouds are loaded on access and kept in a bounded cache
+        LazyRoom<PointType> room(allSweeps[i].roomXmlFile);
+        const SimpleXMLParser<PointType>::RoomData& roomData = room.getMetadata();
+        cout<<"Complete cloud size "<<room.getCompleteCloud().get()->points.size()<<endl;
         cout<<"Room waypoint id "<<roomData.roomWaypointId<<std::endl;
 
-        for (size_t i=0; i<roomData.vIntermediateRoomClouds.size(); i++)
+        for (size_t i=0; i<room.getIntermediateClouds().size(); i++)
         {
-            cout<<"Intermediate cloud size "<<roomData.vIntermediateRoomClouds[i]->points.size()<<endl;
+            cout<<"Intermediate cloud size "<<room.getIntermediateClouds()[i].get()->points.size()<<endl;
             cout<<"Fx: "<<roomData.vIntermediateRoomCloudCamParams[i].fx()<<" Fy: "<<roomData.vIntermediateRoomCloudCamParams[i].fy()<<endl;
         }
+        room.release();
     }
 
 }
@@ -0,0 +1,242 @@
+#ifndef __CLOUD_MSG_CONVERSION__H
+#define __CLOUD_MSG_CONVERSION__H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/PointField.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/conversions.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+/*
+ * Conversions between pcl point clouds and sensor_msgs::PointCloud2 in a single pass.
+ *
+ * pcl::toROSMsg goes through a pcl::PCLPointCloud2 and copies the point data twice, pcl::fromROSMsg does the same in the
+ * other direction. Here the points are written straight into the data buffer of the message, which is reused when the
+ * same message is filled again. The message can also be restricted to the XYZ or XYZRGB fields, packed without the
+ * padding of the pcl point types (12 and 16 bytes per point instead of 32 for pcl::PointXYZRGB).
+ *
+ * CloudMsgCache keeps the messages of the clouds that were converted last, so a cloud that is published several times
+ * (or published and returned by a service) is only serialized once.
+ */
+namespace cloud_msg_utilities
+{
+    enum CloudFields
+    {
+        ALL_FIELDS,         // the fields of the point type, same message as pcl::toROSMsg
+        XYZ_FIELDS,         // x, y, z
+        XYZRGB_FIELDS       // x, y, z, rgb
+    };
+
+    inline void setPointField(sensor_msgs::PointField& field, const std::string& name, uint32_t offset, uint8_t datatype = sensor_msgs::PointField::FLOAT32)
+    {
+        field.name = name;
+        field.offset = offset;
+        field.datatype = datatype;
+        field.count = 1;
+    }
+
+    template <class PointType>
+    void getPointFields(CloudFields fields, std::vector<sensor_msgs::PointField>& msg_fields, uint32_t& point_step)
+    {
+        msg_fields.clear();
+        if (fields == ALL_FIELDS)
+        {
+            std::vector<pcl::PCLPointField> pcl_fields;
+            pcl::for_each_type<typename pcl::traits::fieldList<PointType>::type>(pcl::detail::FieldAdder<PointType>(pcl_fields));
+            msg_fields.resize(pcl_fields.size());
+            for (size_t i=0; i<pcl_fields.size(); i++)
+            {
+                msg_fields[i].name = pcl_fields[i].name;
+                msg_fields[i].offset = pcl_fields[i].offset;
+                msg_fields[i].datatype = pcl_fields[i].datatype;
+                msg_fields[i].count = pcl_fields[i].count;
+            }
+            point_step = sizeof(PointType);
+            return;
+        }
+
+        msg_fields.resize((fields == XYZ_FIELDS) ? 3 : 4);
+        setPointField(msg_fields[0], "x", 0);
+        setPointField(msg_fields[1], "y", 4);
+        setPointField(msg_fields[2], "z", 8);
+        if (fields == XYZRGB_FIELDS)
+        {
+            setPointField(msg_fields[3], "rgb", 12);
+        }
+        point_step = (fields == XYZ_FIELDS) ? 12 : 16;
+    }
+
+    //! Fills msg with the points of the cloud. The data buffer of msg is reused, so converting into the same message
+    //! again doesn't allocate unless the cloud grew. XYZRGB_FIELDS needs a point type with an rgb field.
+    template <class PointType>
+    void toROSMsg(const pcl::PointCloud<PointType>& cloud, sensor_msgs::PointCloud2& msg, CloudFields fields = ALL_FIELDS)
+    {
+        msg.header = pcl_conversions::fromPCL(cloud.header);
+        msg.height = cloud.height;
+        msg.width = cloud.width;
+        if (size_t(cloud.width) * cloud.height != cloud.points.size())
+        {
+            // unorganized, same as pcl::toROSMsg
+            msg.height = 1;
+            msg.width = cloud.points.size();
+        }
+        getPointFields<PointType>(fields, msg.fields, msg.point_step);
+        msg.row_step = msg.point_step * msg.width;
+        msg.is_bigendian = false;
+        msg.is_dense = cloud.is_dense;
+
+        const size_t no_points = cloud.points.size();
+        msg.data.resize(no_points * msg.point_step);
+        if (!no_points)
+        {
+            return;
+        }
+
+        uint8_t* data = &msg.data[0];
+        if (fields == ALL_FIELDS)
+        {
+            memcpy(data, &cloud.points[0], no_points * sizeof(PointType));
+        } else if (fields == XYZ_FIELDS) {
+            for (size_t i=0; i<no_points; i++, data += 12)
+            {
+                memcpy(data, &cloud.points[i].x, 12);
+            }
+        } else {
+            for (size_t i=0; i<no_points; i++, data += 16)
+            {
+                memcpy(data, &cloud.points[i].x, 12);
+                memcpy(data + 12, &cloud.points[i].rgb, 4);
+            }
+        }
+    }
+
+    //! Fills cloud from msg. Messages with the layout of the point type (e.g. published with ALL_FIELDS or by
+    //! pcl::toROSMsg) are copied in one go, any other message goes through pcl::fromROSMsg.
+    template <class PointType>
+    void fromROSMsg(const sensor_msgs::PointCloud2& msg, pcl::PointCloud<PointType>& cloud)
+    {
+        std::vector<sensor_msgs::PointField> point_fields;
+        uint32_t point_step;
+        getPointFields<PointType>(ALL_FIELDS, point_fields, point_step);
+
+        bool same_layout = (msg.point_step == point_step) && (msg.row_step == msg.point_step * msg.width) && !msg.is_bigendian &&
+                (msg.fields.size() == point_fields.size()) && (msg.data.size() >= size_t(msg.width) * msg.height * point_step);
+        for (size_t i=0; same_layout && (i<point_fields.size()); i++)
+        {
+            same_layout = (msg.fields[i].name == point_fields[i].name) && (msg.fields[i].offset == point_fields[i].offset) &&
+                    (msg.fields[i].datatype == point_fields[i].datatype) && (msg.fields[i].count == point_fields[i].count);
+        }
+        if (!same_layout)
+        {
+            pcl::fromROSMsg(msg, cloud);
+            return;
+        }
+
+        cloud.header = pcl_conversions::toPCL(msg.header);
+        cloud.width = msg.width;
+        cloud.height = msg.height;
+        cloud.is_dense = msg.is_dense;
+        cloud.points.resize(size_t(msg.width) * msg.height);
+        if (cloud.points.size())
+        {
+            memcpy(&cloud.points[0], &msg.data[0], cloud.points.size() * sizeof(PointType));
+        }
+    }
+
+    //! Messages of the clouds converted last, in LRU order. A cloud is serialized again if it is a different object
+    //! than the cached one or if its number of points, point buffer or header stamp changed; clouds whose points are
+    //! modified in place otherwise have to be invalidated. Not thread safe.
+    template <class PointType>
+    class CloudMsgCache
+    {
+    public:
+        typedef pcl::PointCloud<PointType> Cloud;
+        typedef typename Cloud::ConstPtr CloudConstPtr;
+
+        CloudMsgCache(size_t capacity = 4) : m_Capacity(capacity), m_Hits(0), m_Misses(0) {}
+
+        //! The message of the cloud, with the frame id replaced by frame_id if it is not empty.
+        const sensor_msgs::PointCloud2& getMsg(const CloudConstPtr& cloud, CloudFields fields = ALL_FIELDS, const std::string& frame_id = "")
+        {
+            for (auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+            {
+                if ((it->cloud.lock() == cloud) && (it->fields == fields) && (it->frame_id == frame_id) &&
+                        (it->data == dataOf(*cloud)) && (it->size == cloud->points.size()) && (it->stamp == cloud->header.stamp))
+                {
+                    m_Hits++;
+                    m_Entries.splice(m_Entries.begin(), m_Entries, it);
+                    return it->msg;
+                }
+            }
+            m_Misses++;
+
+            // reuse the message buffer of the least recently used entry
+            if (m_Entries.size() >= std::max<size_t>(m_Capacity, 1))
+            {
+                m_Entries.splice(m_Entries.begin(), m_Entries, --m_Entries.end());
+            } else {
+                m_Entries.push_front(Entry());
+            }
+            Entry& entry = m_Entries.front();
+            entry.cloud = cloud;
+            entry.fields = fields;
+            entry.frame_id = frame_id;
+            entry.data = dataOf(*cloud);
+            entry.size = cloud->points.size();
+            entry.stamp = cloud->header.stamp;
+            toROSMsg(*cloud, entry.msg, fields);
+            if (frame_id != "")
+            {
+                entry.msg.header.frame_id = frame_id;
+            }
+            return entry.msg;
+        }
+
+        void invalidate(const CloudConstPtr& cloud)
+        {
+            for (auto it = m_Entries.begin(); it != m_Entries.end(); )
+            {
+                it = (it->cloud.lock() == cloud) ? m_Entries.erase(it) : ++it;
+            }
+        }
+
+        void clear() { m_Entries.clear(); }
+
+        size_t getHits() const { return m_Hits; }
+        size_t getMisses() const { return m_Misses; }
+
+    private:
+        struct Entry
+        {
+            boost::weak_ptr<const Cloud>    cloud;
+            CloudFields                     fields;
+            std::string                     frame_id;
+            const PointType*                data;
+            size_t                          size;
+            uint64_t                        stamp;
+            sensor_msgs::PointCloud2        msg;
+        };
+
+        static const PointType* dataOf(const Cloud& cloud)
+        {
+            return cloud.points.size() ? &cloud.points[0] : NULL;
+        }
+
+        size_t                              m_Capacity;
+        std::list<Entry>                    m_Entries;
+        size_t                              m_Hits, m_Misses;
+    };
+}
+
+#endif // __CLOUD_MSG_CONVERSION__H
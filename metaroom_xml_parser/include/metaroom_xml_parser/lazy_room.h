@@ -0,0 +1,349 @@
+#ifndef __LAZY_ROOM__H
+#define __LAZY_ROOM__H
+
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "simple_xml_parser.h"
+
+/*
+ * Lazy access to sweep data. The sweep xml is parsed once for its metadata (transforms, camera parameters,
+ * waypoint, times); the point clouds and images are only read from disk when first accessed, through handles.
+ * Loaded data is kept in a bounded LRU cache shared by all the rooms of a process, so iterating over many sweeps
+ * keeps the memory usage bounded by the cache capacity (plus whatever the caller holds on to).
+ */
+
+template <class PointType>
+class LazyRoomCache {
+public:
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef typename Cloud::Ptr CloudPtr;
+
+    static LazyRoomCache& instance()
+    {
+        static LazyRoomCache cache;
+        return cache;
+    }
+
+    //! Returns the cloud stored in the PCD file, reading it from disk if it is not cached.
+    CloudPtr getCloud(const std::string& filename, bool verbose = false)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_index.find(filename);
+            if ((it != m_index.end()) && it->second->cloud)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return it->second->cloud;
+            }
+        }
+
+        // read outside of the lock; PCL memory maps binary PCD files when reading them, RGBD views are decoded
+        if (verbose)
+        {
+            ROS_INFO_STREAM("Loading cloud file name "<<filename);
+        }
+        CloudPtr cloud(new Cloud);
+        RGBDView view;
+        if (rgbd_view_utilities::isRGBDViewFile(filename) && rgbd_view_utilities::loadRGBDView(filename, view))
+        {
+            cloud = rgbd_view_utilities::createPCFromRGBDView<PointType>(view);
+        } else {
+            // PCD file, or the fallback for a view which couldn't be read
+            pcl::PCDReader reader;
+            if (reader.read(rgbd_view_utilities::getPCDFilename(filename), *cloud) < 0)
+            {
+                ROS_ERROR_STREAM("Could not load cloud "<<filename);
+                return cloud;
+            }
+        }
+
+        Entry entry;
+        entry.filename = filename;
+        entry.cloud = cloud;
+        entry.bytes = cloud->points.size() * sizeof(PointType);
+        insert(entry);
+        return cloud;
+    }
+
+    //! Returns the image stored in the file (cv::imread flags), reading it from disk if it is not cached.
+    cv::Mat getImage(const std::string& filename, int flags, bool verbose = false)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto it = m_index.find(filename);
+            if ((it != m_index.end()) && !it->second->cloud)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return it->second->image;
+            }
+        }
+
+        if (verbose)
+        {
+            ROS_INFO_STREAM("Loading image "<<filename);
+        }
+        cv::Mat image = cv::imread(filename.c_str(), flags);
+        if (image.empty())
+        {
+            // not cached, so the file is read again once it exists
+            ROS_ERROR_STREAM("Could not load image "<<filename);
+            return image;
+        }
+
+        Entry entry;
+        entry.filename = filename;
+        entry.image = image;
+        entry.bytes = image.total() * image.elemSize();
+        insert(entry);
+        return image;
+    }
+
+    bool isCached(const std::string& filename)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_index.find(filename) != m_index.end();
+    }
+
+    //! Drops the cached copy. Data still referenced by the caller stays valid.
+    void release(const std::string& filename)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(filename);
+        if (it != m_index.end())
+        {
+            m_bytes -= it->second->bytes;
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+
+    //! Maximum memory (in bytes) held by the cache. Defaults to 512 MB.
+    void setCapacity(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_capacity = bytes;
+        evict();
+    }
+
+    size_t getCapacity()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_capacity;
+    }
+
+    size_t getSize()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+private:
+    struct Entry
+    {
+        std::string filename;
+        CloudPtr    cloud;
+        cv::Mat     image;
+        size_t      bytes;
+    };
+
+    LazyRoomCache() : m_capacity(512 * 1024 * 1024), m_bytes(0) {}
+    LazyRoomCache(const LazyRoomCache&);
+    LazyRoomCache& operator=(const LazyRoomCache&);
+
+    void insert(const Entry& entry)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(entry.filename);
+        if (it != m_index.end())
+        {
+            // loaded concurrently by another thread
+            m_bytes -= it->second->bytes;
+            m_entries.erase(it->second);
+        }
+        m_entries.push_front(entry);
+        m_index[entry.filename] = m_entries.begin();
+        m_bytes += entry.bytes;
+        evict();
+    }
+
+    // expects the lock to be held; always keeps the most recent entry
+    void evict()
+    {
+        while ((m_bytes > m_capacity) && (m_entries.size() > 1))
+        {
+            m_bytes -= m_entries.back().bytes;
+            m_index.erase(m_entries.back().filename);
+            m_entries.pop_back();
+        }
+    }
+
+    std::list<Entry>                                                    m_entries;
+    std::map<std::string, typename std::list<Entry>::iterator>          m_index;
+    size_t                                                              m_capacity;
+    size_t                                                              m_bytes;
+    std::mutex                                                          m_mutex;
+};
+
+template <class PointType>
+class LazyCloudHandle {
+public:
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef typename Cloud::Ptr CloudPtr;
+
+    LazyCloudHandle(const std::string& filename = "") : m_filename(filename) {}
+
+    CloudPtr get(bool verbose = false) const
+    {
+        if (m_filename.empty())
+        {
+            return CloudPtr(new Cloud);
+        }
+        return LazyRoomCache<PointType>::instance().getCloud(m_filename, verbose);
+    }
+
+    //! RGB (CV_8UC3) and depth (CV_16UC1) images of an organized cloud. These are not cached.
+    std::pair<cv::Mat, cv::Mat> getRGBandDepth() const
+    {
+        return SimpleXMLParser<PointType>::createRGBandDepthFromPC(get());
+    }
+
+    bool isLoaded() const { return !m_filename.empty() && LazyRoomCache<PointType>::instance().isCached(m_filename); }
+    void release() const { LazyRoomCache<PointType>::instance().release(m_filename); }
+    const std::string& filename() const { return m_filename; }
+
+private:
+    std::string m_filename;
+};
+
+template <class PointType>
+class LazyImageHandle {
+public:
+    LazyImageHandle(const std::string& filename = "", int flags = CV_LOAD_IMAGE_COLOR) : m_filename(filename), m_flags(flags) {}
+
+    cv::Mat get(bool verbose = false) const
+    {
+        return LazyRoomCache<PointType>::instance().getImage(m_filename, m_flags, verbose);
+    }
+
+    bool isLoaded() const { return LazyRoomCache<PointType>::instance().isCached(m_filename); }
+    void release() const { LazyRoomCache<PointType>::instance().release(m_filename); }
+    const std::string& filename() const { return m_filename; }
+
+private:
+    std::string m_filename;
+    int         m_flags;
+};
+
+template <class PointType>
+class LazyRoom {
+public:
+    typedef typename SimpleXMLParser<PointType>::RoomData RoomData;
+    typedef typename SimpleXMLParser<PointType>::IntermediatePositionImages IntermediatePositionImages;
+
+    struct IntermediatePositionHandles
+    {
+        std::vector<LazyImageHandle<PointType>> vRGBImages;
+        std::vector<LazyImageHandle<PointType>> vDepthImages;
+    };
+
+    //! Parses the sweep metadata. No point clouds or images are read from disk.
+    LazyRoom(const std::string& xmlFile, bool verbose = false) : m_xmlFile(xmlFile), m_verbose(verbose)
+    {
+        m_metadata = SimpleXMLParser<PointType>::loadRoomFromXML(xmlFile, std::vector<std::string>{"RoomIntermediateCloud", "IntermediatePosition"}, verbose, false);
+
+        m_completeCloud = LazyCloudHandle<PointType>(m_metadata.completeRoomCloudFilename);
+        for (const std::string& filename : m_metadata.vIntermediateRoomCloudFilenames)
+        {
+            m_vIntermediateClouds.push_back(LazyCloudHandle<PointType>(filename));
+        }
+        for (const IntermediatePositionImages& position : m_metadata.vIntermediatePositionImages)
+        {
+            IntermediatePositionHandles handles;
+            for (const std::string& filename : position.vIntermediateRGBImageFilenames)
+            {
+                handles.vRGBImages.push_back(LazyImageHandle<PointType>(filename, CV_LOAD_IMAGE_COLOR));
+            }
+            for (const std::string& filename : position.vIntermediateDepthImageFilenames)
+            {
+                handles.vDepthImages.push_back(LazyImageHandle<PointType>(filename, CV_LOAD_IMAGE_ANYDEPTH));
+            }
+            m_vIntermediatePositionImages.push_back(handles);
+        }
+    }
+
+    //! Transforms, camera parameters, waypoint and timing information. The cloud and image fields are empty.
+    const RoomData& getMetadata() const { return m_metadata; }
+    const std::string& getXmlFile() const { return m_xmlFile; }
+
+    const LazyCloudHandle<PointType>& getCompleteCloud() const { return m_completeCloud; }
+    const std::vector<LazyCloudHandle<PointType>>& getIntermediateClouds() const { return m_vIntermediateClouds; }
+    const std::vector<IntermediatePositionHandles>& getIntermediatePositionImages() const { return m_vIntermediatePositionImages; }
+
+    //! Loads everything, same as SimpleXMLParser::loadRoomFromXML with the default arguments.
+    RoomData getRoomData() const
+    {
+        // the clouds are the ones held by the cache, the metadata is not modified
+        RoomData toRet = m_metadata;
+        toRet.completeRoomCloud = m_completeCloud.get(m_verbose);
+        for (const LazyCloudHandle<PointType>& handle : m_vIntermediateClouds)
+        {
+            toRet.vIntermediateRoomClouds.push_back(handle.get(m_verbose));
+            std::pair<cv::Mat,cv::Mat> rgbAndDepth = SimpleXMLParser<PointType>::createRGBandDepthFromPC(toRet.vIntermediateRoomClouds.back());
+            toRet.vIntermediateRGBImages.push_back(rgbAndDepth.first);
+            toRet.vIntermediateDepthImages.push_back(rgbAndDepth.second);
+        }
+        for (size_t i=0; i<m_vIntermediatePositionImages.size(); i++)
+        {
+            for (const LazyImageHandle<PointType>& handle : m_vIntermediatePositionImages[i].vRGBImages)
+            {
+                toRet.vIntermediatePositionImages[i].vIntermediateRGBImages.push_back(handle.get(m_verbose));
+            }
+            for (const LazyImageHandle<PointType>& handle : m_vIntermediatePositionImages[i].vDepthImages)
+            {
+                toRet.vIntermediatePositionImages[i].vIntermediateDepthImages.push_back(handle.get(m_verbose));
+            }
+        }
+        return toRet;
+    }
+
+    //! Drops all the cached data belonging to this room.
+    void release() const
+    {
+        m_completeCloud.release();
+        for (const LazyCloudHandle<PointType>& handle : m_vIntermediateClouds)
+        {
+            handle.release();
+        }
+        for (const IntermediatePositionHandles& handles : m_vIntermediatePositionImages)
+        {
+            for (const LazyImageHandle<PointType>& handle : handles.vRGBImages)
+            {
+                handle.release();
+            }
+            for (const LazyImageHandle<PointType>& handle : handles.vDepthImages)
+            {
+                handle.release();
+            }
+        }
+    }
+
+private:
+    std::string                                         m_xmlFile;
+    bool                                                m_verbose;
+    RoomData                                            m_metadata;
+    LazyCloudHandle<PointType>                          m_completeCloud;
+    std::vector<LazyCloudHandle<PointType>>             m_vIntermediateClouds;
+    std::vector<IntermediatePositionHandles>            m_vIntermediatePositionImages;
+};
+
+#endif // __LAZY_ROOM__H
@@ -0,0 +1,164 @@
+#ifndef __RGBD_VIEW__H
+#define __RGBD_VIEW__H
+
+#include <string>
+#include <limits>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <tf/tf.h>
+#include <image_geometry/pinhole_camera_model.h>
+
+#include <opencv2/opencv.hpp>
+
+/*
+ * Native storage format for the intermediate views of a sweep. Instead of a 640x480 organized PCD (~10 MB), a view
+ * is stored as a single .rgbd file containing the intrinsics, the camera pose, the 16 bit depth plane (mm) and the
+ * RGB plane, both compressed losslessly as PNG. Point clouds are only created when a consumer asks for one.
+ *
+ * File layout (little endian):
+ *   char[8]   "RGBDVIEW"
+ *   uint32    version
+ *   uint32    width, height
+ *   float64   fx, fy, cx, cy
+ *   float64   tx, ty, tz, qx, qy, qz, qw     camera pose
+ *   uint32    depth plane size in bytes, followed by the depth PNG
+ *   uint32    RGB plane size in bytes, followed by the RGB PNG
+ */
+
+struct RGBDView
+{
+    cv::Mat         rgb;    // CV_8UC3, BGR
+    cv::Mat         depth;  // CV_16UC1, millimeters, 0 for missing measurements
+    double          fx, fy, cx, cy;
+    tf::Transform   pose;
+
+    RGBDView() : fx(0.0), fy(0.0), cx(0.0), cy(0.0)
+    {
+        pose.setIdentity();
+    }
+};
+
+namespace rgbd_view_utilities
+{
+    const std::string RGBD_VIEW_EXTENSION = ".rgbd";
+
+    bool isRGBDViewFile(const std::string& filename);
+
+    //! Returns the .rgbd file name corresponding to an intermediate cloud file name (intermediate_cloud0000.pcd -> intermediate_cloud0000.rgbd)
+    std::string getRGBDViewFilename(const std::string& cloudFilename);
+
+    //! Returns the organized PCD file name corresponding to a .rgbd file name, used as a fallback when a view can't be read
+    std::string getPCDFilename(const std::string& viewFilename);
+
+    //! \param compressionLevel PNG compression level (0-9), low values trade file size for encoding speed.
+    bool saveRGBDView(const std::string& filename, const RGBDView& view, int compressionLevel = 1);
+
+    //! \param loadRGB whether to decode the RGB plane; depth only consumers can skip it.
+    bool loadRGBDView(const std::string& filename, RGBDView& view, bool loadRGB = true);
+
+    template <class PointType>
+    RGBDView createRGBDViewFromPC(const boost::shared_ptr<pcl::PointCloud<PointType>>& cloud, const image_geometry::PinholeCameraModel& camParams, const tf::Transform& pose)
+    {
+        RGBDView view;
+        view.fx = camParams.fx(); view.fy = camParams.fy();
+        view.cx = camParams.cx(); view.cy = camParams.cy();
+        view.pose = pose;
+
+        if ((cloud->height > 1) && (size_t(cloud->width) * cloud->height == cloud->points.size()))
+        {
+            // organized cloud -> one pixel per point
+            const int width = cloud->width, height = cloud->height;
+            view.rgb = cv::Mat::zeros(height, width, CV_8UC3);
+            view.depth = cv::Mat::zeros(height, width, CV_16UC1);
+            for (int y = 0; y < height; ++y) {
+                const PointType* point = &cloud->points[y*width];
+                uint8_t* rgb = view.rgb.ptr<uint8_t>(y);
+                uint16_t* depth = view.depth.ptr<uint16_t>(y);
+                for (int x = 0; x < width; ++x, ++point, rgb+=3) {
+                    rgb[0] = point->b;
+                    rgb[1] = point->g;
+                    rgb[2] = point->r;
+                    if (pcl_isfinite(point->z) && (point->z > 0))
+                    {
+                        depth[x] = static_cast<uint16_t>(point->z * 1000.0f + 0.5f);
+                    }
+                }
+            }
+            return view;
+        }
+
+        // unorganized cloud -> project the points with the intrinsics, into an image of the size of the camera
+        // (or twice the principal point if the camera info has no size), keeping the closest point of each pixel
+        cv::Size size = camParams.fullResolution();
+        if ((size.width <= 0) || (size.height <= 0))
+        {
+            size = cv::Size(static_cast<int>(2.0 * view.cx + 0.5), static_cast<int>(2.0 * view.cy + 0.5));
+        }
+        view.rgb = cv::Mat::zeros(size, CV_8UC3);
+        view.depth = cv::Mat::zeros(size, CV_16UC1);
+        for (const PointType& point : cloud->points)
+        {
+            if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z) || (point.z <= 0))
+            {
+                continue;
+            }
+            int x = static_cast<int>(view.fx * point.x / point.z + view.cx + 0.5);
+            int y = static_cast<int>(view.fy * point.y / point.z + view.cy + 0.5);
+            if ((x < 0) || (y < 0) || (x >= size.width) || (y >= size.height))
+            {
+                continue;
+            }
+            uint16_t z = static_cast<uint16_t>(point.z * 1000.0f + 0.5f);
+            uint16_t& depth = view.depth.at<uint16_t>(y, x);
+            if ((depth == 0) || (z < depth))
+            {
+                depth = z;
+                view.rgb.at<cv::Vec3b>(y, x) = cv::Vec3b(point.b, point.g, point.r);
+            }
+        }
+
+        return view;
+    }
+
+    //! Back projects the depth plane into an organized cloud, in the camera frame. Missing depth values become NaN points.
+    template <class PointType>
+    boost::shared_ptr<pcl::PointCloud<PointType>> createPCFromRGBDView(const RGBDView& view)
+    {
+        boost::shared_ptr<pcl::PointCloud<PointType>> cloud(new pcl::PointCloud<PointType>);
+        cloud->width = view.depth.cols;
+        cloud->height = view.depth.rows;
+        cloud->is_dense = false;
+        cloud->points.resize(cloud->width * cloud->height);
+
+        const float bad_point = std::numeric_limits<float>::quiet_NaN();
+        const float inv_fx = 0.001 / view.fx;
+        const float inv_fy = 0.001 / view.fy;
+        const bool hasRGB = !view.rgb.empty();
+
+        for (int y = 0; y < view.depth.rows; ++y) {
+            const uint16_t* depth = view.depth.ptr<uint16_t>(y);
+            const uint8_t* rgb = hasRGB ? view.rgb.ptr<uint8_t>(y) : NULL;
+            PointType* point = &cloud->points[y*view.depth.cols];
+            const float dy = (y - view.cy) * inv_fy;
+            for (int x = 0; x < view.depth.cols; ++x, ++point) {
+                if (depth[x] == 0)
+                {
+                    point->x = point->y = point->z = bad_point;
+                } else {
+                    point->x = (x - view.cx) * depth[x] * inv_fx;
+                    point->y = dy * depth[x];
+                    point->z = depth[x] * 0.001f;
+                }
+                if (hasRGB)
+                {
+                    point->b = rgb[3*x]; point->g = rgb[3*x+1]; point->r = rgb[3*x+2];
+                }
+            }
+        }
+
+        return cloud;
+    }
+}
+
+#endif // __RGBD_VIEW__H
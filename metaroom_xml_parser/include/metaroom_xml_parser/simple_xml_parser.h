@@ -18,6 +18,8 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "rgbd_view.h"
+
 
 template <class PointType>
 class SimpleXMLParser {
@@ -43,6 +45,8 @@ public:
     {
         std::vector<cv::Mat>                vIntermediateDepthImages;
         std::vector<cv::Mat>                vIntermediateRGBImages;
+        std::vector<std::string>            vIntermediateDepthImageFilenames;
+        std::vector<std::string>            vIntermediateRGBImageFilenames;
         tf::StampedTransform                intermediateDepthTransform;
         tf::StampedTransform                intermediateRGBTransform;
         image_geometry::PinholeCameraModel  intermediateRGBCamParams;
@@ -53,6 +57,7 @@ public:
     {
 
         std::vector<boost::shared_ptr<pcl::PointCloud<PointType>>>                            vIntermediateRoomClouds;
+        std::vector<std::string>                                                              vIntermediateRoomCloudFilenames;
         std::vector<tf::StampedTransform>                                                     vIntermediateRoomCloudTransforms;
         std::vector<tf::StampedTransform>                                                     vIntermediateRoomCloudTransformsRegistered;
         std::vector<image_geometry::PinholeCameraModel>                                       vIntermediateRoomCloudCamParams;
@@ -60,6 +65,7 @@ public:
         std::vector<cv::Mat>                                                                  vIntermediateRGBImages; // type CV_8UC3
         std::vector<cv::Mat>                                                                  vIntermediateDepthImages; // type CV_16UC1
         boost::shared_ptr<pcl::PointCloud<PointType>>                                         completeRoomCloud;
+        std::string                                                                           completeRoomCloudFilename;
         boost::shared_ptr<pcl::PointCloud<PointType>>                                         dynamicClusterCloud;
         std::string                                                                           roomWaypointId;
         std::string                                                                           roomLogName;
@@ -142,6 +148,7 @@ public:
       \param xmlNodesToParse the nodes from the xml file to parse. Especially usefull when you don't want to load everything; applies to merged cloud - xml node RoomCompleteCloud, intermediate clouds - xml node RoomIntermediateCloud, and intermediate images - xml node IntermediatePosition. All the other xml nodes are parsed by default.
              The default value for this parameter is "*", which means everything will be parsed.
       \param verbose whether to print output when parsing intermediate clouds and intermediate images.
+      \param deepLoad whether to load the intermediate clouds and intermediate images from disk. If false only their file names, transforms and camera parameters are parsed.
       \return The room structure.
     */
     static RoomData loadRoomFromXML(const std::string& xmlFile, std::vector<std::string> xmlNodesToParse=std::vector<std::string>{"RoomCompleteCloud", "RoomIntermediateCloud","IntermediatePosition","RoomDynamicClusters"},bool verbose = false, bool deepLoad = true)
@@ -170,6 +177,7 @@ public:
 
         QXmlStreamReader* xmlReader = new QXmlStreamReader(&file);
         Eigen::Vector4f centroid(0.0,0.0,0.0,0.0);
+        int intermediatePositionCounter = 0;
 
         while (!xmlReader->atEnd() && !xmlReader->hasError())
         {
@@ -187,8 +195,7 @@ public:
 
             if (token == QXmlStreamReader::StartElement)
             {
-                if ((xmlReader->name() == "RoomCompleteCloud") &&
-                    (std::find(xmlNodesToParse.begin(), xmlNodesToParse.end(), "RoomCompleteCloud") != xmlNodesToParse.end()))
+                if (xmlReader->name() == "RoomCompleteCloud")
                 {
                     QXmlStreamAttributes attributes = xmlReader->attributes();
                     if (attributes.hasAttribute("filename"))
@@ -199,6 +206,17 @@ public:
                         {
                             roomCompleteCloudFile=roomFolder + "/" + roomCompleteCloudFile;
                         }
+                        aRoom.completeRoomCloudFilename = roomCompleteCloudFile.toStdString();
+                    }
+                }
+
+                if ((xmlReader->name() == "RoomCompleteCloud") &&
+                    (std::find(xmlNodesToParse.begin(), xmlNodesToParse.end(), "RoomCompleteCloud") != xmlNodesToParse.end()))
+                {
+                    QXmlStreamAttributes attributes = xmlReader->attributes();
+                    if (attributes.hasAttribute("filename"))
+                    {
+                        QString roomCompleteCloudFile(aRoom.completeRoomCloudFilename.c_str());
 
                         if (verbose)
                         {
@@ -286,15 +304,34 @@ public:
                             {
                                 ROS_INFO_STREAM("Loading intermediate cloud file name "<<cloudFileName.toStdString());
                             }
-                            pcl::PCDReader reader;
-                            boost::shared_ptr<pcl::PointCloud<PointType>> cloud (new pcl::PointCloud<PointType>);
-                            reader.read (cloudFileName.toStdString(), *cloud);
-                            aRoom.vIntermediateRoomClouds.push_back(cloud);
-
-                            std::pair<cv::Mat,cv::Mat> rgbAndDepth = SimpleXMLParser::createRGBandDepthFromPC(cloud);
-                            aRoom.vIntermediateRGBImages.push_back(rgbAndDepth.first);
-                            aRoom.vIntermediateDepthImages.push_back(rgbAndDepth.second);
+                            RGBDView view;
+                            bool viewLoaded = false;
+                            if (rgbd_view_utilities::isRGBDViewFile(cloudFileName.toStdString()))
+                            {
+                                viewLoaded = rgbd_view_utilities::loadRGBDView(cloudFileName.toStdString(), view);
+                                if (!viewLoaded)
+                                {
+                                    ROS_WARN_STREAM("Falling back to the PCD file of intermediate cloud "<<cloudFileName.toStdString());
+                                }
+                            }
+                            if (viewLoaded)
+                            {
+                                // native RGBD view -> the images are stored directly, only the cloud needs to be created
+                                aRoom.vIntermediateRoomClouds.push_back(rgbd_view_utilities::createPCFromRGBDView<PointType>(view));
+                                aRoom.vIntermediateRGBImages.push_back(view.rgb);
+                                aRoom.vIntermediateDepthImages.push_back(view.depth);
+                            } else {
+                                pcl::PCDReader reader;
+                                boost::shared_ptr<pcl::PointCloud<PointType>> cloud (new pcl::PointCloud<PointType>);
+                                reader.read (rgbd_view_utilities::getPCDFilename(cloudFileName.toStdString()), *cloud);
+                                aRoom.vIntermediateRoomClouds.push_back(cloud);
+
+                                std::pair<cv::Mat,cv::Mat> rgbAndDepth = SimpleXMLParser::createRGBandDepthFromPC(cloud);
+                                aRoom.vIntermediateRGBImages.push_back(rgbAndDepth.first);
+                                aRoom.vIntermediateDepthImages.push_back(rgbAndDepth.second);
+                            }
                         }
+                        aRoom.vIntermediateRoomCloudFilenames.push_back(cloudFileName.toStdString());
                         aRoom.vIntermediateRoomCloudTransforms.push_back(intermediateCloudData.transform);
                         aRoom.vIntermediateRoomCloudCamParams.push_back(aCameraModel);
                     }
@@ -313,7 +350,7 @@ public:
                 if ((xmlReader->name() == "IntermediatePosition") &&
                         (std::find(xmlNodesToParse.begin(), xmlNodesToParse.end(), "IntermediatePosition") != xmlNodesToParse.end()))
                 {
-                    auto positionImages = parseIntermediatePositionImages(xmlReader, roomFolder.toStdString(), verbose);
+                    auto positionImages = parseIntermediatePositionImages(xmlReader, roomFolder.toStdString(), intermediatePositionCounter++, verbose, deepLoad);
 
                     aRoom.vIntermediatePositionImages.push_back(positionImages);
                 }
@@ -615,11 +652,8 @@ private:
         return structToRet;
     }
 
-    static IntermediatePositionImages parseIntermediatePositionImages(QXmlStreamReader* xmlReader, std::string roomFolder, bool verbose = false)
+    static IntermediatePositionImages parseIntermediatePositionImages(QXmlStreamReader* xmlReader, std::string roomFolder, int intermediatePositionCounter, bool verbose = false, bool deepLoad = true)
     {
-
-        static int intermediatePoisitionCounter = 0;
-
         IntermediatePositionImages toRet;
         tf::StampedTransform transform;
         geometry_msgs::TransformStamped tfmsg;
@@ -649,7 +683,12 @@ private:
 
         for (int i=0; i<numRGB;i++)
         {
-            std::stringstream ss; ss<<roomFolder;ss<<"/rgb_image"; ss<<"_"<<std::setfill('0')<<std::setw(4)<<intermediatePoisitionCounter<<"_"<<std::setfill('0')<<std::setw(4)<<i<<".png";
+            std::stringstream ss; ss<<roomFolder;ss<<"/rgb_image"; ss<<"_"<<std::setfill('0')<<std::setw(4)<<intermediatePositionCounter<<"_"<<std::setfill('0')<<std::setw(4)<<i<<".png";
+            toRet.vIntermediateRGBImageFilenames.push_back(ss.str());
+            if (!deepLoad)
+            {
+                continue;
+            }
             cv::Mat image = cv::imread(ss.str().c_str(), CV_LOAD_IMAGE_COLOR);
             if (verbose)
             {
@@ -660,7 +699,12 @@ private:
 
         for (int i=0; i<numDepth;i++)
         {
-            std::stringstream ss; ss<<roomFolder;ss<<"/depth_image"; ss<<"_"<<std::setfill('0')<<std::setw(4)<<intermediatePoisitionCounter<<"_"<<std::setfill('0')<<std::setw(4)<<i<<".png";
+            std::stringstream ss; ss<<roomFolder;ss<<"/depth_image"; ss<<"_"<<std::setfill('0')<<std::setw(4)<<intermediatePositionCounter<<"_"<<std::setfill('0')<<std::setw(4)<<i<<".png";
+            toRet.vIntermediateDepthImageFilenames.push_back(ss.str());
+            if (!deepLoad)
+            {
+                continue;
+            }
             cv::Mat image = cv::imread(ss.str().c_str(), CV_LOAD_IMAGE_ANYDEPTH);
             if (verbose)
             {
@@ -700,8 +744,6 @@ private:
 
             token = xmlReader->readNext();
         }
-        intermediatePoisitionCounter++;
-
         return toRet;
 
     }
@@ -0,0 +1,17 @@
+#ifndef __TIMING__H
+#define __TIMING__H
+
+#include <sys/time.h>
+
+namespace timing_utilities
+{
+    //! Wall clock time in seconds, for timing the benchmarks and the processing steps of the nodes.
+    inline double getTime()
+    {
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        return double(now.tv_sec) + double(now.tv_usec) / 1000000.0;
+    }
+}
+
+#endif // __TIMING__H
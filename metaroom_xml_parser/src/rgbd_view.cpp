@@ -0,0 +1,173 @@
+#include "metaroom_xml_parser/rgbd_view.h"
+
+#include <fstream>
+#include <cstring>
+#include <stdint.h>
+
+#include "ros/ros.h"
+
+namespace
+{
+    const char      RGBD_VIEW_MAGIC[8] = {'R','G','B','D','V','I','E','W'};
+    const uint32_t  RGBD_VIEW_VERSION = 1;
+
+    template <typename T>
+    void writeValue(std::ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(std::ifstream& in, T& value)
+    {
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return in.good();
+    }
+
+    //! Reads a plane written by writePlane. The size is checked against the rest of the file before anything is
+    //! allocated. An empty plane stays empty, any other plane has to decode to an image of the given size.
+    bool readPlane(std::ifstream& in, int64_t fileLength, int flags, uint32_t width, uint32_t height, cv::Mat& plane)
+    {
+        plane = cv::Mat();
+        uint32_t size;
+        if (!readValue(in, size) || (int64_t(size) > fileLength - int64_t(in.tellg())))
+        {
+            return false;
+        }
+        if (size == 0)
+        {
+            return true;
+        }
+        std::vector<uchar> buffer(size);
+        in.read(reinterpret_cast<char*>(&buffer[0]), size);
+        if (!in.good())
+        {
+            return false;
+        }
+        plane = cv::imdecode(buffer, flags);
+        return !plane.empty() && (plane.cols == int(width)) && (plane.rows == int(height));
+    }
+
+    void writePlane(std::ofstream& out, const cv::Mat& plane, int compressionLevel)
+    {
+        std::vector<uchar> buffer;
+        if (!plane.empty())
+        {
+            std::vector<int> params;
+            params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+            params.push_back(compressionLevel);
+            cv::imencode(".png", plane, buffer, params);
+        }
+        writeValue(out, static_cast<uint32_t>(buffer.size()));
+        if (!buffer.empty())
+        {
+            out.write(reinterpret_cast<const char*>(&buffer[0]), buffer.size());
+        }
+    }
+}
+
+bool rgbd_view_utilities::isRGBDViewFile(const std::string& filename)
+{
+    return (filename.size() >= RGBD_VIEW_EXTENSION.size()) &&
+            (filename.compare(filename.size() - RGBD_VIEW_EXTENSION.size(), RGBD_VIEW_EXTENSION.size(), RGBD_VIEW_EXTENSION) == 0);
+}
+
+std::string rgbd_view_utilities::getRGBDViewFilename(const std::string& cloudFilename)
+{
+    size_t dot = cloudFilename.find_last_of('.');
+    size_t slash = cloudFilename.find_last_of('/');
+    if ((dot == std::string::npos) || ((slash != std::string::npos) && (dot < slash)))
+    {
+        return cloudFilename + RGBD_VIEW_EXTENSION;
+    }
+    return cloudFilename.substr(0, dot) + RGBD_VIEW_EXTENSION;
+}
+
+std::string rgbd_view_utilities::getPCDFilename(const std::string& viewFilename)
+{
+    if (!isRGBDViewFile(viewFilename))
+    {
+        return viewFilename;
+    }
+    return viewFilename.substr(0, viewFilename.size() - RGBD_VIEW_EXTENSION.size()) + ".pcd";
+}
+
+bool rgbd_view_utilities::saveRGBDView(const std::string& filename, const RGBDView& view, int compressionLevel)
+{
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        ROS_ERROR_STREAM("Could not open "<<filename<<" to save RGBD view.");
+        return false;
+    }
+
+    out.write(RGBD_VIEW_MAGIC, sizeof(RGBD_VIEW_MAGIC));
+    writeValue(out, RGBD_VIEW_VERSION);
+    writeValue(out, static_cast<uint32_t>(view.depth.cols));
+    writeValue(out, static_cast<uint32_t>(view.depth.rows));
+    writeValue(out, view.fx); writeValue(out, view.fy);
+    writeValue(out, view.cx); writeValue(out, view.cy);
+
+    tf::Vector3 t = view.pose.getOrigin();
+    tf::Quaternion q = view.pose.getRotation();
+    writeValue(out, static_cast<double>(t.x())); writeValue(out, static_cast<double>(t.y())); writeValue(out, static_cast<double>(t.z()));
+    writeValue(out, static_cast<double>(q.x())); writeValue(out, static_cast<double>(q.y())); writeValue(out, static_cast<double>(q.z())); writeValue(out, static_cast<double>(q.w()));
+
+    writePlane(out, view.depth, compressionLevel);
+    writePlane(out, view.rgb, compressionLevel);
+
+    return out.good();
+}
+
+bool rgbd_view_utilities::loadRGBDView(const std::string& filename, RGBDView& view, bool loadRGB)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+    if (!in)
+    {
+        ROS_ERROR_STREAM("Could not open RGBD view "<<filename);
+        return false;
+    }
+    const int64_t fileLength = in.tellg();
+    in.seekg(0, std::ios::beg);
+
+    char magic[sizeof(RGBD_VIEW_MAGIC)];
+    in.read(magic, sizeof(magic));
+    uint32_t version, width, height;
+    if (!in.good() || (memcmp(magic, RGBD_VIEW_MAGIC, sizeof(magic)) != 0) || !readValue(in, version) || (version != RGBD_VIEW_VERSION))
+    {
+        ROS_ERROR_STREAM("File "<<filename<<" is not a valid RGBD view.");
+        return false;
+    }
+
+    double tx, ty, tz, qx, qy, qz, qw;
+    bool ok = readValue(in, width) && readValue(in, height) &&
+            readValue(in, view.fx) && readValue(in, view.fy) && readValue(in, view.cx) && readValue(in, view.cy) &&
+            readValue(in, tx) && readValue(in, ty) && readValue(in, tz) &&
+            readValue(in, qx) && readValue(in, qy) && readValue(in, qz) && readValue(in, qw);
+    if (!ok)
+    {
+        ROS_ERROR_STREAM("Truncated RGBD view header in "<<filename);
+        return false;
+    }
+    view.pose.setOrigin(tf::Vector3(tx, ty, tz));
+    view.pose.setRotation(tf::Quaternion(qx, qy, qz, qw));
+
+    if (!readPlane(in, fileLength, CV_LOAD_IMAGE_ANYDEPTH, width, height, view.depth))
+    {
+        ROS_ERROR_STREAM("Truncated or corrupt depth plane in RGBD view "<<filename);
+        return false;
+    }
+    if (view.depth.empty())
+    {
+        view.depth = cv::Mat::zeros(height, width, CV_16UC1);
+    }
+
+    view.rgb = cv::Mat();
+    if (loadRGB && !readPlane(in, fileLength, CV_LOAD_IMAGE_COLOR, width, height, view.rgb))
+    {
+        ROS_ERROR_STREAM("Truncated or corrupt RGB plane in RGBD view "<<filename);
+        return false;
+    }
+
+    return true;
+}
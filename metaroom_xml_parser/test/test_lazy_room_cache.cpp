@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+#include <pcl/io/pcd_io.h>
+
+#include "metaroom_xml_parser/lazy_room.h"
+
+typedef pcl::PointXYZRGB PointType;
+typedef LazyRoomCache<PointType> Cache;
+
+namespace
+{
+    const int NO_POINTS = 100;
+    const size_t CLOUD_BYTES = NO_POINTS * sizeof(PointType);
+
+    class LazyRoomCacheTest : public ::testing::Test
+    {
+    protected:
+        void SetUp()
+        {
+            m_folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("lazy_room_cache_%%%%-%%%%");
+            boost::filesystem::create_directories(m_folder);
+            for (int i=0; i<4; i++)
+            {
+                pcl::PointCloud<PointType> cloud;
+                cloud.points.resize(NO_POINTS);
+                for (int j=0; j<NO_POINTS; j++)
+                {
+                    cloud.points[j].x = i; cloud.points[j].y = j; cloud.points[j].z = 1.0;
+                }
+                cloud.width = NO_POINTS;
+                cloud.height = 1;
+                pcl::io::savePCDFileBinary(cloudFile(i), cloud);
+            }
+
+            // the cache is shared by the whole process
+            m_PreviousCapacity = Cache::instance().getCapacity();
+            Cache::instance().clear();
+            Cache::instance().setCapacity(64 * CLOUD_BYTES);
+        }
+
+        void TearDown()
+        {
+            Cache::instance().clear();
+            Cache::instance().setCapacity(m_PreviousCapacity);
+            boost::filesystem::remove_all(m_folder);
+        }
+
+        std::string cloudFile(int i)
+        {
+            return (m_folder / ("intermediate_cloud000" + std::to_string(i) + ".pcd")).string();
+        }
+
+        boost::filesystem::path     m_folder;
+        size_t                      m_PreviousCapacity;
+    };
+}
+
+TEST_F(LazyRoomCacheTest, KeepsLoadedClouds)
+{
+    Cache::CloudPtr first = Cache::instance().getCloud(cloudFile(0));
+    ASSERT_EQ(first->points.size(), size_t(NO_POINTS));
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(0)));
+    EXPECT_EQ(Cache::instance().getSize(), CLOUD_BYTES);
+
+    Cache::CloudPtr second = Cache::instance().getCloud(cloudFile(0));
+    EXPECT_EQ(first.get(), second.get());
+    EXPECT_EQ(Cache::instance().getSize(), CLOUD_BYTES);
+}
+
+TEST_F(LazyRoomCacheTest, EvictsLeastRecentlyUsed)
+{
+    Cache::instance().setCapacity(2 * CLOUD_BYTES);
+    Cache::instance().getCloud(cloudFile(0));
+    Cache::instance().getCloud(cloudFile(1));
+    // 0 becomes the most recently used, so loading 2 evicts 1
+    Cache::instance().getCloud(cloudFile(0));
+    Cache::instance().getCloud(cloudFile(2));
+
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(0)));
+    EXPECT_FALSE(Cache::instance().isCached(cloudFile(1)));
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(2)));
+    EXPECT_EQ(Cache::instance().getSize(), 2 * CLOUD_BYTES);
+}
+
+TEST_F(LazyRoomCacheTest, ShrinkingTheCapacityEvicts)
+{
+    for (int i=0; i<4; i++)
+    {
+        Cache::instance().getCloud(cloudFile(i));
+    }
+    EXPECT_EQ(Cache::instance().getSize(), 4 * CLOUD_BYTES);
+
+    Cache::instance().setCapacity(CLOUD_BYTES);
+    EXPECT_EQ(Cache::instance().getSize(), CLOUD_BYTES);
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(3)));
+
+    // the most recent entry is kept even if it does not fit
+    Cache::instance().setCapacity(0);
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(3)));
+    Cache::instance().getCloud(cloudFile(1));
+    EXPECT_TRUE(Cache::instance().isCached(cloudFile(1)));
+    EXPECT_FALSE(Cache::instance().isCached(cloudFile(3)));
+    EXPECT_EQ(Cache::instance().getSize(), CLOUD_BYTES);
+}
+
+TEST_F(LazyRoomCacheTest, ReleasedCloudStaysValid)
+{
+    LazyCloudHandle<PointType> handle(cloudFile(0));
+    Cache::CloudPtr cloud = handle.get();
+    EXPECT_TRUE(handle.isLoaded());
+
+    handle.release();
+    EXPECT_FALSE(handle.isLoaded());
+    EXPECT_EQ(Cache::instance().getSize(), size_t(0));
+    ASSERT_EQ(cloud->points.size(), size_t(NO_POINTS));
+    EXPECT_EQ(cloud->points[NO_POINTS-1].y, float(NO_POINTS-1));
+}
+
+TEST_F(LazyRoomCacheTest, MissingFileIsNotCached)
+{
+    std::string missing = (m_folder / "missing.pcd").string();
+    Cache::CloudPtr cloud = Cache::instance().getCloud(missing);
+    EXPECT_TRUE(cloud->points.empty());
+    EXPECT_FALSE(Cache::instance().isCached(missing));
+    EXPECT_EQ(Cache::instance().getSize(), size_t(0));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
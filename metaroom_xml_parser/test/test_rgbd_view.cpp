@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <boost/filesystem.hpp>
+
+#include "metaroom_xml_parser/rgbd_view.h"
+
+namespace
+{
+    // magic, version, width, height, intrinsics and pose, see rgbd_view.h
+    const size_t HEADER_BYTES = 8 + 3*sizeof(uint32_t) + 11*sizeof(double);
+
+    class RGBDViewTest : public ::testing::Test
+    {
+    protected:
+        void SetUp()
+        {
+            m_folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("rgbd_view_%%%%-%%%%");
+            boost::filesystem::create_directories(m_folder);
+            m_filename = (m_folder / "intermediate_cloud0000.rgbd").string();
+
+            m_view.fx = 525.0; m_view.fy = 526.0; m_view.cx = 7.5; m_view.cy = 5.5;
+            m_view.pose.setOrigin(tf::Vector3(1.0, 2.0, 3.0));
+            m_view.pose.setRotation(tf::Quaternion(tf::Vector3(0.0, 0.0, 1.0), 0.5));
+            m_view.depth = cv::Mat::zeros(12, 16, CV_16UC1);
+            m_view.rgb = cv::Mat::zeros(12, 16, CV_8UC3);
+            for (int y=0; y<m_view.depth.rows; y++)
+            {
+                for (int x=0; x<m_view.depth.cols; x++)
+                {
+                    // a few missing measurements
+                    m_view.depth.at<uint16_t>(y, x) = ((x + y) % 5 == 0) ? 0 : 1000 + 37*x + 101*y;
+                    m_view.rgb.at<cv::Vec3b>(y, x) = cv::Vec3b(x*10, y*20, (x*y) % 256);
+                }
+            }
+        }
+
+        void TearDown()
+        {
+            boost::filesystem::remove_all(m_folder);
+        }
+
+        std::string readFile()
+        {
+            std::ifstream in(m_filename.c_str(), std::ios::binary);
+            return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+
+        void writeFile(const std::string& contents)
+        {
+            std::ofstream out(m_filename.c_str(), std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), contents.size());
+        }
+
+        static bool equal(const cv::Mat& a, const cv::Mat& b)
+        {
+            return (a.size() == b.size()) && (a.type() == b.type()) && (cv::norm(a, b, cv::NORM_INF) == 0);
+        }
+
+        boost::filesystem::path     m_folder;
+        std::string                 m_filename;
+        RGBDView                    m_view;
+    };
+}
+
+TEST_F(RGBDViewTest, FilenameMapping)
+{
+    EXPECT_EQ(rgbd_view_utilities::getRGBDViewFilename("/a/b/intermediate_cloud0003.pcd"), "/a/b/intermediate_cloud0003.rgbd");
+    EXPECT_EQ(rgbd_view_utilities::getRGBDViewFilename("/a.b/cloud"), "/a.b/cloud.rgbd");
+    EXPECT_EQ(rgbd_view_utilities::getPCDFilename("/a/b/intermediate_cloud0003.rgbd"), "/a/b/intermediate_cloud0003.pcd");
+    EXPECT_TRUE(rgbd_view_utilities::isRGBDViewFile(m_filename));
+}
+
+TEST_F(RGBDViewTest, RoundTrip)
+{
+    ASSERT_TRUE(rgbd_view_utilities::saveRGBDView(m_filename, m_view));
+    RGBDView loaded;
+    ASSERT_TRUE(rgbd_view_utilities::loadRGBDView(m_filename, loaded));
+
+    EXPECT_TRUE(equal(m_view.depth, loaded.depth));
+    EXPECT_TRUE(equal(m_view.rgb, loaded.rgb));
+    EXPECT_EQ(m_view.fx, loaded.fx); EXPECT_EQ(m_view.fy, loaded.fy);
+    EXPECT_EQ(m_view.cx, loaded.cx); EXPECT_EQ(m_view.cy, loaded.cy);
+    EXPECT_NEAR((m_view.pose.getOrigin() - loaded.pose.getOrigin()).length(), 0.0, 1e-9);
+    EXPECT_NEAR(m_view.pose.getRotation().angleShortestPath(loaded.pose.getRotation()), 0.0, 1e-9);
+
+    // depth only consumers skip the RGB plane
+    RGBDView depthOnly;
+    ASSERT_TRUE(rgbd_view_utilities::loadRGBDView(m_filename, depthOnly, false));
+    EXPECT_TRUE(equal(m_view.depth, depthOnly.depth));
+    EXPECT_TRUE(depthOnly.rgb.empty());
+}
+
+TEST_F(RGBDViewTest, TruncatedViewIsRejected)
+{
+    ASSERT_TRUE(rgbd_view_utilities::saveRGBDView(m_filename, m_view));
+    const std::string contents = readFile();
+    ASSERT_GT(contents.size(), HEADER_BYTES);
+    for (size_t length = 0; length < contents.size(); length++)
+    {
+        writeFile(contents.substr(0, length));
+        RGBDView loaded;
+        EXPECT_FALSE(rgbd_view_utilities::loadRGBDView(m_filename, loaded)) << "truncated to " << length << " bytes";
+    }
+}
+
+TEST_F(RGBDViewTest, DepthOnlyLoadIgnoresTruncatedRGBPlane)
+{
+    ASSERT_TRUE(rgbd_view_utilities::saveRGBDView(m_filename, m_view));
+    const std::string contents = readFile();
+    uint32_t depthBytes;
+    memcpy(&depthBytes, contents.data() + HEADER_BYTES, sizeof(depthBytes));
+    const size_t rgbOffset = HEADER_BYTES + sizeof(uint32_t) + depthBytes;
+    ASSERT_LT(rgbOffset, contents.size());
+
+    writeFile(contents.substr(0, rgbOffset + sizeof(uint32_t) + 1));
+    RGBDView loaded;
+    EXPECT_TRUE(rgbd_view_utilities::loadRGBDView(m_filename, loaded, false));
+    EXPECT_TRUE(equal(m_view.depth, loaded.depth));
+    EXPECT_FALSE(rgbd_view_utilities::loadRGBDView(m_filename, loaded, true));
+}
+
+TEST_F(RGBDViewTest, CorruptViewIsRejected)
+{
+    ASSERT_TRUE(rgbd_view_utilities::saveRGBDView(m_filename, m_view));
+    const std::string contents = readFile();
+    RGBDView loaded;
+
+    // a plane size beyond the end of the file is rejected before anything is allocated
+    std::string corrupt = contents;
+    const uint32_t huge = 0xffffffff;
+    corrupt.replace(HEADER_BYTES, sizeof(huge), reinterpret_cast<const char*>(&huge), sizeof(huge));
+    writeFile(corrupt);
+    EXPECT_FALSE(rgbd_view_utilities::loadRGBDView(m_filename, loaded));
+
+    // a plane which decodes to another size than the header
+    corrupt = contents;
+    const uint32_t width = 17;
+    corrupt.replace(8 + sizeof(uint32_t), sizeof(width), reinterpret_cast<const char*>(&width), sizeof(width));
+    writeFile(corrupt);
+    EXPECT_FALSE(rgbd_view_utilities::loadRGBDView(m_filename, loaded));
+
+    corrupt = contents;
+    corrupt[0] = 'X';
+    writeFile(corrupt);
+    EXPECT_FALSE(rgbd_view_utilities::loadRGBDView(m_filename, loaded));
+
+    EXPECT_FALSE(rgbd_view_utilities::loadRGBDView((m_folder / "missing.rgbd").string(), loaded));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -88,7 +88,9 @@ namespace nbv_planning {
         bool update_current_volume(CloudPtr cloud, const Eigen::Affine3d &sensor_origin);
 
         /**
-         * Select the next best view from the candidate views.
+         * Select the next best view from the candidate views. The candidates are evaluated in parallel, split in bundles
+         * of rays. Scores are cached per view and only recomputed for views whose rays traverse cells changed by
+         * update_current_volume since the last evaluation.
          * @param selected_view_index  The index of the view that was selected.
          * @param disable_view   If true then the selected view will be removed from candidates, so as to not be selected again
          * @return false if no view could be chosen (e.g none left to select from)
@@ -101,6 +103,24 @@ namespace nbv_planning {
          */
         float evaluate_view(Eigen::Affine3d &view) const;
 
+        /**
+         * Enable or disable the per view score cache. When disabled, all available views are evaluated at each call to
+         * choose_next_view.
+         */
+        void set_view_cache_enabled(bool enabled);
+
+        /**
+         * Set the number of rays evaluated together by one thread in choose_next_view.
+         */
+        void set_ray_bundle_size(unsigned int bundle_size);
+
+        /**
+         * Return the number of views (re-)evaluated by the last call to choose_next_view.
+         */
+        unsigned int get_last_evaluated_view_count() const {
+            return m_last_evaluated_view_count;
+        }
+
         /**
          * Save a temporary copy of the internal octomap. Stores to /tmp/volume.bt.
          */
@@ -111,15 +131,43 @@ namespace nbv_planning {
          */
         int count_unobserved_cells() const;
     protected:
+        /**
+         * Cached score of a candidate view, together with the octree cells traversed by its rays (and their bounding
+         * box) so that it can be invalidated when any of these cells is updated.
+         */
+        struct ViewScore {
+            ViewScore() : valid(false), score(0) {}
+            bool valid;
+            double score;
+            octomap::KeySet cells;
+            octomap::OcTreeKey min_key, max_key;
+        };
+
         void create_octree();
         double get_node_value(const octomap::OcTreeKey& key) const;
 
+        /**
+         * Information gain of the rays [first, last) of a view. If traversed_cells is not NULL the keys of all cells
+         * looked up are added to it.
+         */
+        double evaluate_rays(const Rays &rays, size_t first, size_t last, octomap::KeySet *traversed_cells) const;
+
+        /**
+         * Invalidate the cached scores of the views whose rays traverse any of the given cells.
+         */
+        void invalidate_view_scores(const octomap::KeySet &changed_cells);
+        void clear_view_scores();
+
         OcTreeT m_octree;
         SensorModel m_sensor_model;
         TargetVolume m_target_volume;
         std::vector<Eigen::Affine3d> m_candidate_views;
         std::vector<unsigned int> m_available_view_idx;
         double m_a;
+        std::vector<ViewScore> m_view_scores;
+        bool m_view_cache_enabled;
+        unsigned int m_ray_bundle_size;
+        unsigned int m_last_evaluated_view_count;
 
     };
 }
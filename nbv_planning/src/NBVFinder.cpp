@@ -35,7 +35,9 @@ namespace octomap {
 namespace nbv_planning {
 
     NBVFinder::NBVFinder(const nbv_planning::SensorModel &sensor_model,
-                         double threshold_a) : m_sensor_model(sensor_model), m_a(threshold_a) {
+                         double threshold_a) : m_sensor_model(sensor_model), m_a(threshold_a),
+                                               m_view_cache_enabled(true), m_ray_bundle_size(16),
+                                               m_last_evaluated_view_count(0) {
         // Initialise the candidate views vector
         m_candidate_views.clear();
         create_octree();
@@ -56,6 +58,7 @@ namespace nbv_planning {
 //        m_octree->setBBXMax(max_o);
 //        m_octree->setBBXMin(min_o);
         m_octree->clear();
+        clear_view_scores();
     }
 
     bool NBVFinder::set_target_volume(TargetVolume volume) {
@@ -98,7 +101,18 @@ namespace nbv_planning {
         octomap::point3d origin(sensor_origin.translation().x(), sensor_origin.translation().y(),sensor_origin.translation().z());
 
 
-        m_octree->insertPointCloud(octomap_cloud, origin, -1,false,true);
+        // Same as OcTree::insertPointCloud(octomap_cloud, origin, -1, false, true), but keeping the updated cells so
+        // that only the view scores depending on them are recomputed
+        octomap::KeySet free_cells, occupied_cells;
+        m_octree->computeDiscreteUpdate(octomap_cloud, origin, free_cells, occupied_cells, -1);
+        for (octomap::KeySet::iterator it = free_cells.begin(); it != free_cells.end(); ++it) {
+            m_octree->updateNode(*it, false, false);
+        }
+        for (octomap::KeySet::iterator it = occupied_cells.begin(); it != occupied_cells.end(); ++it) {
+            m_octree->updateNode(*it, true, false);
+        }
+        free_cells.insert(occupied_cells.begin(), occupied_cells.end());
+        invalidate_view_scores(free_cells);
         // m_octree->toMaxLikelihood();
         std::cout << "Octree now has " << m_octree->calcNumNodes() << " nodes.\n";
         return false;
@@ -106,7 +120,9 @@ namespace nbv_planning {
 
     bool NBVFinder::set_candidate_views(const std::vector<Eigen::Affine3d> &views) {
         m_candidate_views = views;
+        m_available_view_idx.clear();
         m_available_view_idx.reserve(m_candidate_views.size());
+        clear_view_scores();
         for (unsigned i=0;i<m_candidate_views.size();++i)
             m_available_view_idx.push_back(i);
         return true;
@@ -117,12 +133,15 @@ namespace nbv_planning {
         // Find the exit
         // Get the cells along the way
         // Rate the view using the algorithm in the paper
-        double view_gain=0;
         Rays rays = m_sensor_model.get_rays(view, m_target_volume);
+        return evaluate_rays(rays, 0, rays.size(), NULL);
+    }
 
-        float max_range = m_sensor_model.get_max_range();
-        for (Rays::iterator ray = rays.begin(); ray < rays.end(); ++ray) {
-            Eigen::Vector3f volume_origin = m_target_volume.get_origin();
+    double NBVFinder::evaluate_rays(const Rays &rays, size_t first, size_t last,
+                                    octomap::KeySet *traversed_cells) const {
+        double view_gain=0;
+        octomap::KeyRay full_ray;
+        for (Rays::const_iterator ray = rays.begin() + first; ray < rays.begin() + last; ++ray) {
             octomap::point3d origin(ray->position()(0), ray->position()(1), ray->position()(2)),
                     start, end;
             start = origin +
@@ -130,28 +149,32 @@ namespace nbv_planning {
             end = origin +
                   octomap::point3d(ray->direction()(0), ray->direction()(1), ray->direction()(2)) * ray->length();
 
-            octomap::KeyRay ray_inside_volume, full_ray;
-            m_octree->computeRayKeys(start, end, ray_inside_volume);
+            // The part of the ray inside the volume starts at the cell containing start. If start and end fall in the
+            // same cell the ray does not intersect the volume of interest
+            octomap::OcTreeKey start_key, end_key;
+            if (!m_octree->coordToKeyChecked(start, start_key) || !m_octree->coordToKeyChecked(end, end_key) ||
+                start_key == end_key)
+                continue;
             m_octree->computeRayKeys(origin, end, full_ray);
 
-            // iterate over the voxels and set them good?
-            if (ray_inside_volume.size() <1)
-                continue; // this ray does not intersect the volume of interest
-
             bool counting=false; // only count the information gain for cells that are inside the target volume
             double prev_p_x = 1;
             double prev_p_o = 0;
             int number_of_cells_passed =0;
+            // The value of the previous cell is carried over instead of being looked up again. The cell before the
+            // first one is unknown.
+            double prev_cell_value = 0.5;
 //            double ray_vis=1;
             for (octomap::KeyRay::iterator cell = full_ray.begin(); cell < full_ray.end(); ++cell) {
                 number_of_cells_passed+=1;
 
-                if (*cell == *(ray_inside_volume.begin())) {
+                if (*cell == start_key) {
                     // We got to the start of the part of the ray that is inside the volume
                     counting=true;
                 }
-                double prev_cell_value = get_node_value(*(cell-1));
                 double current_cell_value = get_node_value(*cell);
+                if (traversed_cells != NULL)
+                    traversed_cells->insert(*cell);
 
 //                ray_vis*=current_cell_value;
 //                if (counting && current_cell_value==0.5){
@@ -205,7 +228,7 @@ namespace nbv_planning {
                     double gain = prev_entropy - new_entropy; //(Eqn. 4)
                     view_gain +=gain;
                 }
-
+                prev_cell_value = current_cell_value;
             }
         }
 
@@ -228,21 +251,80 @@ namespace nbv_planning {
 
     bool NBVFinder::choose_next_view(bool disable_view, unsigned int &selected_view_index, double &view_score) {
         // Choose which of the views provided by set_candidate_views is the best to select.
-        std::vector<double> scores;
-        scores.reserve(m_available_view_idx.size());
+        if (!m_view_cache_enabled)
+            clear_view_scores();
+
+        // Views which need to be (re-)evaluated
+        std::vector<unsigned int> views_to_evaluate;
+        for (std::vector<unsigned int>::iterator view_index = m_available_view_idx.begin();
+                view_index<m_available_view_idx.end();++view_index) {
+            if (!m_view_scores[*view_index].valid)
+                views_to_evaluate.push_back(*view_index);
+        }
+        m_last_evaluated_view_count = views_to_evaluate.size();
+        std::cout << "Evaluating " << views_to_evaluate.size() << " of " << m_available_view_idx.size()
+                  << " views, the others are cached." << std::endl;
+
+        // Split the rays of all the views to evaluate in bundles, so that the work is balanced across threads even
+        // with few views left
+        std::vector<Rays> view_rays(views_to_evaluate.size());
+        int nr_views = views_to_evaluate.size();
+#pragma omp parallel for schedule(dynamic)
+        for (int i=0; i<nr_views; ++i) {
+            view_rays[i] = m_sensor_model.get_rays(m_candidate_views[views_to_evaluate[i]], m_target_volume);
+        }
+        std::vector<unsigned int> bundle_view;
+        std::vector<size_t> bundle_first, bundle_last;
+        for (unsigned int i=0; i<views_to_evaluate.size(); ++i) {
+            for (size_t first=0; first<view_rays[i].size(); first+=m_ray_bundle_size) {
+                bundle_view.push_back(i);
+                bundle_first.push_back(first);
+                bundle_last.push_back(std::min(first+m_ray_bundle_size, view_rays[i].size()));
+            }
+        }
+
+        std::vector<double> bundle_gains(bundle_view.size(), 0);
+        std::vector<octomap::KeySet> bundle_cells(bundle_view.size());
+        int nr_bundles = bundle_view.size();
+#pragma omp parallel for schedule(dynamic)
+        for (int i=0; i<nr_bundles; ++i) {
+            bundle_gains[i] = evaluate_rays(view_rays[bundle_view[i]], bundle_first[i], bundle_last[i],
+                                            &bundle_cells[i]);
+        }
+
+        // Gather the bundles in order, so that the scores do not depend on the scheduling
+        for (unsigned int i=0; i<views_to_evaluate.size(); ++i) {
+            m_view_scores[views_to_evaluate[i]] = ViewScore();
+            m_view_scores[views_to_evaluate[i]].valid = true;
+        }
+        for (size_t i=0; i<bundle_view.size(); ++i) {
+            ViewScore &cached = m_view_scores[views_to_evaluate[bundle_view[i]]];
+            cached.score += bundle_gains[i];
+            cached.cells.insert(bundle_cells[i].begin(), bundle_cells[i].end());
+        }
+        for (unsigned int i=0; i<views_to_evaluate.size(); ++i) {
+            ViewScore &cached = m_view_scores[views_to_evaluate[i]];
+            for (octomap::KeySet::iterator cell = cached.cells.begin(); cell != cached.cells.end(); ++cell) {
+                for (unsigned int k=0; k<3; ++k) {
+                    if (cell == cached.cells.begin() || (*cell)[k] < cached.min_key[k])
+                        cached.min_key[k] = (*cell)[k];
+                    if (cell == cached.cells.begin() || (*cell)[k] > cached.max_key[k])
+                        cached.max_key[k] = (*cell)[k];
+                }
+            }
+        }
 
         double max_score=0;
         double score;
         unsigned  int best_index =-1;
         for (std::vector<unsigned int>::iterator view_index = m_available_view_idx.begin();
                 view_index<m_available_view_idx.end();++view_index) {
-            std::cout << "Evaluating view " << *view_index << std::endl;
-            score = evaluate_view(m_candidate_views[*view_index]);
+            score = m_view_scores[*view_index].score;
             if (score > max_score) {
                 max_score=score;
                 best_index = *view_index;
             };
-            std::cout << " - score: " << score << std::endl;
+            std::cout << "View " << *view_index << " - score: " << score << std::endl;
         }
         if (best_index ==-1)
             return false;
@@ -258,6 +340,60 @@ namespace nbv_planning {
         }
     }
 
+    void NBVFinder::invalidate_view_scores(const octomap::KeySet &changed_cells) {
+        if (changed_cells.empty())
+            return;
+        octomap::OcTreeKey min_key = *changed_cells.begin(), max_key = *changed_cells.begin();
+        for (octomap::KeySet::const_iterator cell = changed_cells.begin(); cell != changed_cells.end(); ++cell) {
+            for (unsigned int k=0; k<3; ++k) {
+                min_key[k] = std::min(min_key[k], (*cell)[k]);
+                max_key[k] = std::max(max_key[k], (*cell)[k]);
+            }
+        }
+
+        unsigned int invalidated = 0;
+        int nr_views = m_view_scores.size();
+#pragma omp parallel for schedule(dynamic) reduction(+:invalidated)
+        for (int i=0; i<nr_views; ++i) {
+            ViewScore &cached = m_view_scores[i];
+            if (!cached.valid || cached.cells.empty())
+                continue;
+            bool overlap = true;
+            for (unsigned int k=0; k<3; ++k) {
+                if (cached.max_key[k] < min_key[k] || cached.min_key[k] > max_key[k])
+                    overlap = false;
+            }
+            if (!overlap)
+                continue;
+            // Look up the smaller set in the larger one
+            const octomap::KeySet &small = cached.cells.size() < changed_cells.size() ? cached.cells : changed_cells;
+            const octomap::KeySet &large = cached.cells.size() < changed_cells.size() ? changed_cells : cached.cells;
+            for (octomap::KeySet::const_iterator cell = small.begin(); cell != small.end(); ++cell) {
+                if (large.find(*cell) != large.end()) {
+                    cached.valid = false;
+                    invalidated++;
+                    break;
+                }
+            }
+        }
+        std::cout << "Map update invalidated " << invalidated << " cached view scores." << std::endl;
+    }
+
+    void NBVFinder::clear_view_scores() {
+        m_view_scores.clear();
+        m_view_scores.resize(m_candidate_views.size());
+    }
+
+    void NBVFinder::set_view_cache_enabled(bool enabled) {
+        m_view_cache_enabled = enabled;
+        if (!enabled)
+            clear_view_scores();
+    }
+
+    void NBVFinder::set_ray_bundle_size(unsigned int bundle_size) {
+        m_ray_bundle_size = std::max(1u, bundle_size);
+    }
+
     int NBVFinder::count_unobserved_cells() const{
         int count = 0;
         Eigen::Vector3f lower = m_target_volume.get_origin() - m_target_volume.get_extents();
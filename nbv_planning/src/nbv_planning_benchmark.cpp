@@ -0,0 +1,141 @@
+/**
+ * Measures the planning latency of the NBVFinder on synthetic data, so that changes to the view evaluation can be
+ * tracked without a robot or logged point clouds.
+ *
+ * nbv_benchmark [number_of_views] [sub_sample] [number_of_steps]
+ *
+ * The target volume is a 1m cube containing a box and a sphere. The candidate views are placed on a circle around the
+ * volume, looking at its center. At each step the next best view is selected and the synthetic objects visible from
+ * it are inserted in the map. The planning loop is run twice, with and without the per view score cache, and the time
+ * taken by choose_next_view and update_current_volume is reported for every step.
+ */
+#include <nbv_planning/NBVFinder.h>
+#include <pcl/common/time.h>
+#include <cstdlib>
+#include <cmath>
+
+namespace {
+    typedef nbv_planning::NBVFinder::Cloud Cloud;
+    typedef nbv_planning::NBVFinder::CloudPtr CloudPtr;
+
+    CloudPtr create_scene(double resolution) {
+        CloudPtr scene(new Cloud);
+        // a 40cm box standing on the floor
+        for (double a = -0.2; a <= 0.2; a += resolution) {
+            for (double b = -0.2; b <= 0.2; b += resolution) {
+                for (int side = -1; side <= 1; side += 2) {
+                    pcl::PointXYZRGB p;
+                    p.x = 0.2 * side; p.y = a; p.z = b + 0.2; scene->push_back(p);
+                    p.x = a; p.y = 0.2 * side; p.z = b + 0.2; scene->push_back(p);
+                }
+                pcl::PointXYZRGB top;
+                top.x = a; top.y = b; top.z = 0.4; scene->push_back(top);
+            }
+        }
+        // a 15cm sphere on top of it
+        for (double theta = 0; theta < M_PI; theta += resolution / 0.15) {
+            for (double phi = 0; phi < 2 * M_PI; phi += resolution / 0.15) {
+                pcl::PointXYZRGB p;
+                p.x = 0.1 + 0.15 * std::sin(theta) * std::cos(phi);
+                p.y = 0.15 * std::sin(theta) * std::sin(phi);
+                p.z = 0.55 + 0.15 * std::cos(theta);
+                scene->push_back(p);
+            }
+        }
+        return scene;
+    }
+
+    std::vector<Eigen::Affine3d> create_views(unsigned int number_of_views, double radius, double height) {
+        std::vector<Eigen::Affine3d> views;
+        for (unsigned int i = 0; i < number_of_views; ++i) {
+            double angle = 2 * M_PI * i / number_of_views;
+            Eigen::Vector3d position(radius * std::cos(angle), radius * std::sin(angle), height);
+            // camera frame: z forward, x right, y down
+            Eigen::Vector3d z = (Eigen::Vector3d(0, 0, 0.3) - position).normalized();
+            Eigen::Vector3d x = z.cross(Eigen::Vector3d::UnitZ()).normalized();
+            Eigen::Vector3d y = z.cross(x);
+            Eigen::Matrix3d rotation;
+            rotation.col(0) = x; rotation.col(1) = y; rotation.col(2) = z;
+            views.push_back(Eigen::Translation3d(position) * Eigen::Quaterniond(rotation));
+        }
+        return views;
+    }
+
+    // The scene points inside the view frustum, in the camera frame. Occlusions are ignored.
+    CloudPtr observe(const Cloud &scene, const Eigen::Affine3d &view, const nbv_planning::SensorModel &sensor) {
+        CloudPtr observed(new Cloud);
+        Eigen::Affine3f to_camera = view.inverse().cast<float>();
+        const nbv_planning::SensorModel::ProjectionMatrix &P = sensor.get_projection_matrix();
+        for (size_t i = 0; i < scene.size(); ++i) {
+            Eigen::Vector3f p = to_camera * scene.points[i].getVector3fMap();
+            if (p.z() < sensor.get_min_range() || p.z() > sensor.get_max_range())
+                continue;
+            double u = P(0, 0) * p.x() / p.z() + P(0, 2);
+            double v = P(1, 1) * p.y() / p.z() + P(1, 2);
+            if (u < 0 || u >= sensor.get_image_width() || v < 0 || v >= sensor.get_image_height())
+                continue;
+            pcl::PointXYZRGB point = scene.points[i];
+            point.getVector3fMap() = p;
+            observed->push_back(point);
+        }
+        return observed;
+    }
+
+    void run(bool use_cache, const nbv_planning::SensorModel &sensor, const std::vector<Eigen::Affine3d> &views,
+             const Cloud &scene, unsigned int number_of_steps) {
+        nbv_planning::NBVFinder planner(sensor);
+        planner.set_target_volume(nbv_planning::TargetVolume(0.01, Eigen::Vector3f(0, 0, 0.5),
+                                                             Eigen::Vector3f(0.5, 0.5, 0.5)));
+        planner.set_candidate_views(views);
+        planner.set_view_cache_enabled(use_cache);
+
+        std::cout << "\n*** " << (use_cache ? "With" : "Without") << " view score cache ***\n";
+        double total_choose = 0, total_update = 0;
+        unsigned int steps = 0;
+        for (; steps < number_of_steps; ++steps) {
+            unsigned int view;
+            double score;
+            pcl::StopWatch timer;
+            if (!planner.choose_next_view(true, view, score))
+                break;
+            double choose_time = timer.getTime();
+            unsigned int evaluated = planner.get_last_evaluated_view_count();
+
+            timer.reset();
+            planner.update_current_volume(observe(scene, views[view], sensor), views[view]);
+            double update_time = timer.getTime();
+
+            total_choose += choose_time;
+            total_update += update_time;
+            std::cout << "STEP " << steps << " view " << view << " score " << score << " evaluated " << evaluated
+                      << " choose_next_view " << choose_time << " ms update_current_volume " << update_time
+                      << " ms" << std::endl;
+        }
+        if (steps > 0) {
+            std::cout << "Average over " << steps << " steps: choose_next_view " << total_choose / steps
+                      << " ms update_current_volume " << total_update / steps << " ms" << std::endl;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned int number_of_views = argc > 1 ? atoi(argv[1]) : 36;
+    int sub_sample = argc > 2 ? atoi(argv[2]) : 20;
+    unsigned int number_of_steps = argc > 3 ? atoi(argv[3]) : 10;
+
+    nbv_planning::SensorModel::ProjectionMatrix P;
+    P << 525, 0, 319.5, 0,
+            0, 525, 239.5, 0,
+            0, 0, 1, 0;
+    nbv_planning::SensorModel sensor(480, 640, P, 4, 0.3, sub_sample);
+    std::cout << sensor << std::endl;
+
+    std::vector<Eigen::Affine3d> views = create_views(number_of_views, 1.5, 1.2);
+    CloudPtr scene = create_scene(0.01);
+    std::cout << "Synthetic scene with " << scene->size() << " points, " << views.size() << " candidate views."
+              << std::endl;
+
+    run(false, sensor, views, *scene, number_of_steps);
+    run(true, sensor, views, *scene, number_of_steps);
+    return 0;
+}
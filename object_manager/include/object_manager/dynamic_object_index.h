@@ -0,0 +1,106 @@
+#ifndef __DYNAMIC_OBJECT_INDEX__H
+#define __DYNAMIC_OBJECT_INDEX__H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "object_manager/dynamic_object.h"
+#include "object_manager/dynamic_object_xml_parser.h"
+
+/*
+ * Index of the dynamic objects of the latest observation at every waypoint, kept between service calls.
+ *
+ * The folders of the data folder are kept with their modification time and only listed again when it changes, and the
+ * waypoint of an observation (room.xml) is parsed once and kept together with the modification time of the file, so
+ * looking up the latest observation at a waypoint costs a stat per folder and observation, and only parses the
+ * observations that are new or have changed. The object xmls of that observation are parsed again only when their
+ * modification time changes, and the folder is only listed again when its own modification time changes (the xml
+ * parser recreates the object xml on every save). The object clouds are loaded the first time they are asked for, the
+ * additional views only when explicitly requested.
+ */
+class DynamicObjectIndex {
+public:
+
+    struct ObjectEntry
+    {
+        std::string                 xmlFile;
+        int64_t                     xmlTime;            // modification time of the xml when it was parsed (ns)
+        DynamicObject::Ptr          object;
+        bool                        cloudLoaded;
+        bool                        viewsLoaded;        // additional views and their masks
+
+        ObjectEntry() : xmlTime(-1), cloudLoaded(false), viewsLoaded(false) {}
+    };
+
+    DynamicObjectIndex(std::string dataFolder = "", bool verbose = false);
+
+    //! Latest observation recorded at the waypoint, "" if there are none.
+    std::string getLatestObservation(std::string waypoint);
+
+    //! Brings the objects of the waypoint up to date with the object xmls saved next to observationXml. Returns false
+    //! if there are no saved objects.
+    bool update(std::string waypoint, std::string observationXml);
+
+    //! Replaces the objects of the waypoint with objects that are already in memory and saved next to observationXml.
+    void setObjects(std::string waypoint, std::string observationXml, const std::vector<DynamicObject::Ptr>& objects);
+
+    //! The objects of the waypoint, with their clouds loaded.
+    std::vector<DynamicObject::Ptr> getObjects(std::string waypoint);
+    //! NULL if the object is not at the waypoint.
+    DynamicObject::Ptr getObject(std::string waypoint, std::string label, bool loadAdditionalViews = false);
+
+    std::string getObservation(std::string waypoint) const;
+    //! Changes every time the objects of the waypoint change, -1 if the waypoint is not indexed.
+    int getGeneration(std::string waypoint) const;
+
+    void clear();
+
+    //! Modification time of the file in ns, -1 if it doesn't exist.
+    static int64_t getModificationTime(std::string path);
+
+private:
+
+    struct WaypointEntry
+    {
+        std::string                 observationXml;
+        std::string                 observationFolder;
+        int64_t                     folderTime;         // modification time of the observation folder when it was listed
+        int64_t                     listTime;           // when the folder was listed
+        std::vector<ObjectEntry>    objects;
+        int                         generation;
+    };
+
+    struct ObservationEntry
+    {
+        int64_t                     xmlTime;
+        std::string                 waypoint;
+    };
+
+    struct FolderEntry
+    {
+        int64_t                     folderTime;         // modification time of the folder when it was listed
+        int64_t                     listTime;           // when the folder was listed
+        std::vector<std::string>    subfolders;
+        bool                        hasRoomXml;
+
+        FolderEntry() : folderTime(-1), listTime(-1), hasRoomXml(false) {}
+    };
+
+    //! Lists the folder again if it changed, and appends the observations below it.
+    void updateFolder(std::string folder, int depth, std::vector<std::string>& observations);
+    void loadCloud(WaypointEntry& waypoint, ObjectEntry& entry);
+    WaypointEntry& resetWaypoint(std::string waypoint, std::string observationXml);
+
+    static bool observationLess(const std::string& a, const std::string& b);
+
+    std::string                                                     m_dataFolder;
+    bool                                                            m_bVerbose;
+    std::map<std::string, FolderEntry>                              m_folders;          // folders of the data folder
+    std::map<std::string, ObservationEntry>                         m_observations;     // room xml -> waypoint
+    std::map<std::string, WaypointEntry>                            m_waypoints;
+    int                                                             m_generation;
+};
+
+#endif // __DYNAMIC_OBJECT_INDEX__H
@@ -0,0 +1,58 @@
+#ifndef __DYNAMIC_OBJECT_MASK__
+#define __DYNAMIC_OBJECT_MASK__
+
+#include <vector>
+#include <tf/tf.h>
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <opencv2/opencv.hpp>
+#include <image_geometry/pinhole_camera_model.h>
+
+/*
+ * Computation of the masks of a segmented dynamic object in its additional views. A mask is stored as an image of the
+ * size of the view (the masked pixels keep their color, the rest is black) and as the list of the masked pixel indices.
+ */
+namespace dynamic_object_mask_utilities
+{
+    typedef pcl::PointXYZRGB PointType;
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef Cloud::Ptr CloudPtr;
+
+    struct MaskComparison
+    {
+        int first_pixels;
+        int second_pixels;
+        int common_pixels;
+
+        MaskComparison() : first_pixels(0), second_pixels(0), common_pixels(0) {}
+        double intersectionOverUnion() const
+        {
+            int union_pixels = first_pixels + second_pixels - common_pixels;
+            return union_pixels ? (double)common_pixels / union_pixels : 1.0;
+        }
+    };
+
+    /**
+     * Masks the points of the view which have a neighbour in the object cloud closer than neighbor_distance (squared
+     * distance). The view and the object need to be in the same frame. Returns the masked points.
+     */
+    CloudPtr computeMaskUsingKdTree(CloudPtr view, CloudPtr object, cv::Mat& mask_image, std::vector<int>& mask_indices, double neighbor_distance);
+
+    /**
+     * Projects the object into the view and masks the pixels where the depth of the view matches the depth of the
+     * object (within depth_tolerance, in meters). The gaps between the projected object points are filled with a
+     * morphological closing, the filled pixels are kept only if their depth lies within the depth range of the object.
+     * \param view organized cloud in the camera frame, of any resolution
+     * \param view_pose transform from the camera frame of the view to the frame of the object
+     * \param closing_kernel_size diameter (in pixels) of the closing kernel, no closing if < 2
+     * Returns the masked points of the view, in the camera frame.
+     */
+    CloudPtr computeMaskUsingProjection(CloudPtr view, const tf::Transform& view_pose, CloudPtr object,
+                                        const image_geometry::PinholeCameraModel& cam_params,
+                                        cv::Mat& mask_image, std::vector<int>& mask_indices,
+                                        double depth_tolerance, int closing_kernel_size = 5);
+
+    MaskComparison compareMasks(const std::vector<int>& first_mask_indices, const std::vector<int>& second_mask_indices);
+}
+
+#endif // __DYNAMIC_OBJECT_MASK__
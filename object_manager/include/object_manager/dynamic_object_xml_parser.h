@@ -22,7 +22,14 @@ public:
     ~DynamicObjectXMLParser();
 
     std::string saveAsXML(DynamicObject::Ptr object, std::string xml_filename = "", std::string cloud_filename = "");
-    DynamicObject::Ptr loadFromXML(std::string filename, bool load_cloud = true);
+    DynamicObject::Ptr loadFromXML(std::string filename, bool load_cloud = true, bool load_additional_views = true);
+    // loads the additional views (and their masks) of an object parsed with load_additional_views = false
+    void loadAdditionalViews(DynamicObject::Ptr object, std::string objectFolder);
+    void loadAdditionalViewMasks(DynamicObject::Ptr object, std::string objectFolder);
+
+    // mask indices of all the additional views of an object in one binary file (<label>_additional_view_masks.bin)
+    static bool saveMaskIndicesBinary(std::string filename, const std::vector<std::vector<int>>& mask_indices);
+    static bool loadMaskIndicesBinary(std::string filename, std::vector<std::vector<int>>& mask_indices);
 
 
     void saveObjectTrackToXml(tf::Transform pose, CloudPtr cloud, QXmlStreamWriter* xmlWriter, std::string nodeName, std::string cloudFilename);
@@ -57,9 +57,11 @@
 
 // application includes
 #include <metaroom_xml_parser/load_utilities.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 #include "object_manager/dynamic_object.h"
 #include "object_manager/dynamic_object_xml_parser.h"
 #include "object_manager/dynamic_object_utilities.h"
+#include "object_manager/dynamic_object_index.h"
 #include "object_manager/dynamic_object_mongodb_interface.h"
 
 template <class PointType>
@@ -78,6 +80,16 @@ public:
     typedef typename object_manager::ProcessDynamicObjectService::Request ProcessDynamicObjectServiceRequest;
     typedef typename object_manager::ProcessDynamicObjectService::Response ProcessDynamicObjectServiceResponse;
 
+    //! Messages of the objects at a waypoint, converted once per generation of the object index
+    struct WaypointMessages
+    {
+        int generation;
+        sensor_msgs::PointCloud2 allObjects;
+        std::vector<sensor_msgs::PointCloud2> clouds;
+        std::vector<std::string> ids;
+        std::vector<geometry_msgs::Point> centroids;
+    };
+
     struct GetObjStruct
     {
         CloudPtr object_cloud;
@@ -138,8 +150,8 @@ private:
     std::string                                                                 m_additionalViewsTopic;
     std::string                                                                 m_additionalViewsStatusTopic;
     std::string                                                                 m_dataFolder;
-    std::map<std::string, std::vector<DynamicObject::Ptr>>                      m_waypointToObjMap;
-    std::map<std::string, std::string>                                          m_waypointToSweepFileMap;
+    DynamicObjectIndex                                                          m_objectIndex; // objects of the latest observation at each waypoint
+    std::map<std::string, WaypointMessages>                                     m_waypointToMessagesMap;
     bool                                                                        m_bLogToDB;
     bool                                                                        m_bTrackingStarted;
     bool                                                                        m_bSaveMask;
@@ -161,6 +173,7 @@ ObjectManager<PointType>::ObjectManager(ros::NodeHandle nh) : m_TransformListene
 
     m_NodeHandle.param<std::string>("object_folder",m_dataFolder,default_folder);
     ROS_INFO_STREAM("Reading dynamic object from "<<m_dataFolder);
+    m_objectIndex = DynamicObjectIndex(m_dataFolder);
 
     m_PublisherDynamicClusters = m_NodeHandle.advertise<sensor_msgs::PointCloud2>("/object_manager/objects", 1, true);
 
@@ -324,9 +337,8 @@ void ObjectManager<PointType>::additionalViewsStatusCallback(const std_msgs::Str
 
         // views
         for (auto obj_view : object.vAdditionalViews){
-            sensor_msgs::PointCloud2 view_msg;
-            pcl::toROSMsg(*obj_view, view_msg);
-            tracking_data_msg.additional_views.push_back(view_msg);
+            tracking_data_msg.additional_views.push_back(sensor_msgs::PointCloud2());
+            cloud_msg_utilities::toROSMsg(*obj_view, tracking_data_msg.additional_views.back());
         }
 
         // transforms
@@ -381,7 +393,7 @@ void ObjectManager<PointType>::additionalViewsCallback(const sensor_msgs::PointC
     if (m_bTrackingStarted)
     {
         CloudPtr new_cloud(new Cloud());
-        pcl::fromROSMsg(*msg, *new_cloud);
+        cloud_msg_utilities::fromROSMsg(*msg, *new_cloud);
         new_cloud->header = pcl_conversions::toPCL(msg->header);
 
         try {
@@ -439,7 +451,7 @@ void ObjectManager<PointType>::dynamicObjectTracksCallback(const object_manager:
         {
             // cloud message
             CloudPtr new_cloud(new Cloud());
-            pcl::fromROSMsg(msg->clouds[i], *new_cloud);
+            cloud_msg_utilities::fromROSMsg(msg->clouds[i], *new_cloud);
             new_cloud->header = pcl_conversions::toPCL(msg->clouds[i].header);
             // pose message
             tf::Transform pose;
@@ -466,53 +478,54 @@ bool ObjectManager<PointType>::dynamicObjectsServiceCallback(DynamicObjectsServi
 
     using namespace std;
 
-    std::vector<DynamicObject::Ptr> currentObjects;
     bool objects_found = updateObjectsAtWaypoint(req.waypoint_id);
     if (!objects_found)
     {
         return true;
     }
-    currentObjects = m_waypointToObjMap[req.waypoint_id];
-    ROS_INFO_STREAM("Found "<<currentObjects.size() <<" objects at "<<req.waypoint_id);
 
-    // publish objects
-    CloudPtr allObjects(new Cloud());
-
-    for (auto cloudObj : currentObjects)
+    // the clouds are only loaded and converted again when the objects at the waypoint changed
+    int generation = m_objectIndex.getGeneration(req.waypoint_id);
+    auto it = m_waypointToMessagesMap.find(req.waypoint_id);
+    if ((it == m_waypointToMessagesMap.end()) || (it->second.generation != generation))
     {
-        *allObjects += *(cloudObj->m_points);
-    }
+        std::vector<DynamicObject::Ptr> currentObjects = m_objectIndex.getObjects(req.waypoint_id);
+        ROS_INFO_STREAM("Found "<<currentObjects.size() <<" objects at "<<req.waypoint_id);
 
-    sensor_msgs::PointCloud2 msg_objects;
-    pcl::toROSMsg(*allObjects, msg_objects);
-    msg_objects.header.frame_id="/map";
-
-    m_PublisherDynamicClusters.publish(msg_objects);
-
-    std::vector<sensor_msgs::PointCloud2> clouds;
-    std::vector<std::string> id;
-    std::vector<geometry_msgs::Point> centroids;
+        WaypointMessages messages;
+        messages.generation = generation;
+        CloudPtr allObjects(new Cloud());
+        for (auto cloudObj : currentObjects)
+        {
+            *allObjects += *(cloudObj->m_points);
 
-    for (auto cloudObj : currentObjects)
-    {
-        sensor_msgs::PointCloud2 msg_objects;
-        pcl::toROSMsg(*cloudObj->m_points, msg_objects);
-        msg_objects.header.frame_id="/map";
+            messages.clouds.push_back(sensor_msgs::PointCloud2());
+            cloud_msg_utilities::toROSMsg(*cloudObj->m_points, messages.clouds.back());
+            messages.clouds.back().header.frame_id="/map";
 
-        clouds.push_back(msg_objects);
-        id.push_back(cloudObj->m_label);
+            messages.ids.push_back(cloudObj->m_label);
 
+            Eigen::Vector4f centroid;
+            pcl::compute3DCentroid(*cloudObj->m_points, centroid);
 
-        Eigen::Vector4f centroid;
-        pcl::compute3DCentroid(*cloudObj->m_points, centroid);
+            geometry_msgs::Point ros_centroid; ros_centroid.x = centroid[0];ros_centroid.y = centroid[1];ros_centroid.z = centroid[2];
+            messages.centroids.push_back(ros_centroid);
+        }
+        cloud_msg_utilities::toROSMsg(*allObjects, messages.allObjects);
+        messages.allObjects.header.frame_id="/map";
 
-        geometry_msgs::Point ros_centroid; ros_centroid.x = centroid[0];ros_centroid.y = centroid[1];ros_centroid.z = centroid[2];
-        centroids.push_back(ros_centroid);
+        m_waypointToMessagesMap[req.waypoint_id] = messages;
+        it = m_waypointToMessagesMap.find(req.waypoint_id);
+    } else {
+        ROS_INFO_STREAM("Found "<<it->second.ids.size() <<" objects at "<<req.waypoint_id<<" (unchanged)");
     }
 
-    res.objects = clouds;
-    res.object_id = id;
-    res.centroids = centroids;
+    // publish objects
+    m_PublisherDynamicClusters.publish(it->second.allObjects);
+
+    res.objects = it->second.clouds;
+    res.object_id = it->second.ids;
+    res.centroids = it->second.centroids;
 
     return true;
 
@@ -522,27 +535,19 @@ bool ObjectManager<PointType>::dynamicObjectsServiceCallback(DynamicObjectsServi
 template <class PointType>
 bool ObjectManager<PointType>::getDynamicObject(std::string waypoint, std::string object_id, DynamicObject::Ptr& object, std::string& object_observation)
 {
-    auto it =  m_waypointToObjMap.find(waypoint);
-    if (it == m_waypointToObjMap.end() )
+    if (m_objectIndex.getObservation(waypoint) == "")
     {
         ROS_ERROR_STREAM("No objects loaded for waypoint "+waypoint);
         return false;
     }
 
-    std::vector<DynamicObject::Ptr> objects = m_waypointToObjMap[waypoint];
-    bool found = false;
-    for (auto objectStruct : objects)
-    {
-        if (objectStruct->m_label == object_id)
-        {
-            found = true;
-            object = objectStruct;
-            object_observation = m_waypointToSweepFileMap[waypoint];
-            break;
-        }
-    }
-    if(!found)
+    // the object is about to be viewed -> its additional views are needed when it is saved again
+    DynamicObject::Ptr indexed = m_objectIndex.getObject(waypoint, object_id, true);
+    if (indexed)
     {
+        object = indexed;
+        object_observation = m_objectIndex.getObservation(waypoint);
+    } else {
         ROS_ERROR_STREAM("Object "<<object_id<<" at waypoint "<<waypoint<<" could not be found.");
     }
     return true;
@@ -643,9 +648,8 @@ bool ObjectManager<PointType>::processDynamicObjectServiceCallback(ProcessDynami
 
     // views
     for (auto obj_view : processed_object.vAdditionalViews){
-        sensor_msgs::PointCloud2 view_msg;
-        pcl::toROSMsg(*obj_view, view_msg);
-        tracking_data_msg.additional_views.push_back(view_msg);
+        tracking_data_msg.additional_views.push_back(sensor_msgs::PointCloud2());
+        cloud_msg_utilities::toROSMsg(*obj_view, tracking_data_msg.additional_views.back());
     }
 
     // transforms
@@ -696,7 +700,6 @@ bool ObjectManager<PointType>::getDynamicObjectServiceCallback(GetDynamicObjectS
 
     using namespace std;
 
-    std::vector<DynamicObject::Ptr> currentObjects;
     bool objects_found = updateObjectsAtWaypoint(req.waypoint_id);
     if (!objects_found)
     {
@@ -704,7 +707,7 @@ bool ObjectManager<PointType>::getDynamicObjectServiceCallback(GetDynamicObjectS
     }
 
     GetObjStruct object;
-    bool found =returnObjectMask(req.waypoint_id, req.object_id,m_waypointToSweepFileMap[req.waypoint_id], object);
+    bool found =returnObjectMask(req.waypoint_id, req.object_id,m_objectIndex.getObservation(req.waypoint_id), object);
     if (!found)
     {
         ROS_ERROR_STREAM("Could not compute mask for object id "<<req.object_id);
@@ -713,7 +716,7 @@ bool ObjectManager<PointType>::getDynamicObjectServiceCallback(GetDynamicObjectS
 
     res.object_mask = object.object_indices;
     tf::transformTFToMsg(object.transform_to_map, res.transform_to_map);
-    pcl::toROSMsg(*object.object_cloud, res.object_cloud);
+    cloud_msg_utilities::toROSMsg(*object.object_cloud, res.object_cloud);
     res.object_cloud.header.frame_id="/map";
     res.pan_angle = -object.pan_angle;
     res.tilt_angle = -object.tilt_angle;
@@ -747,68 +750,30 @@ template <class PointType>
 bool ObjectManager<PointType>::updateObjectsAtWaypoint(std::string waypoint_id)
 {
     using namespace std;
-    std::vector<std::string> matchingObservations = semantic_map_load_utilties::getSweepXmlsForTopologicalWaypoint<PointType>(m_dataFolder, waypoint_id);
-    if (matchingObservations.size() == 0)
+    // only the observations and object xmls that are new or changed since the last call are parsed
+    string latest = m_objectIndex.getLatestObservation(waypoint_id);
+    if (latest == "")
     {
         ROS_INFO_STREAM("No observations for this waypoint "<<waypoint_id);
         return false;
     }
 
-    ROS_INFO_STREAM("Found "<<matchingObservations.size()<<" matching observations.");
-
-    //    sort(matchingObservations.begin(), matchingObservations.end());
-
-
-    reverse(matchingObservations.begin(), matchingObservations.end());
-    string latest = matchingObservations[0];
-
     ROS_INFO_STREAM("Latest observation "<<latest);
 
-    auto it = m_waypointToSweepFileMap.find(waypoint_id);
-    if (it == m_waypointToSweepFileMap.end())
+    if (m_objectIndex.update(waypoint_id, latest))
     {
-        // no dynamic clusters loaded for this waypoint
-        // -> load them
-        std::vector<DynamicObject::Ptr> dynamicObjects = loadDynamicObjectsFromObservation(latest);
-        if (dynamicObjects.size() == 0)
-        {
-            ROS_INFO_STREAM("No objects detected after clustering.");
-            return false;
-        }
-
-        m_waypointToSweepFileMap[waypoint_id] = latest;
-        m_waypointToObjMap[waypoint_id] = dynamicObjects;
-    } else {
-        if (m_waypointToSweepFileMap[waypoint_id] != latest)
-        {
-            ROS_INFO_STREAM("Older point cloud loaded in memory. Loading objects from latest observation ...");
-            std::vector<DynamicObject::Ptr> dynamicObjects = loadDynamicObjectsFromObservation(latest);
-            if (dynamicObjects.size() == 0)
-            {
-                ROS_INFO_STREAM("No objects detected after clustering.");
-                return false;
-            }
-
-            m_waypointToSweepFileMap[waypoint_id] = latest;
-            m_waypointToObjMap[waypoint_id] = dynamicObjects;
-        } else {
-            ROS_INFO_STREAM("Objects loaded in memory");
-            auto it2 =  m_waypointToObjMap.find(waypoint_id);
-            if (it2 == m_waypointToObjMap.end())
-            {
-                ROS_ERROR_STREAM("Object map is empty. Reload.");
-                std::vector<DynamicObject::Ptr> dynamicObjects = loadDynamicObjectsFromObservation(latest);
-                if (dynamicObjects.size() == 0)
-                {
-                    ROS_INFO_STREAM("No objects detected after clustering.");
-                    return false;
-                }
+        ROS_INFO_STREAM("Objects loaded in memory");
+        return true;
+    }
 
-                m_waypointToSweepFileMap[waypoint_id] = latest;
-                m_waypointToObjMap[waypoint_id] = dynamicObjects;
-            }
-        }
+    // no objects saved for this observation yet -> compute them
+    std::vector<DynamicObject::Ptr> dynamicObjects = loadDynamicObjectsFromObservation(latest);
+    if (dynamicObjects.size() == 0)
+    {
+        ROS_INFO_STREAM("No objects detected after clustering.");
+        return false;
     }
+    m_objectIndex.setObjects(waypoint_id, latest, dynamicObjects);
 
     return true;
 }
@@ -907,27 +872,14 @@ std::vector<DynamicObject::Ptr>  ObjectManager<PointType>::loadDynamicObjectsFro
 template <class PointType>
 bool ObjectManager<PointType>::returnObjectMask(std::string waypoint, std::string object_id, std::string observation_xml, GetObjStruct& returned_object)
 {
-    auto it =  m_waypointToObjMap.find(waypoint);
-    if (it == m_waypointToObjMap.end() )
+    if (m_objectIndex.getObservation(waypoint) == "")
     {
         ROS_ERROR_STREAM("No objects loaded for waypoint "+waypoint);
         return false;
     }
 
-    std::vector<DynamicObject::Ptr> objects = m_waypointToObjMap[waypoint];
-    DynamicObject::Ptr object;
-    bool found = false;
-    for (auto objectStruct : objects)
-    {
-        if (objectStruct->m_label == object_id)
-        {
-            found = true;
-            object = objectStruct;
-            break;
-        }
-    }
-
-    if (!found)
+    DynamicObject::Ptr object = m_objectIndex.getObject(waypoint, object_id);
+    if (!object)
     {
         ROS_ERROR_STREAM("Cannot find object "+object_id+" at waypoint "+waypoint);
         return false;
@@ -0,0 +1,116 @@
+/**
+ * Compares the additional view masks computed with the kdtree and the projection methods of the
+ * dynamic_object_compute_mask_server on recorded sweeps.
+ *
+ * compare_object_masks /path/to/sweeps [neighbor_distance] [closing_kernel_size]
+ *
+ * For every dynamic object with additional views found in the sweeps, the object cloud is masked in each additional
+ * view with both methods. The number of masked pixels, the overlap (IoU) of the two masks and the time taken by each
+ * method are reported per view and averaged over all the views.
+ */
+#include <ros/ros.h>
+#include <pcl_ros/transforms.h>
+#include <pcl/common/time.h>
+#include <metaroom_xml_parser/load_utilities.h>
+#include <metaroom_xml_parser/lazy_room.h>
+#include <object_manager/dynamic_object_mask.h>
+
+typedef pcl::PointXYZRGB PointType;
+typedef semantic_map_load_utilties::DynamicObjectData<PointType> ObjectData;
+typedef pcl::PointCloud<PointType> Cloud;
+typedef typename Cloud::Ptr CloudPtr;
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout<<"Usage: compare_object_masks /path/to/sweeps [neighbor_distance] [closing_kernel_size]"<<endl;
+        return -1;
+    }
+    string folder = argv[1];
+    double neighbor_distance = argc > 2 ? atof(argv[2]) : 0.001;
+    int closing_kernel_size = argc > 3 ? atoi(argv[3]) : 5;
+    double depth_tolerance = sqrt(neighbor_distance);
+
+    vector<string> sweep_xmls = semantic_map_load_utilties::getSweepXmls<PointType>(folder);
+    ROS_INFO_STREAM("Found "<<sweep_xmls.size()<<" sweeps in "<<folder);
+
+    int total_views = 0;
+    double total_iou = 0.0, total_kdtree_time = 0.0, total_projection_time = 0.0;
+    for (const string& sweep_xml : sweep_xmls)
+    {
+        string sweep_folder = sweep_xml.substr(0, sweep_xml.find_last_of("/")+1);
+        vector<ObjectData> objects = semantic_map_load_utilties::loadAllDynamicObjectsFromSingleSweep<PointType>(sweep_folder);
+        if (!objects.size())
+        {
+            continue;
+        }
+
+        LazyRoom<PointType> observation(sweep_xml);
+        const auto& observation_data = observation.getMetadata();
+        if (!observation_data.vIntermediateRoomCloudCamParams.size())
+        {
+            ROS_ERROR_STREAM("No camera parameters found for "<<sweep_xml);
+            continue;
+        }
+        image_geometry::PinholeCameraModel camParams = observation_data.vIntermediateRoomCloudCamParamsCorrected.size() ?
+                    observation_data.vIntermediateRoomCloudCamParamsCorrected[0] : observation_data.vIntermediateRoomCloudCamParams[0];
+
+        for (size_t j=0; j<objects.size(); j++)
+        {
+            ObjectData& object = objects[j];
+            if (!object.objectCloud || !object.vAdditionalViews.size() ||
+                    (object.vAdditionalViewsTransformsRegistered.size() != object.vAdditionalViews.size()))
+            {
+                continue;
+            }
+            // object in the observation frame, as in the mask server
+            CloudPtr object_cloud(new Cloud);
+            pcl::transformPointCloud(*object.objectCloud, *object_cloud, Eigen::Matrix4f(observation_data.roomTransform.inverse()));
+
+            for (size_t i=0; i<object.vAdditionalViews.size(); i++)
+            {
+                if (object.vAdditionalViews[i]->height <= 1)
+                {
+                    ROS_INFO_STREAM("Skipping unorganized view "<<i<<" of object "<<j<<" in "<<sweep_xml);
+                    continue;
+                }
+                tf::Transform view_pose = object.additionalViewsTransformToObservation * object.vAdditionalViewsTransformsRegistered[i];
+                CloudPtr registered_view(new Cloud);
+                pcl_ros::transformPointCloud(*object.vAdditionalViews[i], *registered_view, view_pose);
+
+                cv::Mat kdtree_image, projection_image;
+                vector<int> kdtree_indices, projection_indices;
+                pcl::StopWatch timer;
+                dynamic_object_mask_utilities::computeMaskUsingKdTree(registered_view, object_cloud, kdtree_image, kdtree_indices, neighbor_distance);
+                double kdtree_time = timer.getTime();
+                timer.reset();
+                dynamic_object_mask_utilities::computeMaskUsingProjection(object.vAdditionalViews[i], view_pose, object_cloud, camParams,
+                                                                          projection_image, projection_indices, depth_tolerance, closing_kernel_size);
+                double projection_time = timer.getTime();
+
+                dynamic_object_mask_utilities::MaskComparison comparison = dynamic_object_mask_utilities::compareMasks(kdtree_indices, projection_indices);
+                cout<<sweep_xml<<" object "<<j<<" view "<<i<<" kdtree "<<comparison.first_pixels<<" px "<<kdtree_time<<" ms projection "
+                   <<comparison.second_pixels<<" px "<<projection_time<<" ms common "<<comparison.common_pixels<<" IoU "<<comparison.intersectionOverUnion()<<endl;
+
+                total_views++;
+                total_iou += comparison.intersectionOverUnion();
+                total_kdtree_time += kdtree_time;
+                total_projection_time += projection_time;
+            }
+        }
+        observation.release();
+    }
+
+    if (total_views)
+    {
+        cout<<"Average over "<<total_views<<" views: IoU "<<total_iou / total_views<<" kdtree "<<total_kdtree_time / total_views
+           <<" ms projection "<<total_projection_time / total_views<<" ms"<<endl;
+    } else {
+        cout<<"No dynamic objects with additional views found."<<endl;
+    }
+
+    return 0;
+}
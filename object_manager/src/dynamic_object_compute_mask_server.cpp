@@ -15,6 +15,7 @@
 #include <pcl/features/normal_3d_omp.h>
 #include <object_manager/dynamic_object_xml_parser.h>
 #include <std_msgs/Float32.h>
+#include <object_manager/dynamic_object_mask.h>
 
 #include <observation_registration_services/ProcessRegisteredViews.h>
 #include <observation_registration_services/ObservationRegistrationService.h>
@@ -31,12 +32,11 @@ ros::ServiceClient surfel_client;
 ros::ServiceClient registration_client;
 pcl::visualization::PCLVisualizer *p;
 std::string g_segmentation_method;
+std::string g_mask_method;
+int g_mask_closing_kernel_size;
 
 std::vector<CloudPtr> compute_convex_segmentation(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud_normals);
 
-CloudPtr compute_mask_per_view_from_object(CloudPtr view, CloudPtr object,
-                                           cv::Mat& mask_image, vector<int>& mask_indices, double neighbor_distance);
-
 
 CloudPtr find_object_using_metaroom(std::string sweep_xml, std::string object_xml, CloudPtr registered_views_cloud, CloudPtr object_cloud, const double& cluster_tolerance);
 CloudPtr find_object_using_conv_seg(CloudPtr reg_views_at_origin, pcl::PointCloud<pcl::Normal>::Ptr reg_views_at_origin_normals, CloudPtr object_cloud_at_origin);
@@ -182,26 +182,35 @@ bool dynamic_object_compute_mask_service(
     }
 
     // compute the mask per view
-    CloudPtr prev_mask(new Cloud);
-    ROS_INFO_STREAM("Computing masks for the additional views");
-    for (size_t i=0; i<registered_object_views.size(); i++ ){
-        ROS_INFO_STREAM("Computing masks for the additional view "<<i);
-        CloudPtr registered_view(new Cloud);
-        *registered_view = *registered_object_views[i];
-
-        cv::Mat mask_image;
-        vector<int> mask_indices;
-        double neighbor_distance = 0.001;
-        if (g_segmentation_method != "meta_room"){
-            neighbor_distance = 0.00025;
+    ROS_INFO_STREAM("Computing masks for the additional views using the "<<g_mask_method<<" method");
+    double neighbor_distance = 0.001;
+    if (g_segmentation_method != "meta_room"){
+        neighbor_distance = 0.00025;
+    }
+    // the views are taken with the same camera as the observation
+    // the squared neighbor distance of the kdtree method doubles as depth tolerance for the projection method
+    double depth_tolerance = sqrt(neighbor_distance);
+    vector<cv::Mat> mask_images(registered_object_views.size());
+    vector<vector<int>> mask_indices(registered_object_views.size());
+    int nr_views = registered_object_views.size();
+#pragma omp parallel for schedule(dynamic)
+    for (int i=0; i<nr_views; i++ ){
+        if ((g_mask_method == "projection") && (object.vAdditionalViews[i]->height > 1)){
+            tf::Transform view_pose = object.additionalViewsTransformToObservation * object.vAdditionalViewsTransformsRegistered[i];
+            dynamic_object_mask_utilities::computeMaskUsingProjection(object.vAdditionalViews[i], view_pose, segmented_object_cloud, camParams,
+                                                                      mask_images[i], mask_indices[i], depth_tolerance, g_mask_closing_kernel_size);
+        } else {
+            dynamic_object_mask_utilities::computeMaskUsingKdTree(registered_object_views[i], segmented_object_cloud,
+                                                                  mask_images[i], mask_indices[i], neighbor_distance);
         }
-        CloudPtr mask = compute_mask_per_view_from_object(registered_view, segmented_object_cloud, mask_image, mask_indices, neighbor_distance);
         //        // visualize mask image
-//        ROS_INFO_STREAM("Mask no indices "<<mask_indices.size());
-//        cv::imshow( "Display window", mask_image );
+//        ROS_INFO_STREAM("Mask no indices "<<mask_indices[i].size());
+//        cv::imshow( "Display window", mask_images[i] );
 //        cv::waitKey(0);
-
-        original_object->addAdditionalViewMask(mask_image, mask_indices);
+    }
+    for (size_t i=0; i<registered_object_views.size(); i++ ){
+        ROS_INFO_STREAM("Additional view "<<i<<" mask has "<<mask_indices[i].size()<<" pixels");
+        original_object->addAdditionalViewMask(mask_images[i], mask_indices[i]);
     }
     std::string xml_file = parser.saveAsXML(original_object);
     ROS_INFO_STREAM("Object saved at "<<xml_file);
@@ -223,6 +232,8 @@ int main(int argc, char **argv)
     surfel_client = n.serviceClient<observation_registration_services::ProcessRegisteredViews>("/surfelize_server");
     registration_client = n.serviceClient<observation_registration_services::ObservationRegistrationService>("/observation_registration_server");
     n_private.param<string>("segmentation_method",g_segmentation_method,"meta_room");
+    n_private.param<string>("mask_method",g_mask_method,"kdtree");
+    n_private.param<int>("mask_closing_kernel_size",g_mask_closing_kernel_size,5);
 //    g_segmentation_method = "convex_segmentation";
 //    g_segmentation_method = "meta_room";
 
@@ -234,78 +245,19 @@ int main(int argc, char **argv)
      if (g_segmentation_method != "convex_segmentation"){
              g_segmentation_method = "meta_room";
      }
+     if (g_mask_method != "projection"){
+             g_mask_method = "kdtree";
+     }
 
     ROS_INFO("dynamic_object_compute_mask_server started.");
     ROS_INFO_STREAM("Object segmentation method is "<<g_segmentation_method);
+    ROS_INFO_STREAM("Object mask method is "<<g_mask_method);
     ros::spin();
 
     return 0;
 }
 
 
-CloudPtr compute_mask_per_view_from_object(CloudPtr view, CloudPtr object,
-                                           cv::Mat& mask_image, vector<int>& mask_indices, double neighbor_distance){
-    using namespace std;
-    // mask image -> empty by default
-    mask_image = cv::Mat::zeros(480, 640, CV_8UC3);
-    CloudPtr mask(new Cloud);
-    if (!object->points.size()){
-        ROS_ERROR_STREAM("Could not find mask. The segmented object has 0 points.");
-        return mask;
-    }
-
-    // compute mask
-    // find indices in original point cloud
-    std::vector<int> nn_indices (1);
-    std::vector<float> nn_distances (1);
-    typename pcl::search::KdTree<PointType>::Ptr tree (new pcl::search::KdTree<PointType>);
-    tree->setInputCloud (object);
-
-    // Iterate through the source data set
-    for (int i = 0; i < static_cast<int> (view->points.size ()); ++i)
-    {
-        if (!isFinite (view->points[i]))
-            continue;
-        // Search for the closest point in the target data set (number of neighbors to find = 1)
-        if (!tree->nearestKSearch (view->points[i], 1, nn_indices, nn_distances))
-        {
-            PCL_WARN ("No neighbor found for point %zu (%f %f %f)!\n", i, view->points[i].x, view->points[i].y, view->points[i].z);
-            continue;
-        }
-
-        if (nn_distances[0] < neighbor_distance)
-        {
-            mask_indices.push_back (i);
-            mask->push_back(object->points[nn_indices[0]]);
-        }
-    }
-
-    // create mask image
-    for (int index : mask_indices)
-    {
-        pcl::PointXYZRGB point = view->points[index];
-        int y = index / mask_image.cols;
-        int x = index % mask_image.cols;
-        mask_image.at<cv::Vec3b>(y, x)[0] = point.b;
-        mask_image.at<cv::Vec3b>(y, x)[1] = point.g;
-        mask_image.at<cv::Vec3b>(y, x)[2] = point.r;
-    }
-
-    // visualize
-//    {
-//        pcl::visualization::PointCloudColorHandlerCustom<PointType> view_handler(view, 255, 0,0);
-//        p->addPointCloud (view,view_handler,"view");
-//        pcl::visualization::PointCloudColorHandlerCustom<PointType> object_handler(object, 0, 255, 0);
-//        p->addPointCloud (object,object_handler,"object");
-//        pcl::visualization::PointCloudColorHandlerCustom<PointType> mask_handler(mask, 0, 255, 255);
-//        p->addPointCloud (mask,mask_handler,"mask");
-//        p->spin();
-//        p->removeAllPointClouds();
-//    }
-
-
-}
-
 std::vector<CloudPtr> compute_convex_segmentation(CloudPtr cloud, pcl::PointCloud<pcl::Normal>::Ptr normals){
 
     using Graph = supervoxel_segmentation::Graph;
@@ -0,0 +1,338 @@
+#include "object_manager/dynamic_object_index.h"
+
+#include <time.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include <QDir>
+#include <metaroom_xml_parser/simple_xml_parser.h>
+
+using namespace std;
+
+namespace
+{
+    int64_t getCurrentTime()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        return int64_t(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    }
+
+    std::string joinPath(const std::string& folder, const std::string& name)
+    {
+        if (folder.size() && (folder[folder.size()-1] == '/'))
+        {
+            return folder + name;
+        }
+        return folder + "/" + name;
+    }
+}
+
+DynamicObjectIndex::DynamicObjectIndex(std::string dataFolder, bool verbose) : m_dataFolder(dataFolder), m_bVerbose(verbose), m_generation(0)
+{
+
+}
+
+int64_t DynamicObjectIndex::getModificationTime(std::string path)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return -1;
+    }
+    return int64_t(info.st_mtim.tv_sec) * 1000000000LL + info.st_mtim.tv_nsec;
+}
+
+bool DynamicObjectIndex::observationLess(const std::string& a, const std::string& b)
+{
+    // same order as semantic_map_load_utilties::getSweepXmlsForTopologicalWaypoint: date, patrol run and room number
+    // of .../YYYYMMDD/patrol_run_#/room_#/room.xml
+    std::string patrol_string = "patrol_run_";
+    std::string room_string = "/room_";
+    size_t date_length = 8;
+    size_t p_pos_a = a.find(patrol_string), r_pos_a = a.find(room_string);
+    size_t p_pos_b = b.find(patrol_string), r_pos_b = b.find(room_string);
+
+    // just in case we have some different folder structure
+    if ((p_pos_a == std::string::npos) || (r_pos_a == std::string::npos) || (p_pos_a < date_length + 1) ||
+            (p_pos_b == std::string::npos) || (r_pos_b == std::string::npos) || (p_pos_b < date_length + 1))
+    {
+        return a<b;
+    }
+
+    std::string d_a = a.substr(p_pos_a - date_length - 1, date_length);
+    std::string d_b = b.substr(p_pos_b - date_length - 1, date_length);
+    if (d_a != d_b)
+    {
+        return d_a < d_b;
+    }
+    int p_a = atoi(a.c_str() + p_pos_a + patrol_string.length());
+    int p_b = atoi(b.c_str() + p_pos_b + patrol_string.length());
+    if (p_a != p_b)
+    {
+        return p_a < p_b;
+    }
+    int r_a = atoi(a.c_str() + r_pos_a + room_string.length());
+    int r_b = atoi(b.c_str() + r_pos_b + room_string.length());
+    if (r_a != r_b)
+    {
+        return r_a < r_b;
+    }
+    return a<b;
+}
+
+void DynamicObjectIndex::updateFolder(std::string folder, int depth, std::vector<std::string>& observations)
+{
+    int64_t folderTime = getModificationTime(folder);
+    if ((depth > 10) || (folderTime == -1))
+    {
+        m_folders.erase(folder);
+        return;
+    }
+
+    // a folder changes when entries are added to or removed from it. It is listed again if it changed less than a
+    // second before it was last listed, in case of a coarse timestamp.
+    FolderEntry& entry = m_folders[folder];
+    if ((folderTime != entry.folderTime) || (entry.listTime - folderTime <= 1000000000LL))
+    {
+        entry.folderTime = folderTime;
+        entry.listTime = getCurrentTime();
+
+        QDir qfolder(folder.c_str());
+        entry.hasRoomXml = qfolder.exists("room.xml");
+
+        std::vector<std::string> subfolders;
+        QStringList childFolders = qfolder.entryList(QStringList("*"), QDir::Dirs | QDir::NoSymLinks | QDir::NoDotAndDotDot);
+        for (QString childFolder : childFolders)
+        {
+            if (childFolder.indexOf(QString("vocabulary")) == -1) // avoid vocabulary tree folders
+            {
+                subfolders.push_back(joinPath(folder, childFolder.toStdString()));
+            }
+        }
+
+        // forget the folders which were removed, with everything below them
+        for (const std::string& subfolder : entry.subfolders)
+        {
+            if (std::find(subfolders.begin(), subfolders.end(), subfolder) == subfolders.end())
+            {
+                m_folders.erase(subfolder);
+                m_folders.erase(m_folders.lower_bound(subfolder + "/"), m_folders.lower_bound(subfolder + "0")); // '0' follows '/'
+            }
+        }
+        entry.subfolders.swap(subfolders);
+    }
+
+    if (entry.hasRoomXml)
+    {
+        observations.push_back(joinPath(folder, "room.xml"));
+    }
+
+    std::vector<std::string> subfolders = entry.subfolders;
+    for (const std::string& subfolder : subfolders)
+    {
+        updateFolder(subfolder, depth+1, observations);
+    }
+}
+
+std::string DynamicObjectIndex::getLatestObservation(std::string waypoint)
+{
+    std::vector<std::string> observationXmls;
+    updateFolder(m_dataFolder, 0, observationXmls);
+
+    std::map<std::string, ObservationEntry> observations;
+    std::string latest = "";
+    int parsed = 0;
+    for (const std::string& xml : observationXmls)
+    {
+        int64_t xmlTime = getModificationTime(xml);
+        auto it = m_observations.find(xml);
+        ObservationEntry& observation = observations[xml];
+        if ((it != m_observations.end()) && (it->second.xmlTime == xmlTime))
+        {
+            observation = it->second;
+        } else {
+            auto room = SimpleXMLParser<pcl::PointXYZRGB>::loadRoomFromXML(xml, std::vector<std::string>(), false, false);
+            observation.xmlTime = xmlTime;
+            observation.waypoint = room.roomWaypointId;
+            parsed++;
+        }
+
+        if ((observation.waypoint == waypoint) && ((latest == "") || observationLess(latest, xml)))
+        {
+            latest = xml;
+        }
+    }
+    m_observations.swap(observations);
+
+    if (m_bVerbose)
+    {
+        cout<<"Indexed "<<m_observations.size()<<" observations, parsed "<<parsed<<". Latest observation at "<<waypoint<<": "<<latest<<endl;
+    }
+    return latest;
+}
+
+DynamicObjectIndex::WaypointEntry& DynamicObjectIndex::resetWaypoint(std::string waypoint, std::string observationXml)
+{
+    WaypointEntry& entry = m_waypoints[waypoint];
+    entry.observationXml = observationXml;
+    entry.observationFolder = observationXml.substr(0, observationXml.find_last_of("/"));
+    entry.folderTime = -1;
+    entry.listTime = -1;
+    entry.objects.clear();
+    entry.generation = ++m_generation;
+    return entry;
+}
+
+bool DynamicObjectIndex::update(std::string waypoint, std::string observationXml)
+{
+    auto it = m_waypoints.find(waypoint);
+    WaypointEntry& entry = ((it == m_waypoints.end()) || (it->second.observationXml != observationXml)) ? resetWaypoint(waypoint, observationXml) : it->second;
+
+    // objects are added, removed and saved again by (re)creating their xml, all of which changes the folder. The folder
+    // is listed again if it changed less than a second before it was last listed, in case of a coarse timestamp.
+    int64_t folderTime = getModificationTime(entry.observationFolder);
+    if ((folderTime != -1) && (folderTime == entry.folderTime) && (entry.listTime - folderTime > 1000000000LL))
+    {
+        return entry.objects.size() != 0;
+    }
+
+    int64_t listTime = getCurrentTime();
+    QStringList objectFiles = QDir(entry.observationFolder.c_str()).entryList(QStringList("*object*.xml"));
+
+    std::map<std::string, size_t> previous;
+    for (size_t i=0; i<entry.objects.size(); i++)
+    {
+        previous[entry.objects[i].xmlFile] = i;
+    }
+
+    std::vector<ObjectEntry> objects;
+    bool changed = (size_t(objectFiles.size()) != entry.objects.size());
+    for (QString objectFile : objectFiles)
+    {
+        std::string xml = joinPath(entry.observationFolder, objectFile.toStdString());
+        int64_t xmlTime = getModificationTime(xml);
+        auto it_previous = previous.find(xml);
+        if ((it_previous != previous.end()) && (entry.objects[it_previous->second].xmlTime == xmlTime))
+        {
+            objects.push_back(entry.objects[it_previous->second]);
+            continue;
+        }
+
+        changed = true;
+        ObjectEntry object;
+        object.xmlFile = xml;
+        object.xmlTime = xmlTime;
+        DynamicObjectXMLParser parser(entry.observationFolder, m_bVerbose);
+        object.object = parser.loadFromXML(xml, false);
+        objects.push_back(object);
+    }
+
+    entry.objects.swap(objects);
+    entry.folderTime = folderTime;
+    entry.listTime = listTime;
+    if (changed)
+    {
+        entry.generation = ++m_generation;
+        if (m_bVerbose)
+        {
+            cout<<"Indexed "<<entry.objects.size()<<" objects at "<<waypoint<<" from "<<entry.observationFolder<<endl;
+        }
+    }
+
+    return entry.objects.size() != 0;
+}
+
+void DynamicObjectIndex::setObjects(std::string waypoint, std::string observationXml, const std::vector<DynamicObject::Ptr>& objects)
+{
+    WaypointEntry& entry = resetWaypoint(waypoint, observationXml);
+    for (DynamicObject::Ptr object : objects)
+    {
+        ObjectEntry objectEntry;
+        objectEntry.xmlFile = joinPath(entry.observationFolder, object->m_label + ".xml");
+        objectEntry.xmlTime = getModificationTime(objectEntry.xmlFile);
+        objectEntry.object = object;
+        objectEntry.cloudLoaded = true;
+        objectEntry.viewsLoaded = true;
+        entry.objects.push_back(objectEntry);
+    }
+    entry.listTime = getCurrentTime();
+    entry.folderTime = getModificationTime(entry.observationFolder);
+}
+
+void DynamicObjectIndex::loadCloud(WaypointEntry& waypoint, ObjectEntry& entry)
+{
+    DynamicObjectXMLParser parser(waypoint.observationFolder, m_bVerbose);
+    entry.object = parser.loadFromXML(entry.xmlFile, true, false);
+    entry.cloudLoaded = true;
+    entry.viewsLoaded = false;
+}
+
+std::vector<DynamicObject::Ptr> DynamicObjectIndex::getObjects(std::string waypoint)
+{
+    std::vector<DynamicObject::Ptr> objects;
+    auto it = m_waypoints.find(waypoint);
+    if (it == m_waypoints.end())
+    {
+        return objects;
+    }
+
+    for (ObjectEntry& entry : it->second.objects)
+    {
+        if (!entry.cloudLoaded)
+        {
+            loadCloud(it->second, entry);
+        }
+        objects.push_back(entry.object);
+    }
+    return objects;
+}
+
+DynamicObject::Ptr DynamicObjectIndex::getObject(std::string waypoint, std::string label, bool loadAdditionalViews)
+{
+    auto it = m_waypoints.find(waypoint);
+    if (it == m_waypoints.end())
+    {
+        return DynamicObject::Ptr();
+    }
+
+    for (ObjectEntry& entry : it->second.objects)
+    {
+        if (entry.object->m_label != label)
+        {
+            continue;
+        }
+        if (!entry.cloudLoaded)
+        {
+            loadCloud(it->second, entry);
+        }
+        if (loadAdditionalViews && !entry.viewsLoaded)
+        {
+            DynamicObjectXMLParser parser(it->second.observationFolder, m_bVerbose);
+            parser.loadAdditionalViews(entry.object, it->second.observationFolder);
+            entry.viewsLoaded = true;
+        }
+        return entry.object;
+    }
+    return DynamicObject::Ptr();
+}
+
+std::string DynamicObjectIndex::getObservation(std::string waypoint) const
+{
+    auto it = m_waypoints.find(waypoint);
+    return (it == m_waypoints.end()) ? "" : it->second.observationXml;
+}
+
+int DynamicObjectIndex::getGeneration(std::string waypoint) const
+{
+    auto it = m_waypoints.find(waypoint);
+    return (it == m_waypoints.end()) ? -1 : it->second.generation;
+}
+
+void DynamicObjectIndex::clear()
+{
+    m_folders.clear();
+    m_observations.clear();
+    m_waypoints.clear();
+}
@@ -0,0 +1,165 @@
+#include "object_manager/dynamic_object_mask.h"
+
+#include <limits>
+#include <algorithm>
+#include <ros/ros.h>
+#include <pcl_ros/transforms.h>
+#include <pcl/search/kdtree.h>
+
+using namespace std;
+
+namespace
+{
+    // organized views keep their resolution, unorganized ones are assumed to be 640x480 scans
+    cv::Mat createEmptyMask(dynamic_object_mask_utilities::CloudPtr view)
+    {
+        if (view->height > 1)
+        {
+            return cv::Mat::zeros(view->height, view->width, CV_8UC3);
+        }
+        return cv::Mat::zeros(480, 640, CV_8UC3);
+    }
+
+    void colorMask(dynamic_object_mask_utilities::CloudPtr view, const vector<int>& mask_indices, cv::Mat& mask_image)
+    {
+        for (int index : mask_indices)
+        {
+            const pcl::PointXYZRGB& point = view->points[index];
+            int y = index / mask_image.cols;
+            int x = index % mask_image.cols;
+            mask_image.at<cv::Vec3b>(y, x)[0] = point.b;
+            mask_image.at<cv::Vec3b>(y, x)[1] = point.g;
+            mask_image.at<cv::Vec3b>(y, x)[2] = point.r;
+        }
+    }
+}
+
+dynamic_object_mask_utilities::CloudPtr dynamic_object_mask_utilities::computeMaskUsingKdTree(CloudPtr view, CloudPtr object, cv::Mat& mask_image, vector<int>& mask_indices, double neighbor_distance)
+{
+    // mask image -> empty by default
+    mask_image = createEmptyMask(view);
+    CloudPtr mask(new Cloud);
+    if (!object->points.size()){
+        ROS_ERROR_STREAM("Could not find mask. The segmented object has 0 points.");
+        return mask;
+    }
+
+    // compute mask
+    // find indices in original point cloud
+    std::vector<int> nn_indices (1);
+    std::vector<float> nn_distances (1);
+    pcl::search::KdTree<PointType>::Ptr tree (new pcl::search::KdTree<PointType>);
+    tree->setInputCloud (object);
+
+    // Iterate through the source data set
+    for (int i = 0; i < static_cast<int> (view->points.size ()); ++i)
+    {
+        if (!pcl::isFinite (view->points[i]))
+            continue;
+        // Search for the closest point in the target data set (number of neighbors to find = 1)
+        if (!tree->nearestKSearch (view->points[i], 1, nn_indices, nn_distances))
+        {
+            PCL_WARN ("No neighbor found for point %d (%f %f %f)!\n", i, view->points[i].x, view->points[i].y, view->points[i].z);
+            continue;
+        }
+
+        if (nn_distances[0] < neighbor_distance)
+        {
+            mask_indices.push_back (i);
+            mask->push_back(object->points[nn_indices[0]]);
+        }
+    }
+
+    // create mask image
+    colorMask(view, mask_indices, mask_image);
+
+    return mask;
+}
+
+dynamic_object_mask_utilities::CloudPtr dynamic_object_mask_utilities::computeMaskUsingProjection(CloudPtr view, const tf::Transform& view_pose, CloudPtr object,
+                                                                                                  const image_geometry::PinholeCameraModel& cam_params,
+                                                                                                  cv::Mat& mask_image, vector<int>& mask_indices,
+                                                                                                  double depth_tolerance, int closing_kernel_size)
+{
+    mask_image = createEmptyMask(view);
+    CloudPtr mask(new Cloud);
+    if (!object->points.size()){
+        ROS_ERROR_STREAM("Could not find mask. The segmented object has 0 points.");
+        return mask;
+    }
+    if (view->height <= 1){
+        ROS_ERROR_STREAM("Could not find mask by projection. The view is not an organized point cloud.");
+        return mask;
+    }
+
+    const int width = view->width;
+    const int height = view->height;
+    const double fx = cam_params.fx(), fy = cam_params.fy();
+    const double cx = cam_params.cx(), cy = cam_params.cy();
+
+    // object in the camera frame of the view
+    Cloud object_in_view;
+    pcl_ros::transformPointCloud(*object, object_in_view, view_pose.inverse());
+
+    // z-test the projected object points against the depth of the view
+    cv::Mat hits = cv::Mat::zeros(height, width, CV_8UC1);
+    float min_depth = std::numeric_limits<float>::max();
+    float max_depth = -std::numeric_limits<float>::max();
+    for (const PointType& point : object_in_view.points)
+    {
+        if (!pcl::isFinite(point) || (point.z <= 0))
+            continue;
+        int u = (int)(fx * point.x / point.z + cx + 0.5);
+        int v = (int)(fy * point.y / point.z + cy + 0.5);
+        if ((u < 0) || (u >= width) || (v < 0) || (v >= height))
+            continue;
+        const PointType& view_point = view->points[v * width + u];
+        if (!pcl::isFinite(view_point) || (fabs(view_point.z - point.z) > depth_tolerance))
+            continue;
+        hits.at<uchar>(v, u) = 255;
+        min_depth = std::min(min_depth, view_point.z);
+        max_depth = std::max(max_depth, view_point.z);
+    }
+
+    // the object is usually sparser than the view -> fill the gaps between the projected points
+    cv::Mat closed = hits;
+    if (closing_kernel_size > 1)
+    {
+        cv::Mat kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(closing_kernel_size, closing_kernel_size));
+        cv::morphologyEx(hits, closed, cv::MORPH_CLOSE, kernel);
+    }
+
+    for (int v = 0; v < height; ++v)
+    {
+        const uchar* row = closed.ptr<uchar>(v);
+        for (int u = 0; u < width; ++u)
+        {
+            if (!row[u])
+                continue;
+            int index = v * width + u;
+            const PointType& view_point = view->points[index];
+            if (!pcl::isFinite(view_point) || (view_point.z < min_depth - depth_tolerance) || (view_point.z > max_depth + depth_tolerance))
+                continue;
+            mask_indices.push_back(index);
+            mask->push_back(view_point);
+        }
+    }
+
+    colorMask(view, mask_indices, mask_image);
+
+    return mask;
+}
+
+dynamic_object_mask_utilities::MaskComparison dynamic_object_mask_utilities::compareMasks(const vector<int>& first_mask_indices, const vector<int>& second_mask_indices)
+{
+    MaskComparison comparison;
+    vector<int> first = first_mask_indices, second = second_mask_indices;
+    std::sort(first.begin(), first.end());
+    std::sort(second.begin(), second.end());
+    vector<int> common;
+    std::set_intersection(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(common));
+    comparison.first_pixels = first.size();
+    comparison.second_pixels = second.size();
+    comparison.common_pixels = common.size();
+    return comparison;
+}
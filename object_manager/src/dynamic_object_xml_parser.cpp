@@ -1,6 +1,7 @@
 #include "object_manager/dynamic_object_xml_parser.h"
 
 #include <pcl/io/pcd_io.h>
+#include <stdint.h>
 
 using namespace std;
 
@@ -110,6 +111,11 @@ std::string DynamicObjectXMLParser::saveAsXML(DynamicObject::Ptr object, std::st
         }
         out.close();
     }
+    if (object->m_vAdditionalViewMaskIndices.size())
+    {
+        string masks_path = m_rootFolderPath + "/" + object->m_label + "_additional_view_masks.bin";
+        saveMaskIndicesBinary(masks_path, object->m_vAdditionalViewMaskIndices);
+    }
 
 
     // save object tracks
@@ -150,7 +156,7 @@ std::string DynamicObjectXMLParser::saveAsXML(DynamicObject::Ptr object, std::st
     return path;
 }
 
-DynamicObject::Ptr DynamicObjectXMLParser::loadFromXML(string filename, bool load_cloud)
+DynamicObject::Ptr DynamicObjectXMLParser::loadFromXML(string filename, bool load_cloud, bool load_additional_views)
 {
     DynamicObject::Ptr object(new DynamicObject());
     QFile file(filename.c_str());
@@ -242,7 +248,7 @@ DynamicObject::Ptr DynamicObjectXMLParser::loadFromXML(string filename, bool loa
                 if (attributes.hasAttribute("additionalViews"))
                 {
                     int additionalViews = attributes.value("additionalViews").toString().toInt();
-                    if (load_cloud)
+                    if (load_cloud && load_additional_views)
                     {
                         // load clouds
                         for (size_t i=0; i<additionalViews; i++)
@@ -346,12 +352,63 @@ DynamicObject::Ptr DynamicObjectXMLParser::loadFromXML(string filename, bool loa
         cout<<"Loaded object from: "<<filename<<endl;
     }
 
-    // load masks
+    loadAdditionalViewMasks(object, objectFolder.toStdString());
+
+    delete xmlReader;
+    return object;
+}
+
+void DynamicObjectXMLParser::loadAdditionalViews(DynamicObject::Ptr object, std::string objectFolder)
+{
+    int additionalViews = object->m_noAdditionalViews;
+    object->m_vAdditionalViews.clear();
+    object->m_noAdditionalViews = 0;
+    object->clearAdditionalViewMasks();
+
+    for (int i=0; i<additionalViews; i++)
+    {
+        stringstream ss;ss<<i;
+        string view_path = objectFolder + "/" + object->m_label + "_additional_view_"+ss.str()+".pcd";
+        pcl::PCDReader reader;
+        CloudPtr cloud (new Cloud);
+        reader.read (view_path, *cloud);
+        if (cloud->points.size() != 0)
+        {
+            object->addAdditionalView(cloud);
+            if (m_verbose)
+            {
+                std::cout<<"Loaded additional view cloud "<<view_path<<std::endl;
+            }
+        } else {
+            std::cerr<<"Could not load additional view cloud "<<view_path<<std::endl;
+        }
+    }
+
+    loadAdditionalViewMasks(object, objectFolder);
+}
+
+void DynamicObjectXMLParser::loadAdditionalViewMasks(DynamicObject::Ptr object, std::string objectFolder)
+{
+    if (!object->m_vAdditionalViews.size())
+    {
+        return;
+    }
+
+    // the binary file holds the indices of all the views, the text files are kept for the other readers of the object
+    std::vector<std::vector<int>> mask_indices;
+    string masks_path = objectFolder + "/" + object->m_label + "_additional_view_masks.bin";
+    bool binary_masks = loadMaskIndicesBinary(masks_path, mask_indices) && (mask_indices.size() >= object->m_vAdditionalViews.size());
+
     for (size_t i=0; i<object->m_vAdditionalViews.size();i++){
         stringstream ss;ss<<i;
-        string view_image_mask_path = objectFolder.toStdString() + "/" + object->m_label + "_additional_view_mask_image_"+ss.str()+".jpg";
+        string view_image_mask_path = objectFolder + "/" + object->m_label + "_additional_view_mask_image_"+ss.str()+".jpg";
         cv::Mat mask_image = cv::imread(view_image_mask_path.c_str());
-        string view_image_mask_indices_path = objectFolder.toStdString() + "/" + object->m_label + "_additional_view_mask_indices_"+ss.str()+".txt";
+        if (binary_masks)
+        {
+            object->addAdditionalViewMask(mask_image, mask_indices[i]);
+            continue;
+        }
+        string view_image_mask_indices_path = objectFolder + "/" + object->m_label + "_additional_view_mask_indices_"+ss.str()+".txt";
         ifstream in_file; in_file.open(view_image_mask_indices_path.c_str());
         int index;
         std::vector<int> indices;
@@ -361,9 +418,82 @@ DynamicObject::Ptr DynamicObjectXMLParser::loadFromXML(string filename, bool loa
         in_file.close();
         object->addAdditionalViewMask(mask_image, indices);
     }
+}
 
-    delete xmlReader;
-    return object;
+bool DynamicObjectXMLParser::saveMaskIndicesBinary(std::string filename, const std::vector<std::vector<int>>& mask_indices)
+{
+    // "DOMK", version, number of views, then the number of indices and the indices of every view (int32)
+    ofstream out(filename.c_str(), ios::out | ios::binary | ios::trunc);
+    if (!out.is_open())
+    {
+        std::cerr<<"Could not open file "<<filename<<" to save the object masks"<<std::endl;
+        return false;
+    }
+    const char magic[4] = {'D', 'O', 'M', 'K'};
+    int32_t version = 1, views = mask_indices.size();
+    out.write(magic, 4);
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&views), sizeof(views));
+    for (const std::vector<int>& indices : mask_indices)
+    {
+        std::vector<int32_t> values(indices.begin(), indices.end());
+        int32_t size = values.size();
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        if (size)
+        {
+            out.write(reinterpret_cast<const char*>(&values[0]), size * sizeof(int32_t));
+        }
+    }
+    return out.good();
+}
+
+bool DynamicObjectXMLParser::loadMaskIndicesBinary(std::string filename, std::vector<std::vector<int>>& mask_indices)
+{
+    mask_indices.clear();
+    ifstream in(filename.c_str(), ios::in | ios::binary | ios::ate);
+    if (!in.is_open())
+    {
+        return false;
+    }
+    // the sizes are checked against the rest of the file before anything is allocated
+    const int64_t file_length = in.tellg();
+    in.seekg(0, ios::beg);
+    char magic[4];
+    int32_t version = 0, views = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&views), sizeof(views));
+    if (!in.good() || (string(magic, 4) != "DOMK") || (version != 1) || (views < 0) ||
+            (int64_t(views) * int64_t(sizeof(int32_t)) > file_length - int64_t(in.tellg())))
+    {
+        std::cerr<<"Object masks file "<<filename<<" is not valid"<<std::endl;
+        return false;
+    }
+    mask_indices.resize(views);
+    for (int32_t i=0; i<views; i++)
+    {
+        int32_t size = 0;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        if (!in.good() || (size < 0) || (int64_t(size) * int64_t(sizeof(int32_t)) > file_length - int64_t(in.tellg())))
+        {
+            std::cerr<<"Object masks file "<<filename<<" is truncated"<<std::endl;
+            mask_indices.clear();
+            return false;
+        }
+        std::vector<int32_t> values(size);
+        if (size)
+        {
+            in.read(reinterpret_cast<char*>(&values[0]), size * sizeof(int32_t));
+        }
+        if (!in.good())
+        {
+            std::cerr<<"Object masks file "<<filename<<" is truncated"<<std::endl;
+            mask_indices.clear();
+            return false;
+        }
+        mask_indices[i].assign(values.begin(), values.end());
+    }
+    return true;
 }
 
 
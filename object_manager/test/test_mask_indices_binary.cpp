@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <iterator>
+#include <boost/filesystem.hpp>
+
+#include "object_manager/dynamic_object_xml_parser.h"
+
+namespace
+{
+    class MaskIndicesBinaryTest : public ::testing::Test
+    {
+    protected:
+        void SetUp()
+        {
+            m_folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("mask_indices_%%%%-%%%%");
+            boost::filesystem::create_directories(m_folder);
+            m_filename = (m_folder / "object_additional_view_masks.bin").string();
+
+            m_masks.push_back(std::vector<int>{0, 1, 2, 640, 307199});
+            m_masks.push_back(std::vector<int>());
+            m_masks.push_back(std::vector<int>{42});
+        }
+
+        void TearDown()
+        {
+            boost::filesystem::remove_all(m_folder);
+        }
+
+        std::string readFile()
+        {
+            std::ifstream in(m_filename.c_str(), std::ios::binary);
+            return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        }
+
+        void writeFile(const std::string& contents)
+        {
+            std::ofstream out(m_filename.c_str(), std::ios::binary | std::ios::trunc);
+            out.write(contents.data(), contents.size());
+        }
+
+        boost::filesystem::path             m_folder;
+        std::string                         m_filename;
+        std::vector<std::vector<int>>       m_masks;
+    };
+}
+
+TEST_F(MaskIndicesBinaryTest, RoundTrip)
+{
+    ASSERT_TRUE(DynamicObjectXMLParser::saveMaskIndicesBinary(m_filename, m_masks));
+    std::vector<std::vector<int>> loaded;
+    ASSERT_TRUE(DynamicObjectXMLParser::loadMaskIndicesBinary(m_filename, loaded));
+    EXPECT_EQ(m_masks, loaded);
+}
+
+TEST_F(MaskIndicesBinaryTest, MissingFile)
+{
+    std::vector<std::vector<int>> loaded(1);
+    EXPECT_FALSE(DynamicObjectXMLParser::loadMaskIndicesBinary(m_filename, loaded));
+    EXPECT_TRUE(loaded.empty());
+}
+
+TEST_F(MaskIndicesBinaryTest, TruncatedFileIsRejected)
+{
+    ASSERT_TRUE(DynamicObjectXMLParser::saveMaskIndicesBinary(m_filename, m_masks));
+    const std::string contents = readFile();
+    for (size_t length = 0; length < contents.size(); length++)
+    {
+        writeFile(contents.substr(0, length));
+        std::vector<std::vector<int>> loaded;
+        EXPECT_FALSE(DynamicObjectXMLParser::loadMaskIndicesBinary(m_filename, loaded)) << "truncated to " << length << " bytes";
+        EXPECT_TRUE(loaded.empty());
+    }
+}
+
+TEST_F(MaskIndicesBinaryTest, CorruptCountsAreRejected)
+{
+    ASSERT_TRUE(DynamicObjectXMLParser::saveMaskIndicesBinary(m_filename, m_masks));
+    const std::string contents = readFile();
+    const int32_t huge = 0x7fffffff, negative = -1;
+    // number of views after the magic and the version, then the size of the first view
+    const size_t offsets[2] = {8, 12};
+    for (size_t offset : offsets)
+    {
+        for (int32_t value : {huge, negative})
+        {
+            std::string corrupt = contents;
+            corrupt.replace(offset, sizeof(value), reinterpret_cast<const char*>(&value), sizeof(value));
+            writeFile(corrupt);
+            std::vector<std::vector<int>> loaded;
+            EXPECT_FALSE(DynamicObjectXMLParser::loadMaskIndicesBinary(m_filename, loaded)) << "value " << value << " at " << offset;
+            EXPECT_TRUE(loaded.empty());
+        }
+    }
+
+    std::string corrupt = contents;
+    corrupt[0] = 'X';
+    writeFile(corrupt);
+    std::vector<std::vector<int>> loaded;
+    EXPECT_FALSE(DynamicObjectXMLParser::loadMaskIndicesBinary(m_filename, loaded));
+}
+
+int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
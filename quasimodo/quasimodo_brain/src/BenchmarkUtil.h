@@ -0,0 +1,28 @@
+#ifndef BenchmarkUtil_H
+#define BenchmarkUtil_H
+
+#include <stdlib.h>
+#include <cmath>
+#include <algorithm>
+
+#include "core/Util.h"
+#include "model/Model.h"
+
+//Helpers shared by the benchmarks and tools of quasimodo_brain. Timing uses reglib::getTime.
+
+//uniform in [0,1]
+inline double randu(){return double(rand())/double(RAND_MAX);}
+
+//standard normal, Box-Muller
+inline double randn(){return sqrt(-2.0*log(std::max(1e-12,randu())))*cos(2.0*M_PI*randu());}
+
+//Model has no destructor for the frames and masks it holds
+inline void deleteModel(reglib::Model * model){
+	for(unsigned int f = 0; f < model->frames.size(); f++){
+		delete model->frames[f];
+		delete model->modelmasks[f];
+	}
+	delete model;
+}
+
+#endif // BenchmarkUtil_H
@@ -0,0 +1,204 @@
+#ifndef DescriptorIndex_H
+#define DescriptorIndex_H
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+
+//Approximate nearest neighbour index for normalized histogram descriptors, similarity is the histogram intersection.
+//The descriptors are clustered into lists (inverted file), a query only scores the descriptors in the lists with the
+//closest centroids. The lists are retrained when the number of descriptors has doubled since the last training, with
+//few descriptors every query is exact.
+class DescriptorIndex{
+	public:
+	unsigned int dim;
+	unsigned int nr_probes;			//number of lists scored per query
+	unsigned int min_train_size;	//below this size a single list is used
+	unsigned int kmeans_iterations;
+
+	DescriptorIndex(unsigned int dim_ = 0, unsigned int nr_probes_ = 8){
+		dim					= dim_;
+		nr_probes			= nr_probes_;
+		min_train_size		= 256;
+		kmeans_iterations	= 5;
+		trained_size		= 0;
+		lists.resize(1);
+	}
+	~DescriptorIndex(){}
+
+	static double similarity(const double * a, const double * b, unsigned int dim){
+		double sum = 0;
+		for(unsigned int i = 0; i < dim; i++){sum += std::min(a[i],b[i]);}
+		return sum;
+	}
+
+	unsigned int size() const {return row_id.size();}
+	unsigned int nrLists() const {return lists.size();}
+	bool contains(int id) const {return id_to_row.count(id) != 0;}
+
+	void add(int id, const std::vector<double> & descriptor){
+		if(dim == 0){dim = descriptor.size();}
+		if(contains(id)){remove(id);}
+		int row = row_id.size();
+		data.insert(data.end(),descriptor.begin(),descriptor.end());
+		row_id.push_back(id);
+		row_list.push_back(0);
+		row_pos.push_back(0);
+		id_to_row[id] = row;
+		insertInList(row,closestList(&data[row*dim]));
+
+		if(size() >= min_train_size && size() >= 2*trained_size){train();}
+	}
+
+	bool remove(int id){
+		std::unordered_map<int,int>::iterator it = id_to_row.find(id);
+		if(it == id_to_row.end()){return false;}
+		int row = it->second;
+		id_to_row.erase(it);
+		removeFromList(row);
+
+		//move the last row into the free slot
+		int last = row_id.size()-1;
+		if(row != last){
+			std::copy(data.begin()+last*dim,data.begin()+(last+1)*dim,data.begin()+row*dim);
+			row_id[row]		= row_id[last];
+			row_list[row]	= row_list[last];
+			row_pos[row]	= row_pos[last];
+			lists[row_list[row]][row_pos[row]] = row;
+			id_to_row[row_id[row]] = row;
+		}
+		data.resize(last*dim);
+		row_id.pop_back();
+		row_list.pop_back();
+		row_pos.pop_back();
+		return true;
+	}
+
+	//Returns up to k (similarity, id) pairs, most similar first. The descriptor with id exclude_id is skipped.
+	std::vector< std::pair<double,int> > search(const std::vector<double> & descriptor, unsigned int k, int exclude_id = -1) const {
+		std::vector< std::pair<double,int> > candidates;
+		if(size() == 0 || k == 0){return candidates;}
+
+		std::vector< std::pair<double,int> > list_scores;
+		for(unsigned int l = 0; l < lists.size(); l++){
+			if(lists[l].size() == 0){continue;}
+			double score = lists.size() > 1 ? similarity(&descriptor[0],&centroids[l*dim],dim) : 0;
+			list_scores.push_back(std::make_pair(score,l));
+		}
+		unsigned int probes = std::min<unsigned int>(std::max<unsigned int>(nr_probes,1),list_scores.size());
+		std::partial_sort(list_scores.begin(),list_scores.begin()+probes,list_scores.end(),greater);
+
+		for(unsigned int p = 0; p < probes; p++){
+			const std::vector<int> & list = lists[list_scores[p].second];
+			for(unsigned int i = 0; i < list.size(); i++){
+				int row = list[i];
+				if(row_id[row] == exclude_id){continue;}
+				candidates.push_back(std::make_pair(similarity(&descriptor[0],&data[row*dim],dim),row_id[row]));
+			}
+		}
+		return selectTop(candidates,k);
+	}
+
+	//Scores every descriptor, used as ground truth.
+	std::vector< std::pair<double,int> > searchExact(const std::vector<double> & descriptor, unsigned int k, int exclude_id = -1) const {
+		std::vector< std::pair<double,int> > candidates;
+		for(unsigned int row = 0; row < row_id.size(); row++){
+			if(row_id[row] == exclude_id){continue;}
+			candidates.push_back(std::make_pair(similarity(&descriptor[0],&data[row*dim],dim),row_id[row]));
+		}
+		return selectTop(candidates,k);
+	}
+
+	//Clusters the descriptors into about sqrt(size) lists with k-means.
+	void train(){
+		unsigned int nr_rows = size();
+		trained_size = nr_rows;
+		unsigned int nr_lists = nr_rows < min_train_size ? 1 : std::max(1,int(std::sqrt(double(nr_rows))));
+
+		//deterministic initialization from evenly spaced descriptors
+		centroids.resize(nr_lists*dim);
+		for(unsigned int l = 0; l < nr_lists; l++){
+			unsigned int row = (unsigned long)(l)*nr_rows/nr_lists;
+			std::copy(data.begin()+row*dim,data.begin()+(row+1)*dim,centroids.begin()+l*dim);
+		}
+
+		std::vector<int> assignment(nr_rows,0);
+		for(unsigned int it = 0; it < kmeans_iterations && nr_lists > 1; it++){
+#pragma omp parallel for
+			for(unsigned int row = 0; row < nr_rows; row++){assignment[row] = closestCentroid(&data[row*dim],nr_lists);}
+
+			std::vector<double> sums(nr_lists*dim,0);
+			std::vector<int> counts(nr_lists,0);
+			for(unsigned int row = 0; row < nr_rows; row++){
+				const double * d = &data[row*dim];
+				double * s = &sums[assignment[row]*dim];
+				for(unsigned int i = 0; i < dim; i++){s[i] += d[i];}
+				counts[assignment[row]]++;
+			}
+			for(unsigned int l = 0; l < nr_lists; l++){
+				if(counts[l] == 0){continue;}//keep the old centroid for empty lists
+				for(unsigned int i = 0; i < dim; i++){centroids[l*dim+i] = sums[l*dim+i]/double(counts[l]);}
+			}
+		}
+
+		lists.clear();
+		lists.resize(nr_lists);
+		for(unsigned int row = 0; row < nr_rows; row++){insertInList(row,closestList(&data[row*dim]));}
+	}
+
+	private:
+	std::vector<double>				data;		//row major descriptors
+	std::vector<int>				row_id;
+	std::vector<int>				row_list;
+	std::vector<int>				row_pos;
+	std::unordered_map<int,int>		id_to_row;
+	std::vector< std::vector<int> >	lists;
+	std::vector<double>				centroids;
+	unsigned int					trained_size;
+
+	static bool greater(const std::pair<double,int> & a, const std::pair<double,int> & b){
+		return a.first > b.first || (a.first == b.first && a.second < b.second);
+	}
+
+	//partial top-k selection instead of sorting all the candidates
+	static std::vector< std::pair<double,int> > selectTop(std::vector< std::pair<double,int> > & candidates, unsigned int k){
+		if(candidates.size() > k){
+			std::nth_element(candidates.begin(),candidates.begin()+k,candidates.end(),greater);
+			candidates.resize(k);
+		}
+		std::sort(candidates.begin(),candidates.end(),greater);
+		return candidates;
+	}
+
+	int closestCentroid(const double * descriptor, unsigned int nr_lists) const {
+		int best = 0;
+		double best_score = -1;
+		for(unsigned int l = 0; l < nr_lists; l++){
+			double score = similarity(descriptor,&centroids[l*dim],dim);
+			if(score > best_score){best_score = score; best = l;}
+		}
+		return best;
+	}
+
+	int closestList(const double * descriptor) const {
+		if(lists.size() <= 1 || centroids.size() < lists.size()*dim){return 0;}
+		return closestCentroid(descriptor,lists.size());
+	}
+
+	void insertInList(int row, int list){
+		row_list[row]	= list;
+		row_pos[row]	= lists[list].size();
+		lists[list].push_back(row);
+	}
+
+	void removeFromList(int row){
+		std::vector<int> & list = lists[row_list[row]];
+		int pos = row_pos[row];
+		list[pos] = list.back();
+		row_pos[list[pos]] = pos;
+		list.pop_back();
+	}
+};
+
+#endif // DescriptorIndex_H
@@ -29,5 +29,5 @@ class ModelDatabase{
 
 #include "ModelDatabaseBasic.h"
 #include "ModelDatabaseRGBHistogram.h"
-//#include "ModelDatabaseRetrieval.h"
+#include "ModelDatabaseRetrieval.h"
 #endif // ModelDatabase_H
@@ -1,7 +1,8 @@
 #include "ModelDatabaseRGBHistogram.h"
 
-ModelDatabaseRGBHistogram::ModelDatabaseRGBHistogram(int res_){
+ModelDatabaseRGBHistogram::ModelDatabaseRGBHistogram(int res_, int nr_probes_) : index(res_*res_*res_, nr_probes_){
 	res = res_;
+	next_id = 0;
 	printf("made a ModelDatabaseRGBHistogram(%i)\n",res);
 }
 ModelDatabaseRGBHistogram::~ModelDatabaseRGBHistogram(){}
@@ -27,10 +28,15 @@ std::vector< double > getDescriptor(int res, reglib::Model * model){
 }
 
 void ModelDatabaseRGBHistogram::add(reglib::Model * model){
-	//std::vector< std::vector< double > > descriptors;
+	if(model_ids.count(model) != 0){remove(model);}
 	std::vector< double > descriptor = getDescriptor(res,model);
 	descriptors.push_back(descriptor);
 	models.push_back(model);
+
+	int id = next_id++;
+	model_ids[model] = id;
+	id_models[id] = model;
+	index.add(id,descriptor);
 	//printf("number of models: %i\n",models.size());
 }
 
@@ -41,41 +47,39 @@ bool ModelDatabaseRGBHistogram::remove(reglib::Model * model){
 			models.pop_back();
 			descriptors[i] = descriptors.back();
 			descriptors.pop_back();
+
+			std::map<reglib::Model *, int>::iterator it = model_ids.find(model);
+			if(it != model_ids.end()){
+				index.remove(it->second);
+				id_models.erase(it->second);
+				model_ids.erase(it);
+			}
 			return true;
 		}	
 	}
 	return false;
 }
 
-double dist(std::vector< double > descriptorA, std::vector< double > descriptorB){
-	double sum = 0;
-	for(unsigned int i = 0; i < descriptorA.size(); i++){
-		sum += std::min(descriptorA[i],descriptorB[i]);
-	}
-	return sum;
-}
-
-bool ModelDatabaseRGBHistogram_sort (std::pair<double,reglib::Model *> i, std::pair<double,reglib::Model *> j) { return (i.first>j.first); }
-
 std::vector<reglib::Model *> ModelDatabaseRGBHistogram::search(reglib::Model * model, int number_of_matches){
-	std::vector< double > descriptor = getDescriptor(res,model);
-
-	std::vector< std::pair<double,reglib::Model *> > distances;
-
 	std::vector<reglib::Model *> ret;
-	printf("when searching my database contains %i models\n",models.size());
-	for(unsigned int i = 0; i < models.size(); i++){
-		if(models[i] != model){
-			distances.push_back(std::make_pair(dist(descriptor,descriptors[i]),models[i]));
+	if(number_of_matches <= 0){return ret;}
+
+	//models already in the database are not recomputed
+	std::vector< double > descriptor;
+	int exclude_id = -1;
+	std::map<reglib::Model *, int>::iterator it = model_ids.find(model);
+	if(it != model_ids.end()){
+		exclude_id = it->second;
+		for(unsigned int i = 0; i < models.size(); i++){
+			if(models[i] == model){descriptor = descriptors[i]; break;}
 		}
-		//if(ret.size() == number_of_matches){break;}
 	}
+	if(descriptor.size() == 0){descriptor = getDescriptor(res,model);}
 
-	std::sort (distances.begin(), distances.end(), ModelDatabaseRGBHistogram_sort);
-
-	for(unsigned int i = 0; i < distances.size() && i < number_of_matches; i++){
-		printf("%i -> %f\n",i,distances[i].first);
-		ret.push_back(distances[i].second);
+	std::vector< std::pair<double,int> > matches = index.search(descriptor,number_of_matches,exclude_id);
+	printf("when searching my database contains %i models, best match %f\n",int(models.size()),matches.size() > 0 ? matches.front().first : 0.0);
+	for(unsigned int i = 0; i < matches.size(); i++){
+		ret.push_back(id_models[matches[i].second]);
 	}
 
 	return ret;
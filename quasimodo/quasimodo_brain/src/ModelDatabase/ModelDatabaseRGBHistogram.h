@@ -2,6 +2,8 @@
 #define ModelDatabaseRGBHistogram_H
 
 #include "ModelDatabase.h"
+#include "DescriptorIndex.h"
+#include <map>
 
 
 class ModelDatabaseRGBHistogram: public ModelDatabase{
@@ -9,13 +11,18 @@ class ModelDatabaseRGBHistogram: public ModelDatabase{
 
 	int res;
 	std::vector< std::vector< double > > descriptors;
+	DescriptorIndex index;
+	std::map<reglib::Model *, int> model_ids;
+	std::map<int, reglib::Model *> id_models;
+	int next_id;
 
 	
 	virtual void add(reglib::Model * model);
 	virtual bool remove(reglib::Model * model);
 	virtual std::vector<reglib::Model *> search(reglib::Model * model, int number_of_matches);
 		
-	ModelDatabaseRGBHistogram(int res_);
+	//nr_probes_: number of index lists scored per search, more is slower and closer to an exhaustive search
+	ModelDatabaseRGBHistogram(int res_, int nr_probes_ = 8);
 	~ModelDatabaseRGBHistogram();
 };
 
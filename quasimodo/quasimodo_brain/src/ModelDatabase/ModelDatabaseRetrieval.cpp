@@ -31,8 +31,14 @@ ModelDatabaseRetrieval::ModelDatabaseRetrieval(std::string vpath) : vt_features(
 ModelDatabaseRetrieval::~ModelDatabaseRetrieval(){}
 
 void ModelDatabaseRetrieval::add(reglib::Model * model){
+    if (model_indices.count(model) != 0) {
+        remove(model);
+    }
+    int index = add(model->getPCLnormalcloud(1, true));
+    model_indices[model] = index;
+    index_models[index] = model;
 	models.push_back(model);
-	printf("number of models: %i\n",models.size());
+	printf("number of models: %i\n",int(models.size()));
 }
 
 bool ModelDatabaseRetrieval::remove(reglib::Model * model){
@@ -40,6 +46,12 @@ bool ModelDatabaseRetrieval::remove(reglib::Model * model){
 		if(models[i] == model){
 			models[i] = models.back();
 			models.pop_back();
+            auto it = model_indices.find(model);
+            if (it != model_indices.end()) {
+                remove(it->second);
+                index_models.erase(it->second);
+                model_indices.erase(it);
+            }
 			return true;
 		}
 	}
@@ -48,18 +60,32 @@ bool ModelDatabaseRetrieval::remove(reglib::Model * model){
 
 std::vector<reglib::Model *> ModelDatabaseRetrieval::search(reglib::Model * model, int number_of_matches){
 	std::vector<reglib::Model *> ret;
-		for(unsigned int i = 0; i < models.size(); i++){
-		if(models[i] != model){
-			ret.push_back(models[i]);
-		}
-		if(ret.size() == number_of_matches){break;}
-	}
+    // models which are not in the database (e.g. search results) are queried with features computed from their cloud
+    int model_index = -1;
+    HistCloudT::Ptr features;
+    auto it = model_indices.find(model);
+    if (it != model_indices.end()) {
+        model_index = it->second;
+        features = vt_features[model_index];
+    } else {
+        features = computeFeatures(model->getPCLnormalcloud(1, true));
+    }
+    // one extra result since the model itself is the best match
+    vector<int> matches = searchFeatures(features, number_of_matches+1);
+    for (int index : matches) {
+        if (index == model_index || index_models.count(index) == 0) {
+            continue;
+        }
+        ret.push_back(index_models[index]);
+        if (int(ret.size()) == number_of_matches) {
+            break;
+        }
+    }
 	return ret;
 }
 
 
-//Add pointcloud to database, return index number in database, weight is the bias of the system to perfer this object when searching
-int ModelDatabaseRetrieval::add(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud, double weight)
+HistCloudT::Ptr ModelDatabaseRetrieval::computeFeatures(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud)
 {
     CloudT::Ptr points(new CloudT);
     NormalCloudT::Ptr normals(new NormalCloudT);
@@ -77,6 +103,14 @@ int ModelDatabaseRetrieval::add(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr clo
 
     cout << "Got features!" << endl;
 
+    return features;
+}
+
+//Add pointcloud to database, return index number in database, weight is the bias of the system to perfer this object when searching
+int ModelDatabaseRetrieval::add(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud, double weight)
+{
+    HistCloudT::Ptr features = computeFeatures(cloud);
+
     vt_features.push_back(HistCloudT::Ptr(new HistCloudT(*features)));
 
     int old_index = vt.max_ind();
@@ -111,20 +145,25 @@ bool ModelDatabaseRetrieval::remove(int index)
 
 //Find the number_of_matches closest matches in dabase to the pointcloud for index
 std::vector<int> ModelDatabaseRetrieval::search(int index, int number_of_matches)
+{
+    cout << "Trying to search with index: " << index << endl;
+    return searchFeatures(vt_features[index], number_of_matches);
+}
+
+std::vector<int> ModelDatabaseRetrieval::searchFeatures(HistCloudT::Ptr features, int number_of_matches)
 {
     using result_type = vocabulary_tree<HistT, 8>::result_type;
     vector<result_type> scores;
 
-    cout << "Trying to search with index: " << index << endl;
     cout << "Number clouds added: " << vt_features.size() << endl;
 
-    vt.query_vocabulary(scores, vt_features[index], 0);
+    vt.query_vocabulary(scores, features, 0);
     vector<int> rtn;
 
     cout << "Finished querying, got " << scores.size() << " results!" << endl;
 
     for (const result_type& r : scores) {
-        if (rtn.size() >= number_of_matches) {
+        if (int(rtn.size()) >= number_of_matches) {
             break;
         }
         if (r.index < training_indices) {
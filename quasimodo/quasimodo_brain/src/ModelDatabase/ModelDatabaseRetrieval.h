@@ -2,6 +2,8 @@
 #define MODELDATABASERETRIEVAL_H
 
 #include "ModelDatabase.h"
+#include <map>
+#include <set>
 #include <vocabulary_tree/vocabulary_tree.h>
 #include <dynamic_object_retrieval/visualize.h>
 
@@ -12,10 +14,15 @@ class ModelDatabaseRetrieval: public ModelDatabase{
 private:
 
     vocabulary_tree<HistT, 8> vt;
-    vector<HistCloudT::Ptr> vt_features;
-    map<int, int> added_indices;
+    std::vector<HistCloudT::Ptr> vt_features;
+    std::map<int, int> added_indices;
     int training_indices;
-    set<int> removed_indices;
+    std::set<int> removed_indices;
+    std::map<reglib::Model *, int> model_indices; // model -> index returned by add(cloud)
+    std::map<int, reglib::Model *> index_models;
+
+    HistCloudT::Ptr computeFeatures(pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud);
+    std::vector<int> searchFeatures(HistCloudT::Ptr features, int number_of_matches);
 
 public:
 
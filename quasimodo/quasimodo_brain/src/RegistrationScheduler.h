@@ -0,0 +1,131 @@
+#ifndef RegistrationScheduler_H
+#define RegistrationScheduler_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <stdio.h>
+
+#include "core/Util.h"
+
+//Runs a list of candidate registrations on a bounded number of threads. The candidates are given best first (by
+//retrieval score) and dealt round-robin to per thread queues, so the best candidates start first. A thread takes work
+//from the front of its own queue and steals from the back of the other queues when it runs out. Once a task returns a
+//score of at least stop_score the candidates that have not started are cancelled; running tasks finish.
+class RegistrationScheduler{
+	public:
+	struct TaskResult{
+		bool	done;
+		bool	cancelled;
+		double	score;
+		double	latency;	//seconds spent in the task
+		int		thread;
+		TaskResult(){done = false; cancelled = false; score = 0; latency = 0; thread = -1;}
+	};
+
+	unsigned int	nr_threads;
+	double			stop_score;
+	double			last_time;	//wall time of the last run
+
+	RegistrationScheduler(unsigned int nr_threads_ = 0, double stop_score_ = 100){
+		nr_threads	= nr_threads_;
+		stop_score	= stop_score_;
+		last_time	= 0;
+	}
+	~RegistrationScheduler(){}
+
+	//task(i) registers candidate i and returns its score.
+	std::vector<TaskResult> run(unsigned int nr_tasks, std::function<double(int)> task){
+		double start = reglib::getTime();
+		results.clear();
+		results.resize(nr_tasks);
+		stop = false;
+
+		unsigned int threads = nr_threads > 0 ? nr_threads : std::max(1u,std::thread::hardware_concurrency());
+		threads = std::min(threads,std::max(1u,nr_tasks));
+		queues = std::vector< std::deque<int> >(threads);
+		mutexes = std::vector<std::mutex>(threads);
+		for(unsigned int i = 0; i < nr_tasks; i++){queues[i % threads].push_back(i);}
+
+		if(threads == 1){
+			worker(0,task);
+		}else{
+			std::vector<std::thread> workers;
+			for(unsigned int t = 0; t < threads; t++){workers.push_back(std::thread(&RegistrationScheduler::worker,this,t,task));}
+			for(unsigned int t = 0; t < threads; t++){workers[t].join();}
+		}
+
+		for(unsigned int i = 0; i < nr_tasks; i++){
+			if(!results[i].done){results[i].cancelled = true;}
+		}
+		last_time = reglib::getTime()-start;
+		return results;
+	}
+
+	static void printMetrics(const std::vector<TaskResult> & results, double wall_time){
+		int done = 0;
+		int cancelled = 0;
+		double total = 0;
+		double worst = 0;
+		for(unsigned int i = 0; i < results.size(); i++){
+			const TaskResult & r = results[i];
+			if(r.done){
+				printf("candidate %3i: score %8.3f latency %6.3fs thread %i\n",i,r.score,r.latency,r.thread);
+				done++;
+				total += r.latency;
+				worst = std::max(worst,r.latency);
+			}else{
+				cancelled++;
+			}
+		}
+		printf("registered %i candidates, cancelled %i, wall time %6.3fs, mean latency %6.3fs, max latency %6.3fs, speedup %4.2f\n",
+			   done,cancelled,wall_time,done > 0 ? total/double(done) : 0,worst,wall_time > 0 ? total/wall_time : 0);
+	}
+
+	private:
+	std::vector< std::deque<int> >	queues;
+	std::vector<std::mutex>			mutexes;
+	std::vector<TaskResult>			results;
+	std::atomic<bool>				stop;
+
+	bool next(unsigned int thread, int & task_index){
+		{
+			std::lock_guard<std::mutex> lock(mutexes[thread]);
+			if(queues[thread].size() > 0){
+				task_index = queues[thread].front();
+				queues[thread].pop_front();
+				return true;
+			}
+		}
+		for(unsigned int i = 1; i < queues.size(); i++){
+			unsigned int victim = (thread+i) % queues.size();
+			std::lock_guard<std::mutex> lock(mutexes[victim]);
+			if(queues[victim].size() > 0){
+				task_index = queues[victim].back();
+				queues[victim].pop_back();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void worker(unsigned int thread, std::function<double(int)> task){
+		int task_index;
+		while(!stop && next(thread,task_index)){
+			double start = reglib::getTime();
+			double score = task(task_index);
+			TaskResult & r = results[task_index];
+			r.score		= score;
+			r.latency	= reglib::getTime()-start;
+			r.thread	= thread;
+			r.done		= true;
+			if(score >= stop_score){stop = true;}
+		}
+	}
+};
+
+#endif // RegistrationScheduler_H
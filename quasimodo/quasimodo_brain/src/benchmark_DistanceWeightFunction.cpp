@@ -0,0 +1,90 @@
+//Runtime of the robust weight estimation in DistanceWeightFunction2PPR and DistanceWeightFunction2PPR2, scalar loops
+//against the batched kernels in HistogramKernels.h, on synthetic residuals.
+//
+//benchmark_DistanceWeightFunction [nr_data] [nr_iterations] [outlier_ratio] [noise]
+//
+//The residuals are gaussian inliers mixed with uniformly distributed outliers, with one (point to plane) and three
+//(point to point) dimensions. Every weight function fits its model and computes the weights nr_iterations times, as in
+//the inner loop of a registration. The maximum difference between the weights of the two paths is reported next to
+//the runtimes, and for PPR2 also the single precision batch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+
+#include "weightfunctions/DistanceWeightFunction2.h"
+#include "BenchmarkUtil.h"
+
+using namespace Eigen;
+
+MatrixXd createResiduals(int nr_dim, int nr_data, double outlier_ratio, double noise){
+	MatrixXd residuals (nr_dim,nr_data);
+	for(int j = 0; j < nr_data; j++){
+		bool outlier = randu() < outlier_ratio;
+		for(int k = 0; k < nr_dim; k++){residuals(k,j) = outlier ? 0.5*(2*randu()-1) : noise*randn();}
+	}
+	return residuals;
+}
+
+//Fits the model and computes the weights nr_iterations times, returns the seconds per iteration
+double run(reglib::DistanceWeightFunction2 * func, const MatrixXd & residuals, int nr_iterations, VectorXd & weights){
+	func->reset();
+	func->debugg_print = false;
+	double start = reglib::getTime();
+	for(int it = 0; it < nr_iterations; it++){
+		func->computeModel(residuals);
+		weights = func->getProbs(residuals);
+	}
+	return (reglib::getTime()-start)/double(nr_iterations);
+}
+
+void compare(const char * name, reglib::DistanceWeightFunction2 * scalar, reglib::DistanceWeightFunction2 * batch, const MatrixXd & residuals, int nr_iterations){
+	VectorXd weights_scalar, weights_batch;
+	double time_scalar	= run(scalar,residuals,nr_iterations,weights_scalar);
+	double time_batch	= run(batch,residuals,nr_iterations,weights_batch);
+	double diff = (weights_scalar-weights_batch).cwiseAbs().maxCoeff();
+	printf("%-6s %i dim: scalar %8.3f ms batch %8.3f ms (%4.2fx faster) max weight difference %g\n",name,int(residuals.rows()),
+		   1000.0*time_scalar,1000.0*time_batch,time_batch > 0 ? time_scalar/time_batch : 0,diff);
+}
+
+int main(int argc, char **argv){
+	int nr_data				= argc > 1 ? atoi(argv[1]) : 300000;
+	int nr_iterations		= argc > 2 ? atoi(argv[2]) : 10;
+	double outlier_ratio	= argc > 3 ? atof(argv[3]) : 0.3;
+	double noise			= argc > 4 ? atof(argv[4]) : 0.01;
+	srand(0);
+
+	for(int nr_dim = 1; nr_dim <= 3; nr_dim += 2){
+		MatrixXd residuals = createResiduals(nr_dim,nr_data,outlier_ratio,noise);
+
+		reglib::DistanceWeightFunction2PPR * ppr_scalar	= new reglib::DistanceWeightFunction2PPR();
+		reglib::DistanceWeightFunction2PPR * ppr_batch	= new reglib::DistanceWeightFunction2PPR();
+		ppr_scalar->batch_kernels = false;
+		compare("PPR",ppr_scalar,ppr_batch,residuals,nr_iterations);
+		delete ppr_scalar;
+		delete ppr_batch;
+
+		reglib::DistanceWeightFunction2PPR2 * ppr2_scalar	= new reglib::DistanceWeightFunction2PPR2();
+		reglib::DistanceWeightFunction2PPR2 * ppr2_batch	= new reglib::DistanceWeightFunction2PPR2();
+		ppr2_scalar->batch_kernels = false;
+		compare("PPR2",ppr2_scalar,ppr2_batch,residuals,nr_iterations);
+
+		//single precision weights from the model fitted above
+		std::vector<float> residuals_float (residuals.data(),residuals.data()+residuals.size());
+		std::vector<float> weights_float (nr_data);
+		VectorXd weights_double (nr_data);
+		double start = reglib::getTime();
+		for(int it = 0; it < nr_iterations; it++){ppr2_batch->getProbs(residuals.data(),nr_data,nr_dim,weights_double.data());}
+		double time_double = (reglib::getTime()-start)/double(nr_iterations);
+		start = reglib::getTime();
+		for(int it = 0; it < nr_iterations; it++){ppr2_batch->getProbs(&residuals_float[0],nr_data,nr_dim,&weights_float[0]);}
+		double time_float = (reglib::getTime()-start)/double(nr_iterations);
+		double diff = 0;
+		for(int j = 0; j < nr_data; j++){diff = std::max(diff,fabs(double(weights_float[j])-weights_double(j)));}
+		printf("PPR2   %i dim: getProbs double %8.3f ms float %8.3f ms max weight difference %g\n",nr_dim,1000.0*time_double,1000.0*time_float,diff);
+		delete ppr2_scalar;
+		delete ppr2_batch;
+	}
+	return 0;
+}
@@ -0,0 +1,184 @@
+//Runtime and final alignment error of MassRegistrationPPR::getTransforms on synthetic multi-frame scenes.
+//
+//benchmark_MassRegistrationPPR [nr_frames] [nr_points] [nr_scenes] [noise]
+//
+//Every scene is a room corner (floor and two walls) with a few boxes on the floor. Each frame sees a random part of the
+//scene in its own coordinates, with gaussian noise on the points, and starts from a perturbed pose. Every scene is
+//registered four times:
+//  reference   getTransformsSerial, the previous serial implementation
+//  serial      getTransforms on one thread, every frame pair rematched in every iteration
+//  parallel    getTransforms on all threads, every frame pair rematched in every iteration (the default)
+//  schedule    getTransforms on all threads, only the pairs which moved more than rematch_threshold are rematched (use_rematch_schedule)
+//The runtime and the error of the final poses against the ground truth are reported per scene and averaged, the speedups
+//are relative to the reference.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+#include <omp.h>
+
+#include "modelupdater/ModelUpdater.h"
+#include "BenchmarkUtil.h"
+
+Eigen::Matrix4d randomPose(double max_angle, double max_translation){
+	Eigen::Vector3d axis (randn(),randn(),randn());
+	axis.normalize();
+	Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+	pose.block<3,3>(0,0) = Eigen::AngleAxisd(max_angle*(2*randu()-1),axis).toRotationMatrix();
+	for(int k = 0; k < 3; k++){pose(k,3) = max_translation*(2*randu()-1);}
+	return pose;
+}
+
+//Points and normals on the floor, two walls and a few boxes, in world coordinates
+void createScene(std::vector<Eigen::Vector3d> & scene_points, std::vector<Eigen::Vector3d> & scene_normals, int nr_points){
+	scene_points.clear();
+	scene_normals.clear();
+	std::vector<Eigen::Vector3d> box_min, box_max;
+	for(int b = 0; b < 4; b++){
+		Eigen::Vector3d mi (0.5+2.0*randu(),0.5+2.0*randu(),0);
+		box_min.push_back(mi);
+		box_max.push_back(mi+Eigen::Vector3d(0.2+0.4*randu(),0.2+0.4*randu(),0.2+0.6*randu()));
+	}
+	while(int(scene_points.size()) < nr_points){
+		int surface = rand()%(3+2*box_min.size());
+		Eigen::Vector3d p, n;
+		if(surface == 0){		p = Eigen::Vector3d(3*randu(),3*randu(),0);	n = Eigen::Vector3d(0,0,1);}
+		else if(surface == 1){	p = Eigen::Vector3d(0,3*randu(),2*randu());	n = Eigen::Vector3d(1,0,0);}
+		else if(surface == 2){	p = Eigen::Vector3d(3*randu(),0,2*randu());	n = Eigen::Vector3d(0,1,0);}
+		else{
+			int b = (surface-3)/2;
+			Eigen::Vector3d mi = box_min[b];
+			Eigen::Vector3d ma = box_max[b];
+			Eigen::Vector3d s = ma-mi;
+			p = mi + Eigen::Vector3d(s(0)*randu(),s(1)*randu(),s(2)*randu());
+			int side = rand()%5;
+			if(side == 0){		p(2) = ma(2); n = Eigen::Vector3d(0,0,1);}
+			else if(side == 1){	p(0) = mi(0); n = Eigen::Vector3d(-1,0,0);}
+			else if(side == 2){	p(0) = ma(0); n = Eigen::Vector3d(1,0,0);}
+			else if(side == 3){	p(1) = mi(1); n = Eigen::Vector3d(0,-1,0);}
+			else{				p(1) = ma(1); n = Eigen::Vector3d(0,1,0);}
+		}
+		scene_points.push_back(p);
+		scene_normals.push_back(n);
+	}
+}
+
+//Camera two meters from a random point of the scene, looking at it from above
+Eigen::Matrix4d randomCamera(Eigen::Vector3d & center){
+	center = Eigen::Vector3d(0.5+2.0*randu(),0.5+2.0*randu(),0.5*randu());
+	Eigen::Vector3d dir (randn(),randn(),fabs(randn())+0.5);
+	dir.normalize();
+	Eigen::Vector3d z = -dir;
+	Eigen::Vector3d x = z.cross(Eigen::Vector3d(randn(),randn(),randn())).normalized();
+	Eigen::Vector3d y = z.cross(x);
+	Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+	pose.block<3,1>(0,0) = x;
+	pose.block<3,1>(0,1) = y;
+	pose.block<3,1>(0,2) = z;
+	pose.block<3,1>(0,3) = center+2.0*dir;
+	return pose;
+}
+
+//A frame sees the scene points inside a ball around the point the camera looks at, in the camera coordinates
+pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr createFrame(const std::vector<Eigen::Vector3d> & scene_points, const std::vector<Eigen::Vector3d> & scene_normals,
+														 const Eigen::Matrix4d & pose, const Eigen::Vector3d & center, double noise){
+	pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGBNormal>);
+	Eigen::Matrix4d inv = pose.inverse();
+	Eigen::Matrix3d rot = inv.block<3,3>(0,0);
+	for(unsigned int k = 0; k < scene_points.size(); k++){
+		if((scene_points[k]-center).norm() > 1.5){continue;}
+		Eigen::Vector3d p = rot*scene_points[k] + inv.block<3,1>(0,3) + noise*Eigen::Vector3d(randn(),randn(),randn());
+		Eigen::Vector3d n = rot*scene_normals[k];
+		pcl::PointXYZRGBNormal point;
+		point.x = p(0);			point.y = p(1);			point.z = p(2);
+		point.normal_x = n(0);	point.normal_y = n(1);	point.normal_z = n(2);
+		point.r = 255;			point.g = 255;			point.b = 255;
+		cloud->points.push_back(point);
+	}
+	cloud->width	= cloud->points.size();
+	cloud->height	= 1;
+	return cloud;
+}
+
+//Mean rotation (degrees) and translation error of the poses relative to the first frame
+void poseError(const std::vector<Eigen::Matrix4d> & poses, const std::vector<Eigen::Matrix4d> & gt, double & rot_err, double & trans_err){
+	rot_err = 0;
+	trans_err = 0;
+	Eigen::Matrix4d p0inv = poses[0].inverse();
+	Eigen::Matrix4d g0inv = gt[0].inverse();
+	for(unsigned int i = 1; i < poses.size(); i++){
+		Eigen::Matrix4d diff = (g0inv*gt[i]).inverse()*(p0inv*poses[i]);
+		double c = std::min(1.0,std::max(-1.0,0.5*(diff.block<3,3>(0,0).trace()-1)));
+		rot_err		+= acos(c)*180.0/M_PI;
+		trans_err	+= diff.block<3,1>(0,3).norm();
+	}
+	rot_err		/= double(poses.size()-1);
+	trans_err	/= double(poses.size()-1);
+}
+
+int main(int argc, char **argv){
+	int nr_frames	= argc > 1 ? atoi(argv[1]) : 10;
+	int nr_points	= argc > 2 ? atoi(argv[2]) : 200000;
+	int nr_scenes	= argc > 3 ? atoi(argv[3]) : 5;
+	double noise	= argc > 4 ? atof(argv[4]) : 0.002;
+	int nr_threads	= omp_get_max_threads();
+	srand(0);
+
+	const int nr_modes = 4;
+	const char * mode_names [nr_modes] = {"reference","serial","parallel","schedule"};
+	double total_time [nr_modes] = {0,0,0,0};
+	double total_rot [nr_modes] = {0,0,0,0};
+	double total_trans [nr_modes] = {0,0,0,0};
+	double total_rot_start = 0;
+	double total_trans_start = 0;
+	for(int scene = 0; scene < nr_scenes; scene++){
+		std::vector<Eigen::Vector3d> scene_points, scene_normals;
+		createScene(scene_points,scene_normals,nr_points);
+
+		std::vector< pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr > clouds;
+		std::vector<Eigen::Matrix4d> gt;
+		std::vector<Eigen::Matrix4d> guess;
+		for(int i = 0; i < nr_frames; i++){
+			Eigen::Vector3d center;
+			Eigen::Matrix4d pose = randomCamera(center);
+			gt.push_back(pose);
+			guess.push_back(i == 0 ? pose : Eigen::Matrix4d(pose*randomPose(0.05,0.05)));
+			clouds.push_back(createFrame(scene_points,scene_normals,pose,center,noise));
+		}
+
+		double rot_start, trans_start;
+		poseError(guess,gt,rot_start,trans_start);
+		total_rot_start += rot_start;
+		total_trans_start += trans_start;
+		printf("scene %i: %i frames, start error %6.3f deg %6.4f m\n",scene,nr_frames,rot_start,trans_start);
+
+		for(int mode = 0; mode < nr_modes; mode++){
+			reglib::MassRegistrationPPR * massreg = new reglib::MassRegistrationPPR(0.05);
+			massreg->timeout = 600;
+			massreg->use_rematch_schedule = mode == 3;
+			massreg->setData(clouds);
+			omp_set_num_threads(mode <= 1 ? 1 : nr_threads);
+
+			double start = reglib::getTime();
+			reglib::MassFusionResults mfr = mode == 0 ? massreg->getTransformsSerial(guess) : massreg->getTransforms(guess);
+			double time = reglib::getTime()-start;
+
+			double rot_err, trans_err;
+			poseError(mfr.poses,gt,rot_err,trans_err);
+			printf("%-12s %8.3f s, error %6.3f deg %6.4f m\n",mode_names[mode],time,rot_err,trans_err);
+			total_time[mode] += time;
+			total_rot[mode] += rot_err;
+			total_trans[mode] += trans_err;
+			delete massreg;
+		}
+	}
+	omp_set_num_threads(nr_threads);
+
+	printf("\naverage over %i scenes, start error %6.3f deg %6.4f m\n",nr_scenes,total_rot_start/double(nr_scenes),total_trans_start/double(nr_scenes));
+	for(int mode = 0; mode < nr_modes; mode++){
+		printf("%-12s %8.3f s, error %6.3f deg %6.4f m (%i threads, %4.2fx the reference speed)\n",mode_names[mode],total_time[mode]/double(nr_scenes),total_rot[mode]/double(nr_scenes),total_trans[mode]/double(nr_scenes),
+			   mode <= 1 ? 1 : nr_threads,total_time[mode] > 0 ? total_time[0]/total_time[mode] : 0);
+	}
+	return 0;
+}
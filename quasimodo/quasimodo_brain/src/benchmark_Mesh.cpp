@@ -0,0 +1,142 @@
+//Runtime and heap use of Mesh::build with Vertex and Triangle objects against the flat buffers of IndexedMesh, on
+//synthetic models with many frames.
+//
+//benchmark_Mesh [nr_frames] [width] [step] [merge_distance] [ply_path]
+//
+//The global operator new and delete are replaced to count the allocations, the bytes in use and the peak bytes while a
+//mesh is built. The images of the model are allocated by OpenCV and not counted. The triangle counts of the two
+//builders should be identical when merging is disabled.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <new>
+
+#include "mesher/Mesh.h"
+#include "BenchmarkUtil.h"
+
+static size_t heap_allocations	= 0;
+static size_t heap_bytes		= 0;
+static size_t heap_peak			= 0;
+
+//The size is stored in front of every block so that delete knows how much is freed
+void * operator new(size_t size){
+	size_t * block = (size_t *)malloc(size+sizeof(size_t)*2);
+	if(block == 0){throw std::bad_alloc();}
+	block[0] = size;
+#pragma omp critical (heap_accounting)
+	{
+		heap_allocations++;
+		heap_bytes += size;
+		heap_peak = std::max(heap_peak,heap_bytes);
+	}
+	return block+2;
+}
+
+void operator delete(void * ptr) noexcept {
+	if(ptr == 0){return;}
+	size_t * block = ((size_t *)ptr)-2;
+#pragma omp critical (heap_accounting)
+	heap_bytes -= block[0];
+	free(block);
+}
+
+void * operator new[](size_t size){return operator new(size);}
+void operator delete[](void * ptr) noexcept {operator delete(ptr);}
+
+//Mesh has no destructor of its own
+void deleteMesh(reglib::Mesh * mesh){
+	for(unsigned int i = 0; i < mesh->vertexes.size(); i++){delete mesh->vertexes[i];}
+	for(unsigned int i = 0; i < mesh->triangles.size(); i++){delete mesh->triangles[i];}
+	delete mesh;
+}
+
+//Smooth surfaces with a box in front of them and missing depth, seen from a camera moving sideways, most of the image masked
+reglib::Model * createModel(reglib::Camera * cam, int nr_frames){
+	reglib::Model * model = 0;
+	const double scale = 640.0/double(cam->width);
+	for(int f = 0; f < nr_frames; f++){
+		cv::Mat rgb (cam->height,cam->width,CV_8UC3);
+		cv::Mat depth (cam->height,cam->width,CV_16UC1);
+		cv::Mat mask (cam->height,cam->width,CV_8UC1);
+		double phase = 0.1*f;
+		for(unsigned int h = 0; h < cam->height; h++){
+			for(unsigned int w = 0; w < cam->width; w++){
+				int ind = h*cam->width+w;
+				double u = scale*w;
+				double v = scale*h;
+				double z = 1.5 + 0.3*sin(0.01*u+phase) + 0.2*cos(0.013*v) + (u > 300 && u < 420 && v > 200 && v < 330 ? -0.4 : 0);
+				bool valid = u > 8 && u < 632 && (rand() % 50) != 0;
+				((unsigned short *)depth.data)[ind] = valid ? (unsigned short)(z/cam->idepth_scale) : 0;
+				for(int c = 0; c < 3; c++){rgb.data[3*ind+c] = (unsigned char)(128 + 60*sin(0.02*(c+1)*u+phase)*cos(0.015*v));}
+				mask.data[ind] = u > 40 && u < 600 && v > 40 && v < 440 ? 255 : 0;
+			}
+		}
+		Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+		pose(0,3) = 0.01*f;
+		reglib::RGBDFrame * frame = new reglib::RGBDFrame(cam,rgb,depth,f,pose);
+		if(model == 0){	model = new reglib::Model(frame,mask);}
+		else{			model->addFrameToModel(frame,new reglib::ModelMask(mask),pose);}
+	}
+	return model;
+}
+
+int main(int argc, char **argv){
+	int nr_frames			= argc > 1 ? atoi(argv[1]) : 30;
+	int width				= argc > 2 ? atoi(argv[2]) : 640;
+	int step				= argc > 3 ? atoi(argv[3]) : 10;
+	double merge_distance	= argc > 4 ? atof(argv[4]) : 0.005;
+	std::string ply_path	= argc > 5 ? argv[5] : "";
+	srand(0);
+
+	reglib::Camera * cam = new reglib::Camera();
+	cam->width	= width;
+	cam->height	= 3*width/4;
+	cam->fx		= cam->fy = 535.0*double(width)/640.0;
+	cam->cx		= 0.5*(cam->width-1);
+	cam->cy		= 0.5*(cam->height-1);
+	reglib::Model * model = createModel(cam,nr_frames);
+	printf("%i frames of %ix%i, step %i\n",nr_frames,cam->width,cam->height,step);
+
+	//Mesh::build always uses a step of 10
+	if(step == 10){
+		size_t base = heap_bytes;
+		size_t allocations = heap_allocations;
+		heap_peak = heap_bytes;
+		double start = reglib::getTime();
+		reglib::Mesh * mesh = new reglib::Mesh();
+		mesh->build(model,0);
+		double time = reglib::getTime()-start;
+		printf("Mesh::build        %8.3f s, %8i vertexes, %8i triangles, %10lu allocations, peak %8.2f MB, kept %8.2f MB\n",
+			   time,int(mesh->vertexes.size()),int(mesh->triangles.size()),heap_allocations-allocations,
+			   double(heap_peak-base)/1e6,double(heap_bytes-base)/1e6);
+		deleteMesh(mesh);
+	}
+
+	for(int merge = 0; merge < 2; merge++){
+		size_t base = heap_bytes;
+		size_t allocations = heap_allocations;
+		heap_peak = heap_bytes;
+		double start = reglib::getTime();
+		reglib::IndexedMesh * mesh = new reglib::IndexedMesh();
+		mesh->step = step;
+		mesh->merge_distance = merge ? merge_distance : 0;
+		mesh->build(model);
+		double time = reglib::getTime()-start;
+		printf("IndexedMesh %-6s %8.3f s, %8i vertexes, %8i triangles, %10lu allocations, peak %8.2f MB, kept %8.2f MB\n",
+			   merge ? "merged" : "",time,mesh->nrVertices(),mesh->nrTriangles(),heap_allocations-allocations,
+			   double(heap_peak-base)/1e6,double(heap_bytes-base)/1e6);
+		if(merge && ply_path.size() > 0){
+			start = reglib::getTime();
+			mesh->savePLY(ply_path);
+			printf("saved %s in %8.3f s\n",ply_path.c_str(),reglib::getTime()-start);
+		}
+		delete mesh;
+	}
+
+	deleteModel(model);
+	delete cam;
+	return 0;
+}
@@ -0,0 +1,95 @@
+//Recall versus latency of the DescriptorIndex used by ModelDatabaseRGBHistogram, on synthetic RGB histograms.
+//
+//benchmark_ModelDatabase [nr_models] [nr_queries] [k] [res]
+//
+//The models are drawn from a set of synthetic object classes (a few dominant colors each) with noise, the same way
+//several observations of an object give slightly different histograms. The recall is measured against an exhaustive
+//search for an increasing number of probed lists, after inserting all the models and after removing a part of them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <set>
+
+#include "ModelDatabase/DescriptorIndex.h"
+#include "BenchmarkUtil.h"
+
+std::vector<double> createDescriptor(const std::vector<double> & cls, double noise){
+	std::vector<double> descriptor (cls.size());
+	double sum = 0;
+	for(unsigned int i = 0; i < cls.size(); i++){
+		descriptor[i] = std::max(0.0,cls[i] + noise*(randu()-0.5)*(cls[i]+0.01));
+		sum += descriptor[i];
+	}
+	for(unsigned int i = 0; i < descriptor.size(); i++){descriptor[i] /= sum;}
+	return descriptor;
+}
+
+std::vector<double> createClass(int dim){
+	std::vector<double> cls (dim,0);
+	int nr_colors = 1+rand()%4;
+	for(int c = 0; c < nr_colors; c++){cls[rand()%dim] += randu();}
+	for(int i = 0; i < dim; i++){cls[i] += 0.02*randu();}
+	return cls;
+}
+
+void evaluate(DescriptorIndex & index, const std::vector< std::vector<double> > & queries, unsigned int k){
+	std::vector< std::vector< std::pair<double,int> > > truth;
+	double start = reglib::getTime();
+	for(unsigned int q = 0; q < queries.size(); q++){truth.push_back(index.searchExact(queries[q],k));}
+	double exact_time = (reglib::getTime()-start)/double(queries.size());
+	printf("%i models in %i lists, exact search: %6.3f ms per query\n",index.size(),index.nrLists(),1000.0*exact_time);
+
+	unsigned int probes [] = {1,2,4,8,16,32,64};
+	for(unsigned int p = 0; p < sizeof(probes)/sizeof(unsigned int); p++){
+		if(p > 0 && probes[p-1] >= index.nrLists()){break;}
+		index.nr_probes = probes[p];
+		double found = 0;
+		double total = 0;
+		start = reglib::getTime();
+		std::vector< std::vector< std::pair<double,int> > > results;
+		for(unsigned int q = 0; q < queries.size(); q++){results.push_back(index.search(queries[q],k));}
+		double time = (reglib::getTime()-start)/double(queries.size());
+		for(unsigned int q = 0; q < queries.size(); q++){
+			std::set<int> ids;
+			for(unsigned int i = 0; i < results[q].size(); i++){ids.insert(results[q][i].second);}
+			for(unsigned int i = 0; i < truth[q].size(); i++){found += ids.count(truth[q][i].second);}
+			total += truth[q].size();
+		}
+		printf("probes %3i: recall@%i %5.3f %6.3f ms per query (%5.1fx faster)\n",probes[p],k,total > 0 ? found/total : 1.0,1000.0*time,exact_time/time);
+	}
+}
+
+int main(int argc, char **argv){
+	int nr_models	= argc > 1 ? atoi(argv[1]) : 5000;
+	int nr_queries	= argc > 2 ? atoi(argv[2]) : 200;
+	int k			= argc > 3 ? atoi(argv[3]) : 10;
+	int res			= argc > 4 ? atoi(argv[4]) : 5;
+	int dim			= res*res*res;
+	srand(0);
+
+	std::vector< std::vector<double> > classes;
+	for(int c = 0; c < std::max(1,nr_models/20); c++){classes.push_back(createClass(dim));}
+
+	DescriptorIndex index (dim);
+	double start = reglib::getTime();
+	for(int i = 0; i < nr_models; i++){index.add(i,createDescriptor(classes[rand()%classes.size()],0.5));}
+	printf("added %i models in %6.3f s\n",nr_models,reglib::getTime()-start);
+
+	std::vector< std::vector<double> > queries;
+	for(int q = 0; q < nr_queries; q++){queries.push_back(createDescriptor(classes[rand()%classes.size()],0.5));}
+	evaluate(index,queries,k);
+
+	start = reglib::getTime();
+	int removed = 0;
+	for(int i = 0; i < nr_models; i += 4){removed += index.remove(i);}
+	printf("\nremoved %i models in %6.3f s\n",removed,reglib::getTime()-start);
+	evaluate(index,queries,k);
+	for(int q = 0; q < nr_queries; q++){
+		std::vector< std::pair<double,int> > result = index.search(queries[q],k);
+		for(unsigned int i = 0; i < result.size(); i++){
+			if(result[i].second % 4 == 0){printf("ERROR: removed model %i returned\n",result[i].second); return 1;}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,189 @@
+//Load throughput of models saved with Model::save (directory of pngs and _data.txt files) against ModelFile containers.
+//
+//benchmark_ModelFile [camera_data.txt model_dir [model_dir ...]]
+//benchmark_ModelFile -synthetic [nr_models] [nr_frames] [tmp_dir]
+//
+//Every model is converted to containers with different colour codecs, then the model is loaded from the directory and
+//from every container. Three loads are timed: the full model (frames with normals and the superpoints), the images only
+//(decoding to cv::Mat, the part that depends on the storage) and single frames in random order. The file cache is warm
+//for all of them, so the differences come from the number of files opened and the decoding.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+
+#include "model/ModelFile.h"
+#include "opencv2/highgui/highgui.hpp"
+#include "BenchmarkUtil.h"
+
+double fileSize(std::string path){
+	struct stat st;
+	if(stat(path.c_str(),&st) != 0){return 0;}
+	return double(st.st_size);
+}
+
+//Smooth surfaces with a few depth discontinuities, invalid borders and textured colour, with the object mask in the center
+reglib::Model * createModel(reglib::Camera * cam, int nr_frames){
+	reglib::Model * model = 0;
+	for(int f = 0; f < nr_frames; f++){
+		cv::Mat rgb (cam->height,cam->width,CV_8UC3);
+		cv::Mat depth (cam->height,cam->width,CV_16UC1);
+		cv::Mat mask (cam->height,cam->width,CV_8UC1);
+		double phase = 0.1*f;
+		for(unsigned int h = 0; h < cam->height; h++){
+			for(unsigned int w = 0; w < cam->width; w++){
+				int ind = h*cam->width+w;
+				double z = 1.5 + 0.3*sin(0.01*w+phase) + 0.2*cos(0.013*h) + (w > 300 && w < 420 && h > 200 && h < 330 ? -0.4 : 0);
+				bool valid = w > 8 && w < cam->width-8 && (rand() % 50) != 0;
+				((unsigned short *)depth.data)[ind] = valid ? (unsigned short)(z/cam->idepth_scale) : 0;
+				for(int c = 0; c < 3; c++){
+					rgb.data[3*ind+c] = (unsigned char)(128 + 60*sin(0.02*(c+1)*w+phase)*cos(0.015*h) + (rand() % 8));
+				}
+				mask.data[ind] = w > 280 && w < 440 && h > 180 && h < 350 ? 255 : 0;
+			}
+		}
+		Eigen::Matrix4d pose = Eigen::Matrix4d::Identity();
+		pose(0,3) = 0.01*f;
+		reglib::RGBDFrame * frame = new reglib::RGBDFrame(cam,rgb,depth,f,pose);
+		if(model == 0){	model = new reglib::Model(frame,mask);}
+		else{			model->addFrameToModel(frame,new reglib::ModelMask(mask),pose);}
+	}
+	model->scores.assign(nr_frames,std::vector<float>(nr_frames,0));
+	return model;
+}
+
+//Bytes read by Model::load
+double directorySize(std::string dir, int nr_frames){
+	char buf [1024];
+	double size = fileSize(dir+"/data.txt");
+	for(int f = 0; f < nr_frames; f++){
+		sprintf(buf,"%s/frame_%i",dir.c_str(),f);
+		size += fileSize(std::string(buf)+"_rgb.png") + fileSize(std::string(buf)+"_depth.png") + fileSize(std::string(buf)+"_data.txt");
+		sprintf(buf,"%s/modelmask_%i.png",dir.c_str(),f);
+		size += fileSize(buf);
+	}
+	return size;
+}
+
+struct Result{
+	double bytes;
+	double model_time;
+	double image_time;
+	double frame_time;
+	Result(){bytes = 0; model_time = 0; image_time = 0; frame_time = 0;}
+};
+
+int benchmark(reglib::Camera * cam, std::string dir, std::vector<Result> & results, std::vector<std::string> & names){
+	reglib::Model * model = reglib::Model::load(cam,dir);
+	const int nr_frames = model->frames.size();
+	std::vector<int> order;
+	for(int f = 0; f < nr_frames; f++){order.push_back(f);}
+	for(int f = 0; f < nr_frames; f++){std::swap(order[f],order[rand() % nr_frames]);}
+	char buf [1024];
+
+	const int nr_codecs = 4;
+	int codecs [nr_codecs] = {reglib::ModelFile::CODEC_AUTO, reglib::ModelFile::CODEC_RAW, reglib::ModelFile::CODEC_PNG, reglib::ModelFile::CODEC_JPG};
+	const char * codec_names [nr_codecs] = {"auto", "raw", "png", "jpg"};
+	std::vector<std::string> paths;
+	for(int c = 0; c < nr_codecs; c++){
+		reglib::ModelFile mf;
+		mf.rgb_codec = codecs[c];
+		paths.push_back(dir+"."+codec_names[c]+".qmf");
+		mf.save(model,cam,paths.back());
+	}
+	deleteModel(model);
+
+	if(results.size() == 0){
+		results.resize(nr_codecs+1);
+		names.push_back("directory");
+		for(int c = 0; c < nr_codecs; c++){names.push_back(std::string("container rgb ")+codec_names[c]);}
+	}
+
+	Result & old = results[0];
+	old.bytes += directorySize(dir,nr_frames);
+	double start = reglib::getTime();
+	deleteModel(reglib::Model::load(cam,dir));
+	old.model_time += reglib::getTime()-start;
+	start = reglib::getTime();
+	for(int f = 0; f < nr_frames; f++){
+		sprintf(buf,"%s/frame_%i",dir.c_str(),f);
+		cv::Mat rgb		= cv::imread(std::string(buf)+"_rgb.png",-1);
+		cv::Mat depth	= cv::imread(std::string(buf)+"_depth.png",-1);
+		sprintf(buf,"%s/modelmask_%i.png",dir.c_str(),f);
+		cv::Mat mask	= cv::imread(buf,-1);
+	}
+	old.image_time += reglib::getTime()-start;
+	start = reglib::getTime();
+	for(int f = 0; f < nr_frames; f++){
+		sprintf(buf,"%s/frame_%i",dir.c_str(),order[f]);
+		delete reglib::RGBDFrame::load(cam,std::string(buf));
+	}
+	old.frame_time += reglib::getTime()-start;
+
+	for(int c = 0; c < nr_codecs; c++){
+		Result & r = results[c+1];
+		r.bytes += fileSize(paths[c]);
+		start = reglib::getTime();
+		deleteModel(reglib::ModelFile::load(cam,paths[c]));
+		r.model_time += reglib::getTime()-start;
+
+		reglib::ModelFile mf;
+		start = reglib::getTime();
+		mf.open(paths[c]);
+		for(int f = 0; f < nr_frames; f++){
+			cv::Mat rgb		= mf.loadRGB(f);
+			cv::Mat depth	= mf.loadDepth(f);
+			cv::Mat mask	= mf.loadMask(f);
+		}
+		r.image_time += reglib::getTime()-start;
+		start = reglib::getTime();
+		for(int f = 0; f < nr_frames; f++){delete mf.loadFrame(cam,order[f]);}
+		r.frame_time += reglib::getTime()-start;
+	}
+	printf("%s: %i frames\n",dir.c_str(),nr_frames);
+	return nr_frames;
+}
+
+int main(int argc, char **argv){
+	srand(0);
+	reglib::Camera * cam = 0;
+	std::vector<std::string> dirs;
+	int nr_frames_total = 0;
+	if(argc > 1 && std::string(argv[1]).compare("-synthetic") != 0){
+		cam = reglib::Camera::load(std::string(argv[1]));
+		for(int i = 2; i < argc; i++){dirs.push_back(std::string(argv[i]));}
+	}else{
+		int nr_models		= argc > 2 ? atoi(argv[2]) : 5;
+		int nr_frames		= argc > 3 ? atoi(argv[3]) : 10;
+		std::string tmp		= argc > 4 ? std::string(argv[4]) : std::string("/tmp/benchmark_ModelFile");
+		cam = new reglib::Camera();
+		char buf [1024];
+		for(int m = 0; m < nr_models; m++){
+			sprintf(buf,"%s/model%i",tmp.c_str(),m);
+			dirs.push_back(std::string(buf));
+			boost::filesystem::create_directories(dirs.back()+"/views");
+			reglib::Model * model = createModel(cam,nr_frames);
+			model->save(dirs.back());
+			deleteModel(model);
+		}
+	}
+
+	std::vector<Result> results;
+	std::vector<std::string> names;
+	for(unsigned int i = 0; i < dirs.size(); i++){
+		nr_frames_total += benchmark(cam,dirs[i],results,names);
+	}
+
+	printf("\n%i models, %i frames\n",int(dirs.size()),nr_frames_total);
+	printf("%-22s %10s %14s %14s %14s %10s\n","","MB","model ms/frame","images MB/s","frame ms","speedup");
+	for(unsigned int i = 0; i < results.size(); i++){
+		Result & r = results[i];
+		printf("%-22s %10.2f %14.3f %14.1f %14.3f %9.2fx\n",names[i].c_str(),r.bytes/1e6,1000.0*r.model_time/double(nr_frames_total),
+			   r.image_time > 0 ? r.bytes/1e6/r.image_time : 0,1000.0*r.frame_time/double(nr_frames_total),r.model_time > 0 ? results[0].model_time/r.model_time : 0);
+	}
+	return 0;
+}
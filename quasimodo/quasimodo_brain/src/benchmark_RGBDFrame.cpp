@@ -0,0 +1,223 @@
+//Per stage runtime of the RGBDFrame preprocessing, the previous column-major loops with pcl normal estimation against the
+//row-major kernels in FramePreprocessing.h, on synthetic depth images.
+//
+//benchmark_RGBDFrame [nr_frames]
+//
+//Frames of 640x480, 1280x960 and 1920x1440 pixels are generated with smooth surfaces, a box in front of them and
+//missing depth. For both implementations the depth edges and the normals are timed separately, and the frames are also
+//built with the RGBDFrame constructor, with the segmentation enabled. The number of edge pixels that differ and the mean angle between the normals
+//of the two implementations are reported next to the runtimes.
+//
+//The superpixel segmentation of FrameSegmentation.h is timed per stage on the same frames, with the number of segments
+//and the fraction of depth discontinuities between neighbouring pixels that lie inside a segment instead of on a border.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+
+#include "core/RGBDFrame.h"
+#include "core/FramePreprocessing.h"
+#include "core/FrameSegmentation.h"
+#include "BenchmarkUtil.h"
+
+cv::Mat createDepth(reglib::Camera * cam, int width, int height, int seed){
+	cv::Mat depth (height,width,CV_16UC1);
+	unsigned short * data = (unsigned short *)depth.data;
+	double scale = 640.0/double(width);
+	for(int h = 0; h < height; h++){
+		for(int w = 0; w < width; w++){
+			double u = scale*w;
+			double v = scale*h;
+			double z = 1.5 + 0.3*sin(0.01*u+0.1*seed) + 0.2*cos(0.013*v) + (u > 300 && u < 420 && v > 200 && v < 330 ? -0.4 : 0);
+			bool valid = u > 8 && u < 632 && (rand() % 50) != 0;
+			data[h*width+w] = valid ? (unsigned short)(z/cam->idepth_scale) : 0;
+		}
+	}
+	return depth;
+}
+
+//The loops of the RGBDFrame constructor before FramePreprocessing.h
+void legacyDepthEdges(reglib::Camera * cam, const cv::Mat & depth, cv::Mat & depthedges){
+	const int width = depth.cols;
+	const int height = depth.rows;
+	const double idepth = cam->idepth_scale;
+	unsigned short * depthdata = (unsigned short *)depth.data;
+	depthedges.create(height,width,CV_8UC1);
+	unsigned char * depthedgesdata = (unsigned char *)depthedges.data;
+	double t = 0.01;
+	const int dw [8] = {-1,1,0,0,-1,-1,1,1};
+	const int dh [8] = {0,0,-1,1,-1,1,-1,1};
+	for(int w = 0; w < width; w++){
+		for(int h = 0; h < height;h++){
+			int ind = h*width+w;
+			depthedgesdata[ind] = 0;
+			double z = idepth*double(depthdata[ind]);
+			for(int k = 0; k < 8; k++){
+				int w2 = w+dw[k];
+				int h2 = h+dh[k];
+				if(w2 < 0 || w2 >= width || h2 < 0 || h2 >= height){continue;}
+				double z2 = idepth*double(depthdata[h2*width+w2]);
+				double info = 1.0/(z*z+z2*z2);
+				double diff = fabs(z2-z)*info;
+				if(diff > t){depthedgesdata[ind] = 255;}
+			}
+		}
+	}
+}
+
+void legacyNormals(reglib::Camera * cam, const cv::Mat & depth, cv::Mat & normals){
+	const int width = depth.cols;
+	const int height = depth.rows;
+	const double idepth = cam->idepth_scale;
+	const double ifx = 1.0/cam->fx;
+	const double ify = 1.0/cam->fy;
+	unsigned short * depthdata = (unsigned short *)depth.data;
+	normals.create(height,width,CV_32FC3);
+	float * normalsdata = (float *)normals.data;
+
+	pcl::PointCloud<pcl::PointXYZ>::Ptr	cloud	(new pcl::PointCloud<pcl::PointXYZ>);
+	pcl::PointCloud<pcl::Normal>::Ptr	pclnormals (new pcl::PointCloud<pcl::Normal>);
+	cloud->width	= width;
+	cloud->height	= height;
+	cloud->points.resize(width*height);
+	for(int w = 0; w < width; w++){
+		for(int h = 0; h < height;h++){
+			int ind = h*width+w;
+			pcl::PointXYZ & p = cloud->points[ind];
+			double z = idepth*double(depthdata[ind]);
+			if(z > 0){
+				p.x = (double(w) - cam->cx) * z * ifx;
+				p.y = (double(h) - cam->cy) * z * ify;
+				p.z = z;
+			}else{
+				p.x = NAN;
+				p.y = NAN;
+				p.z = NAN;
+			}
+		}
+	}
+
+	pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
+	ne.setInputCloud(cloud);
+	ne.setMaxDepthChangeFactor(0.02);
+	ne.setNormalSmoothingSize(7);
+	ne.setDepthDependentSmoothing(1);
+	ne.compute(*pclnormals);
+
+	for(int w = 0; w < width; w++){
+		for(int h = 0; h < height;h++){
+			int ind = h*width+w;
+			pcl::Normal p2 = pclnormals->points[ind];
+			bool valid = !std::isnan(p2.normal_x);
+			normalsdata[3*ind+0]	= valid ? p2.normal_x : 2;
+			normalsdata[3*ind+1]	= valid ? p2.normal_y : 2;
+			normalsdata[3*ind+2]	= valid ? p2.normal_z : 2;
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	int nr_frames = argc > 1 ? atoi(argv[1]) : 10;
+	srand(0);
+
+	const int nr_sizes = 3;
+	int widths [nr_sizes] = {640,1280,1920};
+	for(int s = 0; s < nr_sizes; s++){
+		const int width = widths[s];
+		const int height = 3*width/4;
+		const double scale = double(width)/640.0;
+		reglib::Camera * cam = new reglib::Camera();
+		cam->width = width;
+		cam->height = height;
+		cam->fx = cam->fy = 535.0*scale;
+		cam->cx = 0.5*(width-1);
+		cam->cy = 0.5*(height-1);
+
+		std::vector<cv::Mat> depths;
+		for(int f = 0; f < nr_frames; f++){depths.push_back(createDepth(cam,width,height,f));}
+		cv::Mat rgb = cv::Mat::zeros(height,width,CV_8UC3);
+
+		double legacy_edges = 0;
+		double legacy_normals = 0;
+		double frame_time = 0;
+		long edge_diffs = 0;
+		double angle_sum = 0;
+		long angle_count = 0;
+		long normals_only_legacy = 0;
+		long normals_only_new = 0;
+		long nr_segments = 0;
+		long depth_jumps = 0;
+		long depth_jumps_inside = 0;
+
+		reglib::FramePreprocessor preprocessor (cam->idepth_scale,cam->fx,cam->fy,cam->cx,cam->cy);
+		std::vector<unsigned char> edges (width*height);
+		std::vector<float> normals (3*width*height);
+		reglib::FrameSegmenter segmenter;
+		std::vector<int> labels (width*height);
+		std::vector< std::vector< std::pair<int,double> > > connections, intersections;
+		for(int f = 0; f < nr_frames; f++){
+			cv::Mat old_edges, old_normals;
+			double start = reglib::getTime();
+			legacyDepthEdges(cam,depths[f],old_edges);
+			legacy_edges += reglib::getTime()-start;
+			start = reglib::getTime();
+			legacyNormals(cam,depths[f],old_normals);
+			legacy_normals += reglib::getTime()-start;
+
+			preprocessor.compute((unsigned short *)depths[f].data,width,height,edges.data(),normals.data());
+			int nr_labels = segmenter.segment(rgb.data,preprocessor.px.data(),preprocessor.py.data(),preprocessor.pz.data(),normals.data(),width,height,labels.data());
+			segmenter.computeAdjacency(labels.data(),nr_labels,preprocessor.pz.data(),connections,intersections);
+			nr_segments += nr_labels;
+			for(int h = 0; h < height; h++){
+				for(int w = 0; w+1 < width; w++){
+					const int ind = h*width+w;
+					const float z = preprocessor.pz[ind];
+					const float z2 = preprocessor.pz[ind+1];
+					if(std::isfinite(z) && std::isfinite(z2) && std::fabs(z2-z) > segmenter.edge_threshold*(z*z+z2*z2)){
+						depth_jumps++;
+						depth_jumps_inside += labels[ind] == labels[ind+1];
+					}
+				}
+			}
+
+			start = reglib::getTime();
+			delete new reglib::RGBDFrame(cam,rgb,depths[f],0,Eigen::Matrix4d::Identity(),true,true);
+			frame_time += reglib::getTime()-start;
+
+			for(int i = 0; i < width*height; i++){
+				edge_diffs += old_edges.data[i] != edges[i];
+				const float * a = ((float *)old_normals.data)+3*i;
+				const float * b = normals.data()+3*i;
+				bool valid_a = a[0] != 2;
+				bool valid_b = b[0] != 2;
+				normals_only_legacy += valid_a && !valid_b;
+				normals_only_new += !valid_a && valid_b;
+				if(valid_a && valid_b){
+					angle_sum += acos(std::max(-1.0f,std::min(1.0f,a[0]*b[0]+a[1]*b[1]+a[2]*b[2])));
+					angle_count++;
+				}
+			}
+		}
+		double legacy_frame = legacy_edges+legacy_normals;
+
+		double ms = 1000.0/double(nr_frames);
+		double kernel_normals = preprocessor.time_integral+preprocessor.time_distance+preprocessor.time_normals;
+		double kernel_total = preprocessor.time_points+preprocessor.time_edges+kernel_normals;
+		printf("%ix%i, %i frames, ms per frame\n",width,height,nr_frames);
+		printf("  legacy   edges %8.3f normals %8.3f total %8.3f\n",ms*legacy_edges,ms*legacy_normals,ms*legacy_frame);
+		printf("  kernels  points %7.3f edges %8.3f integral %7.3f distance %7.3f normals %7.3f total %8.3f (%4.2fx faster)\n",
+			   ms*preprocessor.time_points,ms*preprocessor.time_edges,ms*preprocessor.time_integral,ms*preprocessor.time_distance,
+			   ms*preprocessor.time_normals,ms*kernel_total,kernel_total > 0 ? legacy_frame/kernel_total : 0);
+		printf("  segmentation  assign %7.3f update %7.3f connectivity %7.3f adjacency %7.3f total %8.3f\n",
+			   ms*segmenter.time_assign,ms*segmenter.time_update,ms*segmenter.time_connectivity,ms*segmenter.time_adjacency,
+			   ms*(segmenter.time_assign+segmenter.time_update+segmenter.time_connectivity+segmenter.time_adjacency));
+		printf("  %li segments per frame, %li of %li depth discontinuities inside a segment\n",
+			   nr_segments/nr_frames,depth_jumps_inside,depth_jumps);
+		printf("  RGBDFrame constructor %8.3f\n",ms*frame_time);
+		printf("  differing edge pixels %li, mean normal angle %6.3f deg over %li pixels, normals only in legacy %li, only in kernels %li\n",
+			   edge_diffs,angle_count > 0 ? 180.0/M_PI*angle_sum/double(angle_count) : 0,angle_count,normals_only_legacy,normals_only_new);
+		delete cam;
+	}
+	return 0;
+}
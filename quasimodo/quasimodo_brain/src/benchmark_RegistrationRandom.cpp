@@ -0,0 +1,122 @@
+//Runtime, repeatability and alignment error of RegistrationRandom::getTransform on synthetic objects.
+//
+//benchmark_RegistrationRandom [nr_objects] [nr_points] [noise] [prune_ratio]
+//
+//Every object is a few boxes stacked on each other. The source is the object in its own coordinates, the destination
+//is the object under a random rotation and translation, both with gaussian noise. Every object is registered with one
+//thread and twice with all threads: the candidates of the three runs should be identical. The runtime, the number of
+//pruned starts and the error of the best candidate against the ground truth are reported.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <cmath>
+#include <omp.h>
+
+#include "registration/Registration.h"
+#include "BenchmarkUtil.h"
+
+//Points and normals on the sides of a few boxes of random sizes, stacked along z
+void createObject(std::vector<Eigen::Vector3d> & points, std::vector<Eigen::Vector3d> & normals, int nr_points){
+	std::vector<Eigen::Vector3d> box_min, box_max;
+	double z = 0;
+	for(int b = 0; b < 3; b++){
+		Eigen::Vector3d size (0.1+0.3*randu(),0.1+0.2*randu(),0.05+0.2*randu());
+		Eigen::Vector3d mi (0.1*randu(),0.1*randu(),z);
+		box_min.push_back(mi);
+		box_max.push_back(mi+size);
+		z += size(2);
+	}
+	points.clear();
+	normals.clear();
+	while(int(points.size()) < nr_points){
+		int b = rand()%box_min.size();
+		Eigen::Vector3d mi = box_min[b];
+		Eigen::Vector3d ma = box_max[b];
+		Eigen::Vector3d s = ma-mi;
+		Eigen::Vector3d p = mi + Eigen::Vector3d(s(0)*randu(),s(1)*randu(),s(2)*randu());
+		Eigen::Vector3d n = Eigen::Vector3d::Zero();
+		int side = rand()%6;
+		p(side/2) = side%2 == 0 ? mi(side/2) : ma(side/2);
+		n(side/2) = side%2 == 0 ? -1 : 1;
+		points.push_back(p);
+		normals.push_back(n);
+	}
+}
+
+reglib::CloudData * createCloud(const std::vector<Eigen::Vector3d> & points, const std::vector<Eigen::Vector3d> & normals, const Eigen::Matrix4d & pose, double noise){
+	reglib::CloudData * cloud = new reglib::CloudData();
+	cloud->data.resize(3,points.size());
+	cloud->normals.resize(3,points.size());
+	cloud->information = Eigen::MatrixXd::Constant(1,points.size(),1.0/(noise*noise));
+	Eigen::Matrix3d rot = pose.block<3,3>(0,0);
+	for(unsigned int i = 0; i < points.size(); i++){
+		cloud->data.col(i)		= rot*points[i] + pose.block<3,1>(0,3) + noise*Eigen::Vector3d(randn(),randn(),randn());
+		cloud->normals.col(i)	= rot*normals[i];
+	}
+	return cloud;
+}
+
+int main(int argc, char **argv){
+	int nr_objects		= argc > 1 ? atoi(argv[1]) : 5;
+	int nr_points		= argc > 2 ? atoi(argv[2]) : 20000;
+	double noise		= argc > 3 ? atof(argv[3]) : 0.002;
+	double prune_ratio	= argc > 4 ? atof(argv[4]) : 3.0;
+	int nr_threads		= omp_get_max_threads();
+	srand(0);
+
+	double total_time [2] = {0,0};
+	int nr_correct = 0;
+	int nr_repeatable = 0;
+	for(int o = 0; o < nr_objects; o++){
+		std::vector<Eigen::Vector3d> points, normals;
+		createObject(points,normals,nr_points);
+		Eigen::Matrix4d gt = Eigen::Matrix4d::Identity();
+		Eigen::Vector3d axis (randn(),randn(),randn());
+		gt.block<3,3>(0,0) = Eigen::AngleAxisd(2.0*M_PI*randu(),axis.normalized()).toRotationMatrix();
+		for(int k = 0; k < 3; k++){gt(k,3) = randn();}
+		reglib::CloudData * src = createCloud(points,normals,Eigen::Matrix4d::Identity(),noise);
+		reglib::CloudData * dst = createCloud(points,normals,gt,noise);
+
+		std::vector<reglib::FusionResults> results;
+		for(int run = 0; run < 3; run++){
+			reglib::RegistrationRandom * reg = new reglib::RegistrationRandom();
+			reg->visualizationLvl	= 0;
+			reg->prune_ratio		= prune_ratio;
+			reg->nr_threads			= run == 0 ? 1 : nr_threads;
+			reg->setSrc(src);
+			reg->setDst(dst);
+			double start = reglib::getTime();
+			results.push_back(reg->getTransform(Eigen::Matrix4d::Identity()));
+			if(run < 2){total_time[run] += reglib::getTime()-start;}
+			delete reg;
+		}
+
+		bool repeatable = true;
+		for(int run = 1; run < 3; run++){
+			repeatable &= results[run].candidates.size() == results[0].candidates.size();
+			for(unsigned int c = 0; repeatable && c < results[0].candidates.size(); c++){
+				repeatable &= (results[run].candidates[c]-results[0].candidates[c]).cwiseAbs().maxCoeff() == 0;
+			}
+		}
+		nr_repeatable += repeatable;
+
+		double rot_err = 180;
+		double trans_err = 0;
+		if(results[0].candidates.size() > 0){
+			Eigen::Matrix4d diff = gt.inverse()*results[0].candidates[0];
+			double c = std::min(1.0,std::max(-1.0,0.5*(diff.block<3,3>(0,0).trace()-1)));
+			rot_err = acos(c)*180.0/M_PI;
+			trans_err = diff.block<3,1>(0,3).norm();
+		}
+		nr_correct += rot_err < 5 && trans_err < 0.05;
+		printf("object %i: %i candidates, best error %7.3f deg %6.4f m, %s\n",o,int(results[0].candidates.size()),rot_err,trans_err,repeatable ? "repeatable" : "NOT repeatable");
+		delete src;
+		delete dst;
+	}
+
+	printf("\n%i objects, %i correct, %i repeatable\n",nr_objects,nr_correct,nr_repeatable);
+	printf("1 thread   %8.3f s per object\n",total_time[0]/double(nr_objects));
+	printf("%-2i threads %8.3f s per object (%4.2fx faster)\n",nr_threads,total_time[1]/double(nr_objects),total_time[1] > 0 ? total_time[0]/total_time[1] : 0);
+	return 0;
+}
@@ -0,0 +1,70 @@
+//Converts models saved by Model::save (a directory with pngs and _data.txt files per frame) to single ModelFile
+//containers, and back.
+//
+//convertModelFile [-rgb raw|delta|png|jpg|auto] [-depth raw|delta|png] camera_data.txt model_dir [model_dir ...]
+//convertModelFile -unpack camera_data.txt model.qmf [model.qmf ...]
+//
+//Every model_dir is written to model_dir.qmf. With -unpack every model.qmf is written to the directory model.qmf.dir
+//in the old layout.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <boost/filesystem.hpp>
+
+#include "model/ModelFile.h"
+#include "BenchmarkUtil.h"
+
+int getCodec(std::string name){
+	if(name.compare("raw") == 0){	return reglib::ModelFile::CODEC_RAW;}
+	if(name.compare("delta") == 0){	return reglib::ModelFile::CODEC_DELTA;}
+	if(name.compare("png") == 0){	return reglib::ModelFile::CODEC_PNG;}
+	if(name.compare("jpg") == 0){	return reglib::ModelFile::CODEC_JPG;}
+	if(name.compare("auto") == 0){	return reglib::ModelFile::CODEC_AUTO;}
+	printf("unknown codec %s, using auto\n",name.c_str());
+	return reglib::ModelFile::CODEC_AUTO;
+}
+
+int main(int argc, char **argv){
+	reglib::ModelFile mf;
+	reglib::Camera * cam = 0;
+	bool unpack = false;
+	int converted = 0;
+	for(int i = 1; i < argc; i++){
+		std::string arg = std::string(argv[i]);
+		if(arg.compare("-rgb") == 0 && i+1 < argc){			mf.rgb_codec = getCodec(argv[++i]);}
+		else if(arg.compare("-depth") == 0 && i+1 < argc){	mf.depth_codec = getCodec(argv[++i]);}
+		else if(arg.compare("-unpack") == 0){				unpack = true;}
+		else if(cam == 0){									cam = reglib::Camera::load(arg);}
+		else if(unpack){
+			reglib::Model * model = reglib::ModelFile::load(cam,arg);
+			if(model == 0){continue;}
+			std::string dir = arg+".dir";
+			boost::system::error_code ec;
+			boost::filesystem::create_directories(dir+"/views",ec);
+			if(ec){printf("cant create %s: %s\n",dir.c_str(),ec.message().c_str()); deleteModel(model); continue;}
+			model->save(dir);
+			printf("unpacked %s to %s\n",arg.c_str(),dir.c_str());
+			deleteModel(model);
+			converted++;
+		}else{
+			while(arg.size() > 1 && arg[arg.size()-1] == '/'){arg.resize(arg.size()-1);}
+			double start = reglib::getTime();
+			reglib::Model * model = reglib::Model::load(cam,arg);
+			if(model == 0){continue;}
+			double load_time = reglib::getTime()-start;
+			start = reglib::getTime();
+			bool ok = mf.save(model,cam,arg+".qmf");
+			printf("%s: %i frames, loaded in %6.3f s, %s %s.qmf in %6.3f s\n",arg.c_str(),int(model->frames.size()),load_time,ok ? "wrote" : "FAILED to write",arg.c_str(),reglib::getTime()-start);
+			deleteModel(model);
+			converted += ok;
+		}
+	}
+	if(cam == 0){
+		printf("usage: convertModelFile [-rgb raw|delta|png|jpg|auto] [-depth raw|delta|png] camera_data.txt model_dir [model_dir ...]\n");
+		printf("       convertModelFile -unpack camera_data.txt model.qmf [model.qmf ...]\n");
+		return 1;
+	}
+	printf("converted %i models\n",converted);
+	return 0;
+}
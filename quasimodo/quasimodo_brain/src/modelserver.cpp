@@ -23,6 +23,7 @@
 //#include "/home/johane/catkin_ws_dyn/src/quasimodo_models/include/modelupdater/ModelUpdater.h"
 #include "modelupdater/ModelUpdater.h"
 #include "core/RGBDFrame.h"
+#include "model/ModelFile.h"
 #include <sensor_msgs/PointCloud2.h>
 #include <string.h>
 
@@ -38,6 +39,8 @@
 #include <map>
 
 #include "ModelDatabase/ModelDatabase.h"
+#include "RegistrationScheduler.h"
+#include <boost/filesystem.hpp>
 
 #include <thread>
 
@@ -80,6 +83,13 @@ double massreg_timeout = 60;
 
 bool run_search = false;
 double search_timeout = 30;
+int search_candidates = 150;//number of database matches registered against a model added to the database
+int search_probes = 8;//only used by the histogram database
+std::string vocabulary_path = std::string(getenv("HOME") ? getenv("HOME") : ".")+"/.semanticMap/vocabulary";
+bool use_histogram_database = false;
+int registration_threads = 0;//0 -> number of cores
+double registration_stop_score = 100;//candidates not yet registered are cancelled once a registration scores this high
+bool compute_segmentation = true;//superpixels of the indexed and searched frames, see FrameSegmentation.h
 
 bool myfunction (reglib::Model * i,reglib::Model * j) { return i->frames.size() > j->frames.size(); }
 
@@ -387,7 +397,7 @@ bool indexFrame(quasimodo_msgs::index_frame::Request  & req, quasimodo_msgs::ind
 	tf::poseMsgToEigen(pose, epose);
 
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
-	reglib::RGBDFrame * frame = new reglib::RGBDFrame(cameras[0],rgb, depth, double(capture_time.sec)+double(capture_time.nsec)/1000000000.0, epose.matrix());
+	reglib::RGBDFrame * frame = new reglib::RGBDFrame(cameras[0],rgb, depth, double(capture_time.sec)+double(capture_time.nsec)/1000000000.0, epose.matrix(), true, compute_segmentation);
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
 	frames[frame->id] = frame;
 	res.frame_id = frame->id;
@@ -418,29 +428,16 @@ bool removeModel(int id){
 }
 
 
-reglib::Model * mod;
-std::vector<reglib::Model * > res;
-std::vector<reglib::FusionResults > fr_res;
-
-void call_from_thread(int i) {
-	reglib::Model * model2 = res[i];
-
-	printf("testreg %i to %i\n",int(mod->id),int(model2->id));
-	reglib::RegistrationRandom *	reg		= new reglib::RegistrationRandom();
-	reglib::ModelUpdaterBasicFuse * mu	= new reglib::ModelUpdaterBasicFuse( model2, reg);
-	mu->occlusion_penalty               = occlusion_penalty;
-	mu->massreg_timeout                 = massreg_timeout;
-	mu->viewer							= viewer;
-	reg->visualizationLvl				= 0;
-
-	reglib::FusionResults fr = mu->registerModel(mod);
-	fr_res[i] = fr;
-
-	delete mu;
-	delete reg;
+//deletes a model which is not kept, with its frames and masks
+void deleteSearchModel(ModelDatabase * database, reglib::Model * model){
+	database->remove(model);
+	for(unsigned int i = 0; i < model->frames.size(); i++){
+		delete model->frames[i];
+		delete model->modelmasks[i];
+	}
+	delete model;
 }
 
-
 int current_model_update = 0;
 void addToDB(ModelDatabase * database, reglib::Model * model, bool add = true, bool deleteIfFail = false){
 	printf("addToDB %i %i\n",int(add),int(deleteIfFail));
@@ -463,12 +460,11 @@ void addToDB(ModelDatabase * database, reglib::Model * model, bool add = true, b
 		//		show_sorted();
 	}
 
-	mod = model;
-	res = modeldatabase->search(model,150);
-	fr_res.resize(res.size());
+	std::vector<reglib::Model * > res = modeldatabase->search(model,search_candidates);
 
 	if(res.size() == 0){
 		printf("no candidates found in database!\n");
+		if(deleteIfFail){deleteSearchModel(database,model);}
 		return;
 	}
 
@@ -477,88 +473,68 @@ void addToDB(ModelDatabase * database, reglib::Model * model, bool add = true, b
 	std::map<int , reglib::Model *>	updated_models;
 	std::vector<reglib::Model * > models2merge;
 	std::vector<reglib::FusionResults > fr2merge;
-	bool multi_thread = false;
-	if(multi_thread){
-		const int num_threads = res.size();
-		std::thread t[num_threads];
-		for (int i = 0; i < num_threads; ++i) {t[i] = std::thread(call_from_thread,i);}
-		for (int i = 0; i < num_threads; ++i) {t[i].join();}
-		for (int i = 0; i < num_threads; ++i) {
-			reglib::Model * model2 = res[i];
-			reglib::FusionResults fr = fr_res[i];
-			if(fr.score > 100){
-				fr.guess = fr.guess.inverse();
-				fr2merge.push_back(fr);
-				models2merge.push_back(model2);
-				printf("%i could be registered\n",i);
-			}
-		}
 
-		for(unsigned int i = 0; i < models2merge.size(); i++){
-			reglib::Model * model2 = models2merge[i];
-
-			reglib::RegistrationRandom *	reg		= new reglib::RegistrationRandom();
-			reglib::ModelUpdaterBasicFuse * mu	= new reglib::ModelUpdaterBasicFuse( model2, reg);
-			mu->occlusion_penalty               = occlusion_penalty;
-			mu->massreg_timeout                 = massreg_timeout;
-			mu->viewer							= viewer;
-			reg->visualizationLvl				= 0;
-
-			reglib::UpdatedModels ud = mu->fuseData(&(fr2merge[i]), model, model2);
-			printf("merge %i to %i\n",int(model->id),int(model2->id));
-			printf("new_models:     %i\n",int(ud.new_models.size()));
-			printf("updated_models: %i\n",int(ud.updated_models.size()));
-			printf("deleted_models: %i\n",int(ud.deleted_models.size()));
-
-			delete mu;
-			delete reg;
+	//register against the candidates, best retrieval match first, on a bounded number of threads
+	std::vector<reglib::FusionResults > fr_res (res.size());
+	RegistrationScheduler scheduler (registration_threads, registration_stop_score);
+	std::vector<RegistrationScheduler::TaskResult> task_results = scheduler.run(res.size(),[&](int i) -> double {
+		reglib::Model * model2 = res[i];
+		reglib::RegistrationRandom *	reg		= new reglib::RegistrationRandom();
+		reglib::ModelUpdaterBasicFuse * mu	= new reglib::ModelUpdaterBasicFuse( model2, reg);
+		mu->occlusion_penalty               = occlusion_penalty;
+		mu->massreg_timeout                 = massreg_timeout;
+		mu->viewer							= viewer;
+		reg->visualizationLvl				= 0;
+		reg->nr_threads						= 1;//the scheduler already runs one registration per thread
 
-			for(unsigned int j = 0; j < ud.new_models.size(); j++){		new_models[ud.new_models[j]->id]			= ud.new_models[j];}
-			for(unsigned int j = 0; j < ud.updated_models.size(); j++){	updated_models[ud.updated_models[j]->id]	= ud.updated_models[j];}
+		fr_res[i] = mu->registerModel(model);
 
-			for(unsigned int j = 0; j < ud.deleted_models.size(); j++){
-				database->remove(ud.deleted_models[j]);
-				delete ud.deleted_models[j];
-			}
-			if(ud.deleted_models.size() > 0){changed = true; break;}
+		delete mu;
+		delete reg;
+		return fr_res[i].score;
+	});
+	RegistrationScheduler::printMetrics(task_results,scheduler.last_time);
+
+	for(unsigned int i = 0; i < res.size(); i++){
+		reglib::Model * model2 = res[i];
+		reglib::FusionResults fr = fr_res[i];
+		if(task_results[i].done && fr.score >= registration_stop_score){
+			fr.guess = fr.guess.inverse();
+			fr2merge.push_back(fr);
+			models2merge.push_back(model2);
+			printf("%i could be registered\n",i);
 		}
-	}else{
-		for(unsigned int i = 0; i < res.size(); i++){
-			reglib::Model * model2 = res[i];
-			reglib::RegistrationRandom *	reg	= new reglib::RegistrationRandom();
-			reglib::ModelUpdaterBasicFuse * mu	= new reglib::ModelUpdaterBasicFuse( model2, reg);
-			mu->occlusion_penalty               = occlusion_penalty;
-			mu->massreg_timeout                 = massreg_timeout;
-			mu->viewer							= viewer;
-			reg->visualizationLvl				= 0;
-			reglib::FusionResults fr = mu->registerModel(model);
+	}
 
-			if(fr.score > 100){
-				fr.guess = fr.guess.inverse();
+	for(unsigned int i = 0; i < models2merge.size(); i++){
+		reglib::Model * model2 = models2merge[i];
 
-				reglib::UpdatedModels ud = mu->fuseData(&fr, model, model2);
-				printf("merge %i to %i\n",int(model->id),int(model2->id));
-				printf("new_models:     %i\n",int(ud.new_models.size()));
-				printf("updated_models: %i\n",int(ud.updated_models.size()));
-				printf("deleted_models: %i\n",int(ud.deleted_models.size()));
+		reglib::RegistrationRandom *	reg		= new reglib::RegistrationRandom();
+		reglib::ModelUpdaterBasicFuse * mu	= new reglib::ModelUpdaterBasicFuse( model2, reg);
+		mu->occlusion_penalty               = occlusion_penalty;
+		mu->massreg_timeout                 = massreg_timeout;
+		mu->viewer							= viewer;
+		reg->visualizationLvl				= 0;
 
-				for(unsigned int j = 0; j < ud.new_models.size(); j++){		new_models[ud.new_models[j]->id]			= ud.new_models[j];}
-				for(unsigned int j = 0; j < ud.updated_models.size(); j++){	updated_models[ud.updated_models[j]->id]	= ud.updated_models[j];}
+		reglib::UpdatedModels ud = mu->fuseData(&(fr2merge[i]), model, model2);
+		printf("merge %i to %i\n",int(model->id),int(model2->id));
+		printf("new_models:     %i\n",int(ud.new_models.size()));
+		printf("updated_models: %i\n",int(ud.updated_models.size()));
+		printf("deleted_models: %i\n",int(ud.deleted_models.size()));
 
-				for(unsigned int j = 0; j < ud.deleted_models.size(); j++){
-					database->remove(ud.deleted_models[j]);
-					delete ud.deleted_models[j];
-				}
-				if(ud.deleted_models.size() > 0){changed = true; break;}
-			}
+		delete mu;
+		delete reg;
 
-			delete mu;
-			delete reg;
+		for(unsigned int j = 0; j < ud.new_models.size(); j++){		new_models[ud.new_models[j]->id]			= ud.new_models[j];}
+		for(unsigned int j = 0; j < ud.updated_models.size(); j++){	updated_models[ud.updated_models[j]->id]	= ud.updated_models[j];}
+
+		for(unsigned int j = 0; j < ud.deleted_models.size(); j++){
+			database->remove(ud.deleted_models[j]);
+			delete ud.deleted_models[j];
 		}
+		if(ud.deleted_models.size() > 0){changed = true; break;}
 	}
 
-
-
 	for (std::map<int,reglib::Model *>::iterator it=updated_models.begin(); it!=updated_models.end();	++it) {
 		database->remove(it->second);
 		models_deleted_pub.publish(getModelMSG(it->second));
@@ -586,12 +562,7 @@ void addToDB(ModelDatabase * database, reglib::Model * model, bool add = true, b
 	if(deleteIfFail){
 		if(!changed){
 			printf("didnt manage to integrate searchresult\n");
-			database->remove(model);
-			for(unsigned int i = 0; i < model->frames.size(); i++){
-				delete model->frames[i];
-				delete model->modelmasks[i];
-			}
-			delete model;
+			deleteSearchModel(database,model);
 		}else{
 			printf("integrateing searchresult\n");
 		}
@@ -682,6 +653,7 @@ bool modelFromFrame(quasimodo_msgs::model_from_frame::Request  & req, quasimodo_
 		newmodel->recomputeModelPoints();
 		newmodel->last_changed = ++current_model_update;
 		newmodel->print();
+		modeldatabase->add(newmodel);//index it again, it was indexed when it had only its first frame
 		addToDB(modeldatabase, newmodel,false);
 		//if(modaddcount % 1 == 0){show_sorted();}
 		show_sorted();
@@ -800,7 +772,7 @@ bool modelFromFrame(quasimodo_msgs::model_from_frame::Request  & req, quasimodo_
 //								cv::namedWindow( "overlap", cv::WINDOW_AUTOSIZE );			cv::imshow( "overlap", overlap );
 
 								Eigen::Affine3d epose = Eigen::Affine3d::Identity();
-								reglib::RGBDFrame * frame = new reglib::RGBDFrame(cameras[0],rgbimage, depthimage, 0, epose.matrix());
+								reglib::RGBDFrame * frame = new reglib::RGBDFrame(cameras[0],rgbimage, depthimage, 0, epose.matrix(), true, compute_segmentation);
 								reglib::Model * searchmodel = new reglib::Model(frame,maskimage);
 								bool res = searchmodel->testFrame(0);
 
@@ -882,7 +854,6 @@ void clearMem(){
 int main(int argc, char **argv){
 	cameras[0]		= new reglib::Camera();
 	registration	= new reglib::RegistrationRandom();
-	modeldatabase	= new ModelDatabaseRGBHistogram(5);
 
 	ros::init(argc, argv, "quasimodo_model_server");
 	ros::NodeHandle n;
@@ -911,6 +882,7 @@ int main(int argc, char **argv){
 	database_pcd_pub  = n.advertise<sensor_msgs::PointCloud2>("modelserver/databasepcd", 1000);
 
 	int inputstate = -1;
+	std::vector<std::string> modelpaths;
 	for(int i = 1; i < argc;i++){
 		printf("input: %s\n",argv[i]);
 		if(		std::string(argv[i]).compare("-c") == 0){	printf("camera input state\n"); inputstate = 1;}
@@ -926,18 +898,20 @@ int main(int argc, char **argv){
 		else if(std::string(argv[i]).compare("-occlusion_penalty") == 0){printf("occlusion_penalty input state\n");inputstate = 4;}
 		else if(std::string(argv[i]).compare("-massreg_timeout") == 0){printf("massreg_timeout input state\n");inputstate = 5;}
 		else if(std::string(argv[i]).compare("-search") == 0){printf("pointcloud search input state\n");run_search = true; inputstate = 6;}
+		else if(std::string(argv[i]).compare("-candidates") == 0){printf("search candidates input state\n");inputstate = 7;}
+		else if(std::string(argv[i]).compare("-probes") == 0){printf("search probes input state\n");inputstate = 8;}
+		else if(std::string(argv[i]).compare("-threads") == 0){printf("registration threads input state\n");inputstate = 9;}
+		else if(std::string(argv[i]).compare("-stop_score") == 0){printf("registration stop score input state\n");inputstate = 10;}
+		else if(std::string(argv[i]).compare("-vocabulary") == 0){printf("vocabulary path input state\n");inputstate = 11;}
+		else if(std::string(argv[i]).compare("-histogram_database") == 0){printf("using the RGB histogram database\n");use_histogram_database = true;}
+		else if(std::string(argv[i]).compare("-no_segmentation") == 0){printf("frame segmentation turned off\n");compute_segmentation = false;}
 		else if(std::string(argv[i]).compare("-v") == 0){	printf("visualization turned on\n");	visualization = true;}
 		else if(inputstate == 1){
 			reglib::Camera * cam = reglib::Camera::load(std::string(argv[i]));
 			delete cameras[0];
 			cameras[0] = cam;
 		}else if(inputstate == 2){
-			reglib::Model * model = reglib::Model::load(cameras[0],std::string(argv[i]));
-			sweepid_counter = std::max(int(model->modelmasks[0]->sweepid + 1), sweepid_counter);
-			modeldatabase->add(model);
-			//addToDB(modeldatabase, model,false);
-			model->last_changed = ++current_model_update;
-			show_sorted();
+			modelpaths.push_back(std::string(argv[i]));
 		}else if(inputstate == 3){
 			savepath = std::string(argv[i]);
 		}else if(inputstate == 4){
@@ -949,9 +923,44 @@ int main(int argc, char **argv){
 			if(search_timeout == 0){
 				run_search = false;
 			}
+		}else if(inputstate == 7){
+			search_candidates = atoi(argv[i]); printf("search_candidates set to %i\n",search_candidates);
+		}else if(inputstate == 8){
+			search_probes = atoi(argv[i]); printf("search_probes set to %i\n",search_probes);
+		}else if(inputstate == 9){
+			registration_threads = atoi(argv[i]); printf("registration_threads set to %i\n",registration_threads);
+		}else if(inputstate == 10){
+			registration_stop_score = atof(argv[i]); printf("registration_stop_score set to %f\n",registration_stop_score);
+		}else if(inputstate == 11){
+			vocabulary_path = std::string(argv[i]); printf("vocabulary_path set to %s\n",vocabulary_path.c_str());
 		}
 	}
 
+	//The database and the models are created once all the arguments are parsed, so the order of the arguments does not matter
+	if(!use_histogram_database && boost::filesystem::exists(vocabulary_path+"/vocabulary.cereal")){
+		printf("using the vocabulary tree database at %s\n",vocabulary_path.c_str());
+		modeldatabase = new ModelDatabaseRetrieval(vocabulary_path);
+	}else{
+		if(!use_histogram_database){printf("no vocabulary at %s, using the RGB histogram database\n",vocabulary_path.c_str());}
+		modeldatabase = new ModelDatabaseRGBHistogram(5,search_probes);
+	}
+
+	for(unsigned int i = 0; i < modelpaths.size(); i++){
+		std::string modelpath = modelpaths[i];
+		reglib::Model * model = 0;
+		if(modelpath.size() > 4 && modelpath.compare(modelpath.size()-4,4,".qmf") == 0){
+			model = reglib::ModelFile::load(cameras[0],modelpath);
+			if(model == 0){continue;}
+		}else{
+			model = reglib::Model::load(cameras[0],modelpath);
+		}
+		sweepid_counter = std::max(int(model->modelmasks[0]->sweepid + 1), sweepid_counter);
+		modeldatabase->add(model);
+		//addToDB(modeldatabase, model,false);
+		model->last_changed = ++current_model_update;
+		show_sorted();
+	}
+
 	if(visualization){
 		viewer = boost::shared_ptr<pcl::visualization::PCLVisualizer>(new pcl::visualization::PCLVisualizer ("viewer"));
 		viewer->addCoordinateSystem(0.1);
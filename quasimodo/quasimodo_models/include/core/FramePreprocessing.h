@@ -0,0 +1,357 @@
+#ifndef reglibFramePreprocessing_H
+#define reglibFramePreprocessing_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Util.h"
+
+namespace reglib
+{
+
+//Per pixel data of an RGBDFrame computed straight from the depth buffer: the depth edge map and organized normals.
+//
+//All passes walk the images row by row and split the rows between OpenMP threads. The points are stored as separate x,
+//y and z planes in float, and the inner loops over the interior of a row have no branches on the data, so the compiler
+//can vectorize them. The buffers are kept in the FramePreprocessor, so they are only reused when the same preprocessor
+//processes several frames; RGBDFrame creates a new one for every frame.
+//
+//The normals follow pcl::IntegralImageNormalEstimation with AVERAGE_3D_GRADIENT and depth dependent smoothing, as used
+//by RGBDFrame before: the normal of a pixel is the cross product of the mean vertical and horizontal gradients of the
+//points in a square window. The window shrinks with the distance to the closest depth discontinuity, so that it does not
+//smooth over object borders. Unlike pcl the window is clamped to the image.
+class FramePreprocessor{
+	public:
+	float	idepth;
+	float	fx;
+	float	fy;
+	float	cx;
+	float	cy;
+
+	float	edge_threshold;				//|z2-z|/(z^2+z2^2) above which a pixel is a depth edge
+	float	normal_smoothing_size;		//window size in pixels, grows by depth/10
+	float	max_depth_change_factor;	//depth change between neighbours, relative to depth, that breaks the smoothing
+
+	//Seconds spent in each stage, accumulated over calls
+	double	time_points;
+	double	time_edges;
+	double	time_integral;
+	double	time_distance;
+	double	time_normals;
+
+	int width;
+	int height;
+	std::vector<float> px;
+	std::vector<float> py;
+	std::vector<float> pz;
+
+	FramePreprocessor(float idepth_, float fx_, float fy_, float cx_, float cy_){
+		idepth = idepth_;
+		fx = fx_; fy = fy_; cx = cx_; cy = cy_;
+		edge_threshold			= 0.01;
+		normal_smoothing_size	= 7;
+		max_depth_change_factor	= 0.02;
+		width = 0;
+		height = 0;
+		resetTimings();
+	}
+	~FramePreprocessor(){}
+
+	void resetTimings(){time_points = time_edges = time_integral = time_distance = time_normals = 0;}
+
+	//Back projects the depth image, invalid depths give NaN points
+	void computePoints(const unsigned short * depth, int width_, int height_){
+		double start = getTime();
+		width = width_;
+		height = height_;
+		const int cols = width;
+		const int rows = height;
+		const float id = idepth;
+		px.resize(cols*rows);
+		py.resize(cols*rows);
+		pz.resize(cols*rows);
+		const float ifx = 1.0/fx;
+		const float ify = 1.0/fy;
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+#pragma omp parallel for
+		for(int h = 0; h < rows; h++){
+			const unsigned short * d = depth + h*cols;
+			float * x = &px[h*cols];
+			float * y = &py[h*cols];
+			float * z = &pz[h*cols];
+			const float yscale = (float(h) - cy) * ify;
+			for(int w = 0; w < cols; w++){
+				float zw = id*float(d[w]);
+				bool valid = zw > 0;
+				x[w] = valid ? (float(w) - cx) * zw * ifx : nan;
+				y[w] = valid ? yscale * zw : nan;
+				z[w] = valid ? zw : nan;
+			}
+		}
+		time_points += getTime()-start;
+	}
+
+	//Sets edges to 255 where the depth differs from one of the eight neighbours, 0 elsewhere
+	void computeDepthEdges(const unsigned short * depth, unsigned char * edges){
+		const int cols = width;
+		const int rows = height;
+		double start = getTime();
+		const float t = edge_threshold;
+		const float id = idepth;
+#pragma omp parallel for
+		for(int h = 0; h < rows; h++){
+			const bool exists [3] = {h > 0, true, h < rows-1};
+			const unsigned short * cur	= depth + h*cols;
+			const unsigned short * up	= exists[0] ? cur-cols : cur;
+			const unsigned short * down	= exists[2] ? cur+cols : cur;
+			unsigned char * e = edges + h*cols;
+			if(exists[0] && exists[2]){
+				for(int w = 1; w < cols-1; w++){
+					const float z = id*float(cur[w]);
+					bool edge =	isEdge(z,id*float(cur[w-1]),t)	| isEdge(z,id*float(cur[w+1]),t)	|
+								isEdge(z,id*float(up[w-1]),t)	| isEdge(z,id*float(up[w]),t)		| isEdge(z,id*float(up[w+1]),t)	|
+								isEdge(z,id*float(down[w-1]),t)	| isEdge(z,id*float(down[w]),t)	| isEdge(z,id*float(down[w+1]),t);
+					e[w] = edge ? 255 : 0;
+				}
+				e[0] = borderEdge(up,cur,down,exists,0,cols,id,t);
+				if(cols > 1){e[cols-1] = borderEdge(up,cur,down,exists,cols-1,cols,id,t);}
+			}else{
+				for(int w = 0; w < cols; w++){e[w] = borderEdge(up,cur,down,exists,w,cols,id,t);}
+			}
+		}
+		time_edges += getTime()-start;
+	}
+
+	//Writes normals as 3 floats per pixel, pixels without a normal get (2,2,2). Needs computePoints.
+	void computeNormals(float * normals){
+		const int cols = width;
+		const int rows = height;
+		double start = getTime();
+		computeGradients();
+		time_integral += getTime()-start;
+
+		start = getTime();
+		computeDistanceMap();
+		time_distance += getTime()-start;
+
+		start = getTime();
+		const int border = int(normal_smoothing_size);
+		const int W = cols+1;
+#pragma omp parallel for
+		for(int h = 0; h < rows; h++){
+			float * n = normals + 3*h*cols;
+			for(int w = 0; w < cols; w++){
+				n[3*w+0] = 2; n[3*w+1] = 2; n[3*w+2] = 2;
+			}
+			if(h < border || h >= rows-border){continue;}
+			for(int w = border; w < cols-border; w++){
+				const int ind = h*cols+w;
+				const float z = pz[ind];
+				if(!std::isfinite(z)){continue;}
+				float smoothing = std::min(distance[ind], normal_smoothing_size + z/10.0f);
+				if(!(smoothing > 2.0f)){continue;}
+				const int size = int(smoothing);
+				const int x0 = std::max(0,w-size/2);
+				const int y0 = std::max(0,h-size/2);
+				const int x1 = std::min(cols,w-size/2+size);
+				const int y1 = std::min(rows,h-size/2+size);
+				const int ul = y0*W+x0;
+				const int ur = y0*W+x1;
+				const int ll = y1*W+x0;
+				const int lr = y1*W+x1;
+				if(count_dx[lr]+count_dx[ul]-count_dx[ur]-count_dx[ll] == 0){continue;}
+				if(count_dy[lr]+count_dy[ul]-count_dy[ur]-count_dy[ll] == 0){continue;}
+				double gx [3];
+				double gy [3];
+				for(int c = 0; c < 3; c++){
+					gx[c] = sum_dx[3*lr+c]+sum_dx[3*ul+c]-sum_dx[3*ur+c]-sum_dx[3*ll+c];
+					gy[c] = sum_dy[3*lr+c]+sum_dy[3*ul+c]-sum_dy[3*ur+c]-sum_dy[3*ll+c];
+				}
+				double nx = gy[1]*gx[2]-gy[2]*gx[1];
+				double ny = gy[2]*gx[0]-gy[0]*gx[2];
+				double nz = gy[0]*gx[1]-gy[1]*gx[0];
+				double len2 = nx*nx+ny*ny+nz*nz;
+				if(len2 == 0){continue;}
+				double scale = 1.0/sqrt(len2);
+				//Towards the camera
+				if(nx*px[ind]+ny*py[ind]+nz*z > 0){scale = -scale;}
+				n[3*w+0] = nx*scale;
+				n[3*w+1] = ny*scale;
+				n[3*w+2] = nz*scale;
+			}
+		}
+		time_normals += getTime()-start;
+	}
+
+	void compute(const unsigned short * depth, int width_, int height_, unsigned char * edges, float * normals){
+		computePoints(depth,width_,height_);
+		computeDepthEdges(depth,edges);
+		if(normals != 0){computeNormals(normals);}
+	}
+
+	private:
+	//(width+1)x(height+1) integral images of the gradients p(x+1)-p(x-1) and p(y+1)-p(y-1) where they are finite, and
+	//of the number of finite gradients. The first row and column are zero, and so are the gradients on the image border.
+	std::vector<double>		sum_dx;
+	std::vector<double>		sum_dy;
+	std::vector<unsigned>	count_dx;
+	std::vector<unsigned>	count_dy;
+	std::vector<float>		distance;
+
+	//|z2-z|/(z^2+z2^2) > t without the division, false when both depths are zero
+	static inline bool isEdge(float z, float z2, float t){
+		return std::fabs(z2-z) > t*(z*z+z2*z2);
+	}
+
+	//Edge test for pixels on the image border, neighbours outside the image are skipped
+	static unsigned char borderEdge(const unsigned short * up, const unsigned short * cur, const unsigned short * down, const bool * exists, int w, int cols, float id, float t){
+		const float z = id*float(cur[w]);
+		const unsigned short * rows [3] = {up,cur,down};
+		bool edge = false;
+		for(int r = 0; r < 3; r++){
+			if(!exists[r]){continue;}
+			for(int d = -1; d <= 1; d++){
+				if((r == 1 && d == 0) || w+d < 0 || w+d >= cols){continue;}
+				edge |= isEdge(z,id*float(rows[r][w+d]),t);
+			}
+		}
+		return edge ? 255 : 0;
+	}
+
+	void computeGradients(){
+		const int cols = width;
+		const int rows = height;
+		const int W = cols+1;
+		sum_dx.resize(3*W*(rows+1));
+		sum_dy.resize(3*W*(rows+1));
+		count_dx.resize(W*(rows+1));
+		count_dy.resize(W*(rows+1));
+		std::fill(sum_dx.begin(),sum_dx.begin()+3*W,0);
+		std::fill(sum_dy.begin(),sum_dy.begin()+3*W,0);
+		std::fill(count_dx.begin(),count_dx.begin()+W,0);
+		std::fill(count_dy.begin(),count_dy.begin()+W,0);
+
+		//Prefix sums along every row, then down the columns with the columns split between the threads
+#pragma omp parallel for
+		for(int h = 0; h < rows; h++){
+			const int ind = h*cols;
+			prefixRow(&px[ind],&py[ind],&pz[ind],-1,1,1,cols-1,&sum_dx[3*(h+1)*W],&count_dx[(h+1)*W]);
+			if(h > 0 && h < rows-1){
+				prefixRow(&px[ind],&py[ind],&pz[ind],-cols,cols,0,cols,&sum_dy[3*(h+1)*W],&count_dy[(h+1)*W]);
+			}else{
+				prefixRow(&px[ind],&py[ind],&pz[ind],0,0,0,0,&sum_dy[3*(h+1)*W],&count_dy[(h+1)*W]);
+			}
+		}
+		const int block = 64;
+		const int nr_blocks = (W+block-1)/block;
+#pragma omp parallel for
+		for(int b = 0; b < nr_blocks; b++){
+			const int start = b*block;
+			const int stop = std::min(W,start+block);
+			for(int h = 2; h <= rows; h++){
+				double * sx = &sum_dx[3*h*W];			const double * psx = &sum_dx[3*(h-1)*W];
+				double * sy = &sum_dy[3*h*W];			const double * psy = &sum_dy[3*(h-1)*W];
+				unsigned * cx_ = &count_dx[h*W];		const unsigned * pcx = &count_dx[(h-1)*W];
+				unsigned * cy_ = &count_dy[h*W];		const unsigned * pcy = &count_dy[(h-1)*W];
+				for(int i = 3*start; i < 3*stop; i++){sx[i] += psx[i]; sy[i] += psy[i];}
+				for(int i = start; i < stop; i++){cx_[i] += pcx[i]; cy_[i] += pcy[i];}
+			}
+		}
+	}
+
+	//Prefix sums of the gradient p[w+next]-p[w+prev] over a row, the gradient is zero outside columns [first,last)
+	void prefixRow(const float * x, const float * y, const float * z, int prev, int next, int first, int last, double * sum, unsigned * count){
+		const int cols = width;
+		double sx = 0, sy = 0, sz = 0;
+		unsigned c = 0;
+		sum[0] = sum[1] = sum[2] = 0;
+		count[0] = 0;
+		for(int w = 0; w < cols; w++){
+			if(w >= first && w < last){
+				const float a = x[w+next]-x[w+prev];
+				const float b = y[w+next]-y[w+prev];
+				const float d = z[w+next]-z[w+prev];
+				const bool finite = std::isfinite(a+b+d);
+				sx += finite ? a : 0;
+				sy += finite ? b : 0;
+				sz += finite ? d : 0;
+				c += finite;
+			}else{
+				c++;
+			}
+			sum[3*w+3] = sx;
+			sum[3*w+4] = sy;
+			sum[3*w+5] = sz;
+			count[w+1] = c;
+		}
+	}
+
+	//True if the depth change from z to its neighbour z2 is too large to smooth over, also if either is NaN
+	inline bool breaksSmoothing(float z, float z2) const {
+		const float change = max_depth_change_factor * (std::fabs(z) + 1.0f) * 2.0f;
+		return !(std::fabs(z-z2) <= change);
+	}
+
+	//Chamfer distance in pixels to the closest depth discontinuity or invalid depth
+	void computeDistanceMap(){
+		const int cols = width;
+		const int rows = height;
+		const int N = cols*rows;
+		const float far = float(cols+rows);
+		distance.resize(N);
+		//A pixel is a discontinuity if the depth changes too much towards its right or lower neighbour, or from its
+		//left or upper neighbour, with the change relative to the depth of the left or upper pixel of the pair. The
+		//pairs are those of the pixels outside the last row and column. Every pixel is written by its own row only.
+#pragma omp parallel for
+		for(int h = 0; h < rows; h++){
+			for(int w = 0; w < cols; w++){
+				const int ind = h*cols+w;
+				const bool pairs = h < rows-1;
+				bool discontinuity = false;
+				if(pairs && w < cols-1){discontinuity |= breaksSmoothing(pz[ind],pz[ind+1]) | breaksSmoothing(pz[ind],pz[ind+cols]);}
+				if(pairs && w > 0){		discontinuity |= breaksSmoothing(pz[ind-1],pz[ind]);}
+				if(h > 0 && w < cols-1){discontinuity |= breaksSmoothing(pz[ind-cols],pz[ind]);}
+				distance[ind] = discontinuity ? 0 : far;
+			}
+		}
+
+		//Two passes, the neighbours in the previous row are taken for the whole row at once and only the neighbour
+		//in the same row is propagated pixel by pixel. The first row of each pass has no previous row.
+		for(int h = 0; h < rows; h++){
+			float * cur = &distance[h*cols];
+			if(h > 0){
+				const float * prev = &distance[(h-1)*cols];
+				for(int w = 1; w < cols-1; w++){
+					cur[w] = std::min(cur[w],std::min(prev[w]+1.0f,std::min(prev[w-1],prev[w+1])+1.4f));
+				}
+				cur[0] = std::min(cur[0],prev[0]+1.0f);
+				if(cols > 1){
+					cur[0]		= std::min(cur[0],prev[1]+1.4f);
+					cur[cols-1]	= std::min(cur[cols-1],std::min(prev[cols-1]+1.0f,prev[cols-2]+1.4f));
+				}
+			}
+			for(int w = 1; w < cols; w++){cur[w] = std::min(cur[w],cur[w-1]+1.0f);}
+		}
+		for(int h = rows-1; h >= 0; h--){
+			float * cur = &distance[h*cols];
+			if(h < rows-1){
+				const float * next = &distance[(h+1)*cols];
+				for(int w = 1; w < cols-1; w++){
+					cur[w] = std::min(cur[w],std::min(next[w]+1.0f,std::min(next[w-1],next[w+1])+1.4f));
+				}
+				cur[cols-1] = std::min(cur[cols-1],next[cols-1]+1.0f);
+				if(cols > 1){
+					cur[cols-1]	= std::min(cur[cols-1],next[cols-2]+1.4f);
+					cur[0]		= std::min(cur[0],std::min(next[0]+1.0f,next[1]+1.4f));
+				}
+			}
+			for(int w = cols-2; w >= 0; w--){cur[w] = std::min(cur[w],cur[w+1]+1.0f);}
+		}
+	}
+};
+
+}
+
+#endif // reglibFramePreprocessing_H
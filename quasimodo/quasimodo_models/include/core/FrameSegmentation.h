@@ -0,0 +1,425 @@
+#ifndef reglibFrameSegmentation_H
+#define reglibFrameSegmentation_H
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <utility>
+
+#include "Util.h"
+
+namespace reglib
+{
+
+//Superpixel segmentation of an RGBDFrame from its colour, points and normals, as computed by FramePreprocessor.
+//
+//The superpixels are SLIC clusters seeded on a regular grid. A pixel is compared to the clusters of the 3x3 grid cells
+//around it, on colour, image distance, distance to the plane of the cluster relative to depth and the angle between the
+//normals, so that clusters do not grow over depth discontinuities or folds. Pixels without depth are clustered on colour
+//and image distance only. The assignment runs row by row and the cluster update by blocks of rows, both split between
+//OpenMP threads. The number of iterations and the number of clusters are fixed, so the cost is bounded by
+//9*iterations distance evaluations per pixel.
+//
+//Clusters are then made connected, pieces smaller than min_size_factor of the cell area join a neighbouring segment, so
+//there are at most max_segments/min_size_factor segments.
+class FrameSegmenter{
+	public:
+	int		superpixel_size;		//grid cell size in pixels, grows if the frame would get more than max_segments cells
+	int		max_segments;
+	int		iterations;
+	float	compactness;			//weight of the image distance, in units of superpixel_size
+	float	color_scale;			//colour difference (per channel, 0-255) that counts as one unit
+	float	depth_tolerance;		//distance to the cluster plane, relative to z^2, that counts as one unit
+	float	normal_weight;			//weight of 1-cos(angle) between the normals
+	float	invalid_penalty;		//cost of putting a pixel with depth in a cluster without depth, or the reverse
+	float	min_size_factor;
+	float	edge_threshold;			//|z2-z|/(z^2+z2^2) above which neighbouring segments are not connected
+
+	//Seconds spent in each stage, accumulated over calls
+	double	time_assign;
+	double	time_update;
+	double	time_connectivity;
+	double	time_adjacency;
+
+	FrameSegmenter(){
+		superpixel_size	= 24;
+		max_segments	= 400;
+		iterations		= 4;
+		compactness		= 1;
+		color_scale		= 20;
+		depth_tolerance	= 0.005;
+		normal_weight	= 10;
+		invalid_penalty	= 4;
+		min_size_factor	= 0.25;
+		edge_threshold	= 0.01;
+		resetTimings();
+	}
+	~FrameSegmenter(){}
+
+	void resetTimings(){time_assign = time_update = time_connectivity = time_adjacency = 0;}
+
+	//Writes a label in [0,nr_labels) per pixel and returns nr_labels. rgb has 3 bytes per pixel, x, y and z are planes
+	//with NaN for invalid depth and normals has 3 floats per pixel with (2,2,2) for none, or is 0.
+	int segment(const unsigned char * rgb, const float * x, const float * y, const float * z, const float * normals, int width_, int height_, int * labels){
+		width = width_;
+		height = height_;
+		const int N = width*height;
+		if(N == 0){return 0;}
+
+		int step = std::max(1,superpixel_size);
+		if(max_segments > 0){
+			while((width/step)*(height/step) > max_segments){step++;}
+		}
+		grid_w = std::max(1,width/step);
+		grid_h = std::max(1,height/step);
+		cell_w = float(width)/float(grid_w);
+		cell_h = float(height)/float(grid_h);
+		const int nr_centers = grid_w*grid_h;
+		centers.resize(nr_centers);
+		cell_start.assign(grid_w+1,width);
+		for(int w = width-1; w >= 0; w--){cell_start[std::min(grid_w-1,int(float(w)/cell_w))] = w;}
+
+		//Start from the grid cells
+		double start = getTime();
+		features.resize(nr_features*N);
+#pragma omp parallel for
+		for(int h = 0; h < height; h++){
+			const int gy = std::min(grid_h-1,int(float(h)/cell_h));
+			for(int w = 0; w < width; w++){
+				labels[h*width+w] = gy*grid_w+std::min(grid_w-1,int(float(w)/cell_w));
+			}
+			unpackRow(h,rgb,x,y,z,normals,&features[nr_features*h*width]);
+		}
+		time_assign += getTime()-start;
+
+		const float iS2 = compactness/(float(step)*float(step));
+		const float ic2 = 1.0f/(color_scale*color_scale);
+		for(int it = 0; it < iterations; it++){
+			start = getTime();
+			updateCenters(rgb,x,y,z,normals,labels);
+			time_update += getTime()-start;
+
+			//Every candidate is compared to all the pixels of the cell in a loop without branches
+			start = getTime();
+			const float * feature_data = &features[0];
+#pragma omp parallel
+			{
+				std::vector<float> best_dist (width);
+				std::vector<int> best (width);
+				std::vector<float> row (nr_features*width);
+				Candidates cand;
+#pragma omp for
+				for(int h = 0; h < height; h++){
+					//A copy in a buffer of the thread, the compiler only vectorizes the loop below on local buffers
+					std::copy(feature_data+nr_features*h*width,feature_data+nr_features*(h+1)*width,row.begin());
+					const float * fr = &row[0];			const float * fg = fr+width;		const float * fb = fg+width;
+					const float * fx = fb+width;		const float * fy = fx+width;		const float * fz = fy+width;
+					const float * fnx = fz+width;		const float * fny = fnx+width;		const float * fnz = fny+width;
+					const float * fidz = fnz+width;		const float * fnw = fidz+width;		const float * fvalid = fnw+width;
+					float * bd = &best_dist[0];
+					int * bl = &best[0];
+					const float fh = float(h);
+					const int gy = std::min(grid_h-1,int(fh/cell_h));
+					for(int gx = 0; gx < grid_w; gx++){
+						setCandidates(gx,gy,cand);
+						const int w0 = cell_start[gx];
+						const int w1 = cell_start[gx+1];
+						std::fill(bd+w0,bd+w1,std::numeric_limits<float>::max());
+						std::copy(labels+h*width+w0,labels+h*width+w1,bl+w0);
+						for(int k = 0; k < cand.nr; k++){
+							const float cw = cand.w[k], ch = cand.h[k];
+							const float cr = cand.r[k], cg = cand.g[k], cb = cand.b[k];
+							const float cx = cand.x[k], cy = cand.y[k], cz = cand.z[k];
+							const float cnx = cand.nx[k], cny = cand.ny[k], cnz = cand.nz[k];
+							const float cdepth = cand.has_depth[k], cnormal = cand.has_normal[k];
+							const float dh2 = (fh-ch)*(fh-ch);
+							const int index = cand.index[k];
+							for(int w = w0; w < w1; w++){
+								const float dw = float(w)-cw;
+								const float dr = fr[w]-cr, dg = fg[w]-cg, db = fb[w]-cb;
+								//Centers without a normal have (0,0,1), which compares the depths
+								const float d = fidz[w]*(cnx*(fx[w]-cx)+cny*(fy[w]-cy)+cnz*(fz[w]-cz));
+								const float angle = fnw[w]*cnormal*(1.0f-(fnx[w]*cnx+fny[w]*cny+fnz[w]*cnz));
+								//Both 0 or 1, match is 1 if the pixel and the center both have depth or both have none
+								const float match = 1.0f-std::fabs(fvalid[w]-cdepth);
+								const float geometry = match*(d*d+angle) + (1.0f-match)*invalid_penalty;
+								const float dist = (dw*dw+dh2)*iS2 + (dr*dr+dg*dg+db*db)*ic2 + geometry;
+								const int previous = bl[w];
+								const float previous_dist = bd[w];
+								bl[w] = dist < previous_dist ? index : previous;
+								bd[w] = std::min(dist,previous_dist);
+							}
+						}
+					}
+					std::copy(bl,bl+width,labels+h*width);
+				}
+			}
+			time_assign += getTime()-start;
+		}
+
+		start = getTime();
+		int nr_labels = enforceConnectivity(labels,int(min_size_factor*cell_w*cell_h));
+		time_connectivity += getTime()-start;
+		return nr_labels;
+	}
+
+	//For every segment, its neighbouring segments (sorted) paired with the number of 4-neighbour pixel pairs on their
+	//border in intersections, and with the fraction of them where the depth is continuous (both valid and not a depth
+	//edge) in connections. Segments only border a few others, so the lists are kept sparse.
+	void computeAdjacency(const int * labels, int nr_labels, const float * z, std::vector< std::vector< std::pair<int,double> > > & connections, std::vector< std::vector< std::pair<int,double> > > & intersections){
+		double start = getTime();
+		std::vector< std::vector<Border> > borders (nr_labels);
+		for(int h = 0; h < height; h++){
+			for(int w = 0; w < width; w++){
+				const int ind = h*width+w;
+				const int a = labels[ind];
+				if(w < width-1){addBorder(a,labels[ind+1],z[ind],z[ind+1],borders);}
+				if(h < height-1){addBorder(a,labels[ind+width],z[ind],z[ind+width],borders);}
+			}
+		}
+
+		connections.resize(nr_labels);
+		intersections.resize(nr_labels);
+		for(int i = 0; i < nr_labels; i++){
+			std::vector<Border> & neighbours = borders[i];
+			std::sort(neighbours.begin(),neighbours.end(),[](const Border & a, const Border & b){return a.label < b.label;});
+			connections[i].clear();
+			intersections[i].clear();
+			for(const Border & b : neighbours){
+				intersections[i].push_back(std::make_pair(b.label,double(b.border)));
+				connections[i].push_back(std::make_pair(b.label,double(b.continuous)/double(b.border)));
+			}
+		}
+		time_adjacency += getTime()-start;
+	}
+
+	private:
+	struct Center{
+		float w, h;
+		float r, g, b;
+		float x, y, z;
+		float nx, ny, nz;
+		bool has_depth;
+		bool has_normal;
+		unsigned count;
+	};
+
+	//The clusters of the 3x3 grid cells around a cell, that the pixels of the cell are compared to
+	struct Candidates{
+		int nr;
+		int index [9];
+		float w [9], h [9];
+		float r [9], g [9], b [9];
+		float x [9], y [9], z [9];
+		float nx [9], ny [9], nz [9];
+		float has_depth [9];
+		float has_normal [9];
+	};
+
+	int width;
+	int height;
+	int grid_w;
+	int grid_h;
+	float cell_w;
+	float cell_h;
+	std::vector<Center> centers;
+	std::vector<float> features;		//unpackRow of every row
+	std::vector<int> cell_start;
+	std::vector<double> block_sums;
+	std::vector<int> relabelled;
+	std::vector<int> queue;
+
+	static const int nr_features = 12;
+
+	//Planes of colour, point (0 if invalid), normal (0 if none), depth scale, normal weight and validity of row h
+	void unpackRow(int h, const unsigned char * rgb, const float * x, const float * y, const float * z, const float * normals, float * row) const{
+		float * fr = row;				float * fg = fr+width;			float * fb = fg+width;
+		float * fx = fb+width;			float * fy = fx+width;			float * fz = fy+width;
+		float * fnx = fz+width;			float * fny = fnx+width;		float * fnz = fny+width;
+		float * fidz = fnz+width;		float * fnw = fidz+width;		float * fvalid = fnw+width;
+		for(int w = 0; w < width; w++){
+			const int ind = h*width+w;
+			const float pz = z[ind];
+			const bool valid = std::isfinite(pz);
+			const float * n = normals != 0 ? normals+3*ind : 0;
+			const bool has_normal = valid && n != 0 && n[0] != 2;
+			fr[w] = rgb[3*ind+0];			fg[w] = rgb[3*ind+1];			fb[w] = rgb[3*ind+2];
+			fx[w] = valid ? x[ind] : 0;		fy[w] = valid ? y[ind] : 0;		fz[w] = valid ? pz : 0;
+			fnx[w] = has_normal ? n[0] : 0;	fny[w] = has_normal ? n[1] : 0;	fnz[w] = has_normal ? n[2] : 0;
+			fidz[w] = valid ? 1.0f/(depth_tolerance*pz*pz) : 0;
+			fnw[w] = has_normal ? normal_weight : 0;
+			fvalid[w] = valid ? 1 : 0;
+		}
+	}
+
+	void setCandidates(int gx, int gy, Candidates & cand) const{
+		cand.nr = 0;
+		for(int cy = std::max(0,gy-1); cy <= std::min(grid_h-1,gy+1); cy++){
+			for(int cx = std::max(0,gx-1); cx <= std::min(grid_w-1,gx+1); cx++){
+				const int c = cy*grid_w+cx;
+				const Center & center = centers[c];
+				if(center.count == 0){continue;}
+				const int k = cand.nr++;
+				cand.index[k] = c;
+				cand.w[k] = center.w;	cand.h[k] = center.h;
+				cand.r[k] = center.r;	cand.g[k] = center.g;	cand.b[k] = center.b;
+				cand.has_depth[k] = center.has_depth ? 1 : 0;
+				cand.has_normal[k] = center.has_normal ? 1 : 0;
+				cand.x[k] = center.has_depth ? center.x : 0;
+				cand.y[k] = center.has_depth ? center.y : 0;
+				cand.z[k] = center.has_depth ? center.z : 0;
+				cand.nx[k] = center.has_normal ? center.nx : 0;
+				cand.ny[k] = center.has_normal ? center.ny : 0;
+				cand.nz[k] = center.has_normal ? center.nz : 1;
+			}
+		}
+	}
+
+	//Means of the pixels of every cluster. The rows are summed in a fixed number of blocks, merged in order so that the
+	//result does not depend on the number of threads.
+	void updateCenters(const unsigned char * rgb, const float * x, const float * y, const float * z, const float * normals, const int * labels){
+		const int nr_centers = grid_w*grid_h;
+		const int nr_sums = 13;
+		const int nr_blocks = std::min(height,16);
+		block_sums.assign(nr_blocks*nr_sums*nr_centers,0);
+#pragma omp parallel for
+		for(int block = 0; block < nr_blocks; block++){
+			double * local = &block_sums[block*nr_sums*nr_centers];
+			for(int h = block*height/nr_blocks; h < (block+1)*height/nr_blocks; h++){
+				for(int w = 0; w < width; w++){
+					const int ind = h*width+w;
+					double * s = &local[nr_sums*labels[ind]];
+					s[0] += w;
+					s[1] += h;
+					s[2] += rgb[3*ind+0];
+					s[3] += rgb[3*ind+1];
+					s[4] += rgb[3*ind+2];
+					s[5] += 1;
+					if(std::isfinite(z[ind])){
+						s[6] += x[ind];
+						s[7] += y[ind];
+						s[8] += z[ind];
+						s[9] += 1;
+						if(normals != 0 && normals[3*ind] != 2){
+							s[10] += normals[3*ind+0];
+							s[11] += normals[3*ind+1];
+							s[12] += normals[3*ind+2];
+						}
+					}
+				}
+			}
+		}
+		std::vector<double> & sums = block_sums;
+		for(int block = 1; block < nr_blocks; block++){
+			const double * local = &block_sums[block*nr_sums*nr_centers];
+			for(int i = 0; i < nr_sums*nr_centers; i++){sums[i] += local[i];}
+		}
+
+		for(int c = 0; c < nr_centers; c++){
+			const double * s = &sums[nr_sums*c];
+			Center & center = centers[c];
+			center.count = unsigned(s[5]);
+			center.has_depth = s[9] > 0;
+			center.has_normal = false;
+			if(center.count == 0){continue;}
+			const double ic = 1.0/s[5];
+			center.w = s[0]*ic;	center.h = s[1]*ic;
+			center.r = s[2]*ic;	center.g = s[3]*ic;	center.b = s[4]*ic;
+			if(center.has_depth){
+				const double id = 1.0/s[9];
+				center.x = s[6]*id;	center.y = s[7]*id;	center.z = s[8]*id;
+				const double len = sqrt(s[10]*s[10]+s[11]*s[11]+s[12]*s[12]);
+				if(len > 0){
+					center.has_normal = true;
+					center.nx = s[10]/len;	center.ny = s[11]/len;	center.nz = s[12]/len;
+				}
+			}
+		}
+	}
+
+	//Gives every 4-connected piece of a cluster its own label, pieces smaller than min_size take the label of the
+	//segment next to where they start. Returns the number of labels.
+	int enforceConnectivity(int * labels, int min_size){
+		const int N = width*height;
+		relabelled.assign(N,-1);
+		queue.resize(N);
+		const int dw [4] = {-1,0,1,0};
+		const int dh [4] = {0,-1,0,1};
+		int nr_labels = 0;
+		for(int start = 0; start < N; start++){
+			if(relabelled[start] >= 0){continue;}
+			const int label = labels[start];
+			const int sw = start%width;
+			const int sh = start/width;
+
+			//A segment already relabelled next to the start, for merging
+			int adjacent = -1;
+			for(int k = 0; k < 4 && adjacent < 0; k++){
+				const int w = sw+dw[k];
+				const int h = sh+dh[k];
+				if(w < 0 || h < 0 || w >= width || h >= height){continue;}
+				adjacent = relabelled[h*width+w];
+			}
+
+			int size = 0;
+			queue[size++] = start;
+			relabelled[start] = nr_labels;
+			for(int q = 0; q < size; q++){
+				const int w0 = queue[q]%width;
+				const int h0 = queue[q]/width;
+				for(int k = 0; k < 4; k++){
+					const int w = w0+dw[k];
+					const int h = h0+dh[k];
+					if(w < 0 || h < 0 || w >= width || h >= height){continue;}
+					const int ind = h*width+w;
+					if(relabelled[ind] < 0 && labels[ind] == label){
+						relabelled[ind] = nr_labels;
+						queue[size++] = ind;
+					}
+				}
+			}
+
+			if(size < min_size && adjacent >= 0){
+				for(int q = 0; q < size; q++){relabelled[queue[q]] = adjacent;}
+			}else{
+				nr_labels++;
+			}
+		}
+		std::copy(relabelled.begin(),relabelled.end(),labels);
+		return nr_labels;
+	}
+
+	//The border of a segment with one of its neighbours
+	struct Border{
+		int label;
+		unsigned border;
+		unsigned continuous;
+	};
+
+	static void countBorder(std::vector<Border> & neighbours, int label, bool connected){
+		for(Border & n : neighbours){
+			if(n.label == label){
+				n.border++;
+				n.continuous += connected;
+				return;
+			}
+		}
+		Border n;
+		n.label = label;
+		n.border = 1;
+		n.continuous = connected;
+		neighbours.push_back(n);
+	}
+
+	void addBorder(int a, int b, float za, float zb, std::vector< std::vector<Border> > & borders){
+		if(a == b){return;}
+		const bool connected = std::isfinite(za) && std::isfinite(zb) && !(std::fabs(zb-za) > edge_threshold*(za*za+zb*zb));
+		countBorder(borders[a],b,connected);
+		countBorder(borders[b],a,connected);
+	}
+};
+
+}
+
+#endif // reglibFrameSegmentation_H
@@ -0,0 +1,76 @@
+#ifndef reglibImageCodec_H
+#define reglibImageCodec_H
+
+#include <vector>
+#include <string.h>
+
+namespace reglib
+{
+
+//Lossless codec for 8 and 16 bit images with interleaved channels. Every element is predicted by the same channel of
+//the previous pixel, the residuals are zigzag coded as varints and runs of zero residuals are stored as a zero followed
+//by the run length. Depth images with invalid regions and binary masks compress well, and decoding is a single pass
+//without any entropy coder.
+
+template <typename T> inline void appendVarint(std::vector<unsigned char> & out, T v){
+	while(v >= 0x80){
+		out.push_back((unsigned char)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((unsigned char)v);
+}
+
+inline unsigned int readVarint(const unsigned char * & in, const unsigned char * end){
+	unsigned int v = 0;
+	int shift = 0;
+	while(in < end){
+		unsigned char b = *in++;
+		v |= (unsigned int)(b & 0x7f) << shift;
+		if(b < 0x80){break;}
+		shift += 7;
+	}
+	return v;
+}
+
+template <typename T> void encodeDelta(const T * data, unsigned int nr_pixels, int channels, std::vector<unsigned char> & out){
+	out.clear();
+	out.reserve(nr_pixels*channels);
+	const unsigned int nr_elements = nr_pixels*channels;
+	unsigned int i = 0;
+	while(i < nr_elements){
+		int pred = i >= (unsigned int)channels ? int(data[i-channels]) : 0;
+		int r = int(data[i]) - pred;
+		unsigned int z = ((unsigned int)(r) << 1) ^ (unsigned int)(r >> 31);
+		appendVarint(out,z);
+		i++;
+		if(z == 0){
+			unsigned int run = 0;
+			while(i < nr_elements && i >= (unsigned int)channels && data[i] == data[i-channels]){run++; i++;}
+			appendVarint(out,run);
+		}
+	}
+}
+
+//Returns false if the data does not decode to exactly nr_pixels*channels elements
+template <typename T> bool decodeDelta(const unsigned char * in, unsigned long size, unsigned int nr_pixels, int channels, T * data){
+	const unsigned char * end = in+size;
+	const unsigned int nr_elements = nr_pixels*channels;
+	unsigned int i = 0;
+	while(i < nr_elements && in < end){
+		unsigned int z = readVarint(in,end);
+		int r = int(z >> 1) ^ -int(z & 1);
+		int pred = i >= (unsigned int)channels ? int(data[i-channels]) : 0;
+		data[i] = T(pred + r);
+		i++;
+		if(z == 0){
+			unsigned int run = readVarint(in,end);
+			if(run > nr_elements-i || (run > 0 && i < (unsigned int)channels)){return false;}
+			for(unsigned int k = 0; k < run; k++, i++){data[i] = data[i-channels];}
+		}
+	}
+	return i == nr_elements && in == end;
+}
+
+}
+
+#endif // reglibImageCodec_H
@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <utility>
 #include <stdio.h>
 #include <stdlib.h> 
 #include <chrono>
@@ -36,11 +37,14 @@ namespace reglib
 		int * labels;
 		int nr_labels;
 
-		std::vector< std::vector<double> > connections;
-		std::vector< std::vector<double> > intersections;
+		//For every label, its neighbouring labels (sorted) with the fraction of the shared border where the depth is
+		//continuous, and with the length of the border in pixel pairs, see FrameSegmentation.h
+		std::vector< std::vector< std::pair<int,double> > > connections;
+		std::vector< std::vector< std::pair<int,double> > > intersections;
 
 		RGBDFrame();
-		RGBDFrame(Camera * camera_,cv::Mat rgb_, cv::Mat depth_, double capturetime_ = 0, Eigen::Matrix4d pose_ = Eigen::Matrix4d::Identity(), bool compute_normals = true);
+		//Without compute_segmentation every pixel gets label 0
+		RGBDFrame(Camera * camera_,cv::Mat rgb_, cv::Mat depth_, double capturetime_ = 0, Eigen::Matrix4d pose_ = Eigen::Matrix4d::Identity(), bool compute_normals = true, bool compute_segmentation = false);
 		~RGBDFrame();
 
 		void show(bool stop = false);
@@ -0,0 +1,70 @@
+#ifndef reglibIndexedMesh_H
+#define reglibIndexedMesh_H
+
+#include <vector>
+#include <string>
+
+#include <Eigen/Dense>
+
+namespace reglib
+{
+
+class Model;
+
+//One masked depth image to triangulate, the data is not copied
+class MeshFrame{
+    public:
+    const unsigned short * depth;
+    const unsigned char * rgb;      //bgr, may be 0
+    const bool * mask;              //may be 0
+    int width;
+    int height;
+    float idepth;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    Eigen::Matrix4d pose;
+
+    MeshFrame();
+    ~MeshFrame();
+};
+
+//Triangle mesh in flat buffers, built from the frames of a model.
+//
+//Every frame is triangulated on a grid of every step:th pixel, two triangles per grid cell as in Mesh::build, with the
+//frames split between OpenMP threads. The vertices of all frames are then merged through a spatial hash: a vertex
+//closer than merge_distance to an earlier vertex is replaced by it, and triangles that collapse are dropped.
+class IndexedMesh{
+    public:
+    std::vector<float> vertices;            //x,y,z per vertex
+    std::vector<unsigned char> colors;      //r,g,b per vertex
+    std::vector<unsigned int> indices;      //three vertices per triangle
+
+    int step;
+    float merge_distance;                   //0 keeps the vertices of every frame separate
+
+    IndexedMesh();
+    ~IndexedMesh();
+
+    void clear();
+    unsigned int nrVertices() const;
+    unsigned int nrTriangles() const;
+    //Bytes allocated by the buffers
+    size_t memoryUsage() const;
+
+    void build(Model * model);
+    void build(const std::vector<MeshFrame> & frames);
+
+    bool savePLY(std::string path, bool binary = true) const;
+
+    //Vertices and triangles of one frame, only vertices used by a triangle are kept
+    static void triangulate(const MeshFrame & frame, int step, std::vector<float> & vertices, std::vector<unsigned char> & colors, std::vector<unsigned int> & indices);
+
+    private:
+    void mergeVertices();
+};
+
+}
+
+#endif // reglibIndexedMesh_H
@@ -12,6 +12,7 @@
 #include <fstream>
 
 #include "../model/Model.h"
+#include "IndexedMesh.h"
 #include <pcl/visualization/pcl_visualizer.h>
 
 namespace reglib
@@ -44,10 +45,12 @@ class Mesh{
         public:
         std::vector<Vertex*> vertexes;
         std::vector<Triangle*> triangles;
+        IndexedMesh indexed;
 
         Mesh();
         ~Mesh();
 
+        //type 0 builds vertexes and triangles, type 1 builds indexed
         void build(Model * model, int type);
         void show(pcl::visualization::PCLVisualizer * viewer);
         //void save(std::string path = "");
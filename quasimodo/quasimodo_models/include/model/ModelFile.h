@@ -0,0 +1,75 @@
+#ifndef reglibModelFile_H
+#define reglibModelFile_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Model.h"
+
+namespace reglib
+{
+	//Single file container for a Model, replacing the directory of pngs and _data.txt files written by Model::save.
+	//
+	//The file is a header, a sequence of chunks and an index of the chunks at the end. Every chunk holds one item (the
+	//camera, the model data, the superpoints, or the data, rgb, depth or mask of one frame) and is found through the
+	//index by type and frame number, so a single frame can be read without touching the rest of the file. Images are
+	//stored raw, with the lossless delta codec from ImageCodec.h, or as png/jpg through OpenCV.
+	class ModelFile{
+		public:
+		enum ChunkType	{CHUNK_CAMERA = 0, CHUNK_MODEL = 1, CHUNK_SUPERPOINTS = 2, CHUNK_FRAME = 3, CHUNK_RGB = 4, CHUNK_DEPTH = 5, CHUNK_MASK = 6};
+		enum Codec		{CODEC_RAW = 0, CODEC_DELTA = 1, CODEC_PNG = 2, CODEC_JPG = 3, CODEC_AUTO = 4};
+
+		struct Chunk{
+			unsigned int		type;
+			int					frame;
+			unsigned int		codec;
+			unsigned int		rows;
+			unsigned int		cols;
+			unsigned int		cvtype;
+			unsigned long long	offset;
+			unsigned long long	size;
+		};
+
+		//CODEC_AUTO stores an image with the delta codec when that is smaller than the raw image
+		int rgb_codec;
+		int depth_codec;
+		int mask_codec;
+		int jpg_quality;
+
+		ModelFile();
+		~ModelFile();
+
+		bool save(Model * model, Camera * camera, std::string path);
+
+		bool open(std::string path);
+		void close();
+		unsigned int nrFrames();
+		Camera * loadCamera();
+		RGBDFrame * loadFrame(Camera * cam, unsigned int frame, bool compute_normals = true);
+		cv::Mat loadRGB(unsigned int frame);
+		cv::Mat loadDepth(unsigned int frame);
+		cv::Mat loadMask(unsigned int frame);
+		//Reads every chunk of the model, if cam is 0 the camera stored in the file is used
+		Model * loadModel(Camera * cam = 0);
+
+		static Model * load(Camera * cam, std::string path);
+
+		private:
+		std::ifstream file;
+		std::map<std::pair<unsigned int,int>, Chunk> index;
+		std::vector<char> buffer;
+
+		bool readChunk(unsigned int type, int frame, Chunk & chunk);
+		cv::Mat loadImage(unsigned int type, unsigned int frame);
+		Model * loadModelData(Camera * cam);
+		void writeChunk(std::ofstream & out, std::vector<Chunk> & chunks, unsigned int type, int frame, const std::vector<char> & data);
+		void writeImage(std::ofstream & out, std::vector<Chunk> & chunks, unsigned int type, int frame, cv::Mat image, int codec);
+	};
+}
+
+#endif // reglibModelFile_H
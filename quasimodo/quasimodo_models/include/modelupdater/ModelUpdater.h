@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h> 
 #include <chrono>
+#include <map>
 
 #include <Eigen/Dense>
 #include "../model/Model.h"
@@ -38,6 +39,34 @@ namespace reglib
 		~OcclusionScore(){}
 	};
 
+	//Masked test pixels of a frame back-projected into its camera frame, stored as arrays so that the occlusion scoring
+	//kernel vectorizes. Only the pixels visited with the given step are kept, with their bounding box.
+	class OcclusionPoints{
+		public:
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> nx;
+		std::vector<float> ny;
+		std::vector<float> nz;
+		std::vector<int> w;
+		std::vector<int> h;
+		float min [3];
+		float max [3];
+
+		OcclusionPoints(RGBDFrame * frame, ModelMask * modelmask, int step = 1);
+		~OcclusionPoints(){}
+		//false if no point can project inside the image of dst with the relative pose p
+		bool canSee(RGBDFrame * dst, Eigen::Matrix4d p);
+	};
+
+	class CachedOcclusionScore{
+		public:
+		double pose [16];//column major, not an Eigen matrix to avoid alignment issues in the map
+		int step;
+		OcclusionScore score;
+	};
+
 	class ModelUpdater{
         public:
         double occlusion_penalty;
@@ -71,6 +100,21 @@ namespace reglib
 		virtual void recomputeScores();
 
 		CloudData * getCD(std::vector<Eigen::Matrix4d> current_poses, std::vector<RGBDFrame*> current_frames,std::vector<cv::Mat> current_masks, int step);
+
+		//Occlusion scores of frame pairs whose relative pose has not changed are reused between getOcclusionScores calls.
+		//The cache is keyed on frame and mask ids, which are never reused, so a deleted frame can not alias a new one.
+		//Its entries are only dropped by clearOcclusionCache.
+		void clearOcclusionCache();
+
+		protected:
+		typedef std::pair<unsigned long, int> OcclusionFrameKey;//frame id, mask id
+		typedef std::pair< OcclusionFrameKey, int > OcclusionPointsKey;
+		typedef std::pair< OcclusionFrameKey, OcclusionFrameKey > OcclusionPairKey;
+		std::map< OcclusionPointsKey, OcclusionPoints * >	occlusion_points;
+		std::map< OcclusionPairKey, CachedOcclusionScore >	occlusion_scores;
+
+		//not thread safe when the points are not cached yet
+		OcclusionPoints * getOcclusionPoints(RGBDFrame * frame, ModelMask * modelmask, int step);
 	};
 
 }
@@ -21,6 +21,10 @@ namespace reglib
 		double stopval;
 		unsigned steps;
 
+		bool debugg_print;
+		bool use_rematch_schedule;	//only rematch the frame pairs whose relative pose has moved since they were last matched, off by default
+		double rematch_threshold;	//largest point motion (in meters) allowed before a frame pair is rematched
+
 		std::vector<int> nr_datas;
 
 		std::vector< bool > is_ok;
@@ -38,6 +42,9 @@ namespace reglib
 
 		std::vector<int> nr_matches;
 		std::vector< std::vector< std::vector<int> > > matchids;
+		std::vector< Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > matched_poses;//relative pose of pair i*nr_frames+j when it was last matched
+		std::vector< char > matched_valid;
+		std::vector< double > radiuses;//largest distance from the origin of a point in each frame
 
 		std::vector<int> sweepids;
 		std::vector<int> background_nr_datas;
@@ -62,6 +69,7 @@ namespace reglib
 		~MassRegistrationPPR();
 		
 		MassFusionResults getTransforms(std::vector<Eigen::Matrix4d> guess);
+		MassFusionResults getTransformsSerial(std::vector<Eigen::Matrix4d> guess);//the previous serial implementation, reference for benchmarks
 		void setData(std::vector<RGBDFrame*> frames_, std::vector<ModelMask *> mmasks);
 		void setData(std::vector< pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr > all_clouds);
 
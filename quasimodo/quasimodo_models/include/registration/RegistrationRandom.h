@@ -8,20 +8,38 @@
 
 namespace reglib
 {
+	//Global registration by refining from many start rotations around the centroids. The starts are scored cheaply by
+	//their nearest neighbour distances first and starts scoring much worse than the best one are dropped. The remaining
+	//starts are refined in parallel, every thread with its own RegistrationRefinement, and the solutions are clustered
+	//in the order of the starts. The refinements are limited by a number of iterations rather than by time, so the
+	//result only depends on the input, seed and nr_random_starts.
 	class RegistrationRandom : public Registration
 	{
 		public:
 
 		Registration * refinement;
 
+		int nr_threads;						//0 uses omp_get_max_threads(), use 1 when registrations already run in parallel
+		unsigned int seed;					//for the random starts
+		int nr_random_starts;				//added to the rotation grid
+		double prune_ratio;					//starts with a coarse score above prune_ratio times the best are not refined, 0 refines all
+		int calibration_starts;				//starts used to set the iteration budget of the others
+		int max_refinement_iterations;		//iteration cap of the calibration starts and of the final refinement of the best clusters
+
 		virtual void setSrc(CloudData * src_);
 		virtual void setDst(CloudData * dst_);
 
 
 		RegistrationRandom();
 		~RegistrationRandom();
-		
+
 		FusionResults getTransform(Eigen::MatrixXd guess);
+
+		private:
+		std::vector<RegistrationRefinement *> workers;
+		std::vector<char> worker_has_dst;	//not vector<bool>, the flags are set from several threads
+
+		void prepareWorkers(int threads);
 	};
 }
 
@@ -30,6 +30,11 @@ namespace reglib
 		Tree3d * trees3d;
 		ArrayData3D<double> * a3d;
 
+		//Stops after maxiterations weight and transformation updates, unlike maxtime this does not depend on the load
+		//of the machine. nr_iterations is the number of updates of the last getTransform.
+		int maxiterations;
+		int nr_iterations;
+
 		RegistrationRefinement();
 		~RegistrationRefinement();
 
@@ -44,8 +44,8 @@ public:
 	DistanceWeightFunction2();
 	~DistanceWeightFunction2();
 
-	virtual void computeModel(MatrixXd mat);
-	virtual VectorXd getProbs(MatrixXd mat);
+	virtual void computeModel(const MatrixXd & mat);
+	virtual VectorXd getProbs(const MatrixXd & mat);
 	virtual double getProb(double d);
 	virtual double getNoise();
 	virtual double getConvergenceThreshold();
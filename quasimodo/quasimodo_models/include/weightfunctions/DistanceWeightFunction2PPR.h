@@ -4,6 +4,7 @@
 #include <cmath>
 #include <sys/time.h>
 #include "DistanceWeightFunction2.h"
+#include "HistogramKernels.h"
 
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
@@ -61,10 +62,13 @@ public:
 	bool bidir;
 	int iter;
 
+	bool batch_kernels;//use the batched kernels in HistogramKernels.h, false runs the scalar loops
+	HistogramWorkspace workspace;
+
 	DistanceWeightFunction2PPR(	double maxd_	= 0.25, int histogram_size_ = 25000);
 	~DistanceWeightFunction2PPR();
-	virtual void computeModel(MatrixXd mat);
-	virtual VectorXd getProbs(MatrixXd mat);
+	virtual void computeModel(const MatrixXd & mat);
+	virtual VectorXd getProbs(const MatrixXd & mat);
 	virtual double getNoise();
 	virtual double getConvergenceThreshold();
 	virtual bool update();
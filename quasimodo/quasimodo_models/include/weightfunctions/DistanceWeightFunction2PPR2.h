@@ -4,6 +4,7 @@
 #include <cmath>
 #include <sys/time.h>
 #include "DistanceWeightFunction2.h"
+#include "HistogramKernels.h"
 
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
@@ -81,10 +82,17 @@ public:
 	bool bidir;
 	int iter;
 
+	bool batch_kernels;//use the batched kernels in HistogramKernels.h, false runs the scalar loops
+	HistogramWorkspace workspace;
+	std::vector<double> inlier_weights;
+
 	DistanceWeightFunction2PPR2(	double maxd_	= 0.25, int histogram_size_ = 25000);
 	~DistanceWeightFunction2PPR2();
-	virtual void computeModel(MatrixXd mat);
-	virtual VectorXd getProbs(MatrixXd mat);
+	virtual void computeModel(const MatrixXd & mat);
+	virtual VectorXd getProbs(const MatrixXd & mat);
+	//Batched probabilities of a column major nr_dim x nr_data residual array, also in single precision
+	void getProbs(const double * residuals, unsigned int nr_data, int nr_dim, double * weights);
+	void getProbs(const float * residuals, unsigned int nr_data, int nr_dim, float * weights);
 	virtual double getProb(double d);
 	virtual double getNoise();
 	virtual double getConvergenceThreshold();
@@ -0,0 +1,187 @@
+#ifndef HistogramKernels_H
+#define HistogramKernels_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace reglib
+{
+
+//Batched kernels for the residual histograms of the PPR weight functions. The loops over the residuals have no
+//branches on the data, so the compiler can vectorize them, and the float versions process twice as many residuals per
+//instruction as the double versions. Scratch buffers live in a HistogramWorkspace that is reused between iterations.
+
+//How a scaled residual v is mapped to a bin:
+//BinFloor	bin int(v), valid for 0 <= int(v) < size						(DistanceWeightFunction2PPR)
+//BinRound	bin int(v+0.5), valid for v >= 0 and v+0.5 < size				(DistanceWeightFunction2PPR2)
+//BinInterp	as BinRound, but probabilities are interpolated between int(v) and int(v)+1
+enum BinMode { BinFloor, BinRound, BinInterp };
+
+class HistogramWorkspace{
+	public:
+	std::vector<int>	counts;
+	std::vector<float>	padded;
+	std::vector<float>	weights;
+	std::vector<float>	mirrored;
+
+	HistogramWorkspace(){}
+	~HistogramWorkspace(){}
+};
+
+//Residuals with |x| < maxd
+template <typename T> unsigned int countInside(const T * data, unsigned int nr_data, T maxd){
+	unsigned int nr_inside = 0;
+	for(unsigned int i = 0; i < nr_data; i++){nr_inside += std::fabs(data[i]) < maxd;}
+	return nr_inside;
+}
+
+//Scaled value of a residual, (|x| or x+shift) * mul
+template <typename T> inline T binValue(T x, bool absolute, T shift, T mul){
+	return (absolute ? std::fabs(x) : x+shift)*mul;
+}
+
+//Sets histogram[0..histogram_size) to the number of residuals in each bin, residuals outside the histogram are counted
+//in an extra bin that is dropped
+template <typename T, int mode, bool absolute> void buildHistogramT(const T * data, unsigned int nr_data, T shift, T mul, int histogram_size, float * histogram, HistogramWorkspace & ws){
+	ws.counts.assign(histogram_size+1,0);
+	int * counts = ws.counts.data();
+	const T round = mode == BinFloor ? T(0) : T(0.5);
+	for(unsigned int i = 0; i < nr_data; i++){
+		T v = binValue(data[i],absolute,shift,mul);
+		int b = int(v+round);
+		bool valid = (mode == BinFloor ? b >= 0 : v >= 0) && b < histogram_size;
+		counts[valid ? b : histogram_size]++;
+	}
+	for(int k = 0; k < histogram_size; k++){histogram[k] = counts[k];}
+}
+
+template <typename T> void buildHistogram(const T * data, unsigned int nr_data, bool absolute, T shift, T mul, BinMode mode,
+										  int histogram_size, float * histogram, HistogramWorkspace & ws){
+	if(mode == BinFloor){
+		if(absolute){	buildHistogramT<T,BinFloor,true>	(data,nr_data,shift,mul,histogram_size,histogram,ws);}
+		else{			buildHistogramT<T,BinFloor,false>	(data,nr_data,shift,mul,histogram_size,histogram,ws);}
+	}else{
+		if(absolute){	buildHistogramT<T,BinRound,true>	(data,nr_data,shift,mul,histogram_size,histogram,ws);}
+		else{			buildHistogramT<T,BinRound,false>	(data,nr_data,shift,mul,histogram_size,histogram,ws);}
+	}
+}
+
+//out[j] = sum over |d| <= offset of w(|d|) * signal[first+j+d], for j in [0,nr_out). The signal is zero outside
+//[0,length). w(k) = exp(-0.5 k^2/stdval^2) up to and including the first weight below cutoff, zero after it.
+inline void convolveGaussian(const float * signal, int length, int first, int nr_out, float stdval, float cutoff, float * out, HistogramWorkspace & ws){
+	int offset = std::max(4,int(4.0*stdval));
+	double info = -0.5/(stdval*stdval);
+	ws.weights.assign(offset+1,0);
+	for(int k = 0; k <= offset && k < length; k++){
+		double current = exp(k*k*info);
+		ws.weights[k] = current;
+		if(current < cutoff){break;}
+	}
+
+	ws.padded.assign(length+2*offset,0);
+	std::copy(signal,signal+length,ws.padded.begin()+offset);
+
+	for(int j = 0; j < nr_out; j++){out[j] = 0;}
+	for(int d = -offset; d <= offset; d++){
+		const float w = ws.weights[abs(d)];
+		if(w == 0){continue;}
+		const float * src = ws.padded.data()+offset+first+d;
+		for(int j = 0; j < nr_out; j++){out[j] += w*src[j];}
+	}
+}
+
+//Blurs the histogram mirrored around zero, keeping its sum. With cutoff 0 every weight inside the kernel is used.
+inline void blurMirroredHistogram(float * blur_hist, const float * hist, int nr_data, float stdval, float cutoff, HistogramWorkspace & ws){
+	ws.mirrored.resize(2*nr_data);
+	for(int i = 0; i < nr_data; i++){
+		ws.mirrored[i]			= hist[nr_data-1-i];
+		ws.mirrored[nr_data+i]	= hist[i];
+	}
+	convolveGaussian(ws.mirrored.data(),2*nr_data,nr_data,nr_data,stdval,cutoff,blur_hist,ws);
+
+	float bef = 0;
+	float aft = 0;
+	for(int i = 0; i < nr_data; i++){
+		bef += hist[i];
+		aft += blur_hist[i];
+	}
+	for(int i = 0; i < nr_data; i++){blur_hist[i] *= bef/aft;}
+}
+
+//Blurs a histogram over signed residuals, keeping its sum.
+inline void blurHistogramKernel(float * blur_hist, const float * hist, int nr_data, float stdval, HistogramWorkspace & ws){
+	convolveGaussian(hist,nr_data,0,nr_data,stdval,0,blur_hist,ws);
+
+	float bef = 0;
+	float aft = 0;
+	for(int i = 0; i < nr_data; i++){
+		bef += hist[i];
+		aft += blur_hist[i];
+	}
+	for(int i = 0; i < nr_data; i++){blur_hist[i] *= bef/aft;}
+}
+
+//Probability of a single scaled residual, prob needs histogram_size+1 entries for BinInterp
+template <typename T, int mode> inline float binProb(T v, const float * prob, int histogram_size){
+	if(mode == BinFloor){
+		int b = int(v);
+		bool valid = b >= 0 && b < histogram_size;
+		return valid ? prob[std::min(std::max(b,0),histogram_size-1)] : 0.0f;
+	}
+	bool valid = v >= 0 && (v+T(0.5)) < histogram_size;
+	if(mode == BinRound){
+		return valid ? prob[std::min(std::max(int(v+T(0.5)),0),histogram_size-1)] : 0.0f;
+	}
+	int b = std::min(std::max(int(v),0),histogram_size-1);
+	T w2 = v-int(v);
+	T w1 = 1-w2;
+	return valid ? float(prob[b]*w1 + prob[b+1]*w2) : 0.0f;
+}
+
+template <typename T, int mode, bool absolute> double computeProbsT(const T * data, unsigned int nr_data, int nr_dim, T shift, T mul, const float * prob, int histogram_size, T * weights){
+	double nr_inliers = 0;
+	if(nr_dim == 1){
+		for(unsigned int j = 0; j < nr_data; j++){
+			float p = binProb<T,mode>(binValue(data[j],absolute,shift,mul),prob,histogram_size);
+			float inl  = p;
+			float ninl = 1.0-p;
+			T d = inl / (inl+ninl);
+			nr_inliers += d;
+			weights[j] = d;
+		}
+		return nr_inliers;
+	}
+
+	for(unsigned int j = 0; j < nr_data; j++){
+		float inl  = 1;
+		float ninl = 1;
+		for(int k = 0; k < nr_dim; k++){
+			float p = binProb<T,mode>(binValue(data[j*nr_dim+k],absolute,shift,mul),prob,histogram_size);
+			inl *= p;
+			ninl *= 1.0-p;
+		}
+		T d = inl / (inl+ninl);
+		nr_inliers += d;
+		weights[j] = d;
+	}
+	return nr_inliers;
+}
+
+//Inlier probability of every column of a column major nr_dim x nr_data residual matrix, the probabilities of the
+//dimensions are combined as inl/(inl+outl). Returns the sum of the probabilities (the expected number of inliers).
+template <typename T> double computeProbs(const T * data, unsigned int nr_data, int nr_dim, bool absolute, T shift, T mul, BinMode mode,
+										  const float * prob, int histogram_size, T * weights){
+	switch(mode){
+		case BinFloor:	{return absolute ?	computeProbsT<T,BinFloor,true>	(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights) :
+											computeProbsT<T,BinFloor,false>	(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights);}
+		case BinRound:	{return absolute ?	computeProbsT<T,BinRound,true>	(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights) :
+											computeProbsT<T,BinRound,false>	(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights);}
+		default:		{return absolute ?	computeProbsT<T,BinInterp,true>	(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights) :
+											computeProbsT<T,BinInterp,false>(data,nr_data,nr_dim,shift,mul,prob,histogram_size,weights);}
+	}
+}
+
+}
+
+#endif // HistogramKernels_H
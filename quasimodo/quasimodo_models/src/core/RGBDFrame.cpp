@@ -1,4 +1,6 @@
 #include "core/RGBDFrame.h"
+#include "core/FramePreprocessing.h"
+#include "core/FrameSegmentation.h"
 
 #include <pcl/console/parse.h>
 #include <pcl/point_cloud.h>
@@ -42,7 +44,7 @@ RGBDFrame::RGBDFrame(){
 bool updated = true;
 void on_trackbar( int, void* ){updated = true;}
 
-RGBDFrame::RGBDFrame(Camera * camera_, cv::Mat rgb_, cv::Mat depth_, double capturetime_, Eigen::Matrix4d pose_, bool compute_normals){
+RGBDFrame::RGBDFrame(Camera * camera_, cv::Mat rgb_, cv::Mat depth_, double capturetime_, Eigen::Matrix4d pose_, bool compute_normals, bool compute_segmentation){
 
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
 
@@ -68,19 +70,6 @@ RGBDFrame::RGBDFrame(Camera * camera_, cv::Mat rgb_, cv::Mat depth_, double capt
 	const double ifx			= 1.0/camera->fx;
 	const double ify			= 1.0/camera->fy;
 
-	connections.resize(1);
-	connections[0].resize(1);
-	connections[0][0] = 0;
-
-	intersections.resize(1);
-	intersections[0].resize(1);
-	intersections[0][0] = 0;
-
-	nr_labels = 1;
-	labels = new int[width*height];
-    for(int i = 0; i < width*height; i++){labels[i] = 0;}
-
-
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
 	unsigned short * depthdata = (unsigned short *)depth.data;
 	unsigned char * rgbdata = (unsigned char *)rgb.data;
@@ -88,206 +77,64 @@ RGBDFrame::RGBDFrame(Camera * camera_, cv::Mat rgb_, cv::Mat depth_, double capt
 	depthedges.create(height,width,CV_8UC1);
 	unsigned char * depthedgesdata = (unsigned char *)depthedges.data;
 
-	double t = 0.01;
-    for(int w = 0; w < width; w++){
-        for(int h = 0; h < height;h++){
-			int ind = h*width+w;
-			depthedgesdata[ind] = 0;
-			double z = idepth*double(depthdata[ind]);
-			if(w > 0){
-				double z2 = idepth*double(depthdata[ind-1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(w < width-1){
-				double z2 = idepth*double(depthdata[ind+1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(h > 0){
-				double z2 = idepth*double(depthdata[ind-width]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(h < height-1){
-				double z2 = idepth*double(depthdata[ind+width]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(h > 0 && w > 0){
-				double z2 = idepth*double(depthdata[ind-width-1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(w > 0 && h < height-1){
-				double z2 = idepth*double(depthdata[ind+width-1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(h > 0 && w < width-1){
-				double z2 = idepth*double(depthdata[ind-width+1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-
-			if(h < height-1 && w < width-1){
-				double z2 = idepth*double(depthdata[ind+width+1]);
-				double info = 1.0/(z*z+z2*z2);
-				double diff = fabs(z2-z)*info;
-				if(diff > t){depthedgesdata[ind] = 255;}
-			}
-		}
-	}
+	//Row-major and multithreaded, see FramePreprocessing.h
+	FramePreprocessor preprocessor (idepth,camera->fx,camera->fy,cx,cy);
+	preprocessor.computePoints(depthdata,width,height);
+	preprocessor.computeDepthEdges(depthdata,depthedgesdata);
 
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
 	if(compute_normals){
 		normals.create(height,width,CV_32FC3);
 		float * normalsdata = (float *)normals.data;
-
-		pcl::PointCloud<pcl::PointXYZ>::Ptr	cloud	(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::PointCloud<pcl::Normal>::Ptr	normals (new pcl::PointCloud<pcl::Normal>);
-		cloud->width	= width;
-		cloud->height	= height;
-		cloud->points.resize(width*height);
-
-        for(int w = 0; w < width; w++){
-            for(int h = 0; h < height;h++){
-				int ind = h*width+w;
-				pcl::PointXYZ & p = cloud->points[ind];
-				double z = idepth*double(depthdata[ind]);
-				if(z > 0){
-					p.x = (double(w) - cx) * z * ifx;
-					p.y = (double(h) - cy) * z * ify;
-					p.z = z;
-				}else{
-					p.x = NAN;
-					p.y = NAN;
-					p.z = NAN;
-				}
-			}
-		}
-
-		//printf("%s LINE:%i\n",__FILE__,__LINE__);
-		pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
-		ne.setInputCloud(cloud);
+		preprocessor.computeNormals(normalsdata);
 
 		bool tune = false;
-		unsigned char * combidata;
-		cv::Mat combined;
-
-		int NormalEstimationMethod = 0;
-		int MaxDepthChangeFactor = 20;
-		int NormalSmoothingSize = 7;
-		int depth_dependent_smoothing = 1;
-
-		ne.setMaxDepthChangeFactor(0.001*double(MaxDepthChangeFactor));
-		ne.setNormalSmoothingSize(NormalSmoothingSize);
-		ne.setDepthDependentSmoothing (depth_dependent_smoothing);
-		ne.compute(*normals);
-
-        for(int w = 0; w < width; w++){
-            for(int h = 0; h < height;h++){
-				int ind = h*width+w;
-				pcl::Normal		p2		= normals->points[ind];
-				if(!isnan(p2.normal_x)){
-					normalsdata[3*ind+0]	= p2.normal_x;
-					normalsdata[3*ind+1]	= p2.normal_y;
-					normalsdata[3*ind+2]	= p2.normal_z;
-				}else{
-					normalsdata[3*ind+0]	= 2;
-					normalsdata[3*ind+1]	= 2;
-					normalsdata[3*ind+2]	= 2;
-				}
-			}
-		}
-
-		//printf("%s LINE:%i\n",__FILE__,__LINE__);
 		if(tune){
+			cv::Mat combined;
 			combined.create(height,2*width,CV_8UC3);
-			combidata = (unsigned char *)combined.data;
-
-			cv::namedWindow( "normals", cv::WINDOW_AUTOSIZE );
-			cv::namedWindow( "combined", cv::WINDOW_AUTOSIZE );
-
-			//cv::createTrackbar( "NormalEstimationMethod", "combined", &NormalEstimationMethod, 3, on_trackbar );
-			//cv::createTrackbar( "MaxDepthChangeFactor", "combined", &MaxDepthChangeFactor, 1000, on_trackbar );
-			//cv::createTrackbar( "NormalSmoothingSize", "combined", &NormalSmoothingSize, 100, on_trackbar );
-			//cv::createTrackbar( "depth_dependent_smoothing", "combined", &depth_dependent_smoothing, 1, on_trackbar );
-
-			//while(true){
-
-				if(NormalEstimationMethod == 0){ne.setNormalEstimationMethod (ne.COVARIANCE_MATRIX);}
-				if(NormalEstimationMethod == 1){ne.setNormalEstimationMethod (ne.AVERAGE_3D_GRADIENT);}
-				if(NormalEstimationMethod == 2){ne.setNormalEstimationMethod (ne.AVERAGE_DEPTH_CHANGE);}
-				if(NormalEstimationMethod == 3){ne.setNormalEstimationMethod (ne.SIMPLE_3D_GRADIENT);}
-
-				ne.setMaxDepthChangeFactor(0.001*double(MaxDepthChangeFactor));
-				ne.setNormalSmoothingSize(NormalSmoothingSize);
-				ne.setDepthDependentSmoothing (depth_dependent_smoothing);
-				ne.compute(*normals);
-                for(int w = 0; w < width; w++){
-                    for(int h = 0; h < height;h++){
-						int ind = h*width+w;
-						pcl::Normal		p2		= normals->points[ind];
-						if(!isnan(p2.normal_x)){
-							normalsdata[3*ind+0]	= p2.normal_x;
-							normalsdata[3*ind+1]	= p2.normal_y;
-							normalsdata[3*ind+2]	= p2.normal_z;
-						}else{
-							normalsdata[3*ind+0]	= 2;
-							normalsdata[3*ind+1]	= 2;
-							normalsdata[3*ind+2]	= 2;
-						}
-					}
-				}
-
-
-                for(int w = 0; w < width; w++){
-                    for(int h = 0; h < height;h++){
-						int ind = h*width+w;
-						int indn = h*2*width+(w+width);
-						int indc = h*2*width+(w);
-						combidata[3*indc+0]	= rgbdata[3*ind+0];
-						combidata[3*indc+1]	= rgbdata[3*ind+1];
-						combidata[3*indc+2]	= rgbdata[3*ind+2];
-						pcl::Normal		p2		= normals->points[ind];
-						if(!isnan(p2.normal_x)){
-							combidata[3*indn+0]	= 255.0*fabs(p2.normal_x);
-							combidata[3*indn+1]	= 255.0*fabs(p2.normal_y);
-							combidata[3*indn+2]	= 255.0*fabs(p2.normal_z);
-						}else{
-							combidata[3*indn+0]	= 255;
-							combidata[3*indn+1]	= 255;
-							combidata[3*indn+2]	= 255;
-						}
+			unsigned char * combidata = (unsigned char *)combined.data;
+			for(int h = 0; h < height; h++){
+				for(int w = 0; w < width; w++){
+					int ind = h*width+w;
+					int indn = h*2*width+(w+width);
+					int indc = h*2*width+(w);
+					combidata[3*indc+0]	= rgbdata[3*ind+0];
+					combidata[3*indc+1]	= rgbdata[3*ind+1];
+					combidata[3*indc+2]	= rgbdata[3*ind+2];
+					if(normalsdata[3*ind+0] != 2){
+						combidata[3*indn+0]	= 255.0*fabs(normalsdata[3*ind+0]);
+						combidata[3*indn+1]	= 255.0*fabs(normalsdata[3*ind+1]);
+						combidata[3*indn+2]	= 255.0*fabs(normalsdata[3*ind+2]);
+					}else{
+						combidata[3*indn+0]	= 255;
+						combidata[3*indn+1]	= 255;
+						combidata[3*indn+2]	= 255;
 					}
 				}
-				char buf [1024];
-                sprintf(buf,"combined%i.png",int(id));
-				cv::imwrite( buf, combined );
-				printf("saving: %s\n",buf);
-				cv::imshow( "combined", combined );
-				cv::waitKey(0);
-				//while(!updated){cv::waitKey(50);}
-				updated = false;
-			//}
+			}
+			char buf [1024];
+			sprintf(buf,"combined%i.png",int(id));
+			cv::imwrite( buf, combined );
+			printf("saving: %s\n",buf);
+			cv::namedWindow( "combined", cv::WINDOW_AUTOSIZE );
+			cv::imshow( "combined", combined );
+			cv::waitKey(0);
 		}
-
 		//printf("%s LINE:%i\n",__FILE__,__LINE__);
 	}
+
+	labels = new int[width*height];
+	if(compute_segmentation){
+		//Superpixels on colour, depth and normals, and their adjacency, see FrameSegmentation.h
+		FrameSegmenter segmenter;
+		nr_labels = segmenter.segment(rgbdata,preprocessor.px.data(),preprocessor.py.data(),preprocessor.pz.data(),compute_normals ? (float *)normals.data : 0,width,height,labels);
+		segmenter.computeAdjacency(labels,nr_labels,preprocessor.pz.data(),connections,intersections);
+	}else{
+		nr_labels = 1;
+		std::fill(labels,labels+width*height,0);
+		connections.resize(1);
+		intersections.resize(1);
+	}
 	//show(true);
 
 	//printf("%s LINE:%i\n",__FILE__,__LINE__);
@@ -0,0 +1,294 @@
+#include "../../include/mesher/IndexedMesh.h"
+#include "../../include/model/Model.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <fstream>
+#include <unordered_map>
+
+namespace reglib
+{
+
+//21 bits per axis, enough for +-5km with 5mm cells
+static inline unsigned long long cellKey(long long x, long long y, long long z){
+    const unsigned long long m = (1ull << 21)-1;
+    return ((unsigned long long)(x & m) << 42) | ((unsigned long long)(y & m) << 21) | (unsigned long long)(z & m);
+}
+
+MeshFrame::MeshFrame(){
+    depth = 0;
+    rgb = 0;
+    mask = 0;
+    width = 0;
+    height = 0;
+    idepth = 0.001;
+    fx = fy = 525;
+    cx = 319.5;
+    cy = 239.5;
+    pose = Eigen::Matrix4d::Identity();
+}
+MeshFrame::~MeshFrame(){}
+
+IndexedMesh::IndexedMesh(){
+    step = 10;
+    merge_distance = 0.005;
+}
+IndexedMesh::~IndexedMesh(){}
+
+void IndexedMesh::clear(){
+    vertices.clear();
+    colors.clear();
+    indices.clear();
+}
+
+unsigned int IndexedMesh::nrVertices() const {return vertices.size()/3;}
+unsigned int IndexedMesh::nrTriangles() const {return indices.size()/3;}
+
+size_t IndexedMesh::memoryUsage() const {
+    return vertices.capacity()*sizeof(float) + colors.capacity()*sizeof(unsigned char) + indices.capacity()*sizeof(unsigned int);
+}
+
+void IndexedMesh::build(Model * model){
+    std::vector<MeshFrame> frames (model->frames.size());
+    for(unsigned int f = 0; f < model->frames.size(); f++){
+        RGBDFrame * frame   = model->frames[f];
+        Camera * camera     = frame->camera;
+        MeshFrame & mf      = frames[f];
+        mf.depth    = (const unsigned short *)frame->depth.data;
+        mf.rgb      = (const unsigned char *)frame->rgb.data;
+        mf.mask     = model->modelmasks[f]->maskvec;
+        mf.width    = camera->width;
+        mf.height   = camera->height;
+        mf.idepth   = camera->idepth_scale;
+        mf.fx       = camera->fx;
+        mf.fy       = camera->fy;
+        mf.cx       = camera->cx;
+        mf.cy       = camera->cy;
+        mf.pose     = model->relativeposes[f];
+    }
+    build(frames);
+}
+
+void IndexedMesh::build(const std::vector<MeshFrame> & frames){
+    clear();
+    const int nr_frames = frames.size();
+    std::vector< std::vector<float> >           frame_vertices (nr_frames);
+    std::vector< std::vector<unsigned char> >   frame_colors (nr_frames);
+    std::vector< std::vector<unsigned int> >    frame_indices (nr_frames);
+#pragma omp parallel for schedule(dynamic)
+    for(int f = 0; f < nr_frames; f++){
+        triangulate(frames[f],step,frame_vertices[f],frame_colors[f],frame_indices[f]);
+    }
+
+    std::vector<unsigned int> vertex_offset (nr_frames+1,0);
+    std::vector<unsigned int> index_offset (nr_frames+1,0);
+    for(int f = 0; f < nr_frames; f++){
+        vertex_offset[f+1]  = vertex_offset[f] + frame_vertices[f].size()/3;
+        index_offset[f+1]   = index_offset[f] + frame_indices[f].size();
+    }
+    vertices.resize(3*vertex_offset[nr_frames]);
+    colors.resize(3*vertex_offset[nr_frames]);
+    indices.resize(index_offset[nr_frames]);
+#pragma omp parallel for schedule(dynamic)
+    for(int f = 0; f < nr_frames; f++){
+        std::copy(frame_vertices[f].begin(),frame_vertices[f].end(),vertices.begin()+3*vertex_offset[f]);
+        std::copy(frame_colors[f].begin(),frame_colors[f].end(),colors.begin()+3*vertex_offset[f]);
+        for(unsigned int i = 0; i < frame_indices[f].size(); i++){indices[index_offset[f]+i] = vertex_offset[f]+frame_indices[f][i];}
+        std::vector<float>().swap(frame_vertices[f]);
+        std::vector<unsigned char>().swap(frame_colors[f]);
+        std::vector<unsigned int>().swap(frame_indices[f]);
+    }
+
+    if(merge_distance > 0){mergeVertices();}
+}
+
+void IndexedMesh::triangulate(const MeshFrame & frame, int step, std::vector<float> & vertices, std::vector<unsigned char> & colors, std::vector<unsigned int> & indices){
+    vertices.clear();
+    colors.clear();
+    indices.clear();
+    if(step <= 0 || frame.width <= 0 || frame.height <= 0){return;}
+
+    const int width     = frame.width;
+    const int height    = frame.height;
+    const int gw        = (width-1)/step+1;
+    const int gh        = (height-1)/step+1;
+    const float ifx     = 1.0/frame.fx;
+    const float ify     = 1.0/frame.fy;
+    const Eigen::Matrix4d & p = frame.pose;
+    float m00 = p(0,0); float m01 = p(0,1); float m02 = p(0,2); float m03 = p(0,3);
+    float m10 = p(1,0); float m11 = p(1,1); float m12 = p(1,2); float m13 = p(1,3);
+    float m20 = p(2,0); float m21 = p(2,1); float m22 = p(2,2); float m23 = p(2,3);
+
+    //Grid point to vertex, -1 where there is no depth
+    std::vector<int> grid (gw*gh,-1);
+    std::vector<float> points;
+    std::vector<unsigned char> pointcolors;
+    int nr_points = 0;
+    for(int gy = 0; gy < gh; gy++){
+        const int h = gy*step;
+        for(int gx = 0; gx < gw; gx++){
+            const int w = gx*step;
+            const int ind = h*width+w;
+            if(frame.mask != 0 && !frame.mask[ind]){continue;}
+            float z = frame.idepth*float(frame.depth[ind]);
+            if(z <= 0){continue;}
+            float x = (w - frame.cx) * z * ifx;
+            float y = (h - frame.cy) * z * ify;
+            points.push_back(m00*x + m01*y + m02*z + m03);
+            points.push_back(m10*x + m11*y + m12*z + m13);
+            points.push_back(m20*x + m21*y + m22*z + m23);
+            for(int c = 0; c < 3; c++){pointcolors.push_back(frame.rgb != 0 ? frame.rgb[3*ind+2-c] : 255);}
+            grid[gy*gw+gx] = nr_points++;
+        }
+    }
+
+    std::vector<unsigned int> triangles;
+    for(int gy = 0; gy < gh; gy++){
+        for(int gx = 0; gx < gw; gx++){
+            int a = grid[gy*gw+gx];
+            if(a < 0){continue;}
+            if(gx > 0 && gy > 0){
+                int b = grid[gy*gw+gx-1];
+                int c = grid[(gy-1)*gw+gx];
+                if(b >= 0 && c >= 0){triangles.push_back(a); triangles.push_back(b); triangles.push_back(c);}
+            }
+            if(gx+1 < gw && gy+1 < gh){
+                int b = grid[gy*gw+gx+1];
+                int c = grid[(gy+1)*gw+gx];
+                if(b >= 0 && c >= 0){triangles.push_back(a); triangles.push_back(b); triangles.push_back(c);}
+            }
+        }
+    }
+
+    //Drop the points without triangles
+    std::vector<int> remap (nr_points,-1);
+    for(unsigned int i = 0; i < triangles.size(); i++){remap[triangles[i]] = 0;}
+    int nr_used = 0;
+    for(int i = 0; i < nr_points; i++){
+        if(remap[i] < 0){continue;}
+        remap[i] = nr_used++;
+        for(int k = 0; k < 3; k++){
+            vertices.push_back(points[3*i+k]);
+            colors.push_back(pointcolors[3*i+k]);
+        }
+    }
+    indices.resize(triangles.size());
+    for(unsigned int i = 0; i < triangles.size(); i++){indices[i] = remap[triangles[i]];}
+}
+
+void IndexedMesh::mergeVertices(){
+    const unsigned int nr_vertices = nrVertices();
+    const float ir = 1.0/merge_distance;
+    const float r2 = merge_distance*merge_distance;
+
+    //Buckets of the kept vertices as linked lists in a flat array
+    std::unordered_map<unsigned long long, int> buckets;
+    buckets.reserve(nr_vertices);
+    std::vector<int> next;
+    next.reserve(nr_vertices);
+    std::vector<unsigned int> remap (nr_vertices);
+    unsigned int nr_kept = 0;
+    for(unsigned int i = 0; i < nr_vertices; i++){
+        const float x = vertices[3*i+0];
+        const float y = vertices[3*i+1];
+        const float z = vertices[3*i+2];
+        const long long cx = (long long)std::floor(x*ir);
+        const long long cy = (long long)std::floor(y*ir);
+        const long long cz = (long long)std::floor(z*ir);
+
+        int best = -1;
+        float best_dist = r2;
+        for(int dx = -1; dx <= 1; dx++){
+            for(int dy = -1; dy <= 1; dy++){
+                for(int dz = -1; dz <= 1; dz++){
+                    auto bucket = buckets.find(cellKey(cx+dx,cy+dy,cz+dz));
+                    if(bucket == buckets.end()){continue;}
+                    for(int j = bucket->second; j >= 0; j = next[j]){
+                        const float ex = vertices[3*j+0]-x;
+                        const float ey = vertices[3*j+1]-y;
+                        const float ez = vertices[3*j+2]-z;
+                        const float d = ex*ex+ey*ey+ez*ez;
+                        if(d < best_dist || (d == best_dist && best >= 0 && j < best)){
+                            best = j;
+                            best_dist = d;
+                        }
+                    }
+                }
+            }
+        }
+        if(best >= 0){
+            remap[i] = best;
+            continue;
+        }
+
+        //Kept vertices are moved to the front, j < i so nothing is overwritten before it is read
+        const unsigned int j = nr_kept++;
+        for(int k = 0; k < 3; k++){
+            vertices[3*j+k] = vertices[3*i+k];
+            colors[3*j+k] = colors[3*i+k];
+        }
+        remap[i] = j;
+        unsigned long long key = cellKey(cx,cy,cz);
+        auto bucket = buckets.find(key);
+        next.push_back(bucket == buckets.end() ? -1 : bucket->second);
+        buckets[key] = j;
+    }
+    vertices.resize(3*nr_kept);
+    colors.resize(3*nr_kept);
+
+    unsigned int nr_triangles = 0;
+    for(unsigned int t = 0; t < nrTriangles(); t++){
+        unsigned int a = remap[indices[3*t+0]];
+        unsigned int b = remap[indices[3*t+1]];
+        unsigned int c = remap[indices[3*t+2]];
+        if(a == b || b == c || a == c){continue;}
+        indices[3*nr_triangles+0] = a;
+        indices[3*nr_triangles+1] = b;
+        indices[3*nr_triangles+2] = c;
+        nr_triangles++;
+    }
+    indices.resize(3*nr_triangles);
+}
+
+bool IndexedMesh::savePLY(std::string path, bool binary) const {
+    std::ofstream file (path.c_str(), std::ios::out | std::ios::binary);
+    if(!file.is_open()){
+        printf("could not open %s\n",path.c_str());
+        return false;
+    }
+    file << "ply\n";
+    file << (binary ? "format binary_little_endian 1.0\n" : "format ascii 1.0\n");
+    file << "element vertex " << nrVertices() << "\n";
+    file << "property float x\nproperty float y\nproperty float z\n";
+    file << "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+    file << "element face " << nrTriangles() << "\n";
+    file << "property list uchar int vertex_indices\n";
+    file << "end_header\n";
+    if(binary){
+        std::vector<char> buffer (nrVertices()*15);
+        for(unsigned int i = 0; i < nrVertices(); i++){
+            memcpy(&buffer[15*i],&vertices[3*i],12);
+            memcpy(&buffer[15*i+12],&colors[3*i],3);
+        }
+        file.write(buffer.data(),buffer.size());
+        buffer.resize(nrTriangles()*13);
+        for(unsigned int t = 0; t < nrTriangles(); t++){
+            buffer[13*t] = 3;
+            memcpy(&buffer[13*t+1],&indices[3*t],12);
+        }
+        file.write(buffer.data(),buffer.size());
+    }else{
+        for(unsigned int i = 0; i < nrVertices(); i++){
+            file << vertices[3*i+0] << " " << vertices[3*i+1] << " " << vertices[3*i+2] << " ";
+            file << int(colors[3*i+0]) << " " << int(colors[3*i+1]) << " " << int(colors[3*i+2]) << "\n";
+        }
+        for(unsigned int t = 0; t < nrTriangles(); t++){
+            file << "3 " << indices[3*t+0] << " " << indices[3*t+1] << " " << indices[3*t+2] << "\n";
+        }
+    }
+    file.close();
+    return !file.fail();
+}
+
+}
@@ -25,10 +25,10 @@ Mesh::~Mesh(){}
 
 void Mesh::build(Model * model, int type){
     if(type == 0){
-        Vertex ** pixelvertexes = new Vertex*[640*480];
         for(unsigned int f = 0; f < model->frames.size(); f++){
-            for(unsigned int i = 0; i < 640*480; i++){pixelvertexes[i] = 0;}
             RGBDFrame * frame = model->frames[f];
+            Vertex ** pixelvertexes = new Vertex*[frame->camera->width*frame->camera->height];
+            for(unsigned int i = 0; i < frame->camera->width*frame->camera->height; i++){pixelvertexes[i] = 0;}
 
             bool * maskvec = model->modelmasks[f]->maskvec;
             Eigen::Matrix4d p = model->relativeposes[f];
@@ -106,7 +106,7 @@ void Mesh::build(Model * model, int type){
                 }
             }
 
-            for(unsigned int i = 0; i < 640*480; i++){
+            for(unsigned int i = 0; i < width*height; i++){
                 Vertex * v = pixelvertexes[i];
                 if(v){
                     if(v->triangles.size() > 0){
@@ -116,13 +116,39 @@ void Mesh::build(Model * model, int type){
                     }
                 }
             }
+            delete[] pixelvertexes;
         }
-
-        delete[] pixelvertexes;
+    }else if(type == 1){
+        indexed.build(model);
     }
-
 }
 void Mesh::show(pcl::visualization::PCLVisualizer * viewer){
+    if(indexed.nrTriangles() > 0){
+        pcl::PolygonMesh mesh;
+        pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
+        cloud->points.resize(indexed.nrVertices());
+        for(unsigned int i = 0; i < indexed.nrVertices(); i++){
+            pcl::PointXYZRGB & p = cloud->points[i];
+            p.x = indexed.vertices[3*i+0];
+            p.y = indexed.vertices[3*i+1];
+            p.z = indexed.vertices[3*i+2];
+            p.r = indexed.colors[3*i+0];
+            p.g = indexed.colors[3*i+1];
+            p.b = indexed.colors[3*i+2];
+        }
+        mesh.polygons.resize(indexed.nrTriangles());
+        for(unsigned int i = 0; i < indexed.nrTriangles(); i++){
+            mesh.polygons[i].vertices.push_back(indexed.indices[3*i+0]);
+            mesh.polygons[i].vertices.push_back(indexed.indices[3*i+1]);
+            mesh.polygons[i].vertices.push_back(indexed.indices[3*i+2]);
+        }
+        pcl::toPCLPointCloud2(*cloud,mesh.cloud);
+        viewer->removeAllShapes();
+        viewer->addPolygonMesh(mesh, "polygon");
+        viewer->spin();
+        return;
+    }
+
     pcl::PolygonMesh mesh;
     //mesh.cloud.resize(3*triangles.size());
     pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZRGB>);
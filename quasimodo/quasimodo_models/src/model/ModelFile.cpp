@@ -0,0 +1,419 @@
+#include "model/ModelFile.h"
+#include "core/ImageCodec.h"
+
+#include <string.h>
+#include <algorithm>
+#include "opencv2/highgui/highgui.hpp"
+
+namespace reglib
+{
+
+extern unsigned int camera_id_count;
+
+static const char			modelfile_magic [4]		= {'Q','M','F','1'};
+static const unsigned int	modelfile_version		= 1;
+static const unsigned int	modelfile_header_size	= 4+4+8+4;
+
+template <typename T> void put(std::vector<char> & data, T v){
+	const char * p = (const char *)(&v);
+	data.insert(data.end(),p,p+sizeof(T));
+}
+
+template <typename T> T get(const char * & p){
+	T v;
+	memcpy(&v,p,sizeof(T));
+	p += sizeof(T);
+	return v;
+}
+
+void putPose(std::vector<char> & data, const Eigen::Matrix4d & pose){
+	for(int i = 0; i < 4; i++){
+		for(int j = 0; j < 4; j++){put<double>(data,pose(i,j));}
+	}
+}
+
+//true if bytes more bytes can be read from p without passing end
+bool fits(const char * p, const char * end, unsigned long long bytes){
+	return p <= end && bytes <= (unsigned long long)(end-p);
+}
+
+//Model has no destructor for the frames and masks it holds
+void deleteModelData(Model * model){
+	for(unsigned int f = 0; f < model->frames.size(); f++){delete model->frames[f];}
+	for(unsigned int f = 0; f < model->modelmasks.size(); f++){delete model->modelmasks[f];}
+	delete model;
+}
+
+Eigen::Matrix4d getPose(const char * & p){
+	Eigen::Matrix4d pose;
+	for(int i = 0; i < 4; i++){
+		for(int j = 0; j < 4; j++){pose(i,j) = get<double>(p);}
+	}
+	return pose;
+}
+
+ModelFile::ModelFile(){
+	rgb_codec	= CODEC_AUTO;
+	depth_codec	= CODEC_DELTA;
+	mask_codec	= CODEC_DELTA;
+	jpg_quality	= 95;
+}
+
+ModelFile::~ModelFile(){close();}
+
+void ModelFile::writeChunk(std::ofstream & out, std::vector<Chunk> & chunks, unsigned int type, int frame, const std::vector<char> & data){
+	Chunk chunk;
+	chunk.type		= type;
+	chunk.frame		= frame;
+	chunk.codec		= CODEC_RAW;
+	chunk.rows		= 0;
+	chunk.cols		= 0;
+	chunk.cvtype	= 0;
+	chunk.offset	= out.tellp();
+	chunk.size		= data.size();
+	if(data.size() > 0){out.write(&data[0],data.size());}
+	chunks.push_back(chunk);
+}
+
+void ModelFile::writeImage(std::ofstream & out, std::vector<Chunk> & chunks, unsigned int type, int frame, cv::Mat image, int codec){
+	if(!image.isContinuous()){image = image.clone();}
+	const unsigned int nr_pixels	= image.rows*image.cols;
+	const int channels				= image.channels();
+	const bool is16bit				= image.elemSize1() == 2;
+	if(codec == CODEC_JPG && is16bit){codec = CODEC_DELTA;}
+
+	std::vector<unsigned char> encoded;
+	if(codec == CODEC_DELTA || codec == CODEC_AUTO){
+		if(is16bit){	encodeDelta((unsigned short *)image.data,nr_pixels,channels,encoded);}
+		else{			encodeDelta((unsigned char *)image.data,nr_pixels,channels,encoded);}
+		if(codec == CODEC_AUTO){codec = encoded.size() < nr_pixels*image.elemSize() ? CODEC_DELTA : CODEC_RAW;}
+	}else if(codec == CODEC_PNG){
+		cv::imencode(".png",image,encoded);
+	}else if(codec == CODEC_JPG){
+		std::vector<int> params;
+		params.push_back(CV_IMWRITE_JPEG_QUALITY);
+		params.push_back(jpg_quality);
+		cv::imencode(".jpg",image,encoded,params);
+	}
+
+	std::vector<char> data;
+	if(codec == CODEC_RAW){	data.assign((char *)image.data,(char *)image.data+nr_pixels*image.elemSize());}
+	else{					data.assign(encoded.begin(),encoded.end());}
+	writeChunk(out,chunks,type,frame,data);
+	chunks.back().codec		= codec;
+	chunks.back().rows		= image.rows;
+	chunks.back().cols		= image.cols;
+	chunks.back().cvtype	= image.type();
+}
+
+bool ModelFile::save(Model * model, Camera * camera, std::string path){
+	std::ofstream out (path.c_str(),std::ofstream::binary);
+	if(!out.is_open()){printf("ModelFile::save: cant open %s\n",path.c_str()); return false;}
+
+	std::vector<char> header (modelfile_header_size,0);
+	out.write(&header[0],header.size());
+
+	std::vector<Chunk> chunks;
+	std::vector<char> data;
+
+	put<int>(data,camera->id);
+	put<unsigned int>(data,camera->width);
+	put<unsigned int>(data,camera->height);
+	put<double>(data,camera->fx);
+	put<double>(data,camera->fy);
+	put<double>(data,camera->cx);
+	put<double>(data,camera->cy);
+	put<double>(data,camera->idepth_scale);
+	put<double>(data,camera->bias);
+	writeChunk(out,chunks,CHUNK_CAMERA,-1,data);
+
+	const unsigned int nr_frames = model->frames.size();
+	data.clear();
+	put<unsigned long long>(data,model->id);
+	put<double>(data,model->score);
+	put<double>(data,model->total_scores);
+	put<unsigned int>(data,nr_frames);
+	for(unsigned int f = 0; f < nr_frames; f++){
+		putPose(data,model->relativeposes[f]);
+		put<int>(data,model->modelmasks[f]->sweepid);
+	}
+	for(unsigned int f1 = 0; f1 < nr_frames; f1++){
+		for(unsigned int f2 = 0; f2 < nr_frames; f2++){put<double>(data,model->scores[f1][f2]);}
+	}
+	writeChunk(out,chunks,CHUNK_MODEL,-1,data);
+
+	//frame ids are assigned at load time, the superpoints refer to frames by their index in the model
+	std::map<unsigned long,int> frame_index;
+	for(unsigned int f = 0; f < nr_frames; f++){frame_index[model->frames[f]->id] = f;}
+
+	data.clear();
+	put<unsigned int>(data,model->points.size());
+	for(unsigned int i = 0; i < model->points.size(); i++){
+		superpoint & sp = model->points[i];
+		for(int k = 0; k < 3; k++){put<float>(data,sp.point(k));}
+		for(int k = 0; k < 3; k++){put<float>(data,sp.normal(k));}
+		const int nr_features = sp.feature.size();
+		put<unsigned int>(data,nr_features);
+		for(int k = 0; k < nr_features; k++){put<float>(data,sp.feature(k));}
+		put<double>(data,sp.point_information);
+		put<double>(data,sp.feature_information);
+		std::map<unsigned long,int>::iterator it = frame_index.find(sp.last_update_frame_id);
+		put<int>(data,it != frame_index.end() ? it->second : -1);
+	}
+	writeChunk(out,chunks,CHUNK_SUPERPOINTS,-1,data);
+
+	for(unsigned int f = 0; f < nr_frames; f++){
+		RGBDFrame * frame = model->frames[f];
+		data.clear();
+		put<double>(data,frame->capturetime);
+		putPose(data,frame->pose);
+		put<int>(data,frame->sweepid);
+		put<int>(data,frame->camera->id);
+		writeChunk(out,chunks,CHUNK_FRAME,f,data);
+
+		writeImage(out,chunks,CHUNK_RGB,f,frame->rgb,rgb_codec);
+		writeImage(out,chunks,CHUNK_DEPTH,f,frame->depth,depth_codec);
+		writeImage(out,chunks,CHUNK_MASK,f,model->modelmasks[f]->getMask(),mask_codec);
+	}
+
+	unsigned long long index_offset = out.tellp();
+	data.clear();
+	for(unsigned int i = 0; i < chunks.size(); i++){
+		put<unsigned int>(data,chunks[i].type);
+		put<int>(data,chunks[i].frame);
+		put<unsigned int>(data,chunks[i].codec);
+		put<unsigned int>(data,chunks[i].rows);
+		put<unsigned int>(data,chunks[i].cols);
+		put<unsigned int>(data,chunks[i].cvtype);
+		put<unsigned long long>(data,chunks[i].offset);
+		put<unsigned long long>(data,chunks[i].size);
+	}
+	out.write(&data[0],data.size());
+
+	header.clear();
+	header.insert(header.end(),modelfile_magic,modelfile_magic+4);
+	put<unsigned int>(header,modelfile_version);
+	put<unsigned long long>(header,index_offset);
+	put<unsigned int>(header,chunks.size());
+	out.seekp(0);
+	out.write(&header[0],header.size());
+	out.close();
+	return !out.fail();
+}
+
+bool ModelFile::open(std::string path){
+	close();
+	file.open(path.c_str(),std::ios::in | std::ios::binary);
+	if(!file.is_open()){printf("ModelFile::open: cant open %s\n",path.c_str()); return false;}
+
+	std::vector<char> header (modelfile_header_size);
+	file.read(&header[0],header.size());
+	if(!file || memcmp(&header[0],modelfile_magic,4) != 0){printf("ModelFile::open: %s is not a model file\n",path.c_str()); close(); return false;}
+	const char * p = &header[4];
+	unsigned int version			= get<unsigned int>(p);
+	unsigned long long index_offset	= get<unsigned long long>(p);
+	unsigned int nr_chunks			= get<unsigned int>(p);
+	if(version != modelfile_version){printf("ModelFile::open: unsupported version %i in %s\n",version,path.c_str()); close(); return false;}
+
+	file.seekg(0,std::ios::end);
+	const unsigned long long file_size = file.tellg();
+	const unsigned int entry_size = 6*4+2*8;
+	if(index_offset < modelfile_header_size || index_offset > file_size || (unsigned long long)(nr_chunks)*entry_size > file_size-index_offset){
+		printf("ModelFile::open: truncated index in %s\n",path.c_str()); close(); return false;
+	}
+	std::vector<char> data (nr_chunks*entry_size);
+	file.seekg(index_offset);
+	if(data.size() > 0){file.read(&data[0],data.size());}
+	if(!file){printf("ModelFile::open: truncated index in %s\n",path.c_str()); close(); return false;}
+
+	p = data.size() > 0 ? &data[0] : 0;
+	for(unsigned int i = 0; i < nr_chunks; i++){
+		Chunk chunk;
+		chunk.type		= get<unsigned int>(p);
+		chunk.frame		= get<int>(p);
+		chunk.codec		= get<unsigned int>(p);
+		chunk.rows		= get<unsigned int>(p);
+		chunk.cols		= get<unsigned int>(p);
+		chunk.cvtype	= get<unsigned int>(p);
+		chunk.offset	= get<unsigned long long>(p);
+		chunk.size		= get<unsigned long long>(p);
+		if(chunk.offset < modelfile_header_size || chunk.offset > index_offset || chunk.size > index_offset-chunk.offset){
+			printf("ModelFile::open: chunk %i of frame %i is outside of the data in %s\n",chunk.type,chunk.frame,path.c_str()); close(); return false;
+		}
+		index[std::make_pair(chunk.type,chunk.frame)] = chunk;
+	}
+	return true;
+}
+
+void ModelFile::close(){
+	if(file.is_open()){file.close();}
+	file.clear();
+	index.clear();
+}
+
+bool ModelFile::readChunk(unsigned int type, int frame, Chunk & chunk){
+	std::map<std::pair<unsigned int,int>, Chunk>::iterator it = index.find(std::make_pair(type,frame));
+	if(it == index.end()){return false;}
+	chunk = it->second;
+	buffer.resize(chunk.size+1);
+	file.seekg(chunk.offset);
+	file.read(&buffer[0],chunk.size);
+	if(!file){printf("ModelFile::readChunk: failed to read chunk %i of frame %i\n",type,frame); file.clear(); return false;}
+	return true;
+}
+
+unsigned int ModelFile::nrFrames(){
+	Chunk chunk;
+	if(!readChunk(CHUNK_MODEL,-1,chunk) || chunk.size < 8+8+8+4){return 0;}
+	const char * p = &buffer[0]+8+8+8;
+	return get<unsigned int>(p);
+}
+
+Camera * ModelFile::loadCamera(){
+	Chunk chunk;
+	if(!readChunk(CHUNK_CAMERA,-1,chunk)){return 0;}
+	if(chunk.size < 4+4+4+6*8){printf("ModelFile::loadCamera: truncated camera chunk\n"); return 0;}
+	const char * p = &buffer[0];
+	Camera * cam = new Camera();
+	cam->id				= get<int>(p);
+	cam->width			= get<unsigned int>(p);
+	cam->height			= get<unsigned int>(p);
+	cam->fx				= get<double>(p);
+	cam->fy				= get<double>(p);
+	cam->cx				= get<double>(p);
+	cam->cy				= get<double>(p);
+	cam->idepth_scale	= get<double>(p);
+	cam->bias			= get<double>(p);
+	camera_id_count = std::max(int(cam->id+1),int(camera_id_count));
+	return cam;
+}
+
+cv::Mat ModelFile::loadImage(unsigned int type, unsigned int frame){
+	Chunk chunk;
+	if(!readChunk(type,frame,chunk)){return cv::Mat();}
+	if(chunk.codec == CODEC_PNG || chunk.codec == CODEC_JPG){
+		if(chunk.size == 0){return cv::Mat();}
+		return cv::imdecode(cv::Mat(1,chunk.size,CV_8UC1,&buffer[0]),-1);
+	}
+
+	cv::Mat image (chunk.rows,chunk.cols,chunk.cvtype);
+	const unsigned int nr_pixels = chunk.rows*chunk.cols;
+	if(chunk.codec == CODEC_RAW){
+		if(chunk.size != nr_pixels*image.elemSize()){printf("ModelFile::loadImage: wrong size of chunk %i of frame %i\n",type,frame); return cv::Mat();}
+		memcpy(image.data,&buffer[0],chunk.size);
+	}else{
+		bool ok;
+		if(image.elemSize1() == 2){	ok = decodeDelta((const unsigned char *)&buffer[0],chunk.size,nr_pixels,image.channels(),(unsigned short *)image.data);}
+		else{						ok = decodeDelta((const unsigned char *)&buffer[0],chunk.size,nr_pixels,image.channels(),(unsigned char *)image.data);}
+		if(!ok){printf("ModelFile::loadImage: corrupt chunk %i of frame %i\n",type,frame); return cv::Mat();}
+	}
+	return image;
+}
+
+cv::Mat ModelFile::loadRGB(unsigned int frame){	return loadImage(CHUNK_RGB,frame);}
+cv::Mat ModelFile::loadDepth(unsigned int frame){	return loadImage(CHUNK_DEPTH,frame);}
+cv::Mat ModelFile::loadMask(unsigned int frame){	return loadImage(CHUNK_MASK,frame);}
+
+RGBDFrame * ModelFile::loadFrame(Camera * cam, unsigned int frame, bool compute_normals){
+	Chunk chunk;
+	if(!readChunk(CHUNK_FRAME,frame,chunk)){printf("ModelFile::loadFrame: no frame %i\n",frame); return 0;}
+	if(chunk.size < 8+16*8+4){printf("ModelFile::loadFrame: truncated frame %i\n",frame); return 0;}
+	const char * p = &buffer[0];
+	double capturetime		= get<double>(p);
+	Eigen::Matrix4d pose	= getPose(p);
+	int sweepid				= get<int>(p);
+
+	cv::Mat rgb		= loadRGB(frame);
+	cv::Mat depth	= loadDepth(frame);
+	if(rgb.empty() || depth.empty()){return 0;}
+
+	RGBDFrame * rgbdframe = new RGBDFrame(cam,rgb,depth,capturetime,pose,compute_normals);
+	rgbdframe->sweepid = sweepid;
+	return rgbdframe;
+}
+
+Model * ModelFile::loadModel(Camera * cam){
+	Camera * loaded_cam = 0;
+	if(cam == 0){cam = loaded_cam = loadCamera();}
+	if(cam == 0){printf("ModelFile::loadModel: no camera\n"); return 0;}
+
+	//the camera read from the file belongs to the frames of the model, or to nobody if the model can not be loaded
+	Model * mod = loadModelData(cam);
+	if(mod == 0){delete loaded_cam;}
+	return mod;
+}
+
+Model * ModelFile::loadModelData(Camera * cam){
+	Chunk chunk;
+	if(!readChunk(CHUNK_MODEL,-1,chunk)){printf("ModelFile::loadModel: no model data\n"); return 0;}
+	if(chunk.size < 8+8+8+4){printf("ModelFile::loadModel: truncated model data\n"); return 0;}
+	std::vector<char> modeldata (buffer.begin(),buffer.begin()+chunk.size);
+	const char * p = &modeldata[0];
+	const char * end = p+modeldata.size();
+	get<unsigned long long>(p);//id of the saved model, loaded models get new ids as with Model::load
+
+	Model * mod = new Model();
+	mod->score			= get<double>(p);
+	mod->total_scores	= get<double>(p);
+	unsigned int nr_frames = get<unsigned int>(p);
+	if(nr_frames > modeldata.size()/(16*8+4) || !fits(p,end,(unsigned long long)(nr_frames)*(16*8+4) + (unsigned long long)(nr_frames)*nr_frames*8)){
+		printf("ModelFile::loadModel: model data too short for %i frames\n",nr_frames); delete mod; return 0;
+	}
+	for(unsigned int f = 0; f < nr_frames; f++){
+		Eigen::Matrix4d pose = getPose(p);
+		int sweepid = get<int>(p);
+
+		RGBDFrame * frame = loadFrame(cam,f);
+		cv::Mat mask = loadMask(f);
+		if(frame == 0 || mask.empty()){
+			printf("ModelFile::loadModel: failed to load frame %i\n",f);
+			delete frame;
+			deleteModelData(mod);
+			return 0;
+		}
+
+		mod->relativeposes.push_back(pose);
+		mod->frames.push_back(frame);
+		mod->modelmasks.push_back(new ModelMask(mask));
+		mod->modelmasks.back()->sweepid = sweepid;
+	}
+
+	mod->scores.resize(nr_frames);
+	for(unsigned int f1 = 0; f1 < nr_frames; f1++){
+		mod->scores[f1].resize(nr_frames);
+		for(unsigned int f2 = 0; f2 < nr_frames; f2++){mod->scores[f1][f2] = get<double>(p);}
+	}
+
+	if(readChunk(CHUNK_SUPERPOINTS,-1,chunk) && chunk.size >= 4){
+		p = &buffer[0];
+		end = p+chunk.size;
+		unsigned int nr_points = get<unsigned int>(p);
+		mod->points.reserve(std::min<unsigned long long>(nr_points,chunk.size/(7*4+2*8+4)));
+		for(unsigned int i = 0; i < nr_points; i++){
+			if(!fits(p,end,7*4)){printf("ModelFile::loadModel: truncated superpoints\n"); deleteModelData(mod); return 0;}
+			Eigen::Vector3f point, normal;
+			for(int k = 0; k < 3; k++){point(k) = get<float>(p);}
+			for(int k = 0; k < 3; k++){normal(k) = get<float>(p);}
+			unsigned int nr_features = get<unsigned int>(p);
+			if(!fits(p,end,(unsigned long long)(nr_features)*4+2*8+4)){printf("ModelFile::loadModel: truncated superpoints\n"); deleteModelData(mod); return 0;}
+			Eigen::VectorXf feature (nr_features);
+			for(int k = 0; k < feature.size(); k++){feature(k) = get<float>(p);}
+			double pi	= get<double>(p);
+			double fi	= get<double>(p);
+			int f		= get<int>(p);
+			int id		= f >= 0 && f < int(nr_frames) ? int(mod->frames[f]->id) : 0;
+			mod->points.push_back(superpoint(point,normal,feature,pi,fi,id));
+		}
+	}else{
+		mod->recomputeModelPoints();
+	}
+	return mod;
+}
+
+Model * ModelFile::load(Camera * cam, std::string path){
+	ModelFile mf;
+	if(!mf.open(path)){return 0;}
+	return mf.loadModel(cam);
+}
+
+}
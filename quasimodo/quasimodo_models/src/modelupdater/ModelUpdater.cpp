@@ -148,7 +148,94 @@ ModelUpdater::ModelUpdater(){
 }
 
 ModelUpdater::ModelUpdater(Model * model_){	model = model_;}
-ModelUpdater::~ModelUpdater(){}
+ModelUpdater::~ModelUpdater(){clearOcclusionCache();}
+
+OcclusionPoints::OcclusionPoints(RGBDFrame * frame, ModelMask * modelmask, int step){
+	unsigned char  * maskdata		= (unsigned char	*)(modelmask->mask.data);
+	unsigned short * depthdata		= (unsigned short	*)(frame->depth.data);
+	float		   * normalsdata	= (float			*)(frame->normals.data);
+
+	Camera * camera				= frame->camera;
+	const unsigned int width	= camera->width;
+	const float idepth			= camera->idepth_scale;
+	const float cx				= camera->cx;
+	const float cy				= camera->cy;
+	const float ifx				= 1.0/camera->fx;
+	const float ify				= 1.0/camera->fy;
+
+	for(int d = 0; d < 3; d++){min[d] = 0; max[d] = 0;}
+
+	std::vector<int> & testw = modelmask->testw;
+	std::vector<int> & testh = modelmask->testh;
+	unsigned int test_nrdata = testw.size();
+	for(unsigned int ind = 0; ind < test_nrdata;ind+=std::max(1,step)){
+		unsigned int src_w = testw[ind];
+		unsigned int src_h = testh[ind];
+
+		int src_ind = src_h*width+src_w;
+		if(maskdata[src_ind] != 255){continue;}
+		float pz = idepth*float(depthdata[src_ind]);
+		float pnx = normalsdata[3*src_ind+0];
+		if(pz > 0 && pnx != 2){
+			float px = (float(src_w) - cx) * pz * ifx;
+			float py = (float(src_h) - cy) * pz * ify;
+			float p [3] = {px,py,pz};
+			for(int d = 0; d < 3; d++){
+				if(z.size() == 0 || p[d] < min[d]){min[d] = p[d];}
+				if(z.size() == 0 || p[d] > max[d]){max[d] = p[d];}
+			}
+			x.push_back(px);
+			y.push_back(py);
+			z.push_back(pz);
+			nx.push_back(pnx);
+			ny.push_back(normalsdata[3*src_ind+1]);
+			nz.push_back(normalsdata[3*src_ind+2]);
+			w.push_back(src_w);
+			h.push_back(src_h);
+		}
+	}
+}
+
+bool OcclusionPoints::canSee(RGBDFrame * dst, Eigen::Matrix4d p){
+	if(z.size() == 0){return false;}
+
+	Camera * camera		= dst->camera;
+	const double fx		= camera->fx;
+	const double fy		= camera->fy;
+	const double cx		= camera->cx;
+	const double cy		= camera->cy;
+	const double width2	= double(camera->width)  - 2;
+	const double height2= double(camera->height) - 2;
+
+	//a point is visible if tz > 0 and 0 < w < width2 and 0 < h < height2, each is a half space in the dst camera frame.
+	//If all the corners of the bounding box are outside the same half space so is every point in the box.
+	bool outside [5] = {true,true,true,true,true};
+	for(int c = 0; c < 8; c++){
+		Eigen::Vector4d corner ((c & 1) ? max[0] : min[0], (c & 2) ? max[1] : min[1], (c & 4) ? max[2] : min[2], 1);
+		Eigen::Vector4d t = p*corner;
+		outside[0] = outside[0] && (t(2) <= 0);
+		outside[1] = outside[1] && (fx*t(0) + cx*t(2) <= 0);
+		outside[2] = outside[2] && (fx*t(0) + (cx-width2)*t(2) >= 0);
+		outside[3] = outside[3] && (fy*t(1) + cy*t(2) <= 0);
+		outside[4] = outside[4] && (fy*t(1) + (cy-height2)*t(2) >= 0);
+	}
+	return !(outside[0] || outside[1] || outside[2] || outside[3] || outside[4]);
+}
+
+OcclusionPoints * ModelUpdater::getOcclusionPoints(RGBDFrame * frame, ModelMask * modelmask, int step){
+	OcclusionPointsKey key (OcclusionFrameKey(frame->id,modelmask->id),step);
+	std::map< OcclusionPointsKey, OcclusionPoints * >::iterator it = occlusion_points.find(key);
+	if(it != occlusion_points.end()){return it->second;}
+	OcclusionPoints * points = new OcclusionPoints(frame,modelmask,step);
+	occlusion_points[key] = points;
+	return points;
+}
+
+void ModelUpdater::clearOcclusionCache(){
+	for(std::map< OcclusionPointsKey, OcclusionPoints * >::iterator it = occlusion_points.begin(); it != occlusion_points.end(); ++it){delete it->second;}
+	occlusion_points.clear();
+	occlusion_scores.clear();
+}
 
 FusionResults ModelUpdater::registerModel(Model * model2, Eigen::Matrix4d guess, double uncertanity){return FusionResults();}
 
@@ -505,57 +592,63 @@ OcclusionScore ModelUpdater::computeOcclusionScore(RGBDFrame * src, ModelMask *
         }
     }
 */
-	for(unsigned int ind = 0; ind < test_nrdata;ind+=indstep){
-		unsigned int src_w = testw[ind];
-		unsigned int src_h = testh[ind];
+	OcclusionPoints * points = getOcclusionPoints(src,src_modelmask,indstep);
+	const unsigned int nr_points = points->z.size();
+	const float * px	= nr_points ? &(points->x[0]) : 0;
+	const float * py	= nr_points ? &(points->y[0]) : 0;
+	const float * pz	= nr_points ? &(points->z[0]) : 0;
+
+	//transform and project all the points, branch free so that it vectorizes
+	std::vector<int>	dst_inds (nr_points);
+	std::vector<float>	dst_ws (nr_points);
+	std::vector<float>	dst_hs (nr_points);
+	std::vector<float>	tzs (nr_points);
+	for(unsigned int k = 0; k < nr_points; k++){
+		float x		= px[k];
+		float y		= py[k];
+		float z		= pz[k];
+		float tx	= m00*x + m01*y + m02*z + m03;
+		float ty	= m10*x + m11*y + m12*z + m13;
+		float tz	= m20*x + m21*y + m22*z + m23;
+		float itz	= 1.0f/tz;
+		float dst_w	= dst_fx*tx*itz + dst_cx;
+		float dst_h	= dst_fy*ty*itz + dst_cy;
+		bool inside	= (tz > 0) & (dst_w > 0) & (dst_h > 0) & (dst_w < dst_width2) & (dst_h < dst_height2);
+		dst_inds[k]	= inside ? int(dst_h+0.5f) * int(dst_width) + int(dst_w+0.5f) : -1;
+		dst_ws[k]	= dst_w;
+		dst_hs[k]	= dst_h;
+		tzs[k]		= tz;
+	}
 
-		int src_ind = src_h*src_width+src_w;
-        if(src_maskdata[src_ind] == 255){
-			float z = src_idepth*float(src_depthdata[src_ind]);
-			float nx = src_normalsdata[3*src_ind+0];
-
-			if(z > 0 && nx != 2){
-				float ny = src_normalsdata[3*src_ind+1];
-				float nz = src_normalsdata[3*src_ind+2];
-
-				float x = (float(src_w) - src_cx) * z * src_ifx;
-				float y = (float(src_h) - src_cy) * z * src_ify;
-
-				float tx	= m00*x + m01*y + m02*z + m03;
-				float ty	= m10*x + m11*y + m12*z + m13;
-				float tz	= m20*x + m21*y + m22*z + m23;
-				float itz	= 1.0/tz;
-				float dst_w	= dst_fx*tx*itz + dst_cx;
-				float dst_h	= dst_fy*ty*itz + dst_cy;
-
-				if((dst_w > 0) && (dst_h > 0) && (dst_w < dst_width2) && (dst_h < dst_height2)){
-					unsigned int dst_ind = unsigned(dst_h+0.5) * dst_width + unsigned(dst_w+0.5);
-
-					float dst_z = dst_idepth*float(dst_depthdata[dst_ind]);
-					if(dst_z > 0){
-						float diff_z = (dst_z-tz)/(z*z+dst_z*dst_z);//if tz < dst_z then tz infront and diff_z > 0
-						residuals.push_back(diff_z);
-
-						float tnx	= m00*nx + m01*ny + m02*nz;
-						float tny	= m10*nx + m11*ny + m12*nz;
-						float tnz	= m20*nx + m21*ny + m22*nz;
-
-						float dst_x = (float(dst_w) - dst_cx) * dst_z * dst_ifx;
-						float dst_y = (float(dst_h) - dst_cy) * dst_z * dst_ify;
-						float angle = (tnx*dst_x+tny*dst_y+tnz*dst_z)/sqrt(dst_x*dst_x + dst_y*dst_y + dst_z*dst_z);
-						weights.push_back(1-angle);
-						if(debugg){
-							ws.push_back(src_w);
-							hs.push_back(src_h);
-						}
-					}
-				}
+	for(unsigned int k = 0; k < nr_points; k++){
+		int dst_ind = dst_inds[k];
+		if(dst_ind < 0){continue;}
+
+		float dst_z = dst_idepth*float(dst_depthdata[dst_ind]);
+		if(dst_z > 0){
+			float z		= pz[k];
+			float tz	= tzs[k];
+			float diff_z = (dst_z-tz)/(z*z+dst_z*dst_z);//if tz < dst_z then tz infront and diff_z > 0
+			residuals.push_back(diff_z);
+
+			float nx = points->nx[k];
+			float ny = points->ny[k];
+			float nz = points->nz[k];
+			float tnx	= m00*nx + m01*ny + m02*nz;
+			float tny	= m10*nx + m11*ny + m12*nz;
+			float tnz	= m20*nx + m21*ny + m22*nz;
+
+			float dst_x = (dst_ws[k] - dst_cx) * dst_z * dst_ifx;
+			float dst_y = (dst_hs[k] - dst_cy) * dst_z * dst_ify;
+			float angle = (tnx*dst_x+tny*dst_y+tnz*dst_z)/sqrt(dst_x*dst_x + dst_y*dst_y + dst_z*dst_z);
+			weights.push_back(1-angle);
+			if(debugg){
+				ws.push_back(points->w[k]);
+				hs.push_back(points->h[k]);
 			}
 		}
 	}
-
-
-
+	if(residuals.size() == 0 && !debugg){return oc;}
 
 //	DistanceWeightFunction2PPR2 * func = new DistanceWeightFunction2PPR2();
 //	func->maxp			= 1.0;
@@ -811,7 +904,7 @@ vector<vector< OcclusionScore > > ModelUpdater::computeAllOcclusionScores(RGBDFr
 	const unsigned int dst_width2	= dst_camera->width  - 2;
 	const unsigned int dst_height2	= dst_camera->height - 2;
 	const int * dst_labels			= dst->labels;
-	const int dst_nr_labels			= src->nr_labels;
+	const int dst_nr_labels			= dst->nr_labels;
 
 	vector< vector< OcclusionScore > > all_scores;
 	all_scores.resize(src_nr_labels);
@@ -885,7 +978,7 @@ vector<vector< OcclusionScore > > ModelUpdater::computeAllOcclusionScores(RGBDFr
 	delete func;
 
 	for(int i = 0; i < src_nr_labels; i++){
-		for(int j = 0; j < dst_nr_labels; i++){
+		for(int j = 0; j < dst_nr_labels; j++){
 			std::vector<float> & resi = all_residuals[i][j];
 			OcclusionScore score;
 			for(unsigned int k = 0; k < resi.size(); k++){
@@ -922,31 +1015,80 @@ vector<vector < OcclusionScore > > ModelUpdater::getOcclusionScores(std::vector<
     for(unsigned int i = 0; i < current_frames.size(); i++){occlusionScores[i].resize(current_frames.size());}
 
 	int max_points = step;//100000.0/double(current_frames.size()*(current_frames.size()-1));
-    //float occlusion_penalty = 10.0f;
-	std::vector<std::vector < float > > scores;
-	scores.resize(occlusionScores.size());
-    for(unsigned int i = 0; i < occlusionScores.size(); i++){scores[i].resize(occlusionScores.size());}
 
 	bool lock = true;
-    for(unsigned int i = 0; i < current_frames.size(); i++){
-		scores[i][i] = 0;
-        for(unsigned int j = i+1; j < current_frames.size(); j++){
-			//printf("scores %i %i\n",i,j);
+	std::vector<int> pair_src;
+	std::vector<int> pair_dst;
+	for(unsigned int i = 0; i < current_frames.size(); i++){
+		for(unsigned int j = i+1; j < current_frames.size(); j++){
 			if(lock && current_modelmasks[j]->sweepid == current_modelmasks[i]->sweepid && current_modelmasks[j]->sweepid != -1){
 				occlusionScores[i][j].score = 999999;
 				occlusionScores[i][j].occlusions = 0;
 				occlusionScores[j][i].score = 999999;
 				occlusionScores[j][i].occlusions = 0;
 			}else{
-				Eigen::Matrix4d relative_pose = current_poses[i].inverse() * current_poses[j];
-				occlusionScores[j][i]		= computeOcclusionScore(current_frames[j], current_modelmasks[j],current_frames[i], current_modelmasks[i], relative_pose,max_points,debugg_scores);
-				occlusionScores[i][j]		= computeOcclusionScore(current_frames[i], current_modelmasks[i],current_frames[j], current_modelmasks[j], relative_pose.inverse(),max_points,debugg_scores);
-				//printf("scores: %i %i -> occlusion_penalty: %f -> (%f %f) and (%f %f) -> %f \n",i,j,occlusion_penalty,occlusionScores[i][j].score,occlusionScores[i][j].occlusions,occlusionScores[j][i].score,occlusionScores[j][i].occlusions,occlusionScores[i][j].score+occlusionScores[j][i].score - occlusion_penalty*(occlusionScores[i][j].occlusions+occlusionScores[j][i].occlusions));
+				pair_src.push_back(j); pair_dst.push_back(i);
+				pair_src.push_back(i); pair_dst.push_back(j);
 			}
-			scores[i][j] = occlusionScores[i][j].score+occlusionScores[j][i].score - occlusion_penalty*(occlusionScores[i][j].occlusions+occlusionScores[j][i].occlusions);
-			scores[j][i] = scores[i][j];
 		}
 	}
+
+	if(debugg_scores){
+		for(unsigned int k = 0; k < pair_src.size(); k++){
+			int i = pair_src[k];
+			int j = pair_dst[k];
+			Eigen::Matrix4d relative_pose = current_poses[j].inverse() * current_poses[i];
+			occlusionScores[i][j] = computeOcclusionScore(current_frames[i], current_modelmasks[i],current_frames[j], current_modelmasks[j], relative_pose,max_points,debugg_scores);
+		}
+		return occlusionScores;
+	}
+
+	//reuse the scores of pairs whose relative pose did not change, the points of every frame are computed before the parallel loop
+	const unsigned int nr_pairs = pair_src.size();
+	std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > relative_poses (nr_pairs);
+	std::vector<bool> cached (nr_pairs,false);
+	for(unsigned int k = 0; k < nr_pairs; k++){
+		int i = pair_src[k];
+		int j = pair_dst[k];
+		relative_poses[k] = current_poses[j].inverse() * current_poses[i];
+		OcclusionPairKey key (OcclusionFrameKey(current_frames[i]->id,current_modelmasks[i]->id),OcclusionFrameKey(current_frames[j]->id,current_modelmasks[j]->id));
+		std::map< OcclusionPairKey, CachedOcclusionScore >::iterator it = occlusion_scores.find(key);
+		if(it != occlusion_scores.end() && it->second.step == max_points){
+			bool same = true;
+			for(int e = 0; e < 16; e++){same = same && fabs(it->second.pose[e] - relative_poses[k](e)) < 1e-9;}
+			if(same){
+				occlusionScores[i][j] = it->second.score;
+				cached[k] = true;
+			}
+		}
+	}
+	for(unsigned int f = 0; f < current_frames.size(); f++){getOcclusionPoints(current_frames[f], current_modelmasks[f], max_points);}
+
+	int nr_culled = 0;
+	int nr_cached = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:nr_culled,nr_cached)
+	for(unsigned int k = 0; k < nr_pairs; k++){
+		if(cached[k]){nr_cached++; continue;}
+		int i = pair_src[k];
+		int j = pair_dst[k];
+		if(!getOcclusionPoints(current_frames[i], current_modelmasks[i], max_points)->canSee(current_frames[j],relative_poses[k])){
+			occlusionScores[i][j] = OcclusionScore();
+			nr_culled++;
+		}else{
+			occlusionScores[i][j] = computeOcclusionScore(current_frames[i], current_modelmasks[i],current_frames[j], current_modelmasks[j], relative_poses[k],max_points,false);
+		}
+	}
+
+	for(unsigned int k = 0; k < nr_pairs; k++){
+		if(cached[k]){continue;}
+		int i = pair_src[k];
+		int j = pair_dst[k];
+		CachedOcclusionScore & c = occlusion_scores[OcclusionPairKey(OcclusionFrameKey(current_frames[i]->id,current_modelmasks[i]->id),OcclusionFrameKey(current_frames[j]->id,current_modelmasks[j]->id))];
+		for(int e = 0; e < 16; e++){c.pose[e] = relative_poses[k](e);}
+		c.step	= max_points;
+		c.score	= occlusionScores[i][j];
+	}
+	//printf("occlusion scores: %i pairs, %i cached, %i culled\n",nr_pairs,nr_cached,nr_culled);
 	return occlusionScores;
 }
 
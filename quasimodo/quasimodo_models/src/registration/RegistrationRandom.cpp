@@ -1,6 +1,9 @@
 #include "registration/RegistrationRandom.h"
 #include <iostream>
 #include <fstream>
+#include <random>
+#include <algorithm>
+#include <omp.h>
 
 namespace reglib
 {
@@ -9,18 +12,48 @@ RegistrationRandom::RegistrationRandom(){
 	only_initial_guess		= false;
 	visualizationLvl = 1;
 	refinement = new RegistrationRefinement();
+	workers.push_back((RegistrationRefinement *)refinement);
+	worker_has_dst.push_back(0);
+
+	nr_threads					= 0;
+	seed						= 0;
+	nr_random_starts			= 0;
+	prune_ratio					= 3.0;
+	calibration_starts			= 8;
+	max_refinement_iterations	= 2000;
 }
 RegistrationRandom::~RegistrationRandom(){
-	delete refinement;
+	for(unsigned int i = 0; i < workers.size(); i++){delete workers[i];}
 }
 
 void RegistrationRandom::setSrc(CloudData * src_){
 	src = src_;
-	refinement->setSrc(src_);
+	for(unsigned int i = 0; i < workers.size(); i++){workers[i]->setSrc(src_);}
 }
 void RegistrationRandom::setDst(CloudData * dst_){
 	dst = dst_;
 	refinement->setDst(dst_);
+	//The other workers build their kd-trees when they are first used
+	for(unsigned int i = 0; i < workers.size(); i++){worker_has_dst[i] = i == 0 ? 1 : 0;}
+}
+
+void RegistrationRandom::prepareWorkers(int threads){
+	while(int(workers.size()) < threads){
+		workers.push_back(new RegistrationRefinement());
+		worker_has_dst.push_back(0);
+	}
+#pragma omp parallel for num_threads(threads)
+	for(int i = 0; i < threads; i++){
+		RegistrationRefinement * worker = workers[i];
+		if(!worker_has_dst[i]){
+			worker->setDst(dst);
+			worker_has_dst[i] = 1;
+		}
+		worker->setSrc(src);
+		worker->viewer				= viewer;
+		worker->visualizationLvl	= 0;
+		worker->maxtime				= 9999999;
+	}
 }
 
 double getTime(){
@@ -36,36 +69,65 @@ double transformationdiff(Eigen::Affine3d & A, Eigen::Affine3d & B, double rotat
 	return r*rotationweight+t;
 }
 
+//Median distance from the points to their closest points in the tree
+double coarseScore(RegistrationRefinement * reg, Eigen::Matrix<double, 3, Eigen::Dynamic> & X){
+	std::vector<double> dists (X.cols());
+	for(long i = 0; i < X.cols(); i++){
+		size_t index;
+		double dist;
+		nanoflann::KNNResultSet<double> resultSet(1);
+		resultSet.init(&index, &dist);
+		reg->trees3d->findNeighbors(resultSet, X.col(i).data(), nanoflann::SearchParams(10));
+		dists[i] = dist;
+	}
+	if(dists.size() == 0){return 0;}
+	std::nth_element(dists.begin(),dists.begin()+dists.size()/2,dists.end());
+	return sqrt(dists[dists.size()/2]);
+}
+
+//A cluster of refined starts that ended up close to each other, the source points are kept transformed by the
+//solution of the first start in the cluster
+class StartCluster{
+	public:
+	Eigen::Matrix<double, 3, Eigen::Dynamic> X;
+	Eigen::Vector3d mean;
+	Eigen::Affine3d transform;
+	int count;
+	float score;
+	std::vector< Eigen::VectorXd > starts;
+};
+
+//Adds a refined start to the first cluster within 20*score and keeps the clusters sorted by count. The mean distance
+//between the points is at least the distance between the means, so most clusters are rejected from the means alone.
+void addToClusters(std::vector<StartCluster> & clusters, Eigen::Matrix<double, 3, Eigen::Dynamic> & X, Eigen::Affine3d transform, double score, Eigen::VectorXd startparam){
+	Eigen::Vector3d mean = X.rowwise().mean();
+	for(unsigned int ax = 0; ax < clusters.size(); ax++){
+		if((mean-clusters[ax].mean).norm() >= 20*score){continue;}
+		double diff = (X-clusters[ax].X).colwise().norm().mean();
+		if(diff < 20*score){
+			clusters[ax].count++;
+			clusters[ax].starts.push_back(startparam);
+			for(int bx = ax-1; bx >= 0 && clusters[bx].count < clusters[bx+1].count; bx--){std::swap(clusters[bx],clusters[bx+1]);}
+			return;
+		}
+	}
+	clusters.push_back(StartCluster());
+	StartCluster & c = clusters.back();
+	c.X			= X;
+	c.mean		= mean;
+	c.transform	= transform;
+	c.count		= 1;
+	c.score		= score;
+	c.starts.push_back(startparam);
+}
+
 FusionResults RegistrationRandom::getTransform(Eigen::MatrixXd guess){
+	double total_start = getTime();
 
 	unsigned int s_nr_data = src->data.cols();//std::min(int(src->data.cols()),int(500000));
 	unsigned int d_nr_data = dst->data.cols();
-    refinement->allow_regularization = true;
 	//printf("s_nr_data: %i d_nr_data: %i\n",s_nr_data,d_nr_data);
 
-	int stepy = std::max(1,int(d_nr_data)/100000);
-
-	Eigen::Matrix<double, 3, Eigen::Dynamic> Y;
-	Eigen::Matrix<double, 3, Eigen::Dynamic> N;
-	Y.resize(Eigen::NoChange,d_nr_data/stepy);
-	N.resize(Eigen::NoChange,d_nr_data/stepy);
-	unsigned int ycols = Y.cols();
-
-	for(unsigned int i = 0; i < d_nr_data/stepy; i++){
-		Y(0,i)	= dst->data(0,i*stepy);
-		Y(1,i)	= dst->data(1,i*stepy);
-		Y(2,i)	= dst->data(2,i*stepy);
-		N(0,i)	= dst->normals(0,i*stepy);
-		N(1,i)	= dst->normals(1,i*stepy);
-		N(2,i)	= dst->normals(2,i*stepy);
-	}
-
-	/// Build kd-tree
-	//nanoflann::KDTreeAdaptor<Eigen::Matrix3Xd, 3, nanoflann::metric_L2_Simple>                  kdtree(Y);
-
-	Eigen::VectorXd DST_INORMATION = Eigen::VectorXd::Zero(Y.cols());
-	for(unsigned int i = 0; i < d_nr_data/stepy; i++){DST_INORMATION(i) = dst->information(0,i*stepy);}
-
 	double s_mean_x = 0;
 	double s_mean_y = 0;
 	double s_mean_z = 0;
@@ -90,8 +152,6 @@ FusionResults RegistrationRandom::getTransform(Eigen::MatrixXd guess){
 	d_mean_y /= double(d_nr_data);
 	d_mean_z /= double(d_nr_data);
 
-	double stop		= 0.00001;
-
 	Eigen::Affine3d Ymean = Eigen::Affine3d::Identity();
 	Ymean(0,3) = d_mean_x;
 	Ymean(1,3) = d_mean_y;
@@ -102,150 +162,137 @@ FusionResults RegistrationRandom::getTransform(Eigen::MatrixXd guess){
 	Xmean(1,3) = s_mean_y;
 	Xmean(2,3) = s_mean_z;
 
-	std::vector< Eigen::Matrix<double, 3, Eigen::Dynamic> > all_X;
-	std::vector< Eigen::Affine3d > all_res;
-	std::vector< int > count_X;
-	std::vector< float > score_X;
-    std::vector< std::vector< Eigen::VectorXd > > all_starts;
 	int stepxsmall = std::max(1,int(s_nr_data)/250);
-	Eigen::VectorXd Wsmall (s_nr_data/stepxsmall);
-	for(unsigned int i = 0; i < s_nr_data/stepxsmall; i++){Wsmall(i) = src->information(0,i*stepxsmall);}
-
-
-	double sumtime = 0;
-	double sumtimeSum = 0;
-	double sumtimeOK = 0;
-	int r = 0;
-
-    refinement->viewer = viewer;
-	refinement->visualizationLvl = 0;
-	//for(int r = 0; r < 1000; r++){
-//	while(true){
-//		double rx = 2.0*M_PI*0.0001*double(rand()%10000);
-//		double ry = 2.0*M_PI*0.0001*double(rand()%10000);
-//		double rz = 2.0*M_PI*0.0001*double(rand()%10000);
-    //double stop = 0;
+	Eigen::Matrix<double, 3, Eigen::Dynamic> Xsrc;
+	Xsrc.resize(Eigen::NoChange,s_nr_data/stepxsmall);
+	for(unsigned int i = 0; i < s_nr_data/stepxsmall; i++){
+		Xsrc(0,i) = src->data(0,i*stepxsmall);
+		Xsrc(1,i) = src->data(1,i*stepxsmall);
+		Xsrc(2,i) = src->data(2,i*stepxsmall);
+	}
+
+	//The rotation grid, then the random starts
+	std::vector< Eigen::VectorXd > starts;
 	double step = 0.1+2.0*M_PI/5;
 	for(double rx = 0; rx < 2.0*M_PI; rx += step){
 	for(double ry = 0; ry < 2.0*M_PI; ry += step)
 	for(double rz = 0; rz < 2.0*M_PI; rz += step){
-		printf("rx: %f ry: %f rz: %f\n",rx,ry,rz);
-
-		double start = getTime();
-
-		double meantime = 999999999999;
-		if(r != 0){meantime = sumtimeSum/double(sumtimeOK+1.0);}
-		refinement->maxtime = std::min(0.5,3*meantime);
-
-        Eigen::VectorXd startparam = Eigen::VectorXd(3);
-        startparam(0) = rx;
-        startparam(1) = ry;
-        startparam(2) = rz;
-
-		Eigen::Affine3d randomrot = Eigen::Affine3d::Identity();
-
-		randomrot =	Eigen::AngleAxisd(rx, Eigen::Vector3d::UnitX()) *
-					Eigen::AngleAxisd(ry, Eigen::Vector3d::UnitY()) *
-					Eigen::AngleAxisd(rz, Eigen::Vector3d::UnitZ());
-
-		Eigen::Affine3d current_guess = Ymean*randomrot*Xmean.inverse();//*Ymean;
-        refinement->target_points = 250;
-        FusionResults fr = refinement->getTransform(current_guess.matrix());
-//fr.timeout = timestopped;
-        double stoptime = getTime();
-        sumtime += stoptime-start;
-
-		if(!fr.timeout){
-			sumtimeSum += stoptime-start;
-			sumtimeOK++;
-		}
-
-		//printf("sumtime: %f\n",sumtime);
-        stop = fr.score;
-        Eigen::Matrix4d m = fr.guess;
-        current_guess = m;//fr.guess;
-        float m00 = current_guess(0,0); float m01 = current_guess(0,1); float m02 = current_guess(0,2); float m03 = current_guess(0,3);
-        float m10 = current_guess(1,0); float m11 = current_guess(1,1); float m12 = current_guess(1,2); float m13 = current_guess(1,3);
-        float m20 = current_guess(2,0); float m21 = current_guess(2,1); float m22 = current_guess(2,2); float m23 = current_guess(2,3);
-
-		Eigen::Matrix<double, 3, Eigen::Dynamic> Xsmall;
-		Xsmall.resize(Eigen::NoChange,s_nr_data/stepxsmall);
-		for(unsigned int i = 0; i < s_nr_data/stepxsmall; i++){
-			float x		= src->data(0,i*stepxsmall);
-			float y		= src->data(1,i*stepxsmall);
-			float z		= src->data(2,i*stepxsmall);
-			Xsmall(0,i)	= m00*x + m01*y + m02*z + m03;
-			Xsmall(1,i)	= m10*x + m11*y + m12*z + m13;
-			Xsmall(2,i)	= m20*x + m21*y + m22*z + m23;
-		}
-
-		bool exists = false;
-		for(unsigned int ax = 0; ax < all_X.size(); ax++){
-			Eigen::Matrix<double, 3, Eigen::Dynamic> axX = all_X[ax];
-			Eigen::Affine3d axT = all_res[ax];
-			double diff = (Xsmall-axX).colwise().norm().mean();
-			if(diff < 20*stop){
-				count_X[ax]++;
-                all_starts[ax].push_back(startparam);
-				int count = count_X[ax];
-				float score = score_X[ax];
-                std::vector< Eigen::VectorXd > starts = all_starts[ax];
-				for(int bx = ax-1; bx >= 0; bx--){
-					if(count_X[bx] < count_X[bx+1]){
-						count_X[bx+1]		= count_X[bx];
-						score_X[bx+1]		= score_X[bx];
-						all_X[bx+1]			= all_X[bx];
-						all_starts[bx+1]	= all_starts[bx];
-						all_res[bx+1]		= all_res[bx];
-
-
-						all_X[bx] = axX;
-						count_X[bx] = count;
-						score_X[bx] = score;
-                        all_starts[bx] = starts;
-						all_res[bx] = axT;
-					}else{break;}
-				}
-				exists = true;
-				break;
-			}
-		}
-
-
-
-		if(!exists){
-			all_X.push_back(Xsmall);
-			count_X.push_back(1);
-			score_X.push_back(stop);
-            all_starts.push_back(std::vector< Eigen::VectorXd >());
-            all_starts.back().push_back(startparam);
-			all_res.push_back(current_guess);
+		Eigen::VectorXd startparam = Eigen::VectorXd(3);
+		startparam(0) = rx;
+		startparam(1) = ry;
+		startparam(2) = rz;
+		starts.push_back(startparam);
+	}
+	}
+	std::mt19937 gen (seed);
+	std::uniform_real_distribution<double> angle (0,2.0*M_PI);
+	for(int i = 0; i < nr_random_starts; i++){
+		Eigen::VectorXd startparam = Eigen::VectorXd(3);
+		for(int k = 0; k < 3; k++){startparam(k) = angle(gen);}
+		starts.push_back(startparam);
+	}
+	const int nr_starts = starts.size();
+
+	int threads = nr_threads > 0 ? nr_threads : omp_get_max_threads();
+	prepareWorkers(threads);
+
+	//Coarse scores of the unrefined starts
+	std::vector< Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > initial (nr_starts);
+	std::vector< double > coarse (nr_starts);
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+	for(int s = 0; s < nr_starts; s++){
+		Eigen::Affine3d randomrot =	Eigen::AngleAxisd(starts[s](0), Eigen::Vector3d::UnitX()) *
+									Eigen::AngleAxisd(starts[s](1), Eigen::Vector3d::UnitY()) *
+									Eigen::AngleAxisd(starts[s](2), Eigen::Vector3d::UnitZ());
+		initial[s] = Ymean*randomrot*Xmean.inverse();
+		Eigen::Matrix<double, 3, Eigen::Dynamic> X = initial[s]*Xsrc;
+		coarse[s] = coarseScore(workers[0],X);
+	}
+	double best_coarse = *std::min_element(coarse.begin(),coarse.end());
+	std::vector< int > active;
+	for(int s = 0; s < nr_starts; s++){
+		if(prune_ratio <= 0 || coarse[s] <= prune_ratio*best_coarse){active.push_back(s);}
+	}
+	const int nr_active = active.size();
+
+	std::vector< Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > refined (nr_active);
+	std::vector< double > scores (nr_active);
+	std::vector< int > iterations (nr_active);
+	std::vector< char > stopped (nr_active);//written from the threads, a vector<bool> packs neighbours into one word
+	std::vector<StartCluster> clusters;
+
+	//Refines a start on the calling thread's worker
+	auto refine = [&](int a, int budget){
+		RegistrationRefinement * worker = workers[omp_get_thread_num()];
+		worker->allow_regularization	= true;
+		worker->target_points			= 250;
+		worker->maxiterations			= budget;
+		FusionResults fr = worker->getTransform(initial[active[a]].matrix());
+		refined[a]		= fr.guess;
+		scores[a]		= fr.score;
+		iterations[a]	= worker->nr_iterations;
+		stopped[a]		= fr.timeout;
+	};
+	auto cluster = [&](int a){
+		Eigen::Affine3d current_guess (refined[a]);
+		Eigen::Matrix<double, 3, Eigen::Dynamic> Xsmall = current_guess*Xsrc;
+		addToClusters(clusters,Xsmall,current_guess,scores[a],starts[active[a]]);
+	};
+
+	//The first starts run with the full budget, the others get three times the mean number of iterations of the
+	//calibration starts that converged
+	const int nr_calibration = std::min(nr_active,std::max(1,calibration_starts));
+#pragma omp parallel for num_threads(threads) schedule(dynamic)
+	for(int a = 0; a < nr_calibration; a++){refine(a,max_refinement_iterations);}
+
+	double sum_iterations = 0;
+	double nr_converged = 0;
+	for(int a = 0; a < nr_calibration; a++){
+		cluster(a);
+		if(!stopped[a]){
+			sum_iterations += iterations[a];
+			nr_converged++;
 		}
-        r++;
 	}
-}
-
+	int budget = max_refinement_iterations;
+	if(nr_converged > 0){budget = std::min(budget,std::max(1,int(3.0*sum_iterations/nr_converged)));}
+
+#pragma omp parallel for num_threads(threads) schedule(dynamic) ordered
+	for(int a = nr_calibration; a < nr_active; a++){
+		refine(a,budget);
+#pragma omp ordered
+		cluster(a);
+	}
+	double refine_time = getTime()-total_start;
 
+	//Refinement of the best clusters with more points, the viewer is not thread safe. These run to convergence with the
+	//full cap of the calibration starts, the budget of the starts is tuned for 250 points and would cut them short.
 	FusionResults fr = FusionResults();
-    refinement->allow_regularization = false;
-
-	int tpbef = refinement->target_points;
-	refinement->target_points = 2000;
-	for(unsigned int ax = 0; ax < all_X.size(); ax++){
-        Eigen::Matrix4d np = all_res[ax].matrix();
-		refinement->visualizationLvl = visualizationLvl;
-		if(ax < 25){
-			double start = getTime();
-			FusionResults fr1 = refinement->getTransform(np);
-			double stop = getTime();
-			np = fr1.guess;
-		}
-		refinement->visualizationLvl = 0;
-        fr.candidates.push_back(np);
-		fr.counts.push_back(count_X[ax]);
-		fr.scores.push_back(1.0/score_X[ax]);
+	const int nr_final = std::min(int(clusters.size()),25);
+	std::vector< Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > final_guess (clusters.size());
+	for(unsigned int ax = 0; ax < clusters.size(); ax++){final_guess[ax] = clusters[ax].transform.matrix();}
+	const int final_threads = visualizationLvl >= 2 ? 1 : threads;
+#pragma omp parallel for num_threads(final_threads) schedule(dynamic)
+	for(int ax = 0; ax < nr_final; ax++){
+		RegistrationRefinement * worker = workers[omp_get_thread_num()];
+		worker->allow_regularization	= false;
+		worker->target_points			= 2000;
+		worker->maxiterations			= max_refinement_iterations;
+		worker->visualizationLvl		= visualizationLvl;
+		final_guess[ax] = worker->getTransform(final_guess[ax]).guess;
+		worker->visualizationLvl		= 0;
+	}
+	for(unsigned int ax = 0; ax < clusters.size(); ax++){
+		fr.candidates.push_back(final_guess[ax]);
+		fr.counts.push_back(clusters[ax].count);
+		fr.scores.push_back(1.0/clusters[ax].score);
+	}
+	refinement->target_points = 250;
+
+	if(visualizationLvl > 0){
+		printf("RegistrationRandom: %i starts, %i pruned, %i clusters, budget %i iterations, %i threads, refined in %5.3fs, total %5.3fs\n",
+			   nr_starts,nr_starts-nr_active,int(clusters.size()),budget,threads,refine_time,getTime()-total_start);
 	}
-	refinement->target_points = tpbef;
 	return fr;
 }
 
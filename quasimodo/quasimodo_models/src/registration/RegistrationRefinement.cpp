@@ -28,6 +28,8 @@ RegistrationRefinement::RegistrationRefinement(){
     target_points = 250;
     allow_regularization = true;
     maxtime = 9999999;
+	maxiterations = 1000000000;
+	nr_iterations = 0;
 
 	func = new DistanceWeightFunction2PPR2();
 	func->startreg			= 0.1;
@@ -143,13 +145,14 @@ FusionResults RegistrationRefinement::getTransform(Eigen::MatrixXd guess){
 	stop = 99999;
 
 	double start = getTime();
+	nr_iterations = 0;
 
 bool timestopped = false;
 	/// ICP
 	for(int funcupdate=0; funcupdate < 100; ++funcupdate) {
-		if( (getTime()-start) > maxtime ){timestopped = true; break;}
+		if( (getTime()-start) > maxtime || nr_iterations >= maxiterations ){timestopped = true; break;}
 		for(int rematching=0; rematching < 100; ++rematching) {
-			if( (getTime()-start) > maxtime ){timestopped = true; break;}
+			if( (getTime()-start) > maxtime || nr_iterations >= maxiterations ){timestopped = true; break;}
 
 #pragma omp parallel for
 			for(unsigned int i=0; i< xcols; ++i) {
@@ -173,7 +176,7 @@ bool timestopped = false;
 			}
 
 			for(int outer=0; outer< 1; ++outer) {
-				if( (getTime()-start) > maxtime ){timestopped = true; break;}
+				if( (getTime()-start) > maxtime || nr_iterations >= maxiterations ){timestopped = true; break;}
 				/// Compute weights
 				switch(type) {
 					case PointToPoint:	{residuals = X-Qp;} 						break;
@@ -200,7 +203,7 @@ bool timestopped = false;
 				}
 
 				for(int rematching2=0; rematching2 < 3; ++rematching2) {
-					if( (getTime()-start) > maxtime ){timestopped = true; break;}
+					if( (getTime()-start) > maxtime || nr_iterations >= maxiterations ){timestopped = true; break;}
 					if(rematching2 != 0){
 #pragma omp parallel for
 						for(unsigned int i=0; i< xcols; ++i) {
@@ -225,7 +228,8 @@ bool timestopped = false;
 					}
 
 					for(int inner=0; inner< 40; ++inner) {
-						if( (getTime()-start) > maxtime ){timestopped = true; break;}
+						if( (getTime()-start) > maxtime || nr_iterations >= maxiterations ){timestopped = true; break;}
+						nr_iterations++;
 						if(inner != 0){
 							switch(type) {
 								case PointToPoint:	{residuals = X-Qp;} 						break;
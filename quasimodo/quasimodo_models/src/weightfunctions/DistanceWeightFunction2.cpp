@@ -45,8 +45,8 @@ void robust_weight(Function f, Eigen::VectorXd& r, double p) {
     }
 }
 
-void DistanceWeightFunction2::computeModel(MatrixXd mat){}
-VectorXd DistanceWeightFunction2::getProbs(MatrixXd mat){
+void DistanceWeightFunction2::computeModel(const MatrixXd & mat){}
+VectorXd DistanceWeightFunction2::getProbs(const MatrixXd & mat){
 	VectorXd W = mat.colwise().norm();
 	robust_weight(f, W , p);
 	return W;//VectorXf(mat.rows());
@@ -47,6 +47,8 @@ DistanceWeightFunction2PPR::DistanceWeightFunction2PPR(	double maxd_, int histog
 	bidir = false;
 	iter = 0;
 
+	batch_kernels = true;
+
 	max_under_mean = false;
 	interp = false;
 }
@@ -312,7 +314,7 @@ Gaussian getModel(double & stdval,std::vector<float> & hist, bool uniform_bias,
 
 double DistanceWeightFunction2PPR::getNoise(){return regularization+noiseval;}// + stdval*double(histogram_size)/maxd;}
 
-void DistanceWeightFunction2PPR::computeModel(MatrixXd mat){
+void DistanceWeightFunction2PPR::computeModel(const MatrixXd & mat){
 //printf("void DistanceWeightFunction2PPR::computeModel(MatrixXd mat)\n");
 //debugg_print = true;
 	const unsigned int nr_data = mat.cols();
@@ -322,9 +324,12 @@ void DistanceWeightFunction2PPR::computeModel(MatrixXd mat){
 	if(update_size){maxd = (getNoise()+meanoffset)*target_length;}
 
 	int nr_inside = 0;
-	for(unsigned int j = 0; j < nr_data; j++){
-		for(int k = 0; k < nr_dim; k++){
-			if(fabs(mat(k,j)) < maxd){nr_inside++;}
+	if(batch_kernels){nr_inside = countInside(mat.data(),nr_data*nr_dim,maxd);}
+	else{
+		for(unsigned int j = 0; j < nr_data; j++){
+			for(int k = 0; k < nr_dim; k++){
+				if(fabs(mat(k,j)) < maxd){nr_inside++;}
+			}
 		}
 	}
 
@@ -336,12 +341,14 @@ void DistanceWeightFunction2PPR::computeModel(MatrixXd mat){
 float histogram_mul = 0;
 if(!bidir){
 	histogram_mul = float(histogram_size)/maxd;
-	for(int j = 0; j < histogram_size; j++){histogram[j] = 0;}
-
-	for(unsigned int j = 0; j < nr_data; j++){
-		for(int k = 0; k < nr_dim; k++){
-			int ind = fabs(mat(k,j))*histogram_mul;
-			if(ind >= 0 && ind < histogram_size){histogram[ind]++;}
+	if(batch_kernels){buildHistogram(mat.data(),nr_data*nr_dim,true,0.0,double(histogram_mul),BinFloor,histogram_size,&histogram[0],workspace);}
+	else{
+		for(int j = 0; j < histogram_size; j++){histogram[j] = 0;}
+		for(unsigned int j = 0; j < nr_data; j++){
+			for(int k = 0; k < nr_dim; k++){
+				int ind = fabs(mat(k,j))*histogram_mul;
+				if(ind >= 0 && ind < histogram_size){histogram[ind]++;}
+			}
 		}
 	}
 	/*
@@ -367,7 +374,8 @@ if(!bidir){
 	}
 */
 	start_time = getCurrentTime2();
-    blurHistogram(blur_histogram,histogram,blurval,debugg_print);
+	if(batch_kernels){	blurMirroredHistogram(&blur_histogram[0],&histogram[0],blur_histogram.size(),blurval,0,workspace);}
+	else{				blurHistogram(blur_histogram,histogram,blurval,debugg_print);}
 }else{
 	histogram_mul = float(histogram_size)/(2.0*maxd);
 	for(int j = 0; j < histogram_size; j++){histogram[j] = 0;}
@@ -504,7 +512,7 @@ if(!bidir){
 	//if(bidir){exit(0);}
 }
 
-VectorXd DistanceWeightFunction2PPR::getProbs(MatrixXd mat){
+VectorXd DistanceWeightFunction2PPR::getProbs(const MatrixXd & mat){
 	//printf("debugg_print: %i\n",debugg_print);
 	//exit(0);
 	const unsigned int nr_data = mat.cols();
@@ -513,7 +521,10 @@ VectorXd DistanceWeightFunction2PPR::getProbs(MatrixXd mat){
 	nr_inliers = 0;
 	VectorXd weights = VectorXd(nr_data);
 	float histogram_mul = 0;
-	if(!bidir){
+	if(!bidir && batch_kernels){
+		histogram_mul = float(histogram_size)/maxd;
+		nr_inliers = computeProbs(mat.data(),nr_data,nr_dim,true,0.0,double(histogram_mul),BinFloor,&prob[0],histogram_size,weights.data());
+	}else if(!bidir){
 		histogram_mul = float(histogram_size)/maxd;
 		for(unsigned int j = 0; j < nr_data; j++){
 			float inl  = 1;
@@ -50,6 +50,8 @@ DistanceWeightFunction2PPR2::DistanceWeightFunction2PPR2(	double maxd_, int hist
 	bidir = false;
 	iter = 0;
 
+	batch_kernels = true;
+
 	maxp = 0.99;
 
 	rescaling = true;
@@ -422,7 +424,7 @@ Gaussian3 getModel(double & stdval,std::vector<float> & hist, bool uniform_bias,
 
 double DistanceWeightFunction2PPR2::getNoise(){return regularization+noiseval;}// + stdval*double(histogram_size)/maxd;}
 
-void DistanceWeightFunction2PPR2::computeModel(MatrixXd mat){
+void DistanceWeightFunction2PPR2::computeModel(const MatrixXd & mat){
 	//debugg_print = false;
 
 	const unsigned int nr_data = mat.cols();
@@ -445,9 +447,12 @@ if(!fixed_histogram_size){
 	}
 
 	double nr_inside = 0;
-	for(unsigned int j = 0; j < nr_data; j++){
-		for(int k = 0; k < nr_dim; k++){
-			if(fabs(mat(k,j)) < maxd){nr_inside++;}
+	if(batch_kernels){nr_inside = countInside(mat.data(),nr_data*nr_dim,maxd);}
+	else{
+		for(unsigned int j = 0; j < nr_data; j++){
+			for(int k = 0; k < nr_dim; k++){
+				if(fabs(mat(k,j)) < maxd){nr_inside++;}
+			}
 		}
 	}
 
@@ -466,18 +471,16 @@ if(!fixed_histogram_size){
 
 	double start_time = getCurrentTime3();
 
-	for(int j = 0; j < histogram_size; j++){histogram[j] = 0;}
-	for(unsigned int j = 0; j < nr_data; j++){
-		for(int k = 0; k < nr_dim; k++){
-
-			double ind = fabs(mat(k,j))*histogram_mul;
-			double w2 = ind-int(ind);
-			double w1 = 1-w2;
-			if(ind >= 0 && (ind+0.5) < histogram_size){
-				histogram[int(ind+0.5)]++;
+	if(batch_kernels){buildHistogram(mat.data(),nr_data*nr_dim,true,0.0,histogram_mul,BinRound,histogram_size,&histogram[0],workspace);}
+	else{
+		for(int j = 0; j < histogram_size; j++){histogram[j] = 0;}
+		for(unsigned int j = 0; j < nr_data; j++){
+			for(int k = 0; k < nr_dim; k++){
+				double ind = fabs(mat(k,j))*histogram_mul;
+				if(ind >= 0 && (ind+0.5) < histogram_size){
+					histogram[int(ind+0.5)]++;
+				}
 			}
-
-			//printf("%i %i -> r:%f ind: %f \n",j,k,mat(k,j),ind);
 		}
 	}
 
@@ -485,7 +488,8 @@ if(!fixed_histogram_size){
 	histogram[0]*=2;
 }
 	start_time = getCurrentTime3();
-	blurHistogram2(blur_histogram,histogram,blurval,false);
+	if(batch_kernels){	blurMirroredHistogram(&blur_histogram[0],&histogram[0],blur_histogram.size(),blurval,0.001,workspace);}
+	else{				blurHistogram2(blur_histogram,histogram,blurval,false);}
 
     Gaussian3 g = getModel(stdval,blur_histogram,uniform_bias,refine_mean,refine_mul,refine_std,nr_refineiters,costpen,zeromean);
 
@@ -553,18 +557,23 @@ if(!fixed_histogram_size){
 	}
 
 	nr_inliers = 0;
-	for(unsigned int j = 0; j < nr_data; j++){
-		float inl  = 1;
-		float ninl = 1;
-		for(int k = 0; k < nr_dim; k++){
-			double ind = fabs(mat(k,j))*histogram_mul;
-			float p = 0;
-			if(ind >= 0 && (ind+0.5) < histogram_size){p = prob[int(ind+0.5)];}
-			inl *= p;
-			ninl *= 1.0-p;
+	if(batch_kernels){
+		inlier_weights.resize(nr_data);
+		nr_inliers = computeProbs(mat.data(),nr_data,nr_dim,true,0.0,histogram_mul,BinRound,&prob[0],histogram_size,&inlier_weights[0]);
+	}else{
+		for(unsigned int j = 0; j < nr_data; j++){
+			float inl  = 1;
+			float ninl = 1;
+			for(int k = 0; k < nr_dim; k++){
+				double ind = fabs(mat(k,j))*histogram_mul;
+				float p = 0;
+				if(ind >= 0 && (ind+0.5) < histogram_size){p = prob[int(ind+0.5)];}
+				inl *= p;
+				ninl *= 1.0-p;
+			}
+			double d = inl / (inl+ninl);
+			nr_inliers += d;
 		}
-		double d = inl / (inl+ninl);
-		nr_inliers += d;
 	}
 
 	if(debugg_print){printf("hist = [");				for(int k = 0; k < 300 && k < histogram_size; k++){printf("%i ",int(histogram[k]));}		printf("];\n");}
@@ -590,13 +599,18 @@ if(!fixed_histogram_size){
 	//debugg_print = false;
 }
 
-VectorXd DistanceWeightFunction2PPR2::getProbs(MatrixXd mat){
+VectorXd DistanceWeightFunction2PPR2::getProbs(const MatrixXd & mat){
 	const unsigned int nr_data = mat.cols();
 	const int nr_dim = mat.rows();
 	const float histogram_mul = float(histogram_size)/maxd;
 
-	nr_inliers = 0;
 	VectorXd weights = VectorXd(nr_data);
+	if(batch_kernels){
+		getProbs(mat.data(),nr_data,nr_dim,weights.data());
+		return weights;
+	}
+
+	nr_inliers = 0;
 	for(unsigned int j = 0; j < nr_data; j++){
 		float inl  = 1;
 		float ninl = 1;
@@ -623,6 +637,22 @@ VectorXd DistanceWeightFunction2PPR2::getProbs(MatrixXd mat){
 	return weights;
 }
 
+void DistanceWeightFunction2PPR2::getProbs(const double * residuals, unsigned int nr_data, int nr_dim, double * weights){
+	const float histogram_mul = float(histogram_size)/maxd;
+	nr_inliers = computeProbs(residuals,nr_data,nr_dim,true,0.0,double(histogram_mul),interp ? BinInterp : BinRound,&prob[0],histogram_size,weights);
+	if(threshold){
+		for(unsigned int j = 0; j < nr_data; j++){weights[j] = weights[j] > 0.5;}
+	}
+}
+
+void DistanceWeightFunction2PPR2::getProbs(const float * residuals, unsigned int nr_data, int nr_dim, float * weights){
+	const float histogram_mul = float(histogram_size)/maxd;
+	nr_inliers = computeProbs(residuals,nr_data,nr_dim,true,0.0f,histogram_mul,interp ? BinInterp : BinRound,&prob[0],histogram_size,weights);
+	if(threshold){
+		for(unsigned int j = 0; j < nr_data; j++){weights[j] = weights[j] > 0.5;}
+	}
+}
+
 double DistanceWeightFunction2PPR2::getProb(double d){
 	const float histogram_mul = float(histogram_size)/maxd;
 	double ind = fabs(d)*histogram_mul;
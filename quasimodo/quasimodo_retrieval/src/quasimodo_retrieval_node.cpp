@@ -20,6 +20,7 @@
 #include "quasimodo_msgs/retrieval_query.h"
 #include "quasimodo_msgs/simple_query_cloud.h"
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
 #include <tf_conversions/tf_eigen.h>
@@ -28,6 +29,9 @@
 #include <dynamic_reconfigure/server.h>
 #include <quasimodo_retrieval/parametersConfig.h>
 
+#include <chrono>
+#include "result_hydrator.h"
+
 using namespace std;
 
 using PointT = pcl::PointXYZRGB;
@@ -60,6 +64,8 @@ public:
     VocabularyT vt;
     dynamic_object_retrieval::vocabulary_summary summary;
 
+    result_hydrator<PointT> hydrator;
+
     double iss_model_resolution; // 0.004
     double pfhrgb_radius_search; // 0.04
 
@@ -87,6 +93,13 @@ public:
 
         pn.param<int32_t>("number_query", number_query, 10);
 
+        int hydration_threads;
+        pn.param<int>("hydration_threads", hydration_threads, 0);
+        hydrator.nbr_threads = std::max(0, hydration_threads);
+        int view_cache_mb;
+        pn.param<int>("view_cache_mb", view_cache_mb, 128);
+        hydrator.set_view_capacity(size_t(std::max(0, view_cache_mb))*1024*1024);
+
         pn.param<std::string>("output", retrieval_output, std::string("retrieval_result"));
         pn.param<std::string>("input", retrieval_input, std::string("/models/query"));
 
@@ -127,77 +140,6 @@ public:
         */
     }
 
-    pair<cv::Mat, cv::Mat> sweep_get_rgbd_at(const boost::filesystem::path& sweep_xml, int i)
-    {
-        stringstream ss;
-        ss << "intermediate_cloud" << std::setfill('0') << std::setw(4) << i << ".pcd";
-        boost::filesystem::path cloud_path = sweep_xml.parent_path() / ss.str();
-        CloudT::Ptr cloud(new CloudT);
-        pcl::io::loadPCDFile(cloud_path.string(), *cloud);
-        pair<cv::Mat, cv::Mat> images = SimpleXMLParser<PointT>::createRGBandDepthFromPC(cloud);
-        return images;
-    }
-
-    tuple<vector<cv::Mat>, vector<cv::Mat>, vector<cv::Mat>, vector<int> >
-    generate_images_for_object(const CloudT::Ptr& cloud, const Eigen::Matrix3f& K,
-        const boost::filesystem::path& sweep_xml,
-        const vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> >& transforms)
-    {
-        tuple<vector<cv::Mat>, vector<cv::Mat>, vector<cv::Mat>, vector<int> > images;
-
-        int height = 480;
-        int width = 640;
-
-        for (int i = 0; i < transforms.size(); ++i) {
-            cv::Mat mask = cv::Mat::zeros(height, width, CV_8UC1);
-            int sum = 0;
-            for (const PointT& p : cloud->points) {
-                Eigen::Vector4f q = transforms[i]*p.getVector4fMap();
-                if (q(2)/q(3) < 0) {
-                    continue;
-                }
-                Eigen::Vector3f r = K*q.head<3>();
-                int x = int(r(0)/r(2));
-                int y = int(r(1)/r(2));
-                if (x >= width || x < 0 || y >= height || y < 0) {
-                    continue;
-                }
-                mask.at<uint8_t>(y, x) = 255;
-                ++sum;
-            }
-            if (sum < 100) {
-                continue;
-            }
-
-            int erosion_size = 4;
-            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
-                                       cv::Size(2*erosion_size + 1, 2*erosion_size+1),
-                                       cv::Point(erosion_size, erosion_size));
-            cv::dilate(mask, mask, element);
-            cv::erode(mask, mask, element);
-
-
-            get<0>(images).push_back(mask);
-            pair<cv::Mat, cv::Mat> intermediate_images = sweep_get_rgbd_at(sweep_xml, i);
-            get<1>(images).push_back(intermediate_images.first);
-            get<2>(images).push_back(intermediate_images.second);
-            //get<1>(images).push_back(benchmark_retrieval::sweep_get_rgb_at(sweep_xml, i));
-            //get<2>(images).push_back(benchmark_retrieval::sweep_get_depth_at(sweep_xml, i));
-            get<3>(images).push_back(i);
-
-            /*
-            cv::imshow("Mask", get<0>(images).back());
-            cv::imshow("Rgb", get<1>(images).back());
-            cv::imshow("Depth", get<2>(images).back());
-            cv::waitKey();
-            */
-        }
-
-        // now probably do some dilation on the masks
-
-        return images;
-    }
-
     void test_compute_features(HistCloudT::Ptr& features, CloudT::Ptr& keypoints, CloudT::Ptr& cloud,
                                NormalCloudT::Ptr& normals, bool do_visualize = false, bool is_query = false)
     {
@@ -315,7 +257,7 @@ public:
         cout << "Received query msg..." << endl;
 
         pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-        pcl::fromROSMsg(req.query_cloud, *normal_cloud);
+        cloud_msg_utilities::fromROSMsg(req.query_cloud, *normal_cloud);
 
         CloudT::Ptr cloud(new CloudT);
         NormalCloudT::Ptr normals(new NormalCloudT);
@@ -335,7 +277,9 @@ public:
         vector<CloudT::Ptr> retrieved_clouds;
         vector<boost::filesystem::path> sweep_paths;
         // we should retrieve more than we want and only keep the results with valid files on the system
+        auto query_start = chrono::steady_clock::now();
         auto results = dynamic_object_retrieval::query_reweight_vocabulary((vocabulary_tree<HistT, 8>&)vt, features, 200, vocabulary_path, summary);
+        double query_time = chrono::duration<double>(chrono::steady_clock::now() - query_start).count();
 
         // This is just to make sure that we have valid results even when some meta rooms have been deleted
         size_t counter = 0;
@@ -355,12 +299,15 @@ public:
         }
         results.first.resize(counter);
 
-        tie(retrieved_clouds, sweep_paths) = benchmark_retrieval::load_retrieved_clouds(results.first);
+        // Only used for sweeps without stored camera parameters.
+        // The new parameters in surfelize_it: 528, 525, 317, 245
+        // The old parameters in surfelize_it: 540, 540, 320, 240
+        Eigen::Matrix3f K;
+        K << 540.0f, 0.0f, 320.0f, 0.0f, 540.0f, 240.0f, 0.0f, 0.0f, 1.0f;
 
-        cout << "Query cloud size: " << cloud->size() << endl;
-        for (CloudT::Ptr& c : retrieved_clouds) {
-            cout << "Retrieved cloud size: " << c->size() << endl;
-        }
+        // the results are loaded while the rest of the response is prepared
+        auto hydration_start = chrono::steady_clock::now();
+        auto hydrating = hydrator.hydrate_async(segment_paths(results.first), K);
 
         vector<float> scores;
         vector<int> indices;
@@ -373,35 +320,17 @@ public:
             scores.push_back(s.second.score);
         }
 
-        vector<vector<Eigen::Matrix4f>, Eigen::aligned_allocator<Eigen::Matrix4f > > initial_poses;
-        vector<vector<cv::Mat> > masks(retrieved_clouds.size());
-        vector<vector<cv::Mat> > images(retrieved_clouds.size());
-        vector<vector<cv::Mat> > depths(retrieved_clouds.size());
-        vector<vector<string> > paths(retrieved_clouds.size());
-        Eigen::Matrix3f K;
-        // The new parameters in surfelize_it: 528, 525, 317, 245
-        // The old parameters in surfelize_it: 540, 540, 320, 240
-
-        // The old parameters in this node:
-        // K << 525.0f, 0.0f, 319.5f, 0.0f, 525.0f, 239.5f, 0.0f, 0.0f, 1.0f;
+        vector<vector<cv::Mat> > masks, images, depths;
+        vector<vector<string> > paths;
+        collect_results(hydrating, hydration_start, retrieved_clouds, sweep_paths, masks, images, depths, paths, query_time);
 
-        // Just for johan to test:
-        K << 540.0f, 0.0f, 320.0f, 0.0f, 540.0f, 240.0f, 0.0f, 0.0f, 1.0f;
-        for (int i = 0; i < retrieved_clouds.size(); ++i) {
-            vector<int> inds;
-            auto sweep_data = SimpleXMLParser<PointT>::loadRoomFromXML(sweep_paths[i].string(), std::vector<std::string>{"RoomIntermediateCloud"}, false, false);
-            vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > sweep_transforms;
-            for (tf::StampedTransform& t : sweep_data.vIntermediateRoomCloudTransformsRegistered) {
-                Eigen::Affine3d e;
-                tf::transformTFToEigen(t, e);
-                sweep_transforms.push_back(e.inverse().matrix().cast<float>());
-            }
-            tie(masks[i], images[i], depths[i], inds) = generate_images_for_object(retrieved_clouds[i], K, sweep_paths[i], sweep_transforms);
-            for (int j = 0; j < inds.size(); ++j) {
-                paths[i].push_back(sweep_paths[i].string() + " " + to_string(inds[j]));
-            }
+        cout << "Query cloud size: " << cloud->size() << endl;
+        for (CloudT::Ptr& c : retrieved_clouds) {
+            cout << "Retrieved cloud size: " << c->size() << endl;
         }
 
+        vector<vector<Eigen::Matrix4f>, Eigen::aligned_allocator<Eigen::Matrix4f > > initial_poses;
+
         res.result = construct_msgs(retrieved_clouds, initial_poses, images, depths, masks, paths, scores, indices);
 
         cout << "Finished retrieval..." << endl;
@@ -412,7 +341,7 @@ public:
         cout << "Received query msg..." << endl;
 
         pcl::PointCloud<pcl::PointXYZRGBNormal>::Ptr normal_cloud(new pcl::PointCloud<pcl::PointXYZRGBNormal>);
-        pcl::fromROSMsg(query_msg->cloud, *normal_cloud);
+        cloud_msg_utilities::fromROSMsg(query_msg->cloud, *normal_cloud);
         CloudT::Ptr cloud(new CloudT);
         NormalCloudT::Ptr normals(new NormalCloudT);
         cloud->reserve(normal_cloud->size()); normals->reserve(normal_cloud->size());
@@ -426,7 +355,8 @@ public:
         cam_model.fromCameraInfo(query_msg->camera);
         cv::Matx33d cvK = cam_model.intrinsicMatrix();
         Eigen::Matrix3f K = Eigen::Map<Eigen::Matrix3d>(cvK.val).cast<float>();
-        K << 525.0f, 0.0f, 319.5f, 0.0f, 525.0f, 239.5f, 0.0f, 0.0f, 1.0f; // should be removed if Johan returns K?
+        // only used for sweeps without stored camera parameters
+        K << 525.0f, 0.0f, 319.5f, 0.0f, 525.0f, 239.5f, 0.0f, 0.0f, 1.0f;
 
         HistCloudT::Ptr features(new HistCloudT);
         CloudT::Ptr keypoints(new CloudT);
@@ -435,17 +365,13 @@ public:
         test_compute_features(features, keypoints, cloud, normals, false, true);
         cout << "Done computing features..." << endl;
 
-        sensor_msgs::PointCloud2 keypoint_msg;
-        pcl::toROSMsg(*keypoints, keypoint_msg);
-        keypoint_msg.header.frame_id = "/map";
-        keypoint_msg.header.stamp = ros::Time::now();
-        keypoint_pub.publish(keypoint_msg);
-
         vector<CloudT::Ptr> retrieved_clouds;
         vector<boost::filesystem::path> sweep_paths;
         //auto results = dynamic_object_retrieval::query_reweight_vocabulary(vt, refined_query, query_image, query_depth,
         //                                                                   K, number_query, vocabulary_path, summary, false);
+        auto query_start = chrono::steady_clock::now();
         auto results = dynamic_object_retrieval::query_reweight_vocabulary((vocabulary_tree<HistT, 8>&)vt, features, 200, vocabulary_path, summary);
+        double query_time = chrono::duration<double>(chrono::steady_clock::now() - query_start).count();
 
         // This is just to make sure that we have valid results even when some meta rooms have been deleted
         size_t counter = 0;
@@ -465,16 +391,15 @@ public:
         }
         results.first.resize(counter);
 
-        tie(retrieved_clouds, sweep_paths) = benchmark_retrieval::load_retrieved_clouds(results.first);
-
-        auto data = SimpleXMLParser<PointT>::loadRoomFromXML(sweep_paths[0].string(), std::vector<std::string>{"RoomIntermediateCloud"}, false, false);
-        tf::StampedTransform room_transform = data.vIntermediateRoomCloudTransforms[0];
-        room_transform.setOrigin(tf::Vector3(0.0, 0.0, 0.0));
+        // the results are loaded while the keypoints are published and the rest of the message is prepared
+        auto hydration_start = chrono::steady_clock::now();
+        auto hydrating = hydrator.hydrate_async(segment_paths(results.first), K);
 
-        cout << "Query cloud size: " << cloud->size() << endl;
-        for (CloudT::Ptr& c : retrieved_clouds) {
-            cout << "Retrieved cloud size: " << c->size() << endl;
-        }
+        sensor_msgs::PointCloud2 keypoint_msg;
+        cloud_msg_utilities::toROSMsg(*keypoints, keypoint_msg, cloud_msg_utilities::XYZRGB_FIELDS);
+        keypoint_msg.header.frame_id = "/map";
+        keypoint_msg.header.stamp = ros::Time::now();
+        keypoint_pub.publish(keypoint_msg);
 
         vector<float> scores;
         vector<int> indices;
@@ -488,30 +413,20 @@ public:
             scores.push_back(s.second.score);
         }
 
-        vector<vector<Eigen::Matrix4f>, Eigen::aligned_allocator<Eigen::Matrix4f > > initial_poses;
-        vector<vector<cv::Mat> > masks(retrieved_clouds.size());
-        vector<vector<cv::Mat> > images(retrieved_clouds.size());
-        vector<vector<cv::Mat> > depths(retrieved_clouds.size());
-        vector<vector<string> > paths(retrieved_clouds.size());
-        for (int i = 0; i < retrieved_clouds.size(); ++i) {
-            vector<int> inds;
-            auto sweep_data = SimpleXMLParser<PointT>::loadRoomFromXML(sweep_paths[i].string(), std::vector<std::string>{"RoomIntermediateCloud"}, false, false);
-            vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > sweep_transforms;
-            for (tf::StampedTransform& t : sweep_data.vIntermediateRoomCloudTransformsRegistered) {
-                Eigen::Affine3d e;
-                tf::transformTFToEigen(t, e);
-                sweep_transforms.push_back(e.inverse().matrix().cast<float>());
-            }
-            tie(masks[i], images[i], depths[i], inds) = generate_images_for_object(retrieved_clouds[i], K, sweep_paths[i], sweep_transforms);
-            for (int j = 0; j < inds.size(); ++j) {
-                paths[i].push_back(sweep_paths[i].string() + " " + to_string(inds[j]));
-            }
+        vector<vector<cv::Mat> > masks, images, depths;
+        vector<vector<string> > paths;
+        collect_results(hydrating, hydration_start, retrieved_clouds, sweep_paths, masks, images, depths, paths, query_time);
 
-            //Eigen::Affine3d AT;
-            //tf::transformTFToEigen(sweep_data.vIntermediateRoomCloudTransforms[0], AT);
-            //pcl::transformPointCloud(*retrieved_clouds[i], *retrieved_clouds[i], AT);
+        tf::StampedTransform room_transform = hydrator.get_sweep(sweep_paths[0])->room_transform;
+        room_transform.setOrigin(tf::Vector3(0.0, 0.0, 0.0));
+
+        cout << "Query cloud size: " << cloud->size() << endl;
+        for (CloudT::Ptr& c : retrieved_clouds) {
+            cout << "Retrieved cloud size: " << c->size() << endl;
         }
 
+        vector<vector<Eigen::Matrix4f>, Eigen::aligned_allocator<Eigen::Matrix4f > > initial_poses;
+
         //cv::Mat full_query_image = benchmark_retrieval::sweep_get_rgb_at(sweep_xml, scan_index);
         quasimodo_msgs::retrieval_query_result result;
         result.query = *query_msg;
@@ -523,6 +438,39 @@ public:
         cout << "Finished retrieval..." << endl;
     }
 
+    template <typename ResultsT>
+    vector<boost::filesystem::path> segment_paths(const ResultsT& results)
+    {
+        vector<boost::filesystem::path> paths;
+        for (const auto& r : results) {
+            paths.push_back(r.first);
+        }
+        return paths;
+    }
+
+    // Waits for the clouds, images and masks of the results, loaded in parallel through the hydration cache
+    void collect_results(std::future<vector<result_hydrator<PointT>::result> >& hydrating, chrono::steady_clock::time_point hydration_start,
+                         vector<CloudT::Ptr>& retrieved_clouds, vector<boost::filesystem::path>& sweep_paths,
+                         vector<vector<cv::Mat> >& masks, vector<vector<cv::Mat> >& images,
+                         vector<vector<cv::Mat> >& depths, vector<vector<string> >& paths, double query_time)
+    {
+        auto hydrated = hydrating.get();
+        for (auto& h : hydrated) {
+            retrieved_clouds.push_back(h.cloud);
+            sweep_paths.push_back(h.sweep_path);
+            masks.push_back(h.masks);
+            images.push_back(h.images);
+            depths.push_back(h.depths);
+            paths.push_back(vector<string>());
+            for (int j : h.indices) {
+                paths.back().push_back(h.sweep_path.string() + " " + to_string(j));
+            }
+        }
+        double hydration_time = chrono::duration<double>(chrono::steady_clock::now() - hydration_start).count();
+        cout << "Vocabulary query took " << query_time << "s, loading " << hydrated.size() << " results took " << hydration_time << "s" << endl;
+        hydrator.print_statistics();
+    }
+
     void convert_to_img_msg(const cv::Mat& cv_image, sensor_msgs::Image& ros_image)
     {
         cv_bridge::CvImagePtr cv_pub_ptr(new cv_bridge::CvImage);
@@ -582,7 +530,7 @@ public:
         res.segment_indices.resize(number_retrieved);
 
         for (int i = 0; i < number_retrieved; ++i) {
-            pcl::toROSMsg(*clouds[i], res.retrieved_clouds[i]);
+            cloud_msg_utilities::toROSMsg(*clouds[i], res.retrieved_clouds[i]);
             int nbr_images = images[i].size();
 
             res.retrieved_initial_poses[i].poses.resize(nbr_images);
@@ -13,6 +13,7 @@
 #include "ros/ros.h"
 #include "quasimodo_msgs/retrieval_query_result.h"
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
 #include <tf_conversions/tf_eigen.h>
@@ -245,7 +246,7 @@ public:
         int32 number_query
         geometry_msgs/Transform room_transform
         */
-        pcl::toROSMsg(*query_cloud, res.query.cloud);
+        cloud_msg_utilities::toROSMsg(*query_cloud, res.query.cloud);
         convert_to_img_msg(query_image, res.query.image);
         convert_to_depth_msg(query_depth, res.query.depth);
         convert_to_mask_msg(query_mask, res.query.mask);
@@ -276,7 +277,7 @@ public:
         res.result.retrieved_distance_scores.resize(number_retrieved);
 
         for (int i = 0; i < number_retrieved; ++i) {
-            pcl::toROSMsg(*clouds[i], res.result.retrieved_clouds[i]);
+            cloud_msg_utilities::toROSMsg(*clouds[i], res.result.retrieved_clouds[i]);
             int nbr_images = images[i].size();
 
             res.result.retrieved_initial_poses[i].poses.resize(nbr_images);
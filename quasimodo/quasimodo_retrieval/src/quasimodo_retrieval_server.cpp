@@ -4,6 +4,7 @@
 #include <object_3d_benchmark/benchmark_retrieval.h>
 #include "quasimodo_msgs/query_cloud.h"
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 
 using namespace std;
 
@@ -46,7 +47,7 @@ public:
         using result_type = vector<pair<typename dynamic_object_retrieval::path_result<VocabularyT>::type, typename VocabularyT::result_type> >;
 
         CloudT::Ptr cloud(new CloudT);
-        pcl::fromROSMsg(req.query.cloud, *cloud);
+        cloud_msg_utilities::fromROSMsg(req.query.cloud, *cloud);
 
         image_geometry::PinholeCameraModel cam_model;
         cam_model.fromCameraInfo(req.query.camera);
@@ -69,7 +70,7 @@ public:
         res.result.retrieved_distance_scores.resize(retrieved_clouds.size());
 
         for (int i = 0; i < retrieved_clouds.size(); ++i) {
-            pcl::toROSMsg(*retrieved_clouds[i], res.result.retrieved_clouds[i]);
+            cloud_msg_utilities::toROSMsg(*retrieved_clouds[i], res.result.retrieved_clouds[i]);
             //res.retrieved_initial_poses = geometry_msgs::Pose();
             res.result.retrieved_image_paths[i].strings.push_back(sweep_paths[i].string());
             res.result.retrieved_distance_scores[i] = retrieved_paths[i].second.score;
@@ -8,6 +8,7 @@
 #include "quasimodo_msgs/retrieval_query_result.h"
 #include "quasimodo_msgs/string_array.h"
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
 #include <tf_conversions/tf_eigen.h>
@@ -87,7 +88,7 @@ public:
         vector<CloudT::Ptr> retrieved_clouds;
         for (const sensor_msgs::PointCloud2& cloud : result.retrieved_clouds) {
             retrieved_clouds.push_back(CloudT::Ptr(new CloudT));
-            pcl::fromROSMsg(cloud, *retrieved_clouds.back());
+            cloud_msg_utilities::fromROSMsg(cloud, *retrieved_clouds.back());
         }
 
         string query_label = "Query Image";
@@ -0,0 +1,429 @@
+#ifndef RESULT_HYDRATOR_H
+#define RESULT_HYDRATOR_H
+
+#include <vector>
+#include <list>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#include <pcl/point_cloud.h>
+#include <pcl/io/pcd_io.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <tf_conversions/tf_eigen.h>
+#include <metaroom_xml_parser/simple_xml_parser.h>
+#include <metaroom_xml_parser/rgbd_view.h>
+
+// Least recently used map bounded by the total cost of its entries, not thread safe. Every entry costs 1 unless
+// a cost is given, so by default the capacity is a number of entries. The most recently used entry is never evicted.
+template <typename KeyT, typename ValueT>
+class lru_cache {
+public:
+    lru_cache(size_t capacity) : capacity(capacity), total_cost(0) {}
+
+    bool get(const KeyT& key, ValueT& value)
+    {
+        auto iter = index.find(key);
+        if (iter == index.end()) {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, iter->second);
+        value = iter->second->value;
+        return true;
+    }
+
+    void put(const KeyT& key, const ValueT& value, size_t cost = 1)
+    {
+        auto iter = index.find(key);
+        if (iter != index.end()) {
+            iter->second->value = value;
+            entries.splice(entries.begin(), entries, iter->second);
+        }
+        else {
+            entries.push_front(entry{key, value, 0});
+            index[key] = entries.begin();
+        }
+        set_cost(key, cost);
+    }
+
+    // Changes the cost of an entry, e.g. once the size of a value that was loaded asynchronously is known
+    void set_cost(const KeyT& key, size_t cost)
+    {
+        auto iter = index.find(key);
+        if (iter == index.end()) {
+            return;
+        }
+        total_cost = total_cost - iter->second->cost + cost;
+        iter->second->cost = cost;
+        evict();
+    }
+
+    void erase(const KeyT& key)
+    {
+        auto iter = index.find(key);
+        if (iter == index.end()) {
+            return;
+        }
+        total_cost -= iter->second->cost;
+        entries.erase(iter->second);
+        index.erase(iter);
+    }
+
+    void set_capacity(size_t new_capacity)
+    {
+        capacity = new_capacity;
+        evict();
+    }
+
+    size_t size() const { return entries.size(); }
+    size_t cost() const { return total_cost; }
+
+private:
+    struct entry {
+        KeyT key;
+        ValueT value;
+        size_t cost;
+    };
+
+    size_t capacity;
+    size_t total_cost;
+    std::list<entry> entries;
+    std::unordered_map<KeyT, typename std::list<entry>::iterator> index;
+
+    void evict()
+    {
+        while (total_cost > capacity && entries.size() > 1) {
+            total_cost -= entries.back().cost;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+};
+
+// Loads the payloads of retrieval results: the segment cloud, and for every intermediate view of the segment's sweep
+// the rgb and depth images and a mask of the segment projected into the view. The results are loaded in parallel and
+// the parsed sweeps (transforms and camera intrinsics) and the views are kept in LRU caches, so results from recently
+// returned sweeps do not touch the disk again. The sweep cache is bounded by a number of sweeps and the view cache by
+// the bytes of the images it holds. The caches hold futures, so concurrent requests for the same sweep or view wait
+// for a single load. The keys include the modification time of the files, so a rewritten sweep is loaded again, and a
+// failed load is not cached.
+template <typename PointT>
+class result_hydrator {
+public:
+    using CloudT = pcl::PointCloud<PointT>;
+    using TransformsT = std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> >;
+
+    struct sweep_data {
+        TransformsT transforms; // registered transforms, from sweep to view coordinates
+        std::vector<Eigen::Matrix3f, Eigen::aligned_allocator<Eigen::Matrix3f> > intrinsics; // per view, from the stored camera parameters
+        std::vector<cv::Size> sizes; // per view, image size from the stored camera parameters, empty if unknown
+        tf::StampedTransform room_transform; // transform of the first intermediate cloud
+    };
+
+    struct view_data {
+        cv::Mat rgb;
+        cv::Mat depth;
+    };
+
+    struct result {
+        typename CloudT::Ptr cloud;
+        boost::filesystem::path sweep_path;
+        std::vector<cv::Mat> masks;
+        std::vector<cv::Mat> images;
+        std::vector<cv::Mat> depths;
+        std::vector<int> indices; // intermediate view of every image
+    };
+
+    using SweepPtr = std::shared_ptr<const sweep_data>;
+    using ViewPtr = std::shared_ptr<const view_data>;
+
+    size_t nbr_threads; // 0 uses one thread per hardware thread
+    int min_mask_points;
+
+    // view_bytes bounds the memory of the cached rgb and depth images, 1.5 MB per 640x480 view
+    result_hydrator(size_t sweep_capacity = 32, size_t view_bytes = 128*1024*1024, size_t nbr_threads = 0) :
+        nbr_threads(nbr_threads), min_mask_points(100), sweeps(sweep_capacity), views(view_bytes),
+        sweep_hits(0), sweep_misses(0), view_hits(0), view_misses(0)
+    {
+    }
+
+    // Loads the results for the segment clouds in segment_paths, the sweep of a segment is
+    // segment_path/../../room.xml as in benchmark_retrieval::load_retrieved_clouds. default_K is used for views
+    // without stored intrinsics. If loading a result throws, the remaining results are skipped and the first exception
+    // is rethrown once all the threads have stopped.
+    std::vector<result> hydrate(const std::vector<boost::filesystem::path>& segment_paths, const Eigen::Matrix3f& default_K)
+    {
+        std::vector<result> results(segment_paths.size());
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto worker = [&]() {
+            try {
+                for (size_t i = next++; i < segment_paths.size(); i = next++) {
+                    hydrate_result(segment_paths[i], default_K, results[i]);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = segment_paths.size();
+            }
+        };
+
+        size_t threads = nbr_threads > 0 ? nbr_threads : std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, segment_paths.size());
+        std::vector<std::thread> workers;
+        for (size_t t = 1; t < threads; ++t) {
+            workers.push_back(std::thread(worker));
+        }
+        worker();
+        for (std::thread& t : workers) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return results;
+    }
+
+    std::future<std::vector<result> > hydrate_async(const std::vector<boost::filesystem::path>& segment_paths, const Eigen::Matrix3f& default_K)
+    {
+        return std::async(std::launch::async, [this, segment_paths, default_K]() { return hydrate(segment_paths, default_K); });
+    }
+
+    SweepPtr get_sweep(const boost::filesystem::path& sweep_xml)
+    {
+        return get_cached(sweeps, file_key(sweep_xml), sweep_hits, sweep_misses, [&]() { return load_sweep(sweep_xml); });
+    }
+
+    ViewPtr get_view(const boost::filesystem::path& sweep_xml, int i)
+    {
+        // keyed by the file the view is read from, an RGBD view written after the view was cached replaces the PCD
+        boost::filesystem::path cloud_path = view_cloud_path(sweep_xml, i);
+        boost::filesystem::path view_path = rgbd_view_utilities::getRGBDViewFilename(cloud_path.string());
+        std::string key = boost::filesystem::exists(view_path) ? file_key(view_path) : file_key(cloud_path);
+        return get_cached(views, key, view_hits, view_misses, [&]() { return load_view(sweep_xml, i); },
+                          [](const ViewPtr& view) { return view->rgb.total()*view->rgb.elemSize() + view->depth.total()*view->depth.elemSize(); });
+    }
+
+    void set_view_capacity(size_t view_bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        views.set_capacity(view_bytes);
+    }
+
+    void print_statistics()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "Hydration cache: sweeps " << sweep_hits << " hits " << sweep_misses << " misses, views "
+                  << view_hits << " hits " << view_misses << " misses, " << views.size() << " views cached in "
+                  << views.cost()/(1024*1024) << " MB" << std::endl;
+    }
+
+    static SweepPtr load_sweep(const boost::filesystem::path& sweep_xml)
+    {
+        std::shared_ptr<sweep_data> data(new sweep_data);
+        auto room = SimpleXMLParser<PointT>::loadRoomFromXML(sweep_xml.string(), std::vector<std::string>{"RoomIntermediateCloud"}, false, false);
+        for (tf::StampedTransform& t : room.vIntermediateRoomCloudTransformsRegistered) {
+            Eigen::Affine3d e;
+            tf::transformTFToEigen(t, e);
+            data->transforms.push_back(e.inverse().matrix().cast<float>());
+        }
+        if (!room.vIntermediateRoomCloudTransforms.empty()) {
+            data->room_transform = room.vIntermediateRoomCloudTransforms[0];
+        }
+
+        // the corrected parameters belong to the registered transforms
+        bool corrected = room.vIntermediateRoomCloudCamParamsCorrected.size() == data->transforms.size();
+        for (size_t i = 0; i < data->transforms.size(); ++i) {
+            Eigen::Matrix3f K = Eigen::Matrix3f::Zero();
+            cv::Size size;
+            if (corrected) {
+                K = intrinsics_from_camera(room.vIntermediateRoomCloudCamParamsCorrected[i]);
+                size = room.vIntermediateRoomCloudCamParamsCorrected[i].fullResolution();
+            }
+            else if (i < room.vIntermediateRoomCloudCamParams.size()) {
+                K = intrinsics_from_camera(room.vIntermediateRoomCloudCamParams[i]);
+                size = room.vIntermediateRoomCloudCamParams[i].fullResolution();
+            }
+            data->intrinsics.push_back(K);
+            data->sizes.push_back(size);
+        }
+        return data;
+    }
+
+    static boost::filesystem::path view_cloud_path(const boost::filesystem::path& sweep_xml, int i)
+    {
+        std::stringstream ss;
+        ss << "intermediate_cloud" << std::setfill('0') << std::setw(4) << i << ".pcd";
+        return sweep_xml.parent_path() / ss.str();
+    }
+
+    // Path and modification time of a file, missing files get the time -1
+    static std::string file_key(const boost::filesystem::path& path)
+    {
+        boost::system::error_code ec;
+        std::time_t time = boost::filesystem::last_write_time(path, ec);
+        return path.string() + " " + std::to_string(ec ? std::time_t(-1) : time);
+    }
+
+    static ViewPtr load_view(const boost::filesystem::path& sweep_xml, int i)
+    {
+        std::shared_ptr<view_data> data(new view_data);
+        boost::filesystem::path cloud_path = view_cloud_path(sweep_xml, i);
+        boost::filesystem::path view_path = rgbd_view_utilities::getRGBDViewFilename(cloud_path.string());
+        RGBDView view;
+        if (boost::filesystem::exists(view_path) && rgbd_view_utilities::loadRGBDView(view_path.string(), view)) {
+            // stored as images already, no need to go through a point cloud
+            data->rgb = view.rgb;
+            data->depth = view.depth;
+            return data;
+        }
+        typename CloudT::Ptr cloud(new CloudT);
+        pcl::io::loadPCDFile(cloud_path.string(), *cloud);
+        std::tie(data->rgb, data->depth) = SimpleXMLParser<PointT>::createRGBandDepthFromPC(cloud);
+        return data;
+    }
+
+    static Eigen::Matrix3f intrinsics_from_camera(const image_geometry::PinholeCameraModel& camera)
+    {
+        Eigen::Matrix3f K = Eigen::Matrix3f::Zero();
+        if (camera.fx() > 0 && camera.fy() > 0) {
+            K << camera.fx(), 0.0f, camera.cx(), 0.0f, camera.fy(), camera.cy(), 0.0f, 0.0f, 1.0f;
+        }
+        return K;
+    }
+
+    // Image size of a camera with the principal point in the center, for views without a stored image size
+    static cv::Size size_from_intrinsics(const Eigen::Matrix3f& K)
+    {
+        return cv::Size(2*int(K(0, 2) + 0.5f), 2*int(K(1, 2) + 0.5f));
+    }
+
+    // Mask of the cloud projected into a view of the given size
+    static cv::Mat project_mask(const CloudT& cloud, const Eigen::Matrix4f& transform, const Eigen::Matrix3f& K, const cv::Size& size, int& sum)
+    {
+        int height = size.height;
+        int width = size.width;
+        cv::Mat mask = cv::Mat::zeros(height, width, CV_8UC1);
+        sum = 0;
+        for (const PointT& p : cloud.points) {
+            Eigen::Vector4f q = transform*p.getVector4fMap();
+            if (q(2)/q(3) < 0) {
+                continue;
+            }
+            Eigen::Vector3f r = K*q.head<3>();
+            int x = int(r(0)/r(2));
+            int y = int(r(1)/r(2));
+            if (x >= width || x < 0 || y >= height || y < 0) {
+                continue;
+            }
+            mask.at<uint8_t>(y, x) = 255;
+            ++sum;
+        }
+        return mask;
+    }
+
+protected:
+    // the caches are protected so that the tests can load through them directly
+    template <typename ValueT>
+    using CacheT = lru_cache<std::string, std::shared_future<ValueT> >;
+
+    std::mutex mutex;
+    CacheT<SweepPtr> sweeps;
+    CacheT<ViewPtr> views;
+    size_t sweep_hits, sweep_misses;
+    size_t view_hits, view_misses;
+
+    template <typename ValueT, typename LoadT>
+    ValueT get_cached(CacheT<ValueT>& cache, const std::string& key, size_t& hits, size_t& misses, LoadT load)
+    {
+        return get_cached(cache, key, hits, misses, load, [](const ValueT&) { return size_t(1); });
+    }
+
+    // cost_of gives the cost of a loaded value in the units of the capacity of cache. A load that throws is removed from
+    // the cache again, the threads already waiting for it get the exception and the next request loads it again.
+    template <typename ValueT, typename LoadT, typename CostT>
+    ValueT get_cached(CacheT<ValueT>& cache, const std::string& key, size_t& hits, size_t& misses, LoadT load, CostT cost_of)
+    {
+        std::shared_future<ValueT> future;
+        std::promise<ValueT> promise;
+        bool owner = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (cache.get(key, future)) {
+                ++hits;
+            }
+            else {
+                ++misses;
+                future = promise.get_future().share();
+                cache.put(key, future, 0);
+                owner = true;
+            }
+        }
+        if (owner) {
+            try {
+                ValueT value = load();
+                promise.set_value(value);
+                std::lock_guard<std::mutex> lock(mutex);
+                cache.set_cost(key, cost_of(value));
+            }
+            catch (...) {
+                promise.set_exception(std::current_exception());
+                std::lock_guard<std::mutex> lock(mutex);
+                // a load started after this entry was evicted is still running and is kept
+                std::shared_future<ValueT> cached;
+                if (cache.get(key, cached) && cached.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    cache.erase(key);
+                }
+            }
+        }
+        return future.get();
+    }
+
+    void hydrate_result(const boost::filesystem::path& segment_path, const Eigen::Matrix3f& default_K, result& res)
+    {
+        res.cloud = typename CloudT::Ptr(new CloudT);
+        pcl::io::loadPCDFile(segment_path.string(), *res.cloud);
+        res.sweep_path = segment_path.parent_path().parent_path() / "room.xml";
+
+        SweepPtr sweep = get_sweep(res.sweep_path);
+        int erosion_size = 4;
+        cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE,
+                                                    cv::Size(2*erosion_size + 1, 2*erosion_size+1),
+                                                    cv::Point(erosion_size, erosion_size));
+        for (size_t i = 0; i < sweep->transforms.size(); ++i) {
+            const Eigen::Matrix3f& K = sweep->intrinsics[i](0, 0) > 0 ? sweep->intrinsics[i] : default_K;
+            cv::Size size = sweep->sizes[i].area() > 0 ? sweep->sizes[i] : size_from_intrinsics(K);
+            int sum;
+            cv::Mat mask = project_mask(*res.cloud, sweep->transforms[i], K, size, sum);
+            if (sum < min_mask_points) {
+                continue;
+            }
+            cv::dilate(mask, mask, element);
+            cv::erode(mask, mask, element);
+
+            ViewPtr view = get_view(res.sweep_path, i);
+            res.masks.push_back(mask);
+            res.images.push_back(view->rgb);
+            res.depths.push_back(view->depth);
+            res.indices.push_back(i);
+        }
+    }
+};
+
+#endif // RESULT_HYDRATOR_H
@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include <pcl/point_types.h>
+
+#include "result_hydrator.h"
+
+using namespace std;
+
+using PointT = pcl::PointXYZRGB;
+
+namespace {
+
+// Loads through the sweep cache of the hydrator with any load function
+class test_hydrator : public result_hydrator<PointT> {
+public:
+    SweepPtr get(const string& key, const function<SweepPtr()>& load)
+    {
+        return get_cached(sweeps, key, sweep_hits, sweep_misses, load);
+    }
+
+    size_t hits()
+    {
+        lock_guard<std::mutex> lock(mutex);
+        return sweep_hits;
+    }
+
+    size_t misses()
+    {
+        lock_guard<std::mutex> lock(mutex);
+        return sweep_misses;
+    }
+};
+
+test_hydrator::SweepPtr make_sweep(size_t nbr_views)
+{
+    shared_ptr<test_hydrator::sweep_data> sweep(new test_hydrator::sweep_data);
+    sweep->transforms.resize(nbr_views, Eigen::Matrix4f::Identity());
+    return sweep;
+}
+
+} // namespace
+
+TEST(lru_cache, evicts_least_recently_used)
+{
+    lru_cache<string, int> cache(2);
+    cache.put("a", 1);
+    cache.put("b", 2);
+    int value;
+    ASSERT_TRUE(cache.get("a", value)); // b is now the least recently used
+    EXPECT_EQ(value, 1);
+    cache.put("c", 3);
+
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_FALSE(cache.get("b", value));
+    EXPECT_TRUE(cache.get("a", value));
+    EXPECT_TRUE(cache.get("c", value));
+
+    cache.set_cost("c", 5); // never evicts the most recently used entry
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.cost(), 5u);
+    cache.erase("c");
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.cost(), 0u);
+}
+
+TEST(result_hydrator, failed_load_is_not_cached)
+{
+    test_hydrator hydrator;
+    int loads = 0;
+    auto failing = [&]() -> test_hydrator::SweepPtr { ++loads; throw runtime_error("could not parse sweep"); };
+    auto loading = [&]() { ++loads; return make_sweep(3); };
+
+    EXPECT_THROW(hydrator.get("room.xml 1", failing), runtime_error);
+    EXPECT_EQ(loads, 1);
+
+    // the next request loads again instead of getting the cached error
+    test_hydrator::SweepPtr sweep = hydrator.get("room.xml 1", loading);
+    ASSERT_TRUE(sweep != nullptr);
+    EXPECT_EQ(sweep->transforms.size(), 3u);
+    EXPECT_EQ(loads, 2);
+
+    EXPECT_EQ(hydrator.get("room.xml 1", loading), sweep);
+    EXPECT_EQ(loads, 2);
+    EXPECT_EQ(hydrator.misses(), 2u);
+    EXPECT_EQ(hydrator.hits(), 1u);
+}
+
+TEST(result_hydrator, waiting_requests_get_the_error)
+{
+    test_hydrator hydrator;
+    promise<void> started, release;
+    shared_future<void> released = release.get_future().share();
+    auto blocking = [&]() -> test_hydrator::SweepPtr {
+        started.set_value();
+        released.wait();
+        throw runtime_error("could not parse sweep");
+    };
+
+    thread owner([&]() { EXPECT_THROW(hydrator.get("room.xml 1", blocking), runtime_error); });
+    started.get_future().wait();
+    // the load is in flight, this request waits for it instead of loading
+    future<void> waiting = async(launch::async, [&]() {
+        EXPECT_THROW(hydrator.get("room.xml 1", [&]() { return make_sweep(1); }), runtime_error);
+    });
+    while (hydrator.hits() == 0) {
+        this_thread::yield();
+    }
+    release.set_value();
+    owner.join();
+    waiting.get();
+
+    EXPECT_EQ(hydrator.get("room.xml 1", [&]() { return make_sweep(2); })->transforms.size(), 2u);
+    EXPECT_EQ(hydrator.misses(), 2u);
+}
+
+TEST(result_hydrator, file_key_changes_with_the_file)
+{
+    boost::filesystem::path folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("hydrator_%%%%-%%%%");
+    boost::filesystem::create_directories(folder);
+    boost::filesystem::path file = folder / "room.xml";
+
+    string missing = test_hydrator::file_key(file);
+    EXPECT_EQ(missing, file.string() + " -1");
+
+    ofstream(file.string()) << "<SemanticRoom/>";
+    string written = test_hydrator::file_key(file);
+    EXPECT_NE(written, missing);
+    EXPECT_EQ(test_hydrator::file_key(file), written);
+
+    boost::filesystem::last_write_time(file, boost::filesystem::last_write_time(file) + 10);
+    EXPECT_NE(test_hydrator::file_key(file), written);
+
+    boost::filesystem::remove_all(folder);
+}
+
+int main(int argc, char** argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -7,6 +7,7 @@
 #include <pcl/io/pcd_io.h>
 #include <pcl/filters/approximate_voxel_grid.h>
 #include <pcl_ros/point_cloud.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 
 #include <metaroom_xml_parser/load_utilities.h>
 #include <dynamic_object_retrieval/definitions.h>
@@ -117,7 +118,7 @@ void segmentation_callback(const std_msgs::String::ConstPtr& msg)
     }
     //dynamic_object_retrieval::visualize(colored_segments);
     sensor_msgs::PointCloud2 vis_msg;
-    pcl::toROSMsg(*colored_segments, vis_msg);
+    cloud_msg_utilities::toROSMsg(*colored_segments, vis_msg, cloud_msg_utilities::XYZRGB_FIELDS);
     vis_msg.header.frame_id = "/map";
     vis_cloud_pub.publish(vis_msg);
 #endif
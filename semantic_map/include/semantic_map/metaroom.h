@@ -28,6 +28,7 @@
 #include "room_xml_parser.h"
 #include "occlusion_checker.h"
 #include "metaroom_update_iteration.h"
+#include "metaroom_voxel_pyramid.h"
 
 
 template <class PointType>
@@ -55,6 +56,14 @@ private:
     bool                                                                m_bSaveIntermediateSteps;
     bool                                                                m_bUpdateMetaroom;
 
+    // coarse-to-fine update: the voxel pyramid of the interior cloud is kept between updates
+    bool                                                                m_bCoarseToFineUpdate;
+    MetaRoomVoxelPyramid<PointType>                                     m_InteriorCloudPyramid;
+
+    bool                                                                m_bCoarseToFineRegistration;
+    // NDT grids of the interior cloud, rebuilt when the interior cloud version changes
+    NdtTargetCache                                                      m_NdtTargetCache;
+
 public:
     std::string                                                         m_sMetaroomStringId;
 
@@ -68,6 +77,12 @@ public:
     bool getSaveIntermediateSteps();
     void setSaveIntermediateSteps(bool saveSteps);
 
+    bool getCoarseToFineUpdate();
+    void setCoarseToFineUpdate(bool coarseToFine, std::vector<double> leafSizes = std::vector<double>{0.2, 0.08});
+
+    bool getCoarseToFineRegistration();
+    void setCoarseToFineRegistration(bool coarseToFine);
+
     std::pair<pcl::ModelCoefficients::Ptr,bool> getCeilingPrimitive();;
     void setCeilingPrimitive(pcl::ModelCoefficients::Ptr primitive,bool direction);
     std::pair<pcl::ModelCoefficients::Ptr,bool> getFloorPrimitive();
@@ -94,6 +109,10 @@ public:
     static std::vector<CloudPtr> clusterPointCloud(CloudPtr input_cloud, double tolerance = 0.05, int min_cluster_size = 100, int max_cluster_size=100000);
     static CloudPtr downsampleCloud(CloudPtr input, double leafSize = 0.02f);
 
+private:
+    void computeDifferencesCoarseToFine(CloudPtr metaRoomCloud, CloudPtr roomCloud, CloudPtr differenceMetaRoomToRoom, CloudPtr differenceRoomToMetaRoom,
+                                        CloudPtr metaRoomChanged, CloudPtr metaRoomUnchanged);
+
 };
 
 
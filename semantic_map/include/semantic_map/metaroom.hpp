@@ -6,7 +6,7 @@
 
 template <class PointType>
 MetaRoom<PointType>::MetaRoom(bool saveIntermediateSteps) : RoomBase<PointType>(), m_SensorOrigin(0.0,0.0,0.0), m_ConsistencyUpdateCloud(new Cloud()), m_bSaveIntermediateSteps(saveIntermediateSteps),
-    m_bUpdateMetaroom(true)
+    m_bUpdateMetaroom(true), m_bCoarseToFineUpdate(false), m_bCoarseToFineRegistration(false)
 {
     m_MetaRoomCeilingPrimitive = pcl::ModelCoefficients::Ptr(new (pcl::ModelCoefficients));
     m_MetaRoomCeilingPrimitive->values = std::vector<float>(4,0.0); // initialize with 0
@@ -44,6 +44,8 @@ void MetaRoom<PointType>::resetMetaRoom()
     m_MetaRoomFloorPrimitive = pcl::ModelCoefficients::Ptr(new (pcl::ModelCoefficients));
     m_vMetaRoomWallPrimitives.clear();
     m_MetaRoomUpdateIterations.clear();
+    m_InteriorCloudPyramid.invalidate();
+    m_NdtTargetCache.clear();
 }
 
 template <class PointType>
@@ -58,6 +60,34 @@ void MetaRoom<PointType>::setSaveIntermediateSteps(bool saveSteps)
     m_bSaveIntermediateSteps = saveSteps;
 }
 
+template <class PointType>
+bool MetaRoom<PointType>::getCoarseToFineUpdate()
+{
+    return m_bCoarseToFineUpdate;
+}
+
+template <class PointType>
+void MetaRoom<PointType>::setCoarseToFineUpdate(bool coarseToFine, std::vector<double> leafSizes)
+{
+    m_bCoarseToFineUpdate = coarseToFine;
+    if (leafSizes != m_InteriorCloudPyramid.getLeafSizes())
+    {
+        m_InteriorCloudPyramid = MetaRoomVoxelPyramid<PointType>(leafSizes);
+    }
+}
+
+template <class PointType>
+bool MetaRoom<PointType>::getCoarseToFineRegistration()
+{
+    return m_bCoarseToFineRegistration;
+}
+
+template <class PointType>
+void MetaRoom<PointType>::setCoarseToFineRegistration(bool coarseToFine)
+{
+    m_bCoarseToFineRegistration = coarseToFine;
+}
+
 template <class PointType>
 std::vector<MetaRoomUpdateIteration<PointType>> MetaRoom<PointType>::getUpdateIterations()
 {
@@ -242,6 +272,7 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
 
         this->setDeNoisedRoomCloud(cloud_filtered);
         this->setInteriorRoomCloud(cloud_filtered);
+        m_InteriorCloudPyramid.invalidate();
 
         aRoom.setDeNoisedRoomCloud(cloud_filtered);
         aRoom.setInteriorRoomCloud(cloud_filtered);
@@ -332,7 +363,13 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
         Eigen::Matrix4f finalTransform;
         CloudPtr roomCloud = aRoom.getCompleteRoomCloud();
 
-        transformedRoomCloud = NdtRegistration<PointType>::registerClouds(roomCloud, this->getInteriorRoomCloud(),finalTransform);
+        if (m_bCoarseToFineRegistration)
+        {
+            transformedRoomCloud = NdtRegistration<PointType>::registerCloudsCoarseToFine(roomCloud, this->getInteriorRoomCloud(),finalTransform, Eigen::Matrix4f::Identity(),
+                                                                                      &m_NdtTargetCache, this->getInteriorRoomCloudVersion());
+        } else {
+            transformedRoomCloud = NdtRegistration<PointType>::registerClouds(roomCloud, this->getInteriorRoomCloud(),finalTransform);
+        }
         // Update room XML file to reflect new transformation
         aRoom.setRoomTransform(finalTransform);
         ROS_INFO_STREAM("Room alignment complete.");
@@ -388,21 +425,28 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
 
         // compute the differences
         pcl::SegmentDifferences<PointType> segment;
-        segment.setInputCloud(this->getInteriorRoomCloud());
-        segment.setTargetCloud(transformedRoomCloud);
         segment.setDistanceThreshold(0.001);
-
         typename Tree::Ptr tree (new pcl::search::KdTree<PointType>);
-        tree->setInputCloud (transformedRoomCloud);
         segment.setSearchMethod(tree);
 
-        segment.segment(*differenceMetaRoomToRoom);
+        // metaroom points which may change in this update (all of them, unless running coarse-to-fine)
+        CloudPtr metaRoomChanged = this->getInteriorRoomCloud();
+        CloudPtr metaRoomUnchanged(new Cloud);
 
-        segment.setInputCloud(transformedRoomCloud);
-        segment.setTargetCloud(this->getInteriorRoomCloud());
-        tree->setInputCloud(this->getInteriorRoomCloud());
+        if (m_bCoarseToFineUpdate)
+        {
+            metaRoomChanged = CloudPtr(new Cloud);
+            computeDifferencesCoarseToFine(this->getInteriorRoomCloud(), transformedRoomCloud, differenceMetaRoomToRoom, differenceRoomToMetaRoom,
+                                           metaRoomChanged, metaRoomUnchanged);
+        } else {
+            segment.setInputCloud(this->getInteriorRoomCloud());
+            segment.setTargetCloud(transformedRoomCloud);
+            segment.segment(*differenceMetaRoomToRoom);
 
-        segment.segment(*differenceRoomToMetaRoom);
+            segment.setInputCloud(transformedRoomCloud);
+            segment.setTargetCloud(this->getInteriorRoomCloud());
+            segment.segment(*differenceRoomToMetaRoom);
+        }
 
         // apply a statistical noise removal filter
 //        pcl::StatisticalOutlierRemoval<PointType> sor;
@@ -419,10 +463,6 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
         CloudPtr toBeAdded(new Cloud());
         CloudPtr toBeRemoved(new Cloud());
 
-        // Cluster objects
-        std::vector<CloudPtr> vDifferenceMetaRoomToRoomClusters = this->clusterPointCloud(differenceMetaRoomToRoomFiltered,0.05,65,100000);
-        std::vector<CloudPtr> vDifferenceRoomToMetaRoomClusters = this->clusterPointCloud(differenceRoomToMetaRoomFiltered,0.05,65,100000);
-
 
         // filter clusters based on distance
 //        double maxDistance = 3.0; // max of 3 meters
@@ -501,13 +541,20 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
 //            return updateIteration;
 //        } else
         {
+            // only the points which may have changed are compared with the removed points, the rest are kept as they are
             CloudPtr updatedMetaRoomCloud(new Cloud());
-            segment.setInputCloud(this->getInteriorRoomCloud());
+            segment.setInputCloud(metaRoomChanged);
             segment.setTargetCloud(toBeRemoved);
             segment.segment(*updatedMetaRoomCloud);
             if (toBeAdded->points.size()){
                 *updatedMetaRoomCloud += *toBeAdded;
             }
+            if (m_bCoarseToFineUpdate)
+            {
+                m_InteriorCloudPyramid.removePoints(*metaRoomChanged);
+                m_InteriorCloudPyramid.addPoints(*updatedMetaRoomCloud);
+                *updatedMetaRoomCloud += *metaRoomUnchanged;
+            }
 //            ROS_INFO_STREAM("Metaroom update. Points removed: "<<toBeRemoved->points.size()<<"   Points added: "<<toBeAdded->points.size());
 //            {
 //                // apply a statistical noise removal filter
@@ -542,6 +589,72 @@ MetaRoomUpdateIteration<PointType>    MetaRoom<PointType>::updateMetaRoom(Semant
 
 }
 
+template <class PointType>
+void MetaRoom<PointType>::computeDifferencesCoarseToFine(CloudPtr metaRoomCloud, CloudPtr roomCloud, CloudPtr differenceMetaRoomToRoom, CloudPtr differenceRoomToMetaRoom,
+                                                         CloudPtr metaRoomChanged, CloudPtr metaRoomUnchanged)
+{
+    typedef MetaRoomVoxelPyramid<PointType> Pyramid;
+
+    if (!m_InteriorCloudPyramid.isValid(metaRoomCloud->points.size()))
+    {
+        ROS_INFO_STREAM("Building metaroom voxel pyramid");
+        m_InteriorCloudPyramid.build(*metaRoomCloud);
+    }
+    Pyramid roomPyramid(m_InteriorCloudPyramid.getLeafSizes());
+    roomPyramid.build(*roomCloud);
+
+    // coarse pass: find the regions of the finest pyramid level where the occupancy changed
+    typename Pyramid::VoxelSet changedVoxels = m_InteriorCloudPyramid.findChangedVoxels(roomPyramid);
+    const double leafSize = m_InteriorCloudPyramid.getLeafSizes().back();
+
+    // fine pass, at full resolution. The points compared are the ones in the changed voxels and their neighbours; the
+    // points they are compared against come from one more ring of voxels, so that the nearest neighbour of every compared
+    // point is available (the leaf size is larger than the difference threshold).
+    typename Pyramid::VoxelSet compared = Pyramid::dilate(changedVoxels, 1);
+    typename Pyramid::VoxelSet neighbours = Pyramid::dilate(changedVoxels, 2);
+
+    CloudPtr roomCompared(new Cloud), roomUnchanged(new Cloud), roomNeighbours(new Cloud), metaRoomNeighbours(new Cloud), discarded(new Cloud);
+    Pyramid::splitByVoxels(*metaRoomCloud, leafSize, compared, *metaRoomChanged, *metaRoomUnchanged);
+    Pyramid::splitByVoxels(*roomCloud, leafSize, compared, *roomCompared, *roomUnchanged);
+    Pyramid::splitByVoxels(*metaRoomCloud, leafSize, neighbours, *metaRoomNeighbours, *discarded);
+    Pyramid::splitByVoxels(*roomCloud, leafSize, neighbours, *roomNeighbours, *discarded);
+
+    ROS_INFO_STREAM("Coarse-to-fine update: "<<changedVoxels.size()<<" changed voxels. Comparing "<<metaRoomChanged->points.size()<<" out of "<<metaRoomCloud->points.size()
+                    <<" metaroom points and "<<roomCompared->points.size()<<" out of "<<roomCloud->points.size()<<" room points.");
+
+    differenceMetaRoomToRoom->points.clear();
+    differenceRoomToMetaRoom->points.clear();
+
+    pcl::SegmentDifferences<PointType> segment;
+    segment.setDistanceThreshold(0.001);
+    typename Tree::Ptr tree (new pcl::search::KdTree<PointType>);
+    segment.setSearchMethod(tree);
+
+    if (metaRoomChanged->points.size())
+    {
+        if (roomNeighbours->points.size())
+        {
+            segment.setInputCloud(metaRoomChanged);
+            segment.setTargetCloud(roomNeighbours);
+            segment.segment(*differenceMetaRoomToRoom);
+        } else {
+            *differenceMetaRoomToRoom = *metaRoomChanged;
+        }
+    }
+
+    if (roomCompared->points.size())
+    {
+        if (metaRoomNeighbours->points.size())
+        {
+            segment.setInputCloud(roomCompared);
+            segment.setTargetCloud(metaRoomNeighbours);
+            segment.segment(*differenceRoomToMetaRoom);
+        } else {
+            *differenceRoomToMetaRoom = *roomCompared;
+        }
+    }
+}
+
 template <class PointType>
 std::vector<typename pcl::PointCloud<PointType>::Ptr> MetaRoom<PointType>::clusterPointCloud(CloudPtr input_cloud, double tolerance, int min_cluster_size, int max_cluster_size)
 {
@@ -0,0 +1,235 @@
+#ifndef __METAROOM_VOXEL_PYRAMID__H
+#define __METAROOM_VOXEL_PYRAMID__H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+/*
+ * Voxel occupancy pyramid used by the coarse-to-fine metaroom update. Each level stores, for a given leaf size, the
+ * number of points of a cloud falling in each voxel. Comparing the pyramid of the metaroom with the pyramid of a new
+ * observation gives the regions that changed, starting from the coarsest level and only descending into voxels whose
+ * parent changed. The metaroom pyramid is kept up to date incrementally as points are removed from and added to the
+ * metaroom, so it does not need to be rebuilt between updates.
+ */
+template <class PointType>
+class MetaRoomVoxelPyramid {
+public:
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef typename Cloud::Ptr CloudPtr;
+    typedef int64_t VoxelKey;
+    typedef std::unordered_map<VoxelKey, int> VoxelCounts;
+    typedef std::unordered_set<VoxelKey> VoxelSet;
+
+    //! Leaf sizes are ordered from the coarsest to the finest level.
+    MetaRoomVoxelPyramid(const std::vector<double>& leafSizes = std::vector<double>{0.2, 0.08}) : m_vLeafSizes(leafSizes), m_NoPoints(0), m_bValid(false)
+    {
+        m_vLevels.resize(m_vLeafSizes.size());
+    }
+
+    void build(const Cloud& cloud)
+    {
+        for (size_t i=0; i<m_vLeafSizes.size(); i++)
+        {
+            m_vLevels[i] = computeCounts(cloud, m_vLeafSizes[i]);
+        }
+        m_NoPoints = cloud.points.size();
+        m_bValid = true;
+    }
+
+    void addPoints(const Cloud& cloud)
+    {
+        for (size_t i=0; i<m_vLeafSizes.size(); i++)
+        {
+            for (size_t j=0; j<cloud.points.size(); j++)
+            {
+                if (isValidPoint(cloud.points[j]))
+                {
+                    m_vLevels[i][computeKey(cloud.points[j], m_vLeafSizes[i])]++;
+                }
+            }
+        }
+        m_NoPoints += cloud.points.size();
+    }
+
+    void removePoints(const Cloud& cloud)
+    {
+        for (size_t i=0; i<m_vLeafSizes.size(); i++)
+        {
+            for (size_t j=0; j<cloud.points.size(); j++)
+            {
+                if (!isValidPoint(cloud.points[j]))
+                {
+                    continue;
+                }
+                typename VoxelCounts::iterator it = m_vLevels[i].find(computeKey(cloud.points[j], m_vLeafSizes[i]));
+                if ((it != m_vLevels[i].end()) && (--it->second <= 0))
+                {
+                    m_vLevels[i].erase(it);
+                }
+            }
+        }
+        m_NoPoints = (m_NoPoints > cloud.points.size()) ? m_NoPoints - cloud.points.size() : 0;
+    }
+
+    //! The pyramid is only used if it was built from a cloud with the same number of points as the current one.
+    bool isValid(size_t noPoints) const { return m_bValid && (noPoints == m_NoPoints); }
+    void invalidate() { m_bValid = false; }
+
+    const std::vector<double>& getLeafSizes() const { return m_vLeafSizes; }
+    const VoxelCounts& getLevel(size_t level) const { return m_vLevels[level]; }
+    size_t getNumberOfLevels() const { return m_vLevels.size(); }
+
+    /*
+     * Returns the voxels of the finest level where the two pyramids differ. A voxel differs if the point counts differ
+     * by more than changeRatio of the larger count (and by at least minPointDifference points). Finer levels are only
+     * compared inside the (dilated) changed voxels of the level above.
+     */
+    VoxelSet findChangedVoxels(const MetaRoomVoxelPyramid& other, double changeRatio = 0.2, int minPointDifference = 2) const
+    {
+        VoxelSet changed;
+        for (size_t level=0; level<m_vLevels.size(); level++)
+        {
+            VoxelSet parents = (level == 0) ? VoxelSet() : dilate(changed);
+            const double leaf = m_vLeafSizes[level];
+            const double parentLeaf = (level == 0) ? 0.0 : m_vLeafSizes[level-1];
+            changed.clear();
+
+            auto compare = [&](VoxelKey key, int count, const VoxelCounts& otherCounts, bool checkOther) {
+                if (level != 0 && (parents.find(parentKey(key, leaf, parentLeaf)) == parents.end()))
+                {
+                    return;
+                }
+                typename VoxelCounts::const_iterator otherIt = otherCounts.find(key);
+                int otherCount = (otherIt == otherCounts.end()) ? 0 : otherIt->second;
+                if (checkOther && (otherCount != 0))
+                {
+                    // already compared from the other side
+                    return;
+                }
+                int difference = std::abs(count - otherCount);
+                if ((difference >= minPointDifference) && (difference > changeRatio * std::max(count, otherCount)))
+                {
+                    changed.insert(key);
+                }
+            };
+
+            for (typename VoxelCounts::const_iterator it = m_vLevels[level].begin(); it != m_vLevels[level].end(); ++it)
+            {
+                compare(it->first, it->second, other.m_vLevels[level], false);
+            }
+            for (typename VoxelCounts::const_iterator it = other.m_vLevels[level].begin(); it != other.m_vLevels[level].end(); ++it)
+            {
+                compare(it->first, it->second, m_vLevels[level], true);
+            }
+        }
+        return changed;
+    }
+
+    //! Splits the cloud into the points falling inside / outside the given voxels (at the given leaf size).
+    static void splitByVoxels(const Cloud& input, double leafSize, const VoxelSet& voxels, Cloud& inside, Cloud& outside)
+    {
+        inside.points.clear();
+        outside.points.clear();
+        for (size_t i=0; i<input.points.size(); i++)
+        {
+            if (isValidPoint(input.points[i]) && (voxels.find(computeKey(input.points[i], leafSize)) != voxels.end()))
+            {
+                inside.points.push_back(input.points[i]);
+            } else {
+                outside.points.push_back(input.points[i]);
+            }
+        }
+        inside.width = inside.points.size(); inside.height = 1;
+        outside.width = outside.points.size(); outside.height = 1;
+    }
+
+    //! Adds the 26 neighbours of every voxel, radius times.
+    static VoxelSet dilate(const VoxelSet& voxels, int radius = 1)
+    {
+        VoxelSet dilated = voxels;
+        for (int r=0; r<radius; r++)
+        {
+            VoxelSet current = dilated;
+            for (typename VoxelSet::const_iterator it = current.begin(); it != current.end(); ++it)
+            {
+                int x, y, z;
+                unpackKey(*it, x, y, z);
+                for (int dx=-1; dx<=1; dx++)
+                    for (int dy=-1; dy<=1; dy++)
+                        for (int dz=-1; dz<=1; dz++)
+                        {
+                            dilated.insert(packKey(x+dx, y+dy, z+dz));
+                        }
+            }
+        }
+        return dilated;
+    }
+
+    static VoxelCounts computeCounts(const Cloud& cloud, double leafSize)
+    {
+        VoxelCounts counts;
+        for (size_t i=0; i<cloud.points.size(); i++)
+        {
+            if (isValidPoint(cloud.points[i]))
+            {
+                counts[computeKey(cloud.points[i], leafSize)]++;
+            }
+        }
+        return counts;
+    }
+
+    static VoxelKey computeKey(const PointType& point, double leafSize)
+    {
+        return packKey(static_cast<int>(std::floor(point.x / leafSize)),
+                       static_cast<int>(std::floor(point.y / leafSize)),
+                       static_cast<int>(std::floor(point.z / leafSize)));
+    }
+
+private:
+    // 21 bits per axis, i.e. +/- 1 million voxels around the origin
+    static const int KEY_BITS = 21;
+    static const int KEY_OFFSET = 1 << (KEY_BITS - 1);
+    static const int64_t KEY_MASK = (int64_t(1) << KEY_BITS) - 1;
+
+    static VoxelKey packKey(int x, int y, int z)
+    {
+        return ((int64_t(x + KEY_OFFSET) & KEY_MASK) << (2*KEY_BITS)) |
+               ((int64_t(y + KEY_OFFSET) & KEY_MASK) << KEY_BITS) |
+               (int64_t(z + KEY_OFFSET) & KEY_MASK);
+    }
+
+    static void unpackKey(VoxelKey key, int& x, int& y, int& z)
+    {
+        x = static_cast<int>((key >> (2*KEY_BITS)) & KEY_MASK) - KEY_OFFSET;
+        y = static_cast<int>((key >> KEY_BITS) & KEY_MASK) - KEY_OFFSET;
+        z = static_cast<int>(key & KEY_MASK) - KEY_OFFSET;
+    }
+
+    // key of the voxel containing the center of the given voxel, at the coarser leaf size
+    static VoxelKey parentKey(VoxelKey key, double leafSize, double parentLeafSize)
+    {
+        int x, y, z;
+        unpackKey(key, x, y, z);
+        return packKey(static_cast<int>(std::floor((x + 0.5) * leafSize / parentLeafSize)),
+                       static_cast<int>(std::floor((y + 0.5) * leafSize / parentLeafSize)),
+                       static_cast<int>(std::floor((z + 0.5) * leafSize / parentLeafSize)));
+    }
+
+    static bool isValidPoint(const PointType& point)
+    {
+        return pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z);
+    }
+
+    std::vector<double>                     m_vLeafSizes;
+    std::vector<VoxelCounts>                m_vLevels;
+    size_t                                  m_NoPoints;
+    bool                                    m_bValid;
+};
+
+#endif // __METAROOM_VOXEL_PYRAMID__H
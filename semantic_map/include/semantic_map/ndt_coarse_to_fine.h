@@ -0,0 +1,134 @@
+#ifndef __NDT_COARSE_TO_FINE__H
+#define __NDT_COARSE_TO_FINE__H
+
+#include <vector>
+#include <stdint.h>
+#include <unordered_map>
+
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/*
+ * Point-to-distribution NDT (Magnusson) registration, run coarse-to-fine over a schedule of grid resolutions. Each level
+ * starts from the transform found by the previous one and uses a source cloud downsampled for that level.
+ *
+ * The voxel-covariance grids of the target are built once per resolution. They can be kept in an NdtTargetCache together
+ * with a version of the target supplied by the caller (e.g. the update counter of a metaroom), so registering successive
+ * observations against an unchanged target only pays for the source side. Score, gradient and Hessian are accumulated
+ * in parallel over fixed blocks of source points and the blocks are summed in order, so the result does not depend on
+ * the number of threads.
+ */
+
+typedef std::vector<Eigen::Vector3f, Eigen::aligned_allocator<Eigen::Vector3f> > NdtPoints;
+
+//! Gaussians of one target grid. Every occupied voxel also stores the list of gaussians in its 27-neighbourhood, so
+//! a transformed point finds all the gaussians it is scored against with a single lookup.
+class NdtTargetGrid {
+public:
+    struct Cell
+    {
+        Eigen::Vector3f mean;
+        Eigen::Matrix3f inverseCovariance;
+    };
+
+    NdtTargetGrid();
+
+    void build(const NdtPoints& target, double resolution, int minPointsPerCell = 6);
+
+    double getResolution() const { return m_Resolution; }
+    size_t getNoCells() const { return m_vCells.size(); }
+
+    //! Gaussians around point, as a range of m_vNeighbours. Returns false if there are none.
+    bool neighbours(const Eigen::Vector3f& point, const int*& begin, const int*& end) const;
+
+    const Cell& cell(int index) const { return m_vCells[index]; }
+
+private:
+    int64_t computeKey(int x, int y, int z) const;
+
+    double                                                  m_Resolution;
+    std::vector<Cell, Eigen::aligned_allocator<Cell> >      m_vCells;
+    std::unordered_map<int64_t, int>                        m_VoxelToNeighbourhood;    // voxel key -> index into m_vNeighbourOffsets
+    std::vector<int>                                        m_vNeighbourOffsets;
+    std::vector<int>                                        m_vNeighbours;
+};
+
+//! Target grids of one cloud, one per resolution. The grids are rebuilt when the version of the target changes; the
+//! version is not derived from the points, the owner of the target increments it whenever the target is replaced.
+class NdtTargetCache {
+public:
+    NdtTargetCache();
+
+    //! True if grids of all the resolutions have been built for this version of the target.
+    bool isCurrent(uint64_t version, const std::vector<double>& resolutions) const;
+    //! Returns true if the grids had to be (re)built.
+    bool update(const NdtPoints& target, uint64_t version, const std::vector<double>& resolutions);
+    const NdtTargetGrid* getGrid(double resolution) const;
+
+    void clear();
+    int getNoBuilds() const { return m_NoBuilds; }
+
+private:
+    bool                                                    m_bValid;
+    uint64_t                                                m_Version;
+    std::vector<NdtTargetGrid>                              m_vGrids;
+    int                                                     m_NoBuilds;
+};
+
+class NdtCoarseToFine {
+public:
+    struct Level
+    {
+        double resolution;      // NDT grid resolution
+        double sourceLeafSize;  // voxel size used to downsample the source
+        int maxIterations;
+        double stepSize;        // maximum length of one Newton step
+    };
+
+    struct Result
+    {
+        Eigen::Matrix4f transform;
+        double score;               // mean NDT likelihood of the source points at the finest level, higher is better
+        int iterations;             // Newton iterations over all levels
+        bool targetRebuilt;
+        double targetTime, alignTime;
+    };
+
+    //! Default schedule: 2m, 1m and 0.5m grids, the finest level matches the previous single-resolution registration.
+    NdtCoarseToFine();
+
+    std::vector<Level>          m_vLevels;
+    double                      m_OutlierRatio;
+    double                      m_TransformationEpsilon;
+    int                         m_NoThreads;                // 0 uses omp_get_max_threads()
+
+    std::vector<double> getResolutions() const;
+
+    //! The transform maps source to target, starting from initialTransform. If cache is NULL the target grids are
+    //! built for this call only, otherwise they are reused while targetVersion does not change; target may then be
+    //! empty if cache->isCurrent(targetVersion, getResolutions()).
+    Result align(const NdtPoints& source, const NdtPoints& target, const Eigen::Matrix4f& initialTransform = Eigen::Matrix4f::Identity(),
+                 NdtTargetCache* cache = NULL, uint64_t targetVersion = 0) const;
+
+    //! Mean NDT likelihood of the source transformed by transform, with the grid of the given resolution.
+    double score(const NdtPoints& source, const NdtTargetGrid& grid, const Eigen::Matrix4f& transform) const;
+
+    static NdtPoints downsample(const NdtPoints& points, double leafSize);
+
+private:
+    struct Gaussian
+    {
+        double d1, d2;
+    };
+
+    Gaussian computeGaussian(double resolution) const;
+
+    //! Negated NDT score of the transformed points and, if gradient is not NULL, its gradient and Hessian with respect
+    //! to a translation and a rotation vector applied on the left of the current transform.
+    double evaluate(const NdtPoints& points, const NdtTargetGrid& grid, const Gaussian& gaussian,
+                    Eigen::Matrix<double,6,1>* gradient, Eigen::Matrix<double,6,6>* hessian) const;
+
+    int getThreads() const;
+};
+
+#endif
@@ -15,6 +15,8 @@
 #include <pcl/registration/impl/icp.hpp>
 #include <pcl/filters/approximate_voxel_grid.h>
 
+#include "ndt_coarse_to_fine.h"
+
 #include <string>
 #include <vector>
 
@@ -114,6 +116,44 @@ public:
 
         return transformedCloud;
     }
+
+    /*
+     * Coarse-to-fine replacement of registerClouds (see ndt_coarse_to_fine.h). The input clouds are not modified and
+     * nothing is written to disk. If cache is not NULL the target grids are kept in it and reused as long as
+     * targetVersion does not change, the caller increments the version whenever the target cloud changes.
+     */
+    static CloudPtr registerCloudsCoarseToFine(CloudPtr inputCloud, CloudPtr targetCloud, Eigen::Matrix4f& finalTransform, Eigen::Matrix4f initialTransform = Eigen::Matrix4f::Identity(),
+                                               NdtTargetCache* cache = NULL, uint64_t targetVersion = 0, const NdtCoarseToFine& ndt = NdtCoarseToFine())
+    {
+        NdtPoints source = toNdtPoints(*inputCloud);
+        NdtPoints target;
+        if ((cache == NULL) || !cache->isCurrent(targetVersion, ndt.getResolutions()))
+        {
+            target = toNdtPoints(*targetCloud);
+        }
+        NdtCoarseToFine::Result result = ndt.align(source, target, initialTransform, cache, targetVersion);
+        std::cout << "Coarse-to-fine NDT: " << result.iterations << " iterations, score " << result.score << ", target grids " << (result.targetRebuilt ? "built" : "cached")
+                  << " in " << result.targetTime << "s, alignment " << result.alignTime << "s" << std::endl;
+
+        finalTransform = result.transform;
+        CloudPtr transformedCloud(new Cloud());
+        pcl::transformPointCloud (*inputCloud, *transformedCloud, finalTransform);
+        return transformedCloud;
+    }
+
+    static NdtPoints toNdtPoints(const Cloud& cloud)
+    {
+        NdtPoints points;
+        points.reserve(cloud.points.size());
+        for (size_t i=0; i<cloud.points.size(); i++)
+        {
+            if (pcl::isFinite(cloud.points[i]))
+            {
+                points.push_back(cloud.points[i].getVector3fMap());
+            }
+        }
+        return points;
+    }
 };
 
 
@@ -71,6 +71,7 @@ private:
 
     bool                                             m_bIsMetaRoom;
     bool                                             m_bSaveIntermediateClouds;
+    bool                                             m_bSaveIntermediateCloudsAsRGBD;
 
 public:
 
@@ -94,6 +95,8 @@ public:
     int addIntermediateRoomCloud(std::string filename, tf::StampedTransform cloud_tf, image_geometry::PinholeCameraModel cloudCamParams=image_geometry::PinholeCameraModel());
     bool getSaveIntermediateClouds();
     void setSaveIntermediateClouds(bool saveIntermediate);
+    bool getSaveIntermediateCloudsAsRGBD();
+    void setSaveIntermediateCloudsAsRGBD(bool saveAsRGBD); // save intermediate clouds as RGBD views (.rgbd) instead of PCDs
     auto getIntermediateClouds() -> decltype (m_vIntermediateRoomClouds);
 
     void clearIntermediateCloudRegisteredTransforms();
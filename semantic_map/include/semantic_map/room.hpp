@@ -4,7 +4,7 @@
 
 
 template <class PointType>
-SemanticRoom<PointType>::SemanticRoom(bool saveIntermediateClouds) : RoomBase<PointType>(), m_bSaveIntermediateClouds(saveIntermediateClouds), m_DynamicClustersCloud(new SemanticRoom::Cloud()),
+SemanticRoom<PointType>::SemanticRoom(bool saveIntermediateClouds) : RoomBase<PointType>(), m_bSaveIntermediateClouds(saveIntermediateClouds), m_bSaveIntermediateCloudsAsRGBD(false), m_DynamicClustersCloud(new SemanticRoom::Cloud()),
     m_DynamicClustersLoaded(false), m_DynamicClustersFilename("")
 {
     m_RoomStringId = "";
@@ -161,6 +161,18 @@ void SemanticRoom<PointType>::setSaveIntermediateClouds(bool saveIntermediate)
     m_bSaveIntermediateClouds = saveIntermediate;
 }
 
+template <class PointType>
+bool SemanticRoom<PointType>::getSaveIntermediateCloudsAsRGBD()
+{
+    return m_bSaveIntermediateCloudsAsRGBD;
+}
+
+template <class PointType>
+void SemanticRoom<PointType>::setSaveIntermediateCloudsAsRGBD(bool saveAsRGBD)
+{
+    m_bSaveIntermediateCloudsAsRGBD = saveAsRGBD;
+}
+
 template <class PointType>
 auto SemanticRoom<PointType>::getIntermediateClouds() -> decltype(m_vIntermediateRoomClouds)
 {
@@ -14,6 +14,63 @@
 namespace semantic_map_room_utilities
 {
 
+    // True if the view is organized (an image of points), only these can be reprojected
+    template <class PointType>
+    bool isOrganizedView(const pcl::PointCloud<PointType>& cloud)
+    {
+        return (cloud.height > 1) && (size_t(cloud.width) * cloud.height == cloud.points.size());
+    }
+
+    // Reprojects one organized view with the corrected camera parameters. The depth is quantized to mm, as when going
+    // through the depth image. If mergedPoints is not NULL, the reprojected points are also transformed with registeredTransform
+    // and written there (the caller preallocates the merged cloud, each view writing to its own slice of width*height points).
+    // Views which are not organized are copied unchanged and nothing is written to mergedPoints; returns false for these.
+    template <class PointType>
+    bool reprojectIntermediateCloud(const pcl::PointCloud<PointType>& cloud, pcl::PointCloud<PointType>& reprojected,
+                                    const image_geometry::PinholeCameraModel& camParams,
+                                    const Eigen::Matrix4f* registeredTransform = NULL, PointType* mergedPoints = NULL)
+    {
+        const float center_x = camParams.cx();
+        const float center_y = camParams.cy();
+        const float cx = 0.001 / camParams.fx();
+        const float cy = 0.001 / camParams.fy();
+        const float bad_point = std::numeric_limits<float>::quiet_NaN();
+
+        reprojected = cloud;
+        if (!isOrganizedView(cloud))
+        {
+            return false;
+        }
+        const int width = cloud.width, height = cloud.height;
+        for (int y = 0; y < height; ++y) {
+            const PointType* in = &cloud.points[y*width];
+            PointType* out = &reprojected.points[y*width];
+            PointType* merged = mergedPoints ? &mergedPoints[y*width] : NULL;
+            for (int x = 0; x < width; ++x) {
+                uint16_t depth = in[x].z*1000; // convert to uint 16 from meters
+                if (!(depth != 0))
+                {
+                    out[x].x = out[x].y = out[x].z = bad_point;
+                } else {
+                    out[x].x = (x - center_x) * depth * cx;
+                    out[x].y = (y - center_y) * depth * cy;
+                    out[x].z = depth * 0.001f;
+                }
+                out[x].rgb = in[x].rgb;
+
+                if (merged)
+                {
+                    merged[x] = out[x];
+                    if (depth != 0)
+                    {
+                        merged[x].getVector3fMap() = registeredTransform->topLeftCorner<3,3>() * out[x].getVector3fMap() + registeredTransform->topRightCorner<3,1>();
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
     template <class PointType>
     void reprojectIntermediateCloudsUsingCorrectedParams(SemanticRoom<PointType>& aRoom)
     {
@@ -26,56 +83,33 @@ namespace semantic_map_room_utilities
         std::vector<tf::StampedTransform> cloudTransforms = aRoom.getIntermediateCloudTransforms();
         std::vector<CloudPtr> clouds= aRoom.getIntermediateClouds();
 
-        double fx = camParamCorrected[0].fx();
-        double fy = camParamCorrected[0].fy();
-        double center_x = camParamCorrected[0].cx();
-        double center_y = camParamCorrected[0].cy();
-        double cx = 0.001 / fx;
-        double cy = 0.001 / fy;
-
-        aRoom.clearIntermediateClouds();
-
-        if (cloudTransformsReg.size() == clouds.size())
+        if (cloudTransformsReg.size() != clouds.size())
         {
-           for (size_t j=0; j<clouds.size(); j++)
-           {
-              Cloud rebuilt_cloud = *clouds[j];
-              Cloud transformed_cloud;
-
-              RegistrationFeatures reg;
-
-              std::pair<cv::Mat,cv::Mat> rgbAndDepth = reg.createRGBandDepthFromPC(clouds[j]);
-
-              pcl::PointXYZRGB point;
-              for (size_t y = 0; y < rgbAndDepth.first.rows; ++y) {
-                 for (size_t x = 0; x < rgbAndDepth.first.cols; ++x) {
-
-                    uint16_t depth = rgbAndDepth.second.at<u_int16_t>(y, x)/* * 1000*/;
-                    if (!(depth != 0))
-                    {
-                        point.x = point.y = point.z = std::numeric_limits<float>::quiet_NaN();
-                    } else {
-                       point.x = (x - center_x) * depth * cx;
-                       point.y = (y - center_y) * depth * cy;
-                       point.z = depth * 0.001f;
-                    }
-                    uint32_t rgb = ((uint8_t)rgbAndDepth.first.at<cv::Vec3b>(y, x)[2] << 16 | rgbAndDepth.first.at<cv::Vec3b>(y, x)[1] << 8 | rgbAndDepth.first.at<cv::Vec3b>(y, x)[0]);
-                    point.rgb = *reinterpret_cast<float*>(&rgb);
-
-                    rebuilt_cloud.points[y*rgbAndDepth.first.cols + x] = point;
-
-                 }
-              }
-
-              CloudPtr addToRoom(new Cloud());
-              *addToRoom = rebuilt_cloud;
-              aRoom.addIntermediateRoomCloud(addToRoom, cloudTransforms[j], camParamOrig[j]);
-
-           }
-        } else {
             ROS_INFO_STREAM("Cannot rebuild intermediate clouds as the number of intermediate transforms is less than the number of intermediate clouds."<<cloudTransformsReg.size() <<" "<< clouds.size());
             return;
         }
+
+        std::vector<CloudPtr> reprojected(clouds.size());
+        int nr_clouds = clouds.size();
+#pragma omp parallel for schedule(dynamic)
+        for (int j=0; j<nr_clouds; j++)
+        {
+            reprojected[j] = CloudPtr(new Cloud);
+            reprojectIntermediateCloud(*clouds[j], *reprojected[j], camParamCorrected[0]);
+        }
+        for (int j=0; j<nr_clouds; j++)
+        {
+            if (!isOrganizedView(*clouds[j]))
+            {
+                ROS_WARN_STREAM("Intermediate cloud "<<j<<" is not organized, it is kept without reprojecting it.");
+            }
+        }
+
+        aRoom.clearIntermediateClouds();
+        for (size_t j=0; j<reprojected.size(); j++)
+        {
+            aRoom.addIntermediateRoomCloud(reprojected[j], cloudTransforms[j], camParamOrig[j]);
+        }
         return;
     }
 
@@ -93,11 +127,33 @@ namespace semantic_map_room_utilities
 
         if (cloudTransformsReg.size() == clouds.size())
         {
+            // preallocate the merged cloud, each view is transformed into its own slice
+            std::vector<size_t> offsets(clouds.size()+1, 0);
             for (size_t j=0; j<clouds.size(); j++)
             {
-                Cloud transformed_cloud;
-                pcl_ros::transformPointCloud(*clouds[j], transformed_cloud,cloudTransformsReg[j]);
-                *mergedCloudRegistered+=transformed_cloud;
+                offsets[j+1] = offsets[j] + clouds[j]->points.size();
+            }
+            mergedCloudRegistered->points.resize(offsets.back());
+            mergedCloudRegistered->width = offsets.back();
+            mergedCloudRegistered->height = 1;
+            mergedCloudRegistered->is_dense = false;
+
+            int nr_clouds = clouds.size();
+#pragma omp parallel for schedule(dynamic)
+            for (int j=0; j<nr_clouds; j++)
+            {
+                Eigen::Matrix4f transform;
+                pcl_ros::transformAsMatrix(cloudTransformsReg[j], transform);
+                const Cloud& cloud = *clouds[j];
+                PointType* merged = &mergedCloudRegistered->points[offsets[j]];
+                for (size_t k=0; k<cloud.points.size(); k++)
+                {
+                    merged[k] = cloud.points[k];
+                    if (pcl_isfinite(cloud.points[k].x) && pcl_isfinite(cloud.points[k].y) && pcl_isfinite(cloud.points[k].z))
+                    {
+                        merged[k].getVector3fMap() = transform.topLeftCorner<3,3>() * cloud.points[k].getVector3fMap() + transform.topRightCorner<3,1>();
+                    }
+                }
             }
             mergedCloudRegistered->header = roomCompleteCloud->header;
             aRoom.setCompleteRoomCloud(mergedCloudRegistered);
@@ -109,6 +165,66 @@ namespace semantic_map_room_utilities
 
     }
 
+    // Same as reprojectIntermediateCloudsUsingCorrectedParams followed by rebuildRegisteredCloud, in a single parallel pass over the views:
+    // each reprojected point is transformed and written directly into the preallocated merged cloud.
+    template <class PointType>
+    void reprojectAndRebuildRegisteredCloud(SemanticRoom<PointType>& aRoom)
+    {
+        typedef pcl::PointCloud<PointType> Cloud;
+        typedef typename Cloud::Ptr CloudPtr;
+
+        auto camParamOrig = aRoom.getIntermediateCloudCameraParameters();
+        auto camParamCorrected = aRoom.getIntermediateCloudCameraParametersCorrected();
+        std::vector<tf::StampedTransform> cloudTransformsReg = aRoom.getIntermediateCloudTransformsRegistered();
+        std::vector<tf::StampedTransform> cloudTransforms = aRoom.getIntermediateCloudTransforms();
+        std::vector<CloudPtr> clouds= aRoom.getIntermediateClouds();
+        CloudPtr roomCompleteCloud = aRoom.getCompleteRoomCloud();
+
+        if (cloudTransformsReg.size() != clouds.size())
+        {
+            ROS_INFO_STREAM("Cannot reproject and rebuild registered cloud. Not enough registered transforms."<<cloudTransformsReg.size()<<"  "<<clouds.size());
+            return;
+        }
+
+        // each organized view gets a slice of the merged cloud, the others are left out of it
+        std::vector<size_t> offsets(clouds.size()+1, 0);
+        for (size_t j=0; j<clouds.size(); j++)
+        {
+            const bool organized = isOrganizedView(*clouds[j]);
+            if (!organized)
+            {
+                ROS_WARN_STREAM("Intermediate cloud "<<j<<" is not organized, it is kept without reprojecting it and left out of the merged cloud.");
+            }
+            offsets[j+1] = offsets[j] + (organized ? clouds[j]->points.size() : 0);
+        }
+
+        CloudPtr mergedCloudRegistered(new Cloud);
+        mergedCloudRegistered->points.resize(offsets.back());
+        mergedCloudRegistered->width = mergedCloudRegistered->points.size();
+        mergedCloudRegistered->height = 1;
+        mergedCloudRegistered->is_dense = false;
+
+        std::vector<CloudPtr> reprojected(clouds.size());
+        int nr_clouds = clouds.size();
+#pragma omp parallel for schedule(dynamic)
+        for (int j=0; j<nr_clouds; j++)
+        {
+            Eigen::Matrix4f transform;
+            pcl_ros::transformAsMatrix(cloudTransformsReg[j], transform);
+            reprojected[j] = CloudPtr(new Cloud);
+            PointType* merged = (offsets[j+1] > offsets[j]) ? &mergedCloudRegistered->points[offsets[j]] : NULL;
+            reprojectIntermediateCloud(*clouds[j], *reprojected[j], camParamCorrected[0], &transform, merged);
+        }
+
+        aRoom.clearIntermediateClouds();
+        for (size_t j=0; j<reprojected.size(); j++)
+        {
+            aRoom.addIntermediateRoomCloud(reprojected[j], cloudTransforms[j], camParamOrig[j]);
+        }
+        mergedCloudRegistered->header = roomCompleteCloud->header;
+        aRoom.setCompleteRoomCloud(mergedCloudRegistered);
+    }
+
 }
 
 
@@ -24,6 +24,8 @@
 
 #include "room.h"
 
+#include <metaroom_xml_parser/rgbd_view.h>
+
 
 template <class PointType>
 class SemanticRoomXMLParser {
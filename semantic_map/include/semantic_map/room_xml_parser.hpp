@@ -268,7 +268,7 @@ std::string SemanticRoomXMLParser<PointType>::saveRoomAsXML(SemanticRoom<PointTy
         QString intermediateCloudPath = "";
         if (aRoom.getSaveIntermediateClouds())
         {
-            ss << "intermediate_cloud"<<std::setfill('0')<<std::setw(4)<<i<<".pcd";
+            ss << "intermediate_cloud"<<std::setfill('0')<<std::setw(4)<<i<<(aRoom.getSaveIntermediateCloudsAsRGBD()?rgbd_view_utilities::RGBD_VIEW_EXTENSION:std::string(".pcd"));
             intermediateCloudLocalPath = ss.str().c_str();
             intermediateCloudPath = roomFolder + intermediateCloudLocalPath;
         }
@@ -279,7 +279,13 @@ std::string SemanticRoomXMLParser<PointType>::saveRoomAsXML(SemanticRoom<PointTy
             QFile file(intermediateCloudPath);
             if (!file.exists())
             {
-                pcl::io::savePCDFileBinary(intermediateCloudPath.toStdString(), *roomIntermediateClouds[i]);
+                if (aRoom.getSaveIntermediateCloudsAsRGBD())
+                {
+                    RGBDView view = rgbd_view_utilities::createRGBDViewFromPC(roomIntermediateClouds[i], roomIntermediateCloudCameraParameters[i], roomIntermediateCloudTransforms[i]);
+                    rgbd_view_utilities::saveRGBDView(intermediateCloudPath.toStdString(), view);
+                } else {
+                    pcl::io::savePCDFileBinary(intermediateCloudPath.toStdString(), *roomIntermediateClouds[i]);
+                }
                 if (verbose)
                 {
                     ROS_INFO_STREAM("Saving intermediate cloud file name "<<intermediateCloudPath.toStdString());
@@ -767,6 +773,12 @@ SemanticRoom<PointType> SemanticRoomXMLParser<PointType>::loadRoomFromXML(const
                     intermediateCloudData.filename=roomFolder.toStdString() + "/" + intermediateCloudData.filename;
                 }
 
+                if (rgbd_view_utilities::isRGBDViewFile(intermediateCloudData.filename))
+                {
+                    // keep the storage format when the room is saved again
+                    aRoom.setSaveIntermediateCloudsAsRGBD(true);
+                }
+
                 std::ifstream file(intermediateCloudData.filename.c_str());
                 if (deepLoad && file)
                 {
@@ -774,9 +786,16 @@ SemanticRoom<PointType> SemanticRoomXMLParser<PointType>::loadRoomFromXML(const
                     {
                         std::cout<<"Loading intermediate cloud file name "<<intermediateCloudData.filename<<std::endl;
                     }
-                    pcl::PCDReader reader;
                     CloudPtr cloud (new Cloud);
-                    reader.read (intermediateCloudData.filename, *cloud);
+                    RGBDView view;
+                    if (rgbd_view_utilities::isRGBDViewFile(intermediateCloudData.filename) && rgbd_view_utilities::loadRGBDView(intermediateCloudData.filename, view))
+                    {
+                        cloud = rgbd_view_utilities::createPCFromRGBDView<PointType>(view);
+                    } else {
+                        // PCD file, or the fallback for a view which couldn't be read
+                        pcl::PCDReader reader;
+                        reader.read (rgbd_view_utilities::getPCDFilename(intermediateCloudData.filename), *cloud);
+                    }
                     aRoom.addIntermediateRoomCloud(cloud, intermediateCloudData.transform,aCameraModel);
                 } else {
                     aRoom.addIntermediateRoomCloud(intermediateCloudData.filename, intermediateCloudData.transform,aCameraModel);
@@ -31,6 +31,7 @@ protected:
     CloudPtr                                         m_InteriorRoomCloud;
     bool                                             m_InteriorRoomCloudLoaded;
     std::string                                      m_InteriorRoomCloudFilename;
+    uint64_t                                         m_InteriorRoomCloudVersion;
 
     CloudPtr                                         m_DeNoisedRoomCloud;
     bool                                             m_DeNoisedRoomCloudLoaded;
@@ -58,6 +59,8 @@ public:
     void setInteriorRoomCloud(std::string interiorCloud);
     CloudPtr getInteriorRoomCloud();
     bool getInteriorRoomCloudLoaded();
+    //! Incremented every time the interior cloud is set, e.g. to key data derived from it
+    uint64_t getInteriorRoomCloudVersion();
     std::string getInteriorRoomCloudFilename();
 
     void setDeNoisedRoomCloud(CloudPtr denoisedCloud);
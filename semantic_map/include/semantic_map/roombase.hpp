@@ -2,7 +2,7 @@
 
 template <class PointType>
 RoomBase<PointType>::RoomBase() : m_CompleteRoomCloud(new Cloud()), m_RoomCentroid(0.0,0.0,0.0,0.0), m_CompleteRoomCloudFilename(""), m_CompleteRoomCloudLoaded(false),
-    m_InteriorRoomCloud(new Cloud()), m_InteriorRoomCloudLoaded(false), m_DeNoisedRoomCloud(new Cloud()), m_DeNoisedRoomCloudLoaded(false)
+    m_InteriorRoomCloud(new Cloud()), m_InteriorRoomCloudLoaded(false), m_InteriorRoomCloudVersion(0), m_DeNoisedRoomCloud(new Cloud()), m_DeNoisedRoomCloudLoaded(false)
 {
     m_RoomTransform = Eigen::Matrix4f::Identity();
 }
@@ -70,6 +70,7 @@ void RoomBase<PointType>::setInteriorRoomCloud(CloudPtr interiorCloud)
 {
     *m_InteriorRoomCloud = *interiorCloud;
     m_InteriorRoomCloudLoaded = true;
+    m_InteriorRoomCloudVersion++;
 }
 
 template <class PointType>
@@ -77,6 +78,7 @@ void RoomBase<PointType>::setInteriorRoomCloud(std::string interiorCloud)
 {
     m_InteriorRoomCloudLoaded = false;
     m_InteriorRoomCloudFilename = interiorCloud;
+    m_InteriorRoomCloudVersion++;
 }
 
 template <class PointType>
@@ -101,6 +103,12 @@ bool RoomBase<PointType>::getInteriorRoomCloudLoaded()
     return m_InteriorRoomCloudLoaded;
 }
 
+template <class PointType>
+uint64_t RoomBase<PointType>::getInteriorRoomCloudVersion()
+{
+    return m_InteriorRoomCloudVersion;
+}
+
 template <class PointType>
 std::string RoomBase<PointType>::getInteriorRoomCloudFilename()
 {
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <stdlib.h>
 #include <string>
+#include <algorithm>
 
 // ROS includes
 #include "ros/ros.h"
@@ -91,6 +92,8 @@ private:
     bool                                                                        m_bUpdateMetaroom;
     bool                                                                        m_bNewestClusters;
     bool                                                                        m_bUseNDTRegistration;
+    bool                                                                        m_bCoarseToFineUpdate;
+    bool                                                                        m_bCoarseToFineRegistration;
 	int									m_MinObjectSize;
 
 };
@@ -150,6 +153,22 @@ SemanticMapNode<PointType>::SemanticMapNode(ros::NodeHandle nh) : m_messageStore
 //    }
 
 
+    m_NodeHandle.param<bool>("coarse_to_fine_metaroom_update",m_bCoarseToFineUpdate,false);
+    if (m_bCoarseToFineUpdate)
+    {
+        ROS_INFO_STREAM("The metarooms will be updated coarse-to-fine and kept in memory between observations.");
+    } else {
+        ROS_INFO_STREAM("The metarooms will be updated at full resolution.");
+    }
+
+    m_NodeHandle.param<bool>("coarse_to_fine_registration",m_bCoarseToFineRegistration,false);
+    if (m_bCoarseToFineRegistration)
+    {
+        ROS_INFO_STREAM("Rooms will be registered with coarse-to-fine NDT.");
+    } else {
+        ROS_INFO_STREAM("Rooms will be registered with single resolution NDT.");
+    }
+
     m_NodeHandle.param<int>("min_object_size",m_MinObjectSize,500);
     ROS_INFO_STREAM("Min object size set to"<<m_MinObjectSize);
 
@@ -269,6 +288,9 @@ void SemanticMapNode<PointType>::processRoomObservation(std::string xml_file_nam
         matchingMetaroomXML+="/metaroom.xml";
     }
 
+    metaroom->setCoarseToFineUpdate(m_bCoarseToFineUpdate);
+    metaroom->setCoarseToFineRegistration(m_bCoarseToFineRegistration);
+
     if (!found)
     {
         ROS_INFO_STREAM("Initializing metaroom.");
@@ -335,7 +357,12 @@ void SemanticMapNode<PointType>::processRoomObservation(std::string xml_file_nam
             ROS_INFO_STREAM("Registration done using the observation_registration_server service. Number of constraints "<<srv.response.total_correspondences);
             if (srv.response.total_correspondences <= 0){
                 ROS_ERROR_STREAM("Registration unsuccessful due to insufficient constraints. Will use the default NDT registration");
-                CloudPtr transformedRoomCloud = NdtRegistration<PointType>::registerClouds(room_complete_cloud, prevCloud,registered_transform);
+                if (m_bCoarseToFineRegistration)
+                {
+                    CloudPtr transformedRoomCloud = NdtRegistration<PointType>::registerCloudsCoarseToFine(room_complete_cloud, prevCloud,registered_transform);
+                } else {
+                    CloudPtr transformedRoomCloud = NdtRegistration<PointType>::registerClouds(room_complete_cloud, prevCloud,registered_transform);
+                }
             } else {
                 // registration successfull -> get registered transform
                 tf::Transform tf_registered_transform;
@@ -411,6 +438,11 @@ void SemanticMapNode<PointType>::processRoomObservation(std::string xml_file_nam
         msg_metaroom.header.frame_id="/map";
         m_PublisherMetaroom.publish(msg_metaroom);
     //    m_vLoadedMetarooms.push_back(metaroom); // don't keep data in memory
+        if (m_bCoarseToFineUpdate && (std::find(m_vLoadedMetarooms.begin(), m_vLoadedMetarooms.end(), metaroom) == m_vLoadedMetarooms.end()))
+        {
+            // keep the metaroom (and its voxel pyramid) for the next observation at this location
+            m_vLoadedMetarooms.push_back(metaroom);
+        }
         ROS_INFO_STREAM("Published metaroom");
 
         CloudPtr room_interior_cloud = aRoom.getInteriorRoomCloud();
@@ -0,0 +1,78 @@
+#include <semantic_map/room_xml_parser.h>
+#include <semantic_map/semantic_map_summary_parser.h>
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <vector>
+
+typedef pcl::PointXYZRGB PointType;
+
+typedef typename SemanticMapSummaryParser::EntityStruct Entities;
+
+using namespace std;
+
+size_t fileSize(const std::string& file)
+{
+    struct stat fileStat;
+    if (stat(file.c_str(), &fileStat) != 0)
+    {
+        return 0;
+    }
+    return fileStat.st_size;
+}
+
+// Converts the intermediate clouds of all the sweeps in a folder from organized PCDs to RGBD views (.rgbd)
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout<<"Please provide the folder containing the sweeps to convert. Pass --keep-pcds as a second argument to keep the original PCD files."<<endl;
+        return -1;
+    }
+
+    bool keepPcds = (argc > 2) && (string(argv[2]) == "--keep-pcds");
+
+    string folderPath = argv[1] + string("/");
+    SemanticMapSummaryParser summary_parser(folderPath + string("index.xml"));
+    summary_parser.createSummaryXML<PointType>(folderPath);
+    std::vector<Entities> allSweeps = summary_parser.getRooms();
+
+    size_t totalBefore = 0, totalAfter = 0;
+    for (size_t i=0; i<allSweeps.size(); i++)
+    {
+        string sweepXml = allSweeps[i].roomXmlFile;
+        cout<<"Converting "<<sweepXml<<endl;
+
+        SemanticRoom<PointType> aRoom = SemanticRoomXMLParser<PointType>::loadRoomFromXML(sweepXml,true);
+        if (aRoom.getSaveIntermediateCloudsAsRGBD())
+        {
+            cout<<"Already converted"<<endl;
+            continue;
+        }
+        std::vector<std::string> oldFiles;
+        for (size_t j=0; j<aRoom.getIntermediateClouds().size(); j++)
+        {
+            stringstream ss; ss<<sweepXml.substr(0, sweepXml.find_last_of('/')+1)<<"intermediate_cloud"<<std::setfill('0')<<std::setw(4)<<j<<".pcd";
+            oldFiles.push_back(ss.str());
+        }
+
+        aRoom.setSaveIntermediateClouds(true);
+        aRoom.setSaveIntermediateCloudsAsRGBD(true);
+        SemanticRoomXMLParser<PointType> parser;
+        parser.setRootFolderFromRoomXml(sweepXml);
+        parser.saveRoomAsXML(aRoom, sweepXml.substr(sweepXml.find_last_of('/')+1));
+
+        for (const string& oldFile : oldFiles)
+        {
+            string newFile = rgbd_view_utilities::getRGBDViewFilename(oldFile);
+            totalBefore += fileSize(oldFile);
+            totalAfter += fileSize(newFile);
+            if (!keepPcds && fileSize(newFile))
+            {
+                remove(oldFile.c_str());
+            }
+        }
+    }
+
+    cout<<"Intermediate data size before "<<totalBefore/(1024*1024)<<" MB, after "<<totalAfter/(1024*1024)<<" MB"<<endl;
+}
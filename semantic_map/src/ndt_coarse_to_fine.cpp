@@ -0,0 +1,503 @@
+#include "semantic_map/ndt_coarse_to_fine.h"
+#include <metaroom_xml_parser/timing.h>
+
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+    const int NDT_BLOCK_SIZE = 256;
+
+    using timing_utilities::getTime;
+
+    bool isFinite(const Eigen::Vector3f& p)
+    {
+        return std::isfinite(p(0)) && std::isfinite(p(1)) && std::isfinite(p(2));
+    }
+
+    int64_t voxelKey(int x, int y, int z)
+    {
+        // 21 bits per axis
+        return ((int64_t)(x + (1 << 20)) << 42) | ((int64_t)(y + (1 << 20)) << 21) | (int64_t)(z + (1 << 20));
+    }
+
+    void voxelCoordinates(const Eigen::Vector3f& p, double resolution, int& x, int& y, int& z)
+    {
+        x = (int)std::floor(p(0) / resolution);
+        y = (int)std::floor(p(1) / resolution);
+        z = (int)std::floor(p(2) / resolution);
+    }
+
+    Eigen::Matrix4f incrementToMatrix(const Eigen::Matrix<double,6,1>& increment)
+    {
+        Eigen::Vector3d w = increment.tail<3>();
+        Eigen::Matrix4f m = Eigen::Matrix4f::Identity();
+        if (w.norm() > 0)
+        {
+            m.topLeftCorner<3,3>() = Eigen::AngleAxisd(w.norm(), w.normalized()).toRotationMatrix().cast<float>();
+        }
+        m.topRightCorner<3,1>() = increment.head<3>().cast<float>();
+        return m;
+    }
+
+    void transformPoints(const NdtPoints& points, const Eigen::Matrix4f& transform, NdtPoints& out)
+    {
+        out.resize(points.size());
+        Eigen::Matrix3f rotation = transform.topLeftCorner<3,3>();
+        Eigen::Vector3f translation = transform.topRightCorner<3,1>();
+        for (size_t i=0; i<points.size(); i++)
+        {
+            out[i] = rotation * points[i] + translation;
+        }
+    }
+}
+
+NdtTargetGrid::NdtTargetGrid() : m_Resolution(0)
+{
+}
+
+int64_t NdtTargetGrid::computeKey(int x, int y, int z) const
+{
+    return voxelKey(x, y, z);
+}
+
+void NdtTargetGrid::build(const NdtPoints& target, double resolution, int minPointsPerCell)
+{
+    m_Resolution = resolution;
+    m_vCells.clear();
+    m_VoxelToNeighbourhood.clear();
+    m_vNeighbourOffsets.clear();
+    m_vNeighbours.clear();
+
+    // accumulate first and second moments per voxel
+    std::unordered_map<int64_t, int> voxelToAccumulator;
+    std::vector<Eigen::Vector3i> voxels;
+    std::vector<double> moments; // count, 3 sums, 6 products
+    for (size_t i=0; i<target.size(); i++)
+    {
+        const Eigen::Vector3f& p = target[i];
+        if (!isFinite(p))
+        {
+            continue;
+        }
+        int x, y, z;
+        voxelCoordinates(p, resolution, x, y, z);
+        std::pair<std::unordered_map<int64_t, int>::iterator, bool> inserted = voxelToAccumulator.insert(std::make_pair(computeKey(x, y, z), (int)voxels.size()));
+        if (inserted.second)
+        {
+            voxels.push_back(Eigen::Vector3i(x, y, z));
+            moments.resize(moments.size() + 10, 0.0);
+        }
+        double* m = &moments[10 * inserted.first->second];
+        m[0] += 1;
+        m[1] += p(0); m[2] += p(1); m[3] += p(2);
+        m[4] += p(0) * p(0); m[5] += p(0) * p(1); m[6] += p(0) * p(2);
+        m[7] += p(1) * p(1); m[8] += p(1) * p(2); m[9] += p(2) * p(2);
+    }
+
+    // gaussians, with the smallest eigenvalues inflated so that planar voxels stay invertible (as in pcl::VoxelGridCovariance)
+    std::vector<int> cellOfVoxel(voxels.size(), -1);
+    for (size_t v=0; v<voxels.size(); v++)
+    {
+        const double* m = &moments[10 * v];
+        if (m[0] < minPointsPerCell)
+        {
+            continue;
+        }
+        Eigen::Vector3d mean(m[1] / m[0], m[2] / m[0], m[3] / m[0]);
+        Eigen::Matrix3d products;
+        products << m[4], m[5], m[6],
+                    m[5], m[7], m[8],
+                    m[6], m[8], m[9];
+        Eigen::Matrix3d covariance = (products - m[0] * mean * mean.transpose()) / (m[0] - 1);
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+        Eigen::Vector3d eigenvalues = solver.eigenvalues();
+        if (!(eigenvalues(2) > 0))
+        {
+            continue;
+        }
+        for (int k=0; k<2; k++)
+        {
+            eigenvalues(k) = std::max(eigenvalues(k), 0.01 * eigenvalues(2));
+        }
+        Eigen::Matrix3d inverse = solver.eigenvectors() * eigenvalues.cwiseInverse().asDiagonal() * solver.eigenvectors().transpose();
+
+        Cell cell;
+        cell.mean = mean.cast<float>();
+        cell.inverseCovariance = inverse.cast<float>();
+        cellOfVoxel[v] = (int)m_vCells.size();
+        m_vCells.push_back(cell);
+    }
+
+    // every voxel next to a gaussian gets the list of gaussians around it, sorted by voxel and gaussian
+    std::vector<std::pair<int64_t, int> > entries;
+    entries.reserve(27 * m_vCells.size());
+    for (size_t v=0; v<voxels.size(); v++)
+    {
+        if (cellOfVoxel[v] < 0)
+        {
+            continue;
+        }
+        for (int dx=-1; dx<=1; dx++)
+            for (int dy=-1; dy<=1; dy++)
+                for (int dz=-1; dz<=1; dz++)
+                {
+                    entries.push_back(std::make_pair(computeKey(voxels[v](0) + dx, voxels[v](1) + dy, voxels[v](2) + dz), cellOfVoxel[v]));
+                }
+    }
+    std::sort(entries.begin(), entries.end());
+    m_vNeighbours.resize(entries.size());
+    for (size_t i=0; i<entries.size(); i++)
+    {
+        if ((i == 0) || (entries[i].first != entries[i-1].first))
+        {
+            m_VoxelToNeighbourhood[entries[i].first] = (int)m_vNeighbourOffsets.size();
+            m_vNeighbourOffsets.push_back((int)i);
+        }
+        m_vNeighbours[i] = entries[i].second;
+    }
+    m_vNeighbourOffsets.push_back((int)entries.size());
+}
+
+bool NdtTargetGrid::neighbours(const Eigen::Vector3f& point, const int*& begin, const int*& end) const
+{
+    int x, y, z;
+    voxelCoordinates(point, m_Resolution, x, y, z);
+    std::unordered_map<int64_t, int>::const_iterator it = m_VoxelToNeighbourhood.find(computeKey(x, y, z));
+    if (it == m_VoxelToNeighbourhood.end())
+    {
+        return false;
+    }
+    begin = &m_vNeighbours[m_vNeighbourOffsets[it->second]];
+    end = &m_vNeighbours[0] + m_vNeighbourOffsets[it->second + 1];
+    return true;
+}
+
+NdtTargetCache::NdtTargetCache() : m_bValid(false), m_Version(0), m_NoBuilds(0)
+{
+}
+
+bool NdtTargetCache::isCurrent(uint64_t version, const std::vector<double>& resolutions) const
+{
+    if (!m_bValid || (version != m_Version))
+    {
+        return false;
+    }
+    for (size_t i=0; i<resolutions.size(); i++)
+    {
+        if (getGrid(resolutions[i]) == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NdtTargetCache::update(const NdtPoints& target, uint64_t version, const std::vector<double>& resolutions)
+{
+    if (!m_bValid || (version != m_Version))
+    {
+        m_vGrids.clear();
+        m_Version = version;
+        m_bValid = true;
+    }
+
+    bool built = false;
+    for (size_t i=0; i<resolutions.size(); i++)
+    {
+        if (getGrid(resolutions[i]) != NULL)
+        {
+            continue;
+        }
+        m_vGrids.push_back(NdtTargetGrid());
+        m_vGrids.back().build(target, resolutions[i]);
+        built = true;
+    }
+    if (built)
+    {
+        m_NoBuilds++;
+    }
+    return built;
+}
+
+const NdtTargetGrid* NdtTargetCache::getGrid(double resolution) const
+{
+    for (size_t i=0; i<m_vGrids.size(); i++)
+    {
+        if (std::fabs(m_vGrids[i].getResolution() - resolution) < 1e-9)
+        {
+            return &m_vGrids[i];
+        }
+    }
+    return NULL;
+}
+
+void NdtTargetCache::clear()
+{
+    m_vGrids.clear();
+    m_bValid = false;
+}
+
+NdtCoarseToFine::NdtCoarseToFine() : m_OutlierRatio(0.55), m_TransformationEpsilon(0.001), m_NoThreads(0)
+{
+    Level coarse = {2.0, 0.8, 10, 0.4};
+    Level medium = {1.0, 0.4, 15, 0.2};
+    Level fine   = {0.5, 0.2, 30, 0.1};
+    m_vLevels.push_back(coarse);
+    m_vLevels.push_back(medium);
+    m_vLevels.push_back(fine);
+}
+
+int NdtCoarseToFine::getThreads() const
+{
+    if (m_NoThreads > 0)
+    {
+        return m_NoThreads;
+    }
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+NdtCoarseToFine::Gaussian NdtCoarseToFine::computeGaussian(double resolution) const
+{
+    // constants of the mixture of a gaussian and a uniform outlier distribution, as in pcl::NormalDistributionsTransform
+    double c1 = 10.0 * (1 - m_OutlierRatio);
+    double c2 = m_OutlierRatio / std::pow(resolution, 3);
+    double d3 = -std::log(c2);
+    Gaussian gaussian;
+    gaussian.d1 = -std::log(c1 + c2) - d3;
+    gaussian.d2 = -2 * std::log((-std::log(c1 * std::exp(-0.5) + c2) - d3) / gaussian.d1);
+    return gaussian;
+}
+
+NdtPoints NdtCoarseToFine::downsample(const NdtPoints& points, double leafSize)
+{
+    std::unordered_map<int64_t, int> voxelToPoint;
+    std::vector<Eigen::Vector4d, Eigen::aligned_allocator<Eigen::Vector4d> > sums;
+    for (size_t i=0; i<points.size(); i++)
+    {
+        if (!isFinite(points[i]))
+        {
+            continue;
+        }
+        int x, y, z;
+        voxelCoordinates(points[i], leafSize, x, y, z);
+        std::pair<std::unordered_map<int64_t, int>::iterator, bool> inserted = voxelToPoint.insert(std::make_pair(voxelKey(x, y, z), (int)sums.size()));
+        if (inserted.second)
+        {
+            sums.push_back(Eigen::Vector4d::Zero());
+        }
+        sums[inserted.first->second] += Eigen::Vector4d(points[i](0), points[i](1), points[i](2), 1.0);
+    }
+
+    NdtPoints downsampled(sums.size());
+    for (size_t i=0; i<sums.size(); i++)
+    {
+        downsampled[i] = (sums[i].head<3>() / sums[i](3)).cast<float>();
+    }
+    return downsampled;
+}
+
+double NdtCoarseToFine::evaluate(const NdtPoints& points, const NdtTargetGrid& grid, const Gaussian& gaussian,
+                                 Eigen::Matrix<double,6,1>* gradient, Eigen::Matrix<double,6,6>* hessian) const
+{
+    const int noBlocks = ((int)points.size() + NDT_BLOCK_SIZE - 1) / NDT_BLOCK_SIZE;
+    const bool derivatives = (gradient != NULL);
+    std::vector<double> blockScores(noBlocks, 0.0);
+    std::vector<Eigen::Matrix<double,6,1>, Eigen::aligned_allocator<Eigen::Matrix<double,6,1> > > blockGradients(derivatives ? noBlocks : 0);
+    std::vector<Eigen::Matrix<double,6,6>, Eigen::aligned_allocator<Eigen::Matrix<double,6,6> > > blockHessians(derivatives ? noBlocks : 0);
+
+#pragma omp parallel for schedule(static) num_threads(getThreads()) if(noBlocks > 1)
+    for (int b=0; b<noBlocks; b++)
+    {
+        double score = 0;
+        Eigen::Matrix<double,6,1> g = Eigen::Matrix<double,6,1>::Zero();
+        Eigen::Matrix<double,6,6> H = Eigen::Matrix<double,6,6>::Zero();
+        const int last = std::min((int)points.size(), (b + 1) * NDT_BLOCK_SIZE);
+        for (int i=b*NDT_BLOCK_SIZE; i<last; i++)
+        {
+            const Eigen::Vector3d y = points[i].cast<double>();
+            const int* begin;
+            const int* end;
+            if (!grid.neighbours(points[i], begin, end))
+            {
+                continue;
+            }
+            for (const int* c=begin; c!=end; c++)
+            {
+                const NdtTargetGrid::Cell& cell = grid.cell(*c);
+                const Eigen::Vector3d x = y - cell.mean.cast<double>();
+                if (x.squaredNorm() > grid.getResolution() * grid.getResolution())
+                {
+                    // only the gaussians within one resolution of the point, like the radius search of pcl::NormalDistributionsTransform
+                    continue;
+                }
+                const Eigen::Matrix3d A = cell.inverseCovariance.cast<double>();
+                const Eigen::Vector3d Ax = A * x;
+                const double e = std::exp(-0.5 * gaussian.d2 * x.dot(Ax));
+                if (!(e <= 1.0))
+                {
+                    continue;
+                }
+                score += gaussian.d1 * e;
+                if (!derivatives)
+                {
+                    continue;
+                }
+
+                // jacobian of the point w.r.t. (translation, rotation vector) is [I, -[y]x]
+                Eigen::Matrix<double,6,1> v;
+                v.head<3>() = Ax;
+                v.tail<3>() = y.cross(Ax);
+                Eigen::Matrix<double,3,6> J;
+                J.leftCols<3>().setIdentity();
+                J.rightCols<3>() << 0, y(2), -y(1),
+                                    -y(2), 0, y(0),
+                                    y(1), -y(0), 0;
+                const double c1 = -gaussian.d1 * gaussian.d2 * e;
+                g += c1 * v;
+                Eigen::Matrix<double,6,6> h = J.transpose() * A * J - gaussian.d2 * v * v.transpose();
+                // second derivative of the rotated point, symmetrised: 0.5 (e_l y_k + e_k y_l) - y delta_kl
+                h.bottomRightCorner<3,3>() += 0.5 * (Ax * y.transpose() + y * Ax.transpose()) - Ax.dot(y) * Eigen::Matrix3d::Identity();
+                H += c1 * h;
+            }
+        }
+        blockScores[b] = score;
+        if (derivatives)
+        {
+            blockGradients[b] = g;
+            blockHessians[b] = H;
+        }
+    }
+
+    // summed in block order, independent of the number of threads
+    double score = 0;
+    if (derivatives)
+    {
+        gradient->setZero();
+        hessian->setZero();
+    }
+    for (int b=0; b<noBlocks; b++)
+    {
+        score += blockScores[b];
+        if (derivatives)
+        {
+            *gradient += blockGradients[b];
+            *hessian += blockHessians[b];
+        }
+    }
+    return score;
+}
+
+double NdtCoarseToFine::score(const NdtPoints& source, const NdtTargetGrid& grid, const Eigen::Matrix4f& transform) const
+{
+    if (source.empty())
+    {
+        return 0;
+    }
+    NdtPoints transformed;
+    transformPoints(source, transform, transformed);
+    return -evaluate(transformed, grid, computeGaussian(grid.getResolution()), NULL, NULL) / source.size();
+}
+
+std::vector<double> NdtCoarseToFine::getResolutions() const
+{
+    std::vector<double> resolutions;
+    for (size_t l=0; l<m_vLevels.size(); l++)
+    {
+        resolutions.push_back(m_vLevels[l].resolution);
+    }
+    return resolutions;
+}
+
+NdtCoarseToFine::Result NdtCoarseToFine::align(const NdtPoints& source, const NdtPoints& target, const Eigen::Matrix4f& initialTransform,
+                                                NdtTargetCache* cache, uint64_t targetVersion) const
+{
+    Result result;
+    result.transform = initialTransform;
+    result.score = 0;
+    result.iterations = 0;
+
+    double start = getTime();
+    NdtTargetCache localCache;
+    if (cache == NULL)
+    {
+        cache = &localCache;
+    }
+    result.targetRebuilt = cache->update(target, targetVersion, getResolutions());
+    result.targetTime = getTime() - start;
+
+    start = getTime();
+    NdtPoints levelSource;
+    for (size_t l=0; l<m_vLevels.size(); l++)
+    {
+        const Level& level = m_vLevels[l];
+        const NdtTargetGrid& grid = *cache->getGrid(level.resolution);
+        const Gaussian gaussian = computeGaussian(level.resolution);
+        levelSource = downsample(source, level.sourceLeafSize);
+
+        NdtPoints transformed;
+        transformPoints(levelSource, result.transform, transformed);
+        Eigen::Matrix<double,6,1> gradient;
+        Eigen::Matrix<double,6,6> hessian;
+        double current = evaluate(transformed, grid, gaussian, &gradient, &hessian);
+
+        for (int iteration=0; iteration<level.maxIterations; iteration++)
+        {
+            result.iterations++;
+
+            // Newton step, with the Hessian made positive definite by raising its small or negative eigenvalues
+            Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double,6,6> > solver(hessian);
+            Eigen::Matrix<double,6,1> eigenvalues = solver.eigenvalues();
+            double largest = std::max(eigenvalues.cwiseAbs().maxCoeff(), 1e-12);
+            for (int k=0; k<6; k++)
+            {
+                eigenvalues(k) = std::max(eigenvalues(k), 1e-3 * largest);
+            }
+            Eigen::Matrix<double,6,1> step = -(solver.eigenvectors() * eigenvalues.cwiseInverse().asDiagonal() * solver.eigenvectors().transpose()) * gradient;
+            if (step.norm() > level.stepSize)
+            {
+                step *= level.stepSize / step.norm();
+            }
+
+            // backtracking line search on the score
+            bool accepted = false;
+            Eigen::Matrix4f candidate;
+            for (int k=0; k<10; k++)
+            {
+                candidate = incrementToMatrix(step) * result.transform;
+                transformPoints(levelSource, candidate, transformed);
+                if (evaluate(transformed, grid, gaussian, NULL, NULL) < current)
+                {
+                    accepted = true;
+                    break;
+                }
+                step *= 0.5;
+            }
+            if (!accepted)
+            {
+                break;
+            }
+            result.transform = candidate;
+            current = evaluate(transformed, grid, gaussian, &gradient, &hessian);
+            if (step.norm() < m_TransformationEpsilon)
+            {
+                break;
+            }
+        }
+
+        if (l + 1 == m_vLevels.size())
+        {
+            result.score = levelSource.empty() ? 0 : -current / levelSource.size();
+        }
+    }
+    result.alignTime = getTime() - start;
+    return result;
+}
@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/common/transforms.h>
+
+#include "semantic_map/ndt_registration.h"
+#include <metaroom_xml_parser/timing.h>
+
+/*
+ * Accuracy and latency of NdtRegistration::registerClouds (single resolution pcl NDT) against
+ * NdtRegistration::registerCloudsCoarseToFine, which is run twice: building its target grids in every trial, and with
+ * the grids kept in an NdtTargetCache (marked *), as for a metaroom which has not changed since the last observation.
+ *
+ * ndt_registration_benchmark [target.pcd] [source.pcd] [trials]
+ *
+ * The source (the target itself if only one cloud is given, a synthetic room if none) is moved by a random transform of
+ * up to 30cm and 6 degrees around the vertical axis in every trial, and both methods have to recover that transform.
+ * The source should already be aligned with the target, e.g. an interior cloud and a registered observation.
+ * registerClouds writes room_scan2_transformed.pcd in the working directory at every call.
+ */
+
+typedef pcl::PointXYZRGB PointType;
+typedef pcl::PointCloud<PointType> Cloud;
+typedef Cloud::Ptr CloudPtr;
+
+using timing_utilities::getTime;
+
+double uniform()
+{
+    return double(rand()) / double(RAND_MAX);
+}
+
+void addPlane(CloudPtr cloud, Eigen::Vector3f origin, Eigen::Vector3f u, Eigen::Vector3f v, double density)
+{
+    int nu = u.norm() / 0.015;
+    int nv = v.norm() / 0.015;
+    for (int i=0; i<nu; i++)
+    {
+        for (int j=0; j<nv; j++)
+        {
+            if (uniform() > density)
+            {
+                continue;
+            }
+            Eigen::Vector3f p = origin + u * (float(i) / nu) + v * (float(j) / nv) + 0.005 * Eigen::Vector3f(uniform() - 0.5, uniform() - 0.5, uniform() - 0.5);
+            PointType point;
+            point.getVector3fMap() = p;
+            cloud->push_back(point);
+        }
+    }
+}
+
+//! 6m x 5m room with a table and a cabinet
+CloudPtr createRoom()
+{
+    CloudPtr room(new Cloud());
+    addPlane(room, Eigen::Vector3f(0,0,0), Eigen::Vector3f(6,0,0), Eigen::Vector3f(0,5,0), 0.3);
+    addPlane(room, Eigen::Vector3f(0,0,2.8), Eigen::Vector3f(6,0,0), Eigen::Vector3f(0,5,0), 0.15);
+    addPlane(room, Eigen::Vector3f(0,0,0), Eigen::Vector3f(6,0,0), Eigen::Vector3f(0,0,2.8), 0.3);
+    addPlane(room, Eigen::Vector3f(0,5,0), Eigen::Vector3f(6,0,0), Eigen::Vector3f(0,0,2.8), 0.3);
+    addPlane(room, Eigen::Vector3f(0,0,0), Eigen::Vector3f(0,5,0), Eigen::Vector3f(0,0,2.8), 0.3);
+    addPlane(room, Eigen::Vector3f(6,0,0), Eigen::Vector3f(0,5,0), Eigen::Vector3f(0,0,2.8), 0.3);
+    addPlane(room, Eigen::Vector3f(1,1,0.75), Eigen::Vector3f(1.5,0,0), Eigen::Vector3f(0,1,0), 0.5);
+    addPlane(room, Eigen::Vector3f(5.5,3,0), Eigen::Vector3f(0,1.5,0), Eigen::Vector3f(0,0,1.8), 0.5);
+    addPlane(room, Eigen::Vector3f(5.5,3,0), Eigen::Vector3f(0.5,0,0), Eigen::Vector3f(0,0,1.8), 0.5);
+    return room;
+}
+
+void printError(const char* name, const Eigen::Matrix4f& estimated, const Eigen::Matrix4f& truth, double time, double& translationError, double& rotationError)
+{
+    Eigen::Matrix4f error = estimated.inverse() * truth;
+    translationError = error.topRightCorner<3,1>().norm();
+    rotationError = Eigen::AngleAxisf(Eigen::Matrix3f(error.topLeftCorner<3,3>())).angle() * 180.0 / M_PI;
+    printf("    %-16s %8.4f m %8.3f deg %8.3f s\n", name, translationError, rotationError, time);
+}
+
+int main(int argc, char** argv)
+{
+    srand(0);
+    CloudPtr target(new Cloud());
+    CloudPtr source(new Cloud());
+    if (argc > 1)
+    {
+        if (pcl::io::loadPCDFile<PointType>(argv[1], *target) == -1)
+        {
+            printf("Could not load %s\n", argv[1]);
+            return -1;
+        }
+        if ((argc > 2) && (pcl::io::loadPCDFile<PointType>(argv[2], *source) == -1))
+        {
+            printf("Could not load %s\n", argv[2]);
+            return -1;
+        }
+        if (argc <= 2)
+        {
+            *source = *target;
+        }
+    } else {
+        target = createRoom();
+        source = createRoom();
+    }
+    int trials = (argc > 3) ? atoi(argv[3]) : 10;
+    printf("target %lu points, source %lu points, %i trials\n", target->size(), source->size(), trials);
+
+    NdtTargetCache cache;
+    cache.update(NdtRegistration<PointType>::toNdtPoints(*target), 0, NdtCoarseToFine().getResolutions());
+    double sums[3][3] = {{0,0,0},{0,0,0},{0,0,0}}; // translation error, rotation error, time of pcl, coarse-to-fine and coarse-to-fine cached
+    for (int t=0; t<trials; t++)
+    {
+        Eigen::Matrix4f truth = Eigen::Matrix4f::Identity();
+        truth.topLeftCorner<3,3>() = Eigen::AngleAxisf((uniform() - 0.5) * 0.2, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+        truth.topRightCorner<3,1>() = Eigen::Vector3f((uniform() - 0.5) * 0.6, (uniform() - 0.5) * 0.6, (uniform() - 0.5) * 0.1);
+        CloudPtr moved(new Cloud());
+        pcl::transformPointCloud(*source, *moved, Eigen::Matrix4f(truth.inverse()));
+        printf("trial %i\n", t);
+
+        double translationError, rotationError;
+        Eigen::Matrix4f estimated;
+        CloudPtr targetCopy(new Cloud(*target)); // registerClouds removes the NaNs of its inputs
+        CloudPtr movedCopy(new Cloud(*moved));
+        double start = getTime();
+        NdtRegistration<PointType>::registerClouds(movedCopy, targetCopy, estimated);
+        double time = getTime() - start;
+        printError("pcl NDT", estimated, truth, time, translationError, rotationError);
+        sums[0][0] += translationError; sums[0][1] += rotationError; sums[0][2] += time;
+
+        start = getTime();
+        NdtRegistration<PointType>::registerCloudsCoarseToFine(moved, target, estimated);
+        time = getTime() - start;
+        printError("coarse-to-fine", estimated, truth, time, translationError, rotationError);
+        sums[1][0] += translationError; sums[1][1] += rotationError; sums[1][2] += time;
+
+        start = getTime();
+        NdtRegistration<PointType>::registerCloudsCoarseToFine(moved, target, estimated, Eigen::Matrix4f::Identity(), &cache, 0);
+        time = getTime() - start;
+        printError("coarse-to-fine*", estimated, truth, time, translationError, rotationError);
+        sums[2][0] += translationError; sums[2][1] += rotationError; sums[2][2] += time;
+    }
+
+    if (trials <= 0)
+    {
+        return 0;
+    }
+    printf("mean over trials\n");
+    const char* names[3] = {"pcl NDT", "coarse-to-fine", "coarse-to-fine*"};
+    for (int r=0; r<3; r++)
+    {
+        printf("    %-16s %8.4f m %8.3f deg %8.3f s\n", names[r], sums[r][0] / trials, sums[r][1] / trials, sums[r][2] / trials);
+    }
+    if ((sums[1][2] > 0) && (sums[2][2] > 0))
+    {
+        printf("speedup: %.1fx, %.1fx with cached grids\n", sums[0][2] / sums[1][2], sums[0][2] / sums[2][2]);
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+#ifndef __OBSERVATION_OCTOMAP_CACHE__H
+#define __OBSERVATION_OCTOMAP_CACHE__H
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <sys/stat.h>
+
+#include "ros/ros.h"
+#include <tf/tf.h>
+
+#include <pcl/point_types.h>
+#include <pcl/common/centroid.h>
+#include <pcl_ros/transforms.h>
+
+#include <octomap/octomap.h>
+#include <octomap/OcTree.h>
+
+#include <metaroom_xml_parser/simple_xml_parser.h>
+
+/*
+ * Builds, persists and caches the octomaps served by the SemanticMapPublisher.
+ *
+ * An octree is built once per (observation, resolution) pair by ray casting each intermediate view from its own
+ * sensor origin (instead of inserting the merged cloud from its centroid). The result is written next to the sweep
+ * xml as observation_octomap_<resolution>.bt and subsequent requests are served from an LRU memory cache, falling
+ * back to the .bt file when the octree was evicted or the node was restarted.
+ */
+template <class PointType>
+class ObservationOctomapCache {
+public:
+    typedef pcl::PointCloud<PointType> Cloud;
+    typedef typename Cloud::Ptr CloudPtr;
+    typedef boost::shared_ptr<octomap::OcTree> OcTreePtr;
+
+    ObservationOctomapCache(size_t cacheSize = 10, bool saveToDisk = true, double maxRange = -1.0) :
+        m_cacheSize(cacheSize), m_saveToDisk(saveToDisk), m_maxRange(maxRange)
+    {}
+
+    //! Returns the octomap of the observation at the requested resolution, building it if it is not cached.
+    OcTreePtr getOctomap(const std::string& sweepXml, double resolution)
+    {
+        std::string key = cacheKey(sweepXml, resolution);
+
+        // memory cache
+        auto it = m_cacheIndex.find(key);
+        if (it != m_cacheIndex.end())
+        {
+            ROS_INFO_STREAM("Octomap for "<<sweepXml<<" at resolution "<<resolution<<" found in memory");
+            m_cache.splice(m_cache.begin(), m_cache, it->second);
+            return it->second->second;
+        }
+
+        // disk cache, only valid if it was written after the sweep xml
+        OcTreePtr tree;
+        std::string octomapFile = octomapFileName(sweepXml, resolution);
+        if (isNewer(octomapFile, sweepXml))
+        {
+            tree = OcTreePtr(new octomap::OcTree(resolution));
+            if (tree->readBinary(octomapFile))
+            {
+                ROS_INFO_STREAM("Loaded octomap from "<<octomapFile);
+            } else {
+                ROS_WARN_STREAM("Could not read octomap from "<<octomapFile<<". Rebuilding it.");
+                tree.reset();
+            }
+        }
+
+        if (!tree)
+        {
+            tree = buildOctomap(sweepXml, resolution);
+            if (m_saveToDisk && tree->size())
+            {
+                if (tree->writeBinaryConst(octomapFile))
+                {
+                    ROS_INFO_STREAM("Saved octomap to "<<octomapFile);
+                } else {
+                    ROS_WARN_STREAM("Could not save octomap to "<<octomapFile);
+                }
+            }
+        }
+
+        insert(key, tree);
+        return tree;
+    }
+
+    //! Ray casts every intermediate view of the sweep from its own sensor origin, in the map frame.
+    OcTreePtr buildOctomap(const std::string& sweepXml, double resolution)
+    {
+        auto sweep = SimpleXMLParser<PointType>::loadRoomFromXML(sweepXml, std::vector<std::string>{"RoomIntermediateCloud"}, false);
+
+        std::vector<tf::Transform> viewTransforms;
+        bool registered = (sweep.vIntermediateRoomCloudTransformsRegistered.size() == sweep.vIntermediateRoomClouds.size());
+        for (size_t i=0; i<sweep.vIntermediateRoomClouds.size(); i++)
+        {
+            if (registered)
+            {
+                // registered transforms are relative to the first view; the first raw transform takes them to the map frame
+                viewTransforms.push_back(sweep.vIntermediateRoomCloudTransforms[0] * sweep.vIntermediateRoomCloudTransformsRegistered[i]);
+            } else {
+                viewTransforms.push_back(sweep.vIntermediateRoomCloudTransforms[i]);
+            }
+        }
+
+        if (sweep.vIntermediateRoomClouds.empty())
+        {
+            // old sweeps without intermediate clouds -> insert the merged cloud from its centroid
+            ROS_WARN_STREAM("No intermediate clouds found for "<<sweepXml<<". Building octomap from the merged cloud.");
+            CloudPtr completeCloud = SimpleXMLParser<PointType>::loadRoomFromXML(sweepXml, std::vector<std::string>{"RoomCompleteCloud"}, false).completeRoomCloud;
+            Eigen::Vector4f centroid;
+            pcl::compute3DCentroid(*completeCloud, centroid);
+            tf::Transform centroidTransform;
+            centroidTransform.setIdentity();
+            centroidTransform.setOrigin(tf::Vector3(centroid[0], centroid[1], centroid[2]));
+            // the merged cloud is already in the map frame, express it in the centroid frame
+            CloudPtr centeredCloud(new Cloud);
+            pcl_ros::transformPointCloud(*completeCloud, *centeredCloud, centroidTransform.inverse());
+            return buildOctomapFromViews(std::vector<CloudPtr>{centeredCloud}, std::vector<tf::Transform>{centroidTransform}, resolution, m_maxRange);
+        }
+
+        ROS_INFO_STREAM("Building octomap from "<<sweep.vIntermediateRoomClouds.size()<<" views at resolution "<<resolution);
+        return buildOctomapFromViews(sweep.vIntermediateRoomClouds, viewTransforms, resolution, m_maxRange);
+    }
+
+    //! Inserts each view as a separate scan. The rays are computed in parallel, the occupancy updates are applied serially in view order.
+    static OcTreePtr buildOctomapFromViews(const std::vector<CloudPtr>& views, const std::vector<tf::Transform>& transforms, double resolution, double maxRange = -1.0)
+    {
+        OcTreePtr tree(new octomap::OcTree(resolution));
+        std::vector<octomap::KeySet> freeCells(views.size());
+        std::vector<octomap::KeySet> occupiedCells(views.size());
+        int nr_views = views.size();
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i=0; i<nr_views; i++)
+        {
+            Cloud transformed;
+            pcl_ros::transformPointCloud(*views[i], transformed, transforms[i]);
+            tf::Vector3 o = transforms[i].getOrigin();
+            octomap::point3d origin(o.x(), o.y(), o.z());
+
+            // discretize the end points first, so that only one ray is cast per occupied cell
+            octomap::KeySet endKeys;
+            octomap::OcTreeKey key;
+            for (size_t j=0; j<transformed.points.size(); j++)
+            {
+                const PointType& p = transformed.points[j];
+                if (!pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z))
+                {
+                    continue;
+                }
+                octomap::point3d end(p.x, p.y, p.z);
+                if ((maxRange > 0.0) && ((end - origin).norm() > maxRange))
+                {
+                    end = origin + (end - origin).normalized() * maxRange;
+                    octomap::KeyRay ray;
+                    if (tree->computeRayKeys(origin, end, ray))
+                    {
+                        freeCells[i].insert(ray.begin(), ray.end());
+                    }
+                    continue;
+                }
+                if (tree->coordToKeyChecked(end, key))
+                {
+                    endKeys.insert(key);
+                }
+            }
+
+            octomap::KeyRay ray;
+            for (auto keyIt = endKeys.begin(); keyIt != endKeys.end(); ++keyIt)
+            {
+                if (tree->computeRayKeys(origin, tree->keyToCoord(*keyIt), ray))
+                {
+                    freeCells[i].insert(ray.begin(), ray.end());
+                }
+            }
+            occupiedCells[i].swap(endKeys);
+        }
+
+        for (size_t i=0; i<views.size(); i++)
+        {
+            for (auto it = freeCells[i].begin(); it != freeCells[i].end(); ++it)
+            {
+                if (occupiedCells[i].find(*it) == occupiedCells[i].end())
+                {
+                    tree->updateNode(*it, false, true);
+                }
+            }
+            for (auto it = occupiedCells[i].begin(); it != occupiedCells[i].end(); ++it)
+            {
+                tree->updateNode(*it, true, true);
+            }
+        }
+        tree->updateInnerOccupancy();
+
+        return tree;
+    }
+
+    static std::string octomapFileName(const std::string& sweepXml, double resolution)
+    {
+        size_t index = sweepXml.find_last_of('/');
+        std::string folder = (index == std::string::npos) ? std::string(".") : sweepXml.substr(0, index);
+        std::stringstream ss; ss<<folder<<"/observation_octomap_"<<std::fixed<<std::setprecision(3)<<resolution<<".bt";
+        return ss.str();
+    }
+
+    void clear()
+    {
+        m_cache.clear();
+        m_cacheIndex.clear();
+    }
+
+private:
+    typedef std::list<std::pair<std::string, OcTreePtr>> CacheList;
+
+    static std::string cacheKey(const std::string& sweepXml, double resolution)
+    {
+        std::stringstream ss; ss<<sweepXml<<"@"<<std::fixed<<std::setprecision(3)<<resolution;
+        return ss.str();
+    }
+
+    static bool isNewer(const std::string& file, const std::string& reference)
+    {
+        struct stat fileStat, referenceStat;
+        if ((stat(file.c_str(), &fileStat) != 0) || (stat(reference.c_str(), &referenceStat) != 0))
+        {
+            return false;
+        }
+        return fileStat.st_mtime >= referenceStat.st_mtime;
+    }
+
+    void insert(const std::string& key, OcTreePtr tree)
+    {
+        m_cache.push_front(std::make_pair(key, tree));
+        m_cacheIndex[key] = m_cache.begin();
+        while (m_cache.size() > m_cacheSize)
+        {
+            m_cacheIndex.erase(m_cache.back().first);
+            m_cache.pop_back();
+        }
+    }
+
+    size_t                                                                      m_cacheSize;
+    bool                                                                        m_saveToDisk;
+    double                                                                      m_maxRange;
+    CacheList                                                                   m_cache;
+    std::map<std::string, typename CacheList::iterator>                         m_cacheIndex;
+};
+
+#endif // __OBSERVATION_OCTOMAP_CACHE__H
@@ -41,6 +41,7 @@
 #include <pcl/filters/passthrough.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <metaroom_xml_parser/load_utilities.h>
+#include <metaroom_xml_parser/cloud_msg_conversion.h>
 #include <semantic_map/room_xml_parser.h>
 
 #include <octomap_ros/conversions.h>
@@ -48,6 +49,8 @@
 #include <octomap_msgs/conversions.h>
 #include <pcl/filters/voxel_grid.h>
 
+#include "semantic_map_publisher/observation_octomap_cache.h"
+
 template <class PointType>
 class SemanticMapPublisher {
 public:
@@ -78,6 +81,8 @@ public:
     struct ObsStruct {
         std::string file;
         CloudPtr completeCloud;
+        CloudPtr filteredCloud;         // completeCloud downsampled at filteredResolution
+        double filteredResolution;
     };
 
 
@@ -116,6 +121,8 @@ private:
     std::string                                                                 m_dataFolder;
     std::map<std::string, ObsStruct>                                            m_waypointToObsMap;
     std::map<std::string, ObsStruct>                                            m_waypointToDynClMap;
+    boost::shared_ptr<ObservationOctomapCache<PointType>>                       m_octomapCache;
+    cloud_msg_utilities::CloudMsgCache<PointType>                               m_msgCache;
 };
 
 template <class PointType>
@@ -132,6 +139,14 @@ SemanticMapPublisher<PointType>::SemanticMapPublisher(ros::NodeHandle nh)
     m_NodeHandle.param<std::string>("semantic_map_folder",m_dataFolder,default_folder);
     ROS_INFO_STREAM("Publishing semantic map data from "<<m_dataFolder);
 
+    int octomapCacheSize;
+    bool saveOctomaps;
+    double octomapMaxRange;
+    m_NodeHandle.param<int>("octomap_cache_size",octomapCacheSize,10);
+    m_NodeHandle.param<bool>("save_octomaps",saveOctomaps,true);
+    m_NodeHandle.param<double>("octomap_max_range",octomapMaxRange,-1.0);
+    m_octomapCache = boost::shared_ptr<ObservationOctomapCache<PointType>>(new ObservationOctomapCache<PointType>(octomapCacheSize, saveOctomaps, octomapMaxRange));
+
     m_PublisherMetaroom = m_NodeHandle.advertise<sensor_msgs::PointCloud2>("/local_metric_map/metaroom", 1, true);
     m_PublisherDynamicClusters = m_NodeHandle.advertise<sensor_msgs::PointCloud2>("/local_metric_map/dynamic_clusters", 1, true);
     m_PublisherObservation = m_NodeHandle.advertise<sensor_msgs::PointCloud2>("/local_metric_map/observation", 1, true);
@@ -178,41 +193,33 @@ bool SemanticMapPublisher<PointType>::observationServiceCallback(ObservationServ
     string latest = matchingObservations[0];
 
     auto it = m_waypointToObsMap.find(req.waypoint_id);
-
-    CloudPtr toPublish(new Cloud());
-    if (it == m_waypointToObsMap.end())
+    if ((it == m_waypointToObsMap.end()) || (it->second.file != latest))
     {
-        // no observation loaded and stored in memory for this waypoint
+        // no observation or an older one loaded and stored in memory for this waypoint
         // -> load it
         ROS_INFO_STREAM("Point cloud not loaded in memory. Loading ...");
-        CloudPtr completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(latest);
-        ObsStruct latestObs;latestObs.completeCloud = completeCloud; latestObs.file = latest;
+        ObsStruct latestObs;
+        latestObs.completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(latest);
+        latestObs.file = latest;
         m_waypointToObsMap[req.waypoint_id] = latestObs;
-        *toPublish = *completeCloud;
-    } else {
-        if (m_waypointToObsMap[req.waypoint_id].file != latest)
-        {
-            ROS_INFO_STREAM("Older point cloud loaded in memory. Loading latest observation ...");
-            CloudPtr completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(latest);
-            ObsStruct latestObs;latestObs.completeCloud = completeCloud; latestObs.file = latest;
-            m_waypointToObsMap[req.waypoint_id] = latestObs;
-            *toPublish = *completeCloud;
-        } else {
-            *toPublish = *m_waypointToObsMap[req.waypoint_id].completeCloud;
-        }
+        it = m_waypointToObsMap.find(req.waypoint_id);
     }
 
-    CloudPtr observationCloud(new Cloud());
-    pcl::VoxelGrid<PointType> vg;
-    vg.setInputCloud (toPublish);
-    vg.setLeafSize (req.resolution, req.resolution, req.resolution);
-    vg.filter (*observationCloud);
+    // the downsampled cloud (and its message) are kept until a different resolution or a newer observation is requested
+    ObsStruct& obs = it->second;
+    if (!obs.filteredCloud || (obs.filteredResolution != req.resolution))
+    {
+        obs.filteredCloud = CloudPtr(new Cloud());
+        pcl::VoxelGrid<PointType> vg;
+        vg.setInputCloud (obs.completeCloud);
+        vg.setLeafSize (req.resolution, req.resolution, req.resolution);
+        vg.filter (*obs.filteredCloud);
+        obs.filteredResolution = req.resolution;
+    }
 
-//    CloudPtr observationCloud = toPublish;
-    sensor_msgs::PointCloud2 msg_observation;
-    pcl::toROSMsg(*observationCloud, msg_observation);
-    msg_observation.header.frame_id="/map";
+    const sensor_msgs::PointCloud2& msg_observation = m_msgCache.getMsg(obs.filteredCloud, cloud_msg_utilities::ALL_FIELDS, "/map");
 
+    // the response owns its message, a copy of the cached one instead of a conversion
     res.cloud = msg_observation;
 
     // also publish on topic
@@ -248,14 +255,12 @@ bool SemanticMapPublisher<PointType>::observationInstanceServiceCallback(Observa
     vg.setLeafSize (req.resolution, req.resolution, req.resolution);
     vg.filter (*observationCloud);
 
-    sensor_msgs::PointCloud2 msg_observation;
-    pcl::toROSMsg(*observationCloud, msg_observation);
-    msg_observation.header.frame_id="/map";
-
-    res.cloud = msg_observation;
+    // converted straight into the response, which is also published
+    cloud_msg_utilities::toROSMsg(*observationCloud, res.cloud);
+    res.cloud.header.frame_id="/map";
 
     // also publish on topic
-    m_PublisherObservation.publish(msg_observation);
+    m_PublisherObservation.publish(res.cloud);
 
     // get timestamp
     auto sweep = SimpleXMLParser<PointType>::loadRoomFromXML(sweep_xml, std::vector<std::string>(), false);
@@ -337,22 +342,11 @@ bool SemanticMapPublisher<PointType>::observationOctomapInstanceServiceCallback(
     }
 
     string sweep_xml = matchingObservations[req.instance_number];
-    CloudPtr completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(sweep_xml);
 
-    sensor_msgs::PointCloud2 msg_observation;
-    pcl::toROSMsg(*completeCloud, msg_observation);
-    msg_observation.header.frame_id="/map";
-
-    Eigen::Vector4f centroid;
-    pcl::compute3DCentroid(*completeCloud, centroid);
-    octomap::point3d octo_centroid(centroid[0],centroid[1],centroid[2]);
-    // convert observation cloud to octomap and return it
-    octomap::Pointcloud oct_pc;
-    octomap::pointCloud2ToOctomap(msg_observation, oct_pc);
-    octomap::OcTree map(req.resolution);
-    map.insertPointCloud(oct_pc, octo_centroid);
+    auto map = m_octomapCache->getOctomap(sweep_xml, req.resolution);
     octomap_msgs::Octomap octo_msg;
-    octomap_msgs::fullMapToMsg(map,octo_msg);
+    octomap_msgs::fullMapToMsg(*map,octo_msg);
+    octo_msg.header.frame_id="/map";
     res.octomap = octo_msg;
 
 
@@ -382,45 +376,11 @@ bool SemanticMapPublisher<PointType>::observationOctomapServiceCallback(Observat
     reverse(matchingObservations.begin(), matchingObservations.end());
     string latest = matchingObservations[0];
 
-    auto it = m_waypointToObsMap.find(req.waypoint_id);
-
-    CloudPtr toPublish(new Cloud());
-    if (it == m_waypointToObsMap.end())
-    {
-        // no observation loaded and stored in memory for this waypoint
-        // -> load it
-        ROS_INFO_STREAM("Point cloud not loaded in memory. Loading ...");
-        CloudPtr completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(latest);
-        ObsStruct latestObs;latestObs.completeCloud = completeCloud; latestObs.file = latest;
-        m_waypointToObsMap[req.waypoint_id] = latestObs;
-        *toPublish = *completeCloud;
-    } else {
-        if (m_waypointToObsMap[req.waypoint_id].file != latest)
-        {
-            ROS_INFO_STREAM("Older point cloud loaded in memory. Loading latest observation ...");
-            CloudPtr completeCloud = semantic_map_load_utilties::loadMergedCloudFromSingleSweep<PointType>(latest);
-            ObsStruct latestObs;latestObs.completeCloud = completeCloud; latestObs.file = latest;
-            m_waypointToObsMap[req.waypoint_id] = latestObs;
-            *toPublish = *completeCloud;
-        } else {
-            *toPublish = *m_waypointToObsMap[req.waypoint_id].completeCloud;
-        }
-    }
-    CloudPtr observationCloud = toPublish;
-    sensor_msgs::PointCloud2 msg_observation;
-    pcl::toROSMsg(*toPublish, msg_observation);
-    msg_observation.header.frame_id="/map";
-
-    Eigen::Vector4f centroid;
-    pcl::compute3DCentroid(*toPublish, centroid);
-    octomap::point3d octo_centroid(centroid[0],centroid[1],centroid[2]);
-    // convert observation cloud to octomap and return it
-    octomap::Pointcloud oct_pc;
-    octomap::pointCloud2ToOctomap(msg_observation, oct_pc);
-    octomap::OcTree map(req.resolution);
-    map.insertPointCloud(oct_pc, octo_centroid);
+    // the octomap is built from the intermediate views, no need to load the merged cloud
+    auto map = m_octomapCache->getOctomap(latest, req.resolution);
     octomap_msgs::Octomap octo_msg;
-    octomap_msgs::fullMapToMsg(map,octo_msg);
+    octomap_msgs::fullMapToMsg(*map,octo_msg);
+    octo_msg.header.frame_id="/map";
     res.octomap = octo_msg;
     return true;
 }
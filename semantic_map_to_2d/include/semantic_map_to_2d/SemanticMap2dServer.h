@@ -54,6 +54,22 @@ protected:
 
   void traverseOctomap(const ros::Time& rostime = ros::Time::now());
 
+  /// number of observations at the waypoint, used to detect whether a cached map is out of date. -1 if unknown
+  int getObservationCount(const std::string& waypoint);
+
+  /// updates the sweeps found below folder. Only the folders whose modification time changed are listed again, and
+  /// a room.xml is only parsed again if it was modified, so an unchanged semantic map folder costs one stat per folder
+  void updateSweepFolder(const std::string& folder, int depth);
+
+  /// looks for the map of the waypoint in memory, then on disk. The map is valid if it was projected from the
+  /// same number of observations (or if the number of observations is unknown)
+  bool getCachedMap(const std::string& waypoint, int observationCount, nav_msgs::OccupancyGrid& map);
+  void cacheMap(const std::string& waypoint, int observationCount, const nav_msgs::OccupancyGrid& map);
+
+  std::string cachedMapFileName(const std::string& waypoint) const;
+  bool saveCachedMap(const std::string& filename, int observationCount, const nav_msgs::OccupancyGrid& map) const;
+  bool loadCachedMap(const std::string& filename, int& observationCount, nav_msgs::OccupancyGrid& map) const;
+
 
   /**
   * @brief Find speckle nodes (single occupied voxels with no neighbors). 
@@ -72,6 +88,9 @@ protected:
   /// updates the downprojected 2D map as either occupied or free
   virtual void update2DMap(const OcTreeT::iterator& it, bool occupied);
 
+  /// projects a leaf onto its 2D cells, keeping the maximum value of each column (unknown -1 < free 0 < occupied 100)
+  void projectLeaf(const octomap::OcTreeKey& indexKey, unsigned depth, int8_t value);
+
   inline unsigned mapIdx(int i, int j) const{
     return m_gridmap.info.width*j + i;
   }
@@ -141,6 +160,30 @@ protected:
   octomap::OcTreeKey m_paddedMinKey;
   unsigned m_multires2DScale;
   bool m_projectCompleteMap;
+
+  // projected maps per waypoint
+  struct CachedMap {
+    int observationCount;
+    nav_msgs::OccupancyGrid map;
+  };
+  std::map<std::string, CachedMap> m_waypointMaps;
+  double m_octomapResolution;
+  bool m_checkForNewObservations;
+  bool m_saveWaypointMaps;
+  std::string m_waypointMapFolder;
+
+  // folders of the semantic map, with the waypoint of the sweep they contain (if any)
+  struct SweepFolder {
+    int64_t folderTime;
+    int64_t listTime;
+    std::vector<std::string> subfolders;
+    bool hasRoomXml;
+    int64_t xmlTime;
+    std::string waypoint;
+    SweepFolder() : folderTime(-1), listTime(-1), hasRoomXml(false), xmlTime(-1) {}
+  };
+  std::map<std::string, SweepFolder> m_sweepFolders;
+  std::string m_semanticMapFolder;
 };
 
 #endif
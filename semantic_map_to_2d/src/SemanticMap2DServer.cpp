@@ -1,4 +1,12 @@
 #include <semantic_map_to_2d/SemanticMap2dServer.h>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+#include <dirent.h>
 
 using namespace octomap;
 using octomap_msgs::Octomap;
@@ -15,7 +23,10 @@ SemanticMap2DServer::SemanticMap2DServer(ros::NodeHandle private_nh_)
       m_occupancyMinZ(0.3),
       m_occupancyMaxZ(1.9),
       m_minSizeX(0.0), m_minSizeY(0.0),
-      m_filterSpeckles(true)
+      m_filterSpeckles(true),
+      m_octomapResolution(0.05),
+      m_checkForNewObservations(true),
+      m_saveWaypointMaps(true)
 {
     ros::NodeHandle private_nh(private_nh_);
 
@@ -26,6 +37,21 @@ SemanticMap2DServer::SemanticMap2DServer(ros::NodeHandle private_nh_)
 
     private_nh.param("filter_speckles", m_filterSpeckles, m_filterSpeckles);
 
+    const char* home = getenv("HOME");
+    m_waypointMapFolder = std::string(home ? home : ".") + "/.semanticMap/waypoint_maps";
+    private_nh.param("octomap_resolution", m_octomapResolution, m_octomapResolution);
+    private_nh.param("check_for_new_observations", m_checkForNewObservations, m_checkForNewObservations);
+    private_nh.param("save_waypoint_maps", m_saveWaypointMaps, m_saveWaypointMaps);
+    private_nh.param("waypoint_map_folder", m_waypointMapFolder, m_waypointMapFolder);
+    m_semanticMapFolder = std::string(home ? home : ".") + "/.semanticMap";
+    private_nh.param("semantic_map_folder", m_semanticMapFolder, m_semanticMapFolder);
+    if (m_semanticMapFolder.size() > 1 && m_semanticMapFolder[m_semanticMapFolder.size()-1] == '/')
+        m_semanticMapFolder.erase(m_semanticMapFolder.size()-1);
+    if (m_saveWaypointMaps){
+        mkdir(m_waypointMapFolder.c_str(), 0775);
+        ROS_INFO("Projected waypoint maps will be saved in %s", m_waypointMapFolder.c_str());
+    }
+
     //private_nh.param("sensor_model/hit", m_probHit, m_probHit);
     //private_nh.param("sensor_model/miss", m_probMiss, m_probMiss);
     //private_nh.param("sensor_model/min", m_thresMin, m_thresMin);
@@ -106,40 +132,31 @@ void SemanticMap2DServer::traverseOctomap(const ros::Time& rostime){
     // call pre-traversal hook:
     handlePreNodeTraversal(rostime);
 
-    // now, traverse all leafs in the tree:
-    for (OcTree::iterator it = m_octree->begin(m_maxTreeDepth),
-         end = m_octree->end(); it != end; ++it)
-    {
-        bool inUpdateBBX = isInUpdateBBX(it);
+    // only the leafs intersecting the height band can be projected, the subtrees above and below it are skipped
+    double minX, minY, minZ, maxX, maxY, maxZ;
+    m_octree->getMetricMin(minX, minY, minZ);
+    m_octree->getMetricMax(maxX, maxY, maxZ);
+    minZ = std::max(minZ, m_occupancyMinZ);
+    maxZ = std::min(maxZ, m_occupancyMaxZ);
 
-        if (m_octree->isNodeOccupied(*it)){
+    if (minZ <= maxZ && m_octree->size()){
+        for (OcTree::leaf_bbx_iterator it = m_octree->begin_leafs_bbx(point3d(minX, minY, minZ), point3d(maxX, maxY, maxZ), m_maxTreeDepth),
+             end = m_octree->end_leafs_bbx(); it != end; ++it)
+        {
             double z = it.getZ();
-            if (z > m_occupancyMinZ && z < m_occupancyMaxZ)
-            {
-                double x = it.getX();
-                double y = it.getY();
+            if (!(z > m_occupancyMinZ && z < m_occupancyMaxZ))
+                continue;
 
+            if (m_octree->isNodeOccupied(*it)){
                 // Ignore speckles in the map:
                 if (m_filterSpeckles && (it.getDepth() == m_treeDepth +1) && isSpeckleNode(it.getKey())){
-                    ROS_DEBUG("Ignoring single speckle at (%f,%f,%f)", x, y, z);
+                    ROS_DEBUG("Ignoring single speckle at (%f,%f,%f)", it.getX(), it.getY(), z);
                     continue;
                 } // else: current octree node is no speckle, send it out
 
-
-                update2DMap(it, true);
-                if (inUpdateBBX)
-                    update2DMap(it, true);
-
-            }
-        } else{ // node not occupied => mark as free in 2D map if unknown so far
-            double z = it.getZ();
-            if (z > m_occupancyMinZ && z < m_occupancyMaxZ)
-            {
-                update2DMap(it, false);
-
-                if (inUpdateBBX)
-                    update2DMap(it, false);
-
+                projectLeaf(it.getIndexKey(), it.getDepth(), 100);
+            } else{ // node not occupied => mark as free in 2D map if unknown so far
+                projectLeaf(it.getIndexKey(), it.getDepth(), 0);
             }
         }
     }
@@ -153,12 +170,27 @@ bool SemanticMap2DServer::changeWayPoint(WaypointSrv::Request  &req,
                                    WaypointSrv::Response &res)
 {
     ROS_INFO("Switching waypoint...");
+    ros::WallTime start = ros::WallTime::now();
+
+    int observationCount = -1;
+    if (m_checkForNewObservations){
+        observationCount = getObservationCount(req.waypoint);
+    }
+
+    if (getCachedMap(req.waypoint, observationCount, m_gridmap)){
+        m_gridmap.header.stamp = ros::Time::now();
+        m_mapPub.publish(m_gridmap);
+        ROS_INFO("Published the cached map of waypoint %s (%.1f ms)", req.waypoint.c_str(), (ros::WallTime::now() - start).toSec() * 1000.0);
+        res.is_ok = true;
+        return true;
+    }
+
     ROS_INFO("Requesting octomap from semantic map server....");
     ros::ServiceClient client = m_nh.serviceClient<semantic_map_publisher::ObservationOctomapService>
                                 ("/semantic_map_publisher/SemanticMapPublisher/ObservationOctomapService");
     semantic_map_publisher::ObservationOctomapService srv;
     srv.request.waypoint_id = req.waypoint;
-    srv.request.resolution=0.05;
+    srv.request.resolution=m_octomapResolution;
     if (! client.call(srv))   {
       ROS_ERROR("Could not call semantic map to get a octomap!");
       return false;
@@ -193,6 +225,8 @@ bool SemanticMap2DServer::changeWayPoint(WaypointSrv::Request  &req,
     m_updateBBXMax[2] = m_octree->coordToKey(maxZ);
 
     traverseOctomap();
+    cacheMap(req.waypoint, observationCount, m_gridmap);
+    ROS_INFO("Projected the map of waypoint %s (%.1f ms)", req.waypoint.c_str(), (ros::WallTime::now() - start).toSec() * 1000.0);
 
     //res.map.header.frame_id = m_worldFrameId;
     //res.map.header.stamp = ros::Time::now();
@@ -202,6 +236,209 @@ bool SemanticMap2DServer::changeWayPoint(WaypointSrv::Request  &req,
     return true;
 }
 
+int SemanticMap2DServer::getObservationCount(const std::string& waypoint){
+    struct stat folderStat;
+    if (stat(m_semanticMapFolder.c_str(), &folderStat) != 0){
+        ROS_WARN("Could not find the semantic map folder %s. Cached maps will not be checked for changes.", m_semanticMapFolder.c_str());
+        return -1;
+    }
+
+    updateSweepFolder(m_semanticMapFolder, 0);
+    int count = 0;
+    for (std::map<std::string, SweepFolder>::const_iterator it = m_sweepFolders.begin(); it != m_sweepFolders.end(); ++it){
+        if (it->second.hasRoomXml && it->second.waypoint == waypoint)
+            count++;
+    }
+    return count;
+}
+
+namespace {
+    int64_t modificationTime(const struct stat& fileStat){
+        return int64_t(fileStat.st_mtim.tv_sec) * 1000000000LL + fileStat.st_mtim.tv_nsec;
+    }
+
+    std::string readWaypointId(const std::string& roomXml){
+        std::ifstream in(roomXml.c_str());
+        std::stringstream ss;
+        ss << in.rdbuf();
+        const std::string xml = ss.str();
+        const std::string startTag = "<RoomStringId>", endTag = "</RoomStringId>";
+        size_t start = xml.find(startTag);
+        if (start == std::string::npos)
+            return "";
+        start += startTag.size();
+        size_t end = xml.find(endTag, start);
+        return (end == std::string::npos) ? "" : xml.substr(start, end - start);
+    }
+}
+
+void SemanticMap2DServer::updateSweepFolder(const std::string& folder, int depth){
+    struct stat folderStat;
+    if (depth > 10 || stat(folder.c_str(), &folderStat) != 0 || !S_ISDIR(folderStat.st_mode)){
+        m_sweepFolders.erase(folder);
+        return;
+    }
+
+    // a folder changes when entries are added to or removed from it. It is listed again if it changed less than a
+    // second before it was last listed, in case of a coarse timestamp
+    SweepFolder& entry = m_sweepFolders[folder];
+    int64_t folderTime = modificationTime(folderStat);
+    if (folderTime != entry.folderTime || entry.listTime - folderTime <= 1000000000LL){
+        entry.folderTime = folderTime;
+        entry.listTime = int64_t(ros::WallTime::now().toNSec());
+
+        std::vector<std::string> subfolders;
+        entry.hasRoomXml = false;
+        DIR* dir = opendir(folder.c_str());
+        if (dir){
+            for (struct dirent* child = readdir(dir); child; child = readdir(dir)){
+                std::string name = child->d_name;
+                if (name == "." || name == "..")
+                    continue;
+                std::string path = folder + "/" + name;
+                struct stat childStat;
+                if (lstat(path.c_str(), &childStat) != 0)
+                    continue;
+                if (S_ISDIR(childStat.st_mode)){
+                    if (name.find("vocabulary") == std::string::npos && path != m_waypointMapFolder) // not sweeps
+                        subfolders.push_back(path);
+                } else if (name == "room.xml"){
+                    entry.hasRoomXml = true;
+                }
+            }
+            closedir(dir);
+        }
+
+        // forget the folders which were removed, with everything below them
+        for (size_t i=0; i<entry.subfolders.size(); i++){
+            if (std::find(subfolders.begin(), subfolders.end(), entry.subfolders[i]) == subfolders.end()){
+                m_sweepFolders.erase(entry.subfolders[i]);
+                m_sweepFolders.erase(m_sweepFolders.lower_bound(entry.subfolders[i] + "/"), m_sweepFolders.lower_bound(entry.subfolders[i] + "0")); // '0' follows '/'
+            }
+        }
+        entry.subfolders.swap(subfolders);
+    }
+
+    if (entry.hasRoomXml){
+        struct stat xmlStat;
+        std::string roomXml = folder + "/room.xml";
+        if (stat(roomXml.c_str(), &xmlStat) == 0 && modificationTime(xmlStat) != entry.xmlTime){
+            entry.xmlTime = modificationTime(xmlStat);
+            entry.waypoint = readWaypointId(roomXml);
+        }
+    }
+
+    std::vector<std::string> subfolders = entry.subfolders;
+    for (size_t i=0; i<subfolders.size(); i++){
+        updateSweepFolder(subfolders[i], depth+1);
+    }
+}
+
+bool SemanticMap2DServer::getCachedMap(const std::string& waypoint, int observationCount, nav_msgs::OccupancyGrid& map){
+    std::map<std::string, CachedMap>::iterator it = m_waypointMaps.find(waypoint);
+    if (it == m_waypointMaps.end()){
+        if (!m_saveWaypointMaps)
+            return false;
+        CachedMap cached;
+        if (!loadCachedMap(cachedMapFileName(waypoint), cached.observationCount, cached.map))
+            return false;
+        ROS_INFO("Loaded the map of waypoint %s from disk", waypoint.c_str());
+        it = m_waypointMaps.insert(std::make_pair(waypoint, cached)).first;
+    }
+
+    if (observationCount != -1 && it->second.observationCount != observationCount){
+        ROS_INFO("The map of waypoint %s was projected from %d observations, there are now %d. Updating it.",
+                 waypoint.c_str(), it->second.observationCount, observationCount);
+        return false;
+    }
+    map = it->second.map;
+    return true;
+}
+
+void SemanticMap2DServer::cacheMap(const std::string& waypoint, int observationCount, const nav_msgs::OccupancyGrid& map){
+    CachedMap& cached = m_waypointMaps[waypoint];
+    cached.observationCount = observationCount;
+    cached.map = map;
+    if (m_saveWaypointMaps && !saveCachedMap(cachedMapFileName(waypoint), observationCount, map)){
+        ROS_WARN("Could not save the map of waypoint %s to %s", waypoint.c_str(), cachedMapFileName(waypoint).c_str());
+    }
+}
+
+std::string SemanticMap2DServer::cachedMapFileName(const std::string& waypoint) const{
+    std::stringstream ss;
+    ss << m_waypointMapFolder << "/" << waypoint << "_" << std::fixed << std::setprecision(3) << m_octomapResolution
+       << "_" << m_occupancyMinZ << "_" << m_occupancyMaxZ << ".grid";
+    return ss.str();
+}
+
+namespace {
+    const char WAYPOINT_MAP_MAGIC[4] = {'W','M','A','P'};
+    const uint32_t WAYPOINT_MAP_VERSION = 1;
+}
+
+bool SemanticMap2DServer::saveCachedMap(const std::string& filename, int observationCount, const nav_msgs::OccupancyGrid& map) const{
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    int32_t count = observationCount;
+    uint32_t width = map.info.width, height = map.info.height;
+    float resolution = map.info.resolution;
+    double originX = map.info.origin.position.x, originY = map.info.origin.position.y;
+    out.write(WAYPOINT_MAP_MAGIC, sizeof(WAYPOINT_MAP_MAGIC));
+    out.write(reinterpret_cast<const char*>(&WAYPOINT_MAP_VERSION), sizeof(WAYPOINT_MAP_VERSION));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(&width), sizeof(width));
+    out.write(reinterpret_cast<const char*>(&height), sizeof(height));
+    out.write(reinterpret_cast<const char*>(&resolution), sizeof(resolution));
+    out.write(reinterpret_cast<const char*>(&originX), sizeof(originX));
+    out.write(reinterpret_cast<const char*>(&originY), sizeof(originY));
+    if (!map.data.empty())
+        out.write(reinterpret_cast<const char*>(&map.data[0]), map.data.size());
+    return out.good();
+}
+
+bool SemanticMap2DServer::loadCachedMap(const std::string& filename, int& observationCount, nav_msgs::OccupancyGrid& map) const{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in)
+        return false;
+    char magic[sizeof(WAYPOINT_MAP_MAGIC)];
+    uint32_t version, width, height;
+    int32_t count;
+    float resolution;
+    double originX, originY;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in || memcmp(magic, WAYPOINT_MAP_MAGIC, sizeof(magic)) != 0 || version != WAYPOINT_MAP_VERSION){
+        ROS_WARN("%s is not a valid waypoint map", filename.c_str());
+        return false;
+    }
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    in.read(reinterpret_cast<char*>(&width), sizeof(width));
+    in.read(reinterpret_cast<char*>(&height), sizeof(height));
+    in.read(reinterpret_cast<char*>(&resolution), sizeof(resolution));
+    in.read(reinterpret_cast<char*>(&originX), sizeof(originX));
+    in.read(reinterpret_cast<char*>(&originY), sizeof(originY));
+    map.data.resize(width * height);
+    if (!map.data.empty())
+        in.read(reinterpret_cast<char*>(&map.data[0]), map.data.size());
+    if (!in){
+        ROS_WARN("Truncated waypoint map %s", filename.c_str());
+        return false;
+    }
+
+    observationCount = count;
+    map.header.frame_id = m_worldFrameId;
+    map.info.width = width;
+    map.info.height = height;
+    map.info.resolution = resolution;
+    map.info.origin.position.x = originX;
+    map.info.origin.position.y = originY;
+    map.info.origin.position.z = 0;
+    map.info.origin.orientation.x = map.info.origin.orientation.y = map.info.origin.orientation.z = 0;
+    map.info.origin.orientation.w = 1;
+    return true;
+}
+
 
 void SemanticMap2DServer::handlePreNodeTraversal(const ros::Time& rostime){
     // init projected 2D map:
@@ -279,27 +516,23 @@ void SemanticMap2DServer::handlePostNodeTraversal(const ros::Time& rostime){
 void SemanticMap2DServer::update2DMap(const OcTreeT::iterator& it, bool occupied){
 
     // update 2D map (occupied always overrides):
+    projectLeaf(it.getIndexKey(), it.getDepth(), occupied ? 100 : 0);
 
-    if (it.getDepth() == m_maxTreeDepth){
-        unsigned idx = mapIdx(it.getKey());
-        if (occupied)
-            m_gridmap.data[idx] = 100;
-        else if (m_gridmap.data[idx] == -1){
-            m_gridmap.data[idx] = 0;
-        }
+}
 
+void SemanticMap2DServer::projectLeaf(const octomap::OcTreeKey& indexKey, unsigned depth, int8_t value){
+
+    // max-reduction over the column: occupied always overrides, free only overrides unknown
+    if (depth == m_maxTreeDepth){
+        int8_t& cell = m_gridmap.data[mapIdx(indexKey)];
+        cell = std::max(cell, value);
     } else{
-        int intSize = 1 << (m_maxTreeDepth - it.getDepth());
-        octomap::OcTreeKey minKey=it.getIndexKey();
-        for(int dx=0; dx < intSize; dx++){
-            int i = (minKey[0]+dx - m_paddedMinKey[0])/m_multires2DScale;
-            for(int dy=0; dy < intSize; dy++){
-                unsigned idx = mapIdx(i, (minKey[1]+dy - m_paddedMinKey[1])/m_multires2DScale);
-                if (occupied)
-                    m_gridmap.data[idx] = 100;
-                else if (m_gridmap.data[idx] == -1){
-                    m_gridmap.data[idx] = 0;
-                }
+        int intSize = 1 << (m_maxTreeDepth - depth);
+        for(int dy=0; dy < intSize; dy++){
+            int j = (indexKey[1]+dy - m_paddedMinKey[1])/m_multires2DScale;
+            for(int dx=0; dx < intSize; dx++){
+                int8_t& cell = m_gridmap.data[mapIdx((indexKey[0]+dx - m_paddedMinKey[0])/m_multires2DScale, j)];
+                cell = std::max(cell, value);
             }
         }
     }